@@ -3,6 +3,7 @@
 
 #include <inttypes.h>
 #include <semaphore.h>
+#include <stdalign.h>
 #include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -46,6 +47,27 @@ typedef enum e_autorestart {
   autorestart_max
 } t_autorestart;
 
+/* codec of the rotated log files (see src/compress.h) */
+typedef enum e_codec { codec_none, codec_lz4, codec_max } t_codec;
+
+/* rotation of a log file, done by the io thread (see src/capture.h): a
+ * program with one set has its output captured. taskmaster.log is rotated
+ * by its writer (see src/logger.h). */
+typedef struct s_rotate {
+  uint64_t maxbytes; /* rotate once the file reaches it, 0: never */
+  uint32_t maxage;   /* rotate the file once that old, in sec, 0: never */
+  uint8_t backups;   /* rotated files kept, file.1 being the newest */
+  uint8_t compress;  /* t_codec of the backups */
+} t_rotate;
+
+#define ROTATE_IS_SET(rotate) ((rotate).maxbytes || (rotate).maxage)
+
+/* an output of usr, to path, goes thru a pipe drained by the io thread: kept
+ * in a tail, or captured & not to /dev/null */
+#define OUTPUT_IS_CAPTURED(usr, path, rotate)                                 \
+  ((usr)->tail_bytes ||                                                       \
+   (((usr)->capture || ROTATE_IS_SET(rotate)) && strcmp(path, "/dev/null")))
+
 /* data of a program fetch in config file */
 typedef struct s_pgm_usr {
   char *name; /* pgm name */
@@ -71,29 +93,77 @@ typedef struct s_pgm_usr {
                                 launched. in ms*/
   uint32_t stoptime;         /* time allowed to a processus to stop before it is
                               killed. in ms*/
+  bool capture;              /* outputs go thru pipes drained by the io thread */
+  t_rotate out_rotate;       /* rotation of std_out */
+  t_rotate err_rotate;       /* rotation of std_err */
+  uint32_t tail_bytes;       /* last output kept by processus, 0: none */
 } t_pgm_usr;
 
+/* immutable snapshot of the configuration of a program. Published in
+ * t_pgm.conf & replaced as a whole by a reload, never modified in place.
+ * A reload compares the fingerprints of the old & new snapshots. */
+typedef struct s_pgm_conf {
+  atomic_uint refcount; /* the pgm publishing it + processus launched with it */
+  uint64_t fp_launch;   /* fingerprint of what a processus is launched with */
+  uint64_t fp_conf;     /* fingerprint of all fields but name & numprocs */
+  struct s_conf_cache *cache; /* mapping holding the strings of usr, or NULL */
+  t_pgm_usr usr;
+} t_pgm_conf;
+
 typedef struct thread_data t_thread_data;
+typedef struct s_timer_wheel t_timer_wheel;
+typedef struct s_reaper t_reaper;
+typedef struct s_logger t_logger;
+typedef struct s_logfile t_logfile;
+typedef struct s_journal t_journal;
+typedef struct s_control t_control;
+typedef struct s_status_table t_status_table;
+typedef struct s_tms_proc t_tms_proc;
+typedef struct s_startup t_startup;
+typedef struct s_capture t_capture;
+
+/* kind of file descriptor registered in the reactor epoll instance */
+typedef enum e_reactor_src_type {
+  SRC_EVENT_QUEUE, /* eventfd signaled by add_event() */
+  SRC_CHILD,       /* signalfd of SIGCHLD, read by the reaper */
+  SRC_TIMER,       /* timerfd of the timer wheel */
+} t_reactor_src_type;
+
+/* what epoll_event.data.ptr points to: the type of the source and its owner */
+typedef struct s_reactor_src {
+  t_reactor_src_type type;
+  void *owner; /* t_tm_node, t_reaper or t_timer_wheel */
+} t_reactor_src;
 
 /* data of a program dynamically filled at runtime for taskmaster operations */
 typedef struct s_pgm_private {
   struct log {
-    int32_t out; /* fd for logging out */
-    int32_t err; /* fd for logging err */
+    t_logfile *out; /* file logging out, shared by the programs using it */
+    t_logfile *err; /* file logging err */
+    bool out_plain; /* out not captured: see logfile.h */
+    bool err_plain;
   } log;
-  pthread_rwlock_t rw_pgm;
-  /* atomic_uint nb_thread_alive; */
-  struct timeval stop_timestamp;
-  t_thread_data *thrd; /* array of t_thread_data */
+  struct s_tm_node *node; /* node the pgm belongs to */
+  uint32_t id;            /* identifies the pgm in the journal */
+  uint32_t nb_proc_alive; /* processus of this pgm having a pid */
+  bool deleting;          /* pgm is destroyed once nb_proc_alive drops to 0 */
+  uint32_t nb_thrd;       /* size of thrd, numprocs or more after a reload */
+  t_thread_data *_Atomic thrd; /* array of t_thread_data, grown by a reload */
+  t_tms_proc *status;     /* records of thrd in the status table, or NULL */
+  uint32_t nb_status;     /* records in status: the ranks below numprocs */
   struct s_pgm *next;  /* next link of the linked list */
 } t_pgm_private;
 
 /* concatenation of all data a pgm need in taskmaster */
 typedef struct s_pgm {
-  t_pgm_usr usr;
+  t_pgm_conf *_Atomic conf; /* read it with PGM_CONF() */
   t_pgm_private privy;
 } t_pgm;
 
+/* current configuration of pgm. Outside of the master thread, which is the
+ * only one publishing it, must be read inside an rcu read section. */
+#define PGM_CONF(pgm) atomic_load_explicit(&(pgm)->conf, memory_order_acquire)
+
 /* event corresponding with client command */
 typedef enum e_client_ev {
   CLIENT_STATUS,
@@ -104,36 +174,223 @@ typedef enum e_client_ev {
   CLIENT_ADD,
   CLIENT_DEL,
   CLIENT_MAX_EVENT,
+  CLIENT_BATCH = CLIENT_MAX_EVENT, /* events of one request, in order */
+  CLIENT_RELOAD,                   /* configuration file read again */
 } t_client_ev;
 
+/* set of programs, one bit by pgm id */
+typedef struct s_pgm_set {
+  uint32_t nb_word;
+  uint64_t word[];
+} t_pgm_set;
+
+typedef struct s_ev_batch t_ev_batch;
+
+typedef struct s_group_conf t_group_conf;
+
+/* A client event targets either one pgm or a set of them. The set is owned
+ * by the event & freed by the master thread, as the batch of a
+ * CLIENT_BATCH event and the programs & groups of a CLIENT_RELOAD one. */
 typedef struct s_event {
   t_pgm *pgm;
+  t_pgm_set *set;
+  t_ev_batch *batch;
+  t_group_conf *groups;
   t_client_ev type;
 } t_event;
 
-#define LEN_EV_QUEUE (64U)
+/* events of a batch request, executed in one go by the master thread */
+struct s_ev_batch {
+  uint32_t nb;
+  uint32_t cap;
+  t_event event[];
+};
+
+#define LEN_EV_QUEUE (1024U) /* must be a power of 2 */
+#define EV_QUEUE_BATCH (64U) /* max events popped at once by the consumer */
+
+/* slot of the event queue. seq tells producers & consumer whose turn it is */
+typedef struct s_ev_slot {
+  atomic_uint seq;
+  t_event event;
+} t_ev_slot;
+
+/* bounded lock-free multi-producer/single-consumer ring of client events.
+ * The consumer is woken up thru an eventfd which is only written when it
+ * isn't already signaled. */
+typedef struct s_ev_queue {
+  alignas(64) atomic_uint tail; /* next slot to fill, shared by producers */
+  alignas(64) uint32_t head;    /* next slot to pop, owned by the consumer */
+  atomic_bool signaled;         /* efd had been written since last wakeup */
+  int32_t efd;                  /* eventfd polled by the consumer */
+  t_ev_slot slot[LEN_EV_QUEUE];
+} t_ev_queue;
+
+#define RCU_MAX_READERS (8U) /* threads reading outside the master thread */
+
+/* read section of one reader thread. epoch is 0 when out of section */
+typedef struct s_rcu_reader {
+  alignas(64) atomic_ullong epoch;
+} t_rcu_reader;
+
+/* object unpublished at 'epoch', released once no reader can still see it */
+typedef struct s_rcu_retired {
+  void *ptr;
+  void (*release)(void *ptr);
+  uint64_t epoch;
+  struct s_rcu_retired *next;
+} t_rcu_retired;
+
+/* Epoch based read-copy-update. Readers never block nor write shared data
+ * but their own slot. The master thread is the only updater: it retires the
+ * objects it unpublished and reclaims them after a grace period. */
+typedef struct s_rcu {
+  atomic_ullong epoch;     /* current epoch, starts at 1 */
+  atomic_uint nb_readers;  /* registered reader slots */
+  t_rcu_reader reader[RCU_MAX_READERS];
+  t_rcu_retired *retired; /* master thread only */
+} t_rcu;
+
+/* group declared in the 'groups' section of the configuration */
+typedef struct s_group_conf {
+  char *name;
+  char **member; /* program names or globs */
+  uint32_t nb_member;
+  struct s_conf_cache *cache; /* mapping holding its strings, or NULL */
+  struct s_group_conf *next;
+} t_group_conf;
+
+/* group compiled into the set of the programs it selects */
+typedef struct s_pgm_group {
+  char *name;
+  t_pgm_set *set;
+} t_pgm_group;
+
+/* slot of the name index. hash is compared before the name */
+typedef struct s_pgm_slot {
+  uint32_t hash;
+  t_pgm *pgm; /* NULL if the slot is free */
+} t_pgm_slot;
+
+/* Immutable selection tables of the programs: open addressing index by name,
+ * table by id & the compiled sets of 'all' and of each group */
+typedef struct s_pgm_index {
+  uint64_t gen;  /* tells apart successive indexes */
+  uint32_t nb_id; /* ids of the programs are lower */
+  t_pgm **by_id;  /* NULL for removed programs */
+  t_pgm_set *all;
+  uint32_t nb_group;
+  t_pgm_group *group;
+  uint32_t cap; /* power of 2 */
+  uint32_t size;
+  t_pgm_slot slot[];
+} t_pgm_index;
+
+#define PGM_SET_END (UINT32_MAX) /* returned by pgm_set_next() at the end */
+#define SELECT_CACHE_NB (8U)
+#define SELECT_GROUP_PREFIX "group:"
+
+/* sets of the last globs resolved by a thread, valid for index 'gen' */
+typedef struct s_select_cache {
+  struct s_select_entry {
+    uint64_t gen;
+    char *pattern;
+    t_pgm_set *set;
+  } entry[SELECT_CACHE_NB];
+  uint32_t next; /* entry replaced by the next miss */
+} t_select_cache;
 
 typedef struct s_tm_node {
   char *tm_name;     /* taskmaster name (argv[0]) */
   FILE *config_file; /* configuration file */
+  char *config_path; /* read again by a reload */
+  char *cache_path;  /* compiled configuration cache (-o), or NULL */
   t_pgm *head;       /* head of list of programs */
+  t_group_conf *groups; /* groups of programs of the configuration */
   uint32_t pgm_nb;   /* number of programs */
+  uint32_t pgm_ids;  /* next pgm id */
+  t_pgm_index *_Atomic pgm_index; /* read it with PGM_INDEX() */
   pthread_t master_thrd;
+  pthread_t main_thrd; /* runs the shell */
+
+  t_ev_queue ev_queue; /* client events consumed by the master thread */
+  t_rcu rcu;           /* protects pgm configurations read by other threads */
 
-  t_event event_queue[LEN_EV_QUEUE];
-  pthread_mutex_t mtx_queue;
-  sem_t new_event;
-  sem_t free_place;
-  uint32_t ev_queue_sz;
+  int32_t epoll_fd;        /* reactor epoll instance */
+  t_reactor_src queue_src; /* epoll source of ev_queue.efd */
+  t_timer_wheel *wheel;    /* deadlines of all processus transitions */
+  t_reactor_src wheel_src; /* epoll source of wheel->tfd */
+  t_reaper *reaper;        /* collects the children & routes them by pid */
+  t_reactor_src reaper_src; /* epoll source of reaper->sfd */
+  uint32_t nb_proc_alive;  /* processus having a pid, all pgms included */
+  uint32_t pgm_deleting;   /* pgms waiting for their processus to be reaped */
 
-  pthread_mutex_t mtx_log;
-  FILE *tm_stream_log; /* taskmaster file log */
+  t_logger *logger; /* writes taskmaster.log from its own thread */
+  t_rotate log_rotate; /* of taskmaster.log (-r), none if zero */
+  t_journal *journal; /* binary journal of processus transitions, or NULL */
+  t_status_table *status; /* shared memory status table, or NULL */
+  t_startup *startup;  /* startup trace (-t), or NULL */
+  t_capture *_Atomic capture; /* output capture, created by the first
+                                 captured launch */
+  char *ctl_path;      /* control socket */
+  t_control *control;  /* serves ctl_path, NULL in a client only shell */
+  int32_t ctl_fd;      /* connection of the shell to ctl_path */
   atomic_bool exit_mastt; /* exit master thread */
   atomic_bool exit_maint; /* exit main thread */
 } t_tm_node;
 
+/* current name index. Outside of the master thread, must be read inside an
+ * rcu read section. */
+#define PGM_INDEX(node) \
+  atomic_load_explicit(&(node)->pgm_index, memory_order_acquire)
+
 /* parsing.c */
 uint8_t init_taskmaster(t_tm_node *node);
+uint8_t init_programs(t_tm_node *node, const char *yaml, size_t len);
+uint8_t reload_programs(t_tm_node *node);
+uint8_t compile_config(t_tm_node *node);
+uint8_t rotate_option(t_rotate *rotate, const char *arg);
+
+/* ev_queue.c */
+uint8_t ev_queue_init(t_ev_queue *queue);
+void ev_queue_destroy(t_ev_queue *queue);
+uint8_t ev_queue_push(t_ev_queue *queue, t_event event);
+uint32_t ev_queue_pop_batch(t_ev_queue *queue, t_event *events, uint32_t max);
+void ev_queue_wakeup_ack(t_ev_queue *queue);
+
+/* rcu.c */
+void rcu_init(t_rcu *rcu);
+t_rcu_reader *rcu_register(t_rcu *rcu);
+void rcu_read_lock(t_rcu *rcu, t_rcu_reader *reader);
+void rcu_read_unlock(t_rcu_reader *reader);
+uint8_t rcu_retire(t_rcu *rcu, void *ptr, void (*release)(void *));
+void rcu_reclaim(t_rcu *rcu);
+void rcu_destroy(t_rcu *rcu);
+
+/* pgm_conf.c */
+t_pgm_conf *pgm_conf_new(void);
+t_pgm_conf *pgm_conf_get(t_pgm_conf *conf);
+void pgm_conf_put(t_pgm_conf *conf);
+void pgm_conf_fingerprint(t_pgm_conf *conf);
+uint8_t pgm_conf_publish(t_tm_node *node, t_pgm *pgm, t_pgm_conf *conf);
+
+/* pgm_index.c */
+t_pgm_index *pgm_index_build(t_pgm *head, uint32_t nb, uint32_t nb_id,
+                             const t_group_conf *groups);
+void pgm_index_destroy(t_pgm_index *index);
+t_pgm *pgm_index_find(const t_pgm_index *index, const char *name, size_t len);
+uint8_t pgm_index_publish(t_tm_node *node);
+
+/* pgm_select.c */
+t_pgm_set *pgm_set_new(uint32_t nb_id);
+void pgm_set_add(t_pgm_set *set, uint32_t id);
+void pgm_set_merge(t_pgm_set *dst, const t_pgm_set *src);
+bool pgm_set_is_empty(const t_pgm_set *set);
+uint32_t pgm_set_next(const t_pgm_set *set, uint32_t from);
+t_pgm_set *pgm_select_glob(const t_pgm_index *index, const char *pattern);
+uint8_t pgm_select(const t_pgm_index *index, t_select_cache *cache,
+                   const char *arg, size_t len, t_pgm_set *set);
+void select_cache_destroy(t_select_cache *cache);
 
 /* run_server.c */
 uint8_t run_server(t_tm_node *node);
@@ -145,8 +402,10 @@ uint8_t run_client(t_tm_node *node);
 void print_pgm_list(t_pgm *pgm);
 
 /* destroy.c */
+void destroy_pgm_user_attributes(t_pgm_usr *pgm);
 void destroy_pgm(t_pgm *pgm);
 void destroy_pgm_list(t_pgm **head);
+void destroy_group_list(t_group_conf **head);
 void destroy_taskmaster(t_tm_node *node);
 
 #endif
@@ -0,0 +1,121 @@
+#ifndef TM_PROTOCOL_H
+#define TM_PROTOCOL_H
+
+#include <inttypes.h>
+
+/*
+ * Control protocol of taskmaster, spoken on its Unix socket (taskmaster -s).
+ *
+ * Every message, request or reply, is a t_tmp_header followed by 'len' bytes
+ * of payload. Integers are in host byte order: client & server share the
+ * machine. A connection carries any number of requests, each one gets a
+ * single reply, in the order requests were sent, echoing their tag.
+ *
+ * Requests payloads:
+ *   STATUS, START, STOP, RESTART, DEL   selectors, each NUL terminated: a
+ *                                       program name, a glob or group:<name>.
+ *                                       STATUS without selector is about all
+ *                                       programs.
+ *   ADD                                 yaml document with a 'programs'
+ *                                       section, as in a config file.
+ *   LIST, EXIT, RELOAD                  none. RELOAD reads again the
+ *                                       configuration file taskmaster was
+ *                                       started with.
+ *   BATCH                               requests, each one with its header.
+ *                                       A batch can't be nested.
+ *   TAIL                                a t_tmp_tail then a program name,
+ *                                       NUL terminated.
+ *
+ * Replies payloads:
+ *   on error      nothing, or a NUL terminated detail: the selector
+ *                 matching no program, the program name already taken.
+ *   STATUS        for each program a t_tmp_pgm, its name NUL terminated &
+ *                 padded to TMP_ALIGN, then nb_proc t_tmp_proc ordered by
+ *                 rank. With TMP_FLAG_SUMMARY nb_proc is 0.
+ *   LIST          program names, each NUL terminated.
+ *   BATCH         replies of its requests, in order, each one with its
+ *                 header & own status. The master thread executes the
+ *                 commands of a batch in one go.
+ *   TAIL          the last output of the processus, as kept by taskmaster.
+ *                 With TMP_FLAG_FOLLOW, more replies echoing its tag follow
+ *                 with the output as it comes, until the connection is
+ *                 closed; output overwritten before it was sent is lost.
+ *   others        none.
+ */
+
+#define TMP_MAX_REQUEST (1U << 20) /* max payload of a request */
+#define TMP_ALIGN(n) (((n) + 7U) & ~7U)
+
+typedef struct s_tmp_header {
+    uint32_t len;    /* bytes of payload following the header */
+    uint32_t tag;    /* chosen by the client, echoed by the reply */
+    uint16_t op;     /* t_tmp_op */
+    uint16_t flags;  /* TMP_FLAG_* */
+    uint16_t status; /* t_tmp_status, 0 in requests */
+    uint16_t reserved;
+} t_tmp_header;
+
+typedef enum e_tmp_op {
+    TMP_OP_STATUS = 1,
+    TMP_OP_START,
+    TMP_OP_STOP,
+    TMP_OP_RESTART,
+    TMP_OP_ADD,
+    TMP_OP_DEL,
+    TMP_OP_LIST,
+    TMP_OP_EXIT,
+    TMP_OP_BATCH,
+    TMP_OP_RELOAD,
+    TMP_OP_TAIL,
+    TMP_OP_MAX,
+} t_tmp_op;
+
+#define TMP_FLAG_SUMMARY (0x1) /* STATUS: no t_tmp_proc records */
+#define TMP_FLAG_FOLLOW (0x2)  /* TAIL: stream the output as it comes */
+
+typedef enum e_tmp_status {
+    TMP_OK,
+    TMP_ERR_BAD_OP,      /* unknown op or flags */
+    TMP_ERR_ARG_MISSING, /* op needs at least one selector */
+    TMP_ERR_BAD_ARG,     /* selector matching no program */
+    TMP_ERR_CONFIG,      /* ADD, RELOAD: invalid yaml or program */
+    TMP_ERR_EXITING,     /* taskmaster is exiting */
+    TMP_ERR_NOMEM,
+    TMP_ERR_NO_TAIL, /* TAIL: the output of the processus isn't kept */
+    TMP_ERR_MAX,
+} t_tmp_status;
+
+/* states of a processus */
+#define TMP_PROC_STOPPED (0x00)
+#define TMP_PROC_STARTED (0x01)
+#define TMP_PROC_STOPPING (0x03)
+#define TMP_PROC_STARTING (0x04)
+
+typedef struct s_tmp_pgm {
+    uint32_t id;         /* program id, as in the journal */
+    uint32_t numprocs;
+    uint32_t nb_started; /* processus in the started state */
+    uint32_t nb_proc;    /* t_tmp_proc records following the name */
+    uint32_t name_len;   /* without its NUL */
+    uint32_t reserved;
+} t_tmp_pgm;
+
+typedef struct s_tmp_proc {
+    int64_t start_time; /* seconds since the epoch of its last launch */
+    int32_t pid;        /* 0 if not running */
+    int32_t restart_counter;
+    uint16_t rid;  /* rank of the processus in its program */
+    uint8_t state; /* TMP_PROC_* */
+    uint8_t reserved[5];
+} t_tmp_proc;
+
+typedef struct s_tmp_tail {
+    uint32_t rid; /* rank of the processus in its program */
+    uint32_t reserved;
+} t_tmp_tail;
+
+_Static_assert(sizeof(t_tmp_header) == 16, "t_tmp_header must be 16 bytes");
+_Static_assert(sizeof(t_tmp_pgm) % 8 == 0, "t_tmp_pgm must be 8 aligned");
+_Static_assert(sizeof(t_tmp_proc) == 24, "t_tmp_proc must be 24 bytes");
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef TM_STATUS_H
+#define TM_STATUS_H
+
+#include <inttypes.h>
+#include <stdatomic.h>
+
+#include "tm_protocol.h"
+
+/*
+ * Status table of taskmaster, published in a POSIX shared memory object
+ * (taskmaster -m name) which monitors shm_open() & mmap() read only.
+ *
+ * The region starts with a t_tms_header, followed by the table of programs
+ * then by the table of processus. Both are rewritten when programs are added
+ * or removed, under the layout seqlock of the header: a reader retries while
+ * layout_seq is odd or changed during its read. The region may grow then:
+ * a reader remaps it once size exceeds its mapping.
+ * Each processus record is updated in place under its own seqlock on every
+ * transition of the processus (see tms_read_proc()). The supervisor never
+ * waits for the readers.
+ */
+
+#define TMS_MAGIC "TMSTAT01"
+#define TMS_VERSION (2U)
+#define TMS_NAME_MAX (40) /* stored bytes of a name, NUL included */
+
+typedef struct s_tms_header {
+    char magic[8];           /* TMS_MAGIC, without NUL */
+    uint32_t version;        /* TMS_VERSION */
+    int32_t supervisor_pid;
+    _Atomic uint32_t layout_seq; /* odd while the tables are rewritten */
+    uint32_t nb_pgm;
+    uint32_t nb_proc;
+    uint32_t reserved0;
+    uint64_t pgm_off;  /* t_tms_pgm table, from the start of the region */
+    uint64_t proc_off; /* t_tms_proc table, from the start of the region */
+    _Atomic uint64_t size; /* bytes of the region */
+    uint64_t reserved1;
+} t_tms_header;
+
+typedef struct s_tms_pgm {
+    uint32_t id;         /* program id, as in the journal & the protocol */
+    uint32_t numprocs;
+    uint32_t nb_proc;    /* its records, one by rank below numprocs: the
+                            instances a reload removed leave the table at
+                            once, even while stopping */
+    uint32_t first_proc; /* index of its rank 0 in the processus table */
+    uint32_t name_len;   /* length of the full name, may be truncated */
+    uint32_t reserved;
+    char name[TMS_NAME_MAX];
+} t_tms_pgm;
+
+typedef struct s_tms_proc {
+    _Atomic uint32_t seq; /* odd while the supervisor writes the record */
+    uint32_t pgm;         /* index in the program table */
+    int32_t pid;          /* 0 if not running */
+    int32_t restart_counter;
+    uint16_t rid;  /* rank of the processus in its program */
+    uint8_t state; /* TMP_PROC_* */
+    uint8_t reserved0;
+    uint32_t reserved1;
+    int64_t start_time; /* seconds since the epoch of its last launch */
+    int64_t updated_ns; /* CLOCK_REALTIME_COARSE of its last change */
+    uint8_t reserved2[24];
+} t_tms_proc;
+
+_Static_assert(sizeof(t_tms_header) == 64, "t_tms_header must be 64 bytes");
+_Static_assert(sizeof(t_tms_pgm) == 64, "t_tms_pgm must be 64 bytes");
+_Static_assert(sizeof(t_tms_proc) == 64, "t_tms_proc must be 64 bytes");
+
+/* Start of a read of the tables: spins while they are rewritten */
+static inline uint32_t tms_layout_begin(const t_tms_header *header) {
+    uint32_t seq;
+
+    while ((seq = atomic_load_explicit(&header->layout_seq,
+                                       memory_order_acquire)) &
+           1)
+        ;
+    return seq;
+}
+
+/* The tables read since tms_layout_begin() must be read again */
+static inline int tms_layout_retry(const t_tms_header *header, uint32_t seq) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&header->layout_seq, memory_order_relaxed) !=
+           seq;
+}
+
+/* Consistent copy of a processus record, seq excepted */
+static inline void tms_read_proc(const t_tms_proc *rec, t_tms_proc *copy) {
+    uint32_t seq;
+
+    do {
+        while ((seq = atomic_load_explicit(&rec->seq, memory_order_acquire)) &
+               1)
+            ;
+        copy->pgm = rec->pgm;
+        copy->pid = rec->pid;
+        copy->restart_counter = rec->restart_counter;
+        copy->rid = rec->rid;
+        copy->state = rec->state;
+        copy->start_time = rec->start_time;
+        copy->updated_ns = rec->updated_ns;
+        atomic_thread_fence(memory_order_acquire);
+    } while (atomic_load_explicit(&rec->seq, memory_order_relaxed) != seq);
+}
+
+#endif
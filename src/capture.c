@@ -0,0 +1,535 @@
+#include "capture.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "parsing.h"
+#include "taskmaster.h"
+
+/* =================================== sinks ================================ */
+
+static int64_t capture_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+static void sink_set_rotate(t_capture *capture, t_sink *sink,
+                            const t_rotate *rotate) {
+    const t_rotate none = {0};
+
+    if (!rotate) rotate = &none;
+    atomic_store_explicit(&sink->maxbytes, rotate->maxbytes,
+                          memory_order_relaxed);
+    atomic_store_explicit(&sink->maxage, rotate->maxage, memory_order_relaxed);
+    atomic_store_explicit(&sink->backups, rotate->backups,
+                          memory_order_relaxed);
+    atomic_store_explicit(&sink->compress, rotate->compress,
+                          memory_order_relaxed);
+    if (rotate->maxage && !atomic_exchange(&capture->timed, true))
+        eventfd_write(capture->efd, 1); /* the io thread waits forever */
+}
+
+/* Sink of the log file 'path' names, opened by its first stream on the fd
+ * of the file: see logfile.h. Under capture->lock. */
+static t_sink *sink_get(t_capture *capture, t_logfile *log, const char *path,
+                        const t_rotate *rotate) {
+    t_sink *sink = log->sink;
+    struct stat st;
+
+    if (!sink) {
+        if (strlen(path) + CAPTURE_BACKUP_SUFFIX > PATH_MAX) {
+            errno = ENAMETOOLONG;
+            return NULL;
+        }
+        if (fstat(log->fd, &st) == -1 ||
+            !(sink = calloc(1, sizeof(*sink))))
+            return NULL;
+        if (!(sink->path = strdup(path))) {
+            free(sink);
+            return NULL;
+        }
+        sink->log = logfile_get(log, false);
+        sink->fd = log->fd;
+        sink->size = st.st_size;
+        sink->seekable = lseek(sink->fd, 0, SEEK_END) >= 0;
+        sink_io_file_init(&sink->file, sink->fd, sink->path);
+        sink->opened = capture_now();
+        sink->next = capture->sinks;
+        capture->sinks = sink;
+        log->sink = sink;
+    }
+    sink->refcount++;
+    sink_set_rotate(capture, sink, rotate);
+    return sink;
+}
+
+/* Drops file.N, then renames file.N-1 ... file.1, file to file.N ... file.2,
+ * file.1 - compressed ones as well - and swaps a new file in, on the same fd:
+ * see logfile_rotate(). The former file is then compressed if the sink has
+ * a codec. Without backups, the file is truncated. A file written to without
+ * capture too, by programs added since, doesn't rotate: see
+ * sanitize_config(). On failure, the sink keeps writing where it did. io
+ * thread only. */
+static void sink_rotate(t_capture *capture, t_sink *sink, int64_t now) {
+    uint32_t backups =
+        atomic_load_explicit(&sink->backups, memory_order_relaxed);
+    uint32_t codec =
+        atomic_load_explicit(&sink->compress, memory_order_relaxed);
+    char to[PATH_MAX];
+    int32_t old = -1;
+    uint8_t ret;
+
+    if (atomic_load(&sink->log->plain)) return;
+    sink_io_file_wait(&capture->io, &sink->file);
+    sink->opened = now;
+    sink->size = 0;
+    if (!backups) {
+        if (!ftruncate(sink->fd, 0)) lseek(sink->fd, 0, SEEK_SET);
+        return;
+    }
+    pthread_mutex_lock(&capture->compress.names);
+    compress_shift(sink->path, backups);
+    snprintf(to, sizeof(to), "%s.1", sink->path);
+    ret = logfile_rotate(sink->log, sink->path, to);
+    if (!ret && codec != codec_none)
+        old = open(to, O_RDONLY | O_CLOEXEC); /* the sink is write only */
+    pthread_mutex_unlock(&capture->compress.names);
+    if (ret) return;
+    sink_io_file_reset(&capture->io, &sink->file);
+    if (old >= 0)
+        compress_push(&capture->compress, old, sink->path, backups, codec);
+}
+
+/* Rotates the sinks old enough, out of the lock: only the io thread frees
+ * sinks. Returns the ms until the next one is, or -1 to wait forever. io
+ * thread only. */
+static int32_t sink_sweep(t_capture *capture) {
+    int64_t now, next = -1, due;
+    t_sink *sink, *rotate = NULL;
+    uint32_t maxage;
+
+    if (!atomic_load_explicit(&capture->timed, memory_order_relaxed))
+        return -1;
+    now = capture_now();
+    pthread_mutex_lock(&capture->lock);
+    for (sink = capture->sinks; sink; sink = sink->next) {
+        maxage = atomic_load_explicit(&sink->maxage, memory_order_relaxed);
+        if (!maxage) continue;
+        if (now >= sink->opened + maxage) {
+            if (sink->size) { /* else nothing to rotate */
+                sink->due = rotate;
+                rotate = sink;
+            }
+            sink->opened = now;
+        }
+        due = sink->opened + maxage - now;
+        if (next == -1 || due < next) next = due;
+    }
+    pthread_mutex_unlock(&capture->lock);
+    for (sink = rotate; sink; sink = sink->due) sink_rotate(capture, sink, now);
+    if (next == -1) return -1;
+    return next > INT32_MAX / 1000 ? INT32_MAX : (int32_t)(next * 1000);
+}
+
+/* Unlinks the sink once its last stream closed: returns it, to be closed
+ * out of the lock, or NULL. Under capture->lock. */
+static t_sink *sink_put(t_capture *capture, t_sink *sink) {
+    t_sink **link = &capture->sinks;
+
+    if (--sink->refcount) return NULL;
+    while (*link != sink) link = &(*link)->next;
+    *link = sink->next;
+    sink->log->sink = NULL;
+    return sink;
+}
+
+/* Waits for the writes of an unlinked sink, then closes it. io thread, or
+ * once it is gone. */
+static void sink_close(t_capture *capture, t_sink *sink) {
+    sink_io_file_close(&capture->io, &sink->file);
+    logfile_put(sink->log, false);
+    free(sink->path);
+    free(sink);
+}
+
+/* =================================== tails ================================ */
+
+static inline uint32_t tail_hash(uint32_t id, uint32_t rid) {
+    return (id * 0x9E3779B1U) ^ (rid * 0x85EBCA77U);
+}
+
+void tail_put(t_tail *tail) {
+    if (!tail || atomic_fetch_sub(&tail->refcount, 1) != 1) return;
+    pthread_mutex_destroy(&tail->lock);
+    free(tail->buf);
+    free(tail);
+}
+
+/* Bucket link of the tail of id & rid, pointing to NULL if none. Under
+ * capture->lock. */
+static t_tail **tail_link(t_capture *capture, uint32_t id, uint32_t rid) {
+    t_tail **link = &capture->tails[tail_hash(id, rid) & capture->tail_mask];
+
+    while (*link && ((*link)->id != id || (*link)->rid != rid))
+        link = &(*link)->next;
+    return link;
+}
+
+/* Doubles the buckets once there are more tails than buckets. Under
+ * capture->lock. */
+static uint8_t tail_table_grow(t_capture *capture) {
+    uint32_t nb = capture->tails ? (capture->tail_mask + 1) * 2
+                                 : CAPTURE_TAIL_BUCKETS;
+    t_tail **tails, *tail, *next;
+
+    if (capture->tails && capture->nb_tail <= capture->tail_mask)
+        return EXIT_SUCCESS;
+    if (!(tails = calloc(nb, sizeof(*tails)))) return EXIT_FAILURE;
+    for (uint32_t i = 0; capture->tails && i <= capture->tail_mask; i++)
+        for (tail = capture->tails[i]; tail; tail = next) {
+            next = tail->next;
+            tail->next = tails[tail_hash(tail->id, tail->rid) & (nb - 1)];
+            tails[tail_hash(tail->id, tail->rid) & (nb - 1)] = tail;
+        }
+    free(capture->tails);
+    capture->tails = tails;
+    capture->tail_mask = nb - 1;
+    return EXIT_SUCCESS;
+}
+
+/* Tail of the processus rid of program id, holding 'size' bytes. A tail of
+ * another size is replaced: the streams & followers of the old one keep it
+ * until they are done. Returns a reference, or NULL. Master thread only. */
+t_tail *capture_tail_open(t_capture *capture, uint32_t id, uint32_t rid,
+                          uint32_t size) {
+    t_tail **link, *tail = NULL;
+
+    pthread_mutex_lock(&capture->lock);
+    if (tail_table_grow(capture)) goto end;
+    link = tail_link(capture, id, rid);
+    if (*link && (*link)->size == size) {
+        tail = *link;
+        atomic_fetch_add(&tail->refcount, 1);
+        goto end;
+    }
+    if (!(tail = calloc(1, sizeof(*tail))) ||
+        !(tail->buf = malloc(size))) {
+        DESTROY_PTR(tail);
+        goto end;
+    }
+    pthread_mutex_init(&tail->lock, NULL);
+    atomic_init(&tail->refcount, 2); /* the table & the caller */
+    tail->size = size;
+    tail->id = id;
+    tail->rid = rid;
+    if (*link) { /* resized */
+        tail->next = (*link)->next;
+        tail_put(*link);
+        capture->nb_tail--;
+    }
+    *link = tail;
+    capture->nb_tail++;
+end:
+    pthread_mutex_unlock(&capture->lock);
+    return tail;
+}
+
+/* Reference to the tail of the processus rid of program id, or NULL */
+t_tail *capture_tail(t_capture *capture, uint32_t id, uint32_t rid) {
+    t_tail *tail = NULL;
+
+    pthread_mutex_lock(&capture->lock);
+    if (capture->tails && (tail = *tail_link(capture, id, rid)))
+        atomic_fetch_add(&tail->refcount, 1);
+    pthread_mutex_unlock(&capture->lock);
+    return tail;
+}
+
+/* Drops the tails of a deleted program */
+void capture_forget(t_capture *capture, uint32_t id) {
+    t_tail **link, *tail;
+
+    pthread_mutex_lock(&capture->lock);
+    for (uint32_t i = 0; capture->tails && i <= capture->tail_mask; i++)
+        for (link = &capture->tails[i]; (tail = *link);) {
+            if (tail->id != id) {
+                link = &tail->next;
+                continue;
+            }
+            *link = tail->next;
+            capture->nb_tail--;
+            tail_put(tail);
+        }
+    pthread_mutex_unlock(&capture->lock);
+}
+
+/* Copies what the tail holds from *pos, or from its oldest byte if it was
+ * overwritten since, into dst of tail->size bytes. *pos is moved after the
+ * last byte copied. Returns the number of bytes copied. */
+uint32_t tail_copy(t_tail *tail, uint64_t *pos, uint8_t *dst) {
+    uint32_t len, at, first;
+
+    pthread_mutex_lock(&tail->lock);
+    if (tail->head - *pos > tail->size) *pos = tail->head - tail->size;
+    len = tail->head - *pos;
+    at = *pos % tail->size;
+    first = len < tail->size - at ? len : tail->size - at;
+    memcpy(dst, tail->buf + at, first);
+    memcpy(dst + first, tail->buf, len - first);
+    *pos = tail->head;
+    pthread_mutex_unlock(&tail->lock);
+    return len;
+}
+
+/* Asks for efd to be written each time output is added to the tail */
+void tail_follow(t_tail *tail, int32_t efd) {
+    atomic_store(&tail->notify, efd);
+    atomic_fetch_add(&tail->nb_follow, 1);
+}
+
+void tail_unfollow(t_tail *tail) { atomic_fetch_sub(&tail->nb_follow, 1); }
+
+/* ================================== streams =============================== */
+
+/* Opens a stream of the output 'path', of log file 'log', kept in 'tail'
+ * too if not NULL: returns the write end of its pipe, to be dup2()ed by the
+ * child then closed, or -1. Master thread only. */
+int32_t capture_open(t_capture *capture, t_logfile *log, const char *path,
+                     const t_rotate *rotate, t_tail *tail) {
+    struct epoll_event ev = {.events = EPOLLIN};
+    t_stream *stream = NULL;
+    int32_t fds[2];
+
+    if (pipe2(fds, O_CLOEXEC) == -1) return -1;
+    if (fcntl(fds[0], F_SETFL, O_NONBLOCK) == -1 ||
+        !(stream = calloc(1, sizeof(*stream))))
+        goto error;
+    stream->fd = fds[0];
+    stream->tail = tail;
+    /* nothing is written yet: the io thread can't see the stream before its
+     * sink is set, & only it puts sinks, which may have writes in flight */
+    ev.data.ptr = stream;
+    if (epoll_ctl(capture->epfd, EPOLL_CTL_ADD, fds[0], &ev) == -1)
+        goto error;
+    pthread_mutex_lock(&capture->lock);
+    if ((stream->sink = sink_get(capture, log, path, rotate))) {
+        stream->next = capture->streams;
+        if (capture->streams) capture->streams->prev = stream;
+        capture->streams = stream;
+    }
+    pthread_mutex_unlock(&capture->lock);
+    if (!stream->sink) {
+        epoll_ctl(capture->epfd, EPOLL_CTL_DEL, fds[0], NULL);
+        goto error;
+    }
+    if (tail) atomic_fetch_add(&tail->refcount, 1);
+    return fds[1];
+
+error:
+    free(stream);
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+}
+
+static void stream_close(t_capture *capture, t_stream *stream) {
+    t_sink *sink;
+
+    close(stream->fd);
+    pthread_mutex_lock(&capture->lock);
+    if (stream->prev) stream->prev->next = stream->next;
+    else capture->streams = stream->next;
+    if (stream->next) stream->next->prev = stream->prev;
+    sink = sink_put(capture, stream->sink);
+    pthread_mutex_unlock(&capture->lock);
+    if (sink) sink_close(capture, sink);
+    tail_put(stream->tail);
+    free(stream);
+}
+
+/* Appends len bytes to the ring, of which only the last tail->size are
+ * kept */
+static void tail_push(t_tail *tail, const char *data, uint32_t len) {
+    uint32_t skip = len > tail->size ? len - tail->size : 0, at, first;
+
+    data += skip;
+    pthread_mutex_lock(&tail->lock);
+    at = (tail->head + skip) % tail->size;
+    first = len - skip < tail->size - at ? len - skip : tail->size - at;
+    memcpy(tail->buf + at, data, first);
+    memcpy(tail->buf, data + first, len - skip - first);
+    tail->head += len;
+    pthread_mutex_unlock(&tail->lock);
+}
+
+/* Reads the pipe into a buffer queued for the end of the sink, kept in the
+ * tail too if any: appended if the file is. With CAPTURE_IO_BUFS buffers in
+ * flight, waits for one to complete first: meanwhile the pipes aren't read,
+ * so a processus writing more than the disk takes blocks once its pipe is
+ * full. Returns what read() did. */
+static ssize_t stream_read(t_capture *capture, t_stream *stream,
+                           bool append) {
+    t_sink_buf *buf = sink_io_buf(&capture->io);
+    t_sink *sink = stream->sink;
+    ssize_t len = read(stream->fd, buf->data, SINK_IO_BUF_SIZE);
+
+    if (len <= 0) {
+        sink_io_drop(&capture->io, buf);
+        return len;
+    }
+    buf->len = len;
+    if (stream->tail) tail_push(stream->tail, buf->data, len);
+    sink_io_write(&capture->io, &sink->file, buf,
+                  sink->seekable && !append ? (int64_t)sink->size : -1);
+    return len;
+}
+
+/* Moves what the pipe holds into the sink, up to budget bytes, rotating it
+ * on the way if it is too big, then wakes the followers of its tail up.
+ * Returns true at the end of the stream. A stream left with data past its
+ * budget is still readable: epoll gives it back on its next wait. */
+static bool stream_drain(t_capture *capture, t_stream *stream,
+                         uint64_t budget) {
+    t_sink *sink = stream->sink;
+    bool fed = false, end = false, append;
+    uint64_t maxbytes, moved = 0;
+    ssize_t ret;
+    loff_t off;
+
+    /* the file may be appended to, or truncated, by others: it is trusted
+     * unless it lags behind the writes in flight */
+    if ((off = lseek(sink->fd, 0, SEEK_END)) >= 0 &&
+        ((uint64_t)off > sink->size || !atomic_load(&sink->file.inflight)))
+        sink->size = off;
+    while (moved < budget) {
+        maxbytes = atomic_load_explicit(&sink->maxbytes, memory_order_relaxed);
+        if (maxbytes && sink->size >= maxbytes)
+            sink_rotate(capture, sink, capture_now());
+        off = sink->size;
+        /* O_APPEND, set by the plain outputs or dropped by a rotation */
+        append = atomic_load(&sink->log->append);
+        if (stream->tail || sink->copy || append)
+            ret = stream_read(capture, stream, append);
+        else
+            ret = splice(stream->fd, NULL, sink->fd,
+                         sink->seekable ? &off : NULL, CAPTURE_CHUNK,
+                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (ret > 0) {
+            sink->size += ret;
+            moved += ret;
+            fed = true;
+            continue;
+        }
+        if (ret == -1 && errno == EINTR) continue;
+        if (ret == -1 && errno != EAGAIN && !sink->copy && !stream->tail &&
+            !append) {
+            sink->copy = true;
+            continue;
+        }
+        end = ret != -1 || errno != EAGAIN; /* eof, or the pipe failed */
+        break;
+    }
+    if (fed && stream->tail && atomic_load(&stream->tail->nb_follow))
+        eventfd_write(atomic_load(&stream->tail->notify), 1);
+    return end;
+}
+
+/* ================================= io thread ============================== */
+
+static void *capture_thread(void *arg) {
+    t_capture *capture = arg;
+    struct epoll_event events[CAPTURE_MAX_EVENTS];
+    t_stream *stream, *next;
+    eventfd_t value;
+    int32_t nfds;
+
+    while (!atomic_load_explicit(&capture->exit, memory_order_acquire)) {
+        nfds = epoll_wait(capture->epfd, events, CAPTURE_MAX_EVENTS,
+                          sink_sweep(capture));
+        if (nfds == -1) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (int32_t i = 0; i < nfds; i++) {
+            if (!(stream = events[i].data.ptr)) { /* exit, or a deadline */
+                eventfd_read(capture->efd, &value);
+                continue;
+            }
+            if (stream_drain(capture, stream, CAPTURE_DRAIN_MAX))
+                stream_close(capture, stream);
+        }
+        sink_io_submit(&capture->io);
+    }
+    /* the processus are gone: what is left in the pipes goes to the sinks */
+    for (stream = capture->streams; stream; stream = next) {
+        next = stream->next;
+        if (stream_drain(capture, stream, UINT64_MAX))
+            stream_close(capture, stream);
+    }
+    sink_io_drain(&capture->io);
+    return NULL;
+}
+
+uint8_t capture_init(t_capture *capture) {
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+    sigset_t all, old;
+    int32_t ret;
+
+    *capture = (t_capture){.epfd = -1, .efd = -1};
+    pthread_mutex_init(&capture->lock, NULL);
+    compress_init(&capture->compress);
+    if ((capture->epfd = epoll_create1(EPOLL_CLOEXEC)) == -1 ||
+        (capture->efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) == -1 ||
+        epoll_ctl(capture->epfd, EPOLL_CTL_ADD, capture->efd, &ev) == -1 ||
+        sink_io_init(&capture->io, CAPTURE_IO_BUFS))
+        goto error;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    ret = pthread_create(&capture->thrd, NULL, capture_thread, capture);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret) {
+        errno = ret;
+        goto error;
+    }
+    return EXIT_SUCCESS;
+
+error:
+    if (capture->epfd >= 0) close(capture->epfd);
+    if (capture->efd >= 0) close(capture->efd);
+    sink_io_destroy(&capture->io);
+    compress_destroy(&capture->compress);
+    pthread_mutex_destroy(&capture->lock);
+    return EXIT_FAILURE;
+}
+
+/* Stops the io thread once it drained the pipes. Streams still held by
+ * processus taskmaster doesn't know about - forked by its children - are
+ * closed. */
+void capture_destroy(t_capture *capture) {
+    t_tail *tail;
+
+    atomic_store_explicit(&capture->exit, true, memory_order_release);
+    eventfd_write(capture->efd, 1);
+    pthread_join(capture->thrd, NULL);
+    while (capture->streams) stream_close(capture, capture->streams);
+    for (uint32_t i = 0; capture->tails && i <= capture->tail_mask; i++)
+        while ((tail = capture->tails[i])) {
+            capture->tails[i] = tail->next;
+            tail_put(tail);
+        }
+    free(capture->tails);
+    sink_io_destroy(&capture->io);
+    compress_destroy(&capture->compress);
+    close(capture->epfd);
+    close(capture->efd);
+    pthread_mutex_destroy(&capture->lock);
+}
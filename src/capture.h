@@ -0,0 +1,136 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "compress.h"
+#include "logfile.h"
+#include "sink_io.h"
+
+/*
+ * Output capture of the programs with 'capture: true'.
+ *
+ * Their processus write into pipes instead of their log files. The read
+ * ends are watched by the io thread, which moves the data into the files
+ * - the sinks - with splice(): no copy thru userspace, and the supervision
+ * never waits on a disk. A processus holds one stream by output; a stream
+ * ends once drained after the processus, and all the ones it forked, closed
+ * it.
+ *
+ * The master thread opens streams at each launch, the io thread closes
+ * them: sinks & the list of streams are shared under 'lock', taken once by
+ * launch & by end of stream, never to move data. A sink is opened by the
+ * first stream writing to its file & closed with the last one. It is held by
+ * the log file entry & writes to its fd, see logfile.h: paths naming the same
+ * file share one sink, thus one writer, & one open file with the processus
+ * whose outputs aren't captured. The io thread keeps the size of each sink &
+ * writes at explicit offsets: spliced right away, or thru the buffers of its
+ * sink_io, submitted once by batch of events & completed in any order. Once
+ * the file is O_APPEND, for plain outputs, the sink appends its buffers
+ * instead, as splice() refuses it. The pipes aren't read while
+ * CAPTURE_IO_BUFS buffers are in flight. A stream moves at most
+ * CAPTURE_DRAIN_MAX bytes by wakeup, so that a processus writing faster
+ * than the io thread drains doesn't starve the other streams, the age
+ * rotations nor the exit.
+ *
+ * Sinks rotate in the io thread, between two writes: once the file reaches
+ * maxbytes, or maxage seconds after it was created. The backups are renamed
+ * once the writes in flight completed, then a new file is dup3()ed on the fd
+ * of the log file. Meanwhile the data waits in the pipes: nothing is lost & no
+ * processus waits on it. The settings are the ones of the last stream opened
+ * on the sink. A file also written to without capture doesn't rotate: its
+ * processus would keep writing to the backup. Backups of a sink with a codec
+ * are compressed in the background, see compress.h.
+ *
+ * A processus of a program with tail_bytes keeps its last output, stdout &
+ * stderr interleaved, in a ring found by program id & rank: the tail. Its
+ * streams are read() into a buffer written to their sink, & copied into the
+ * ring, under its lock for a memcpy() only. The ring outlives the processus,
+ * so the output of one which crashed can be read after, & is dropped with
+ * its program.
+ * Readers copy the ring under the lock of the tail; followers are told of
+ * new output thru an eventfd, once by drain.
+ */
+
+#define CAPTURE_CHUNK (64 * 1024) /* bytes moved by splice() call */
+#define CAPTURE_DRAIN_MAX (4 * CAPTURE_CHUNK) /* by stream & wakeup */
+#define CAPTURE_IO_BUFS (32U)     /* buffers of SINK_IO_BUF_SIZE in flight */
+#define CAPTURE_MAX_EVENTS (64)
+#define CAPTURE_BACKUP_SUFFIX (9) /* ".NN.lz4" or ".lz4.tmp" & the NUL byte */
+#define CAPTURE_TAIL_BUCKETS (64)  /* initial buckets of the tail table */
+
+typedef struct s_sink {
+    char *path;
+    t_logfile *log; /* its reference, log->sink being this one */
+    int32_t fd;     /* log->fd */
+    t_sink_file file;
+    uint32_t refcount; /* streams writing to it */
+    bool copy;         /* splice() unsupported: read() into buffers */
+    bool seekable;     /* or written at its position, in order */
+    _Atomic uint64_t maxbytes; /* rotation settings, see t_rotate */
+    _Atomic uint32_t maxage;
+    _Atomic uint32_t backups;
+    _Atomic uint32_t compress;
+    uint64_t size;  /* of the file, io thread only once published */
+    int64_t opened; /* CLOCK_MONOTONIC second the file was created at */
+    struct s_sink *next;
+    struct s_sink *due; /* to rotate, out of the lock */
+} t_sink;
+
+typedef struct s_tail {
+    atomic_uint refcount;    /* the tail table, streams & followers */
+    pthread_mutex_t lock;    /* buf & head, between the io thread & readers */
+    uint64_t head;           /* bytes ever written */
+    uint32_t size;           /* of buf, fixed: a new size is a new tail */
+    uint32_t id;             /* program id */
+    uint32_t rid;            /* rank of the processus */
+    atomic_uint nb_follow;
+    atomic_int notify;       /* eventfd of the followers */
+    char *buf;
+    struct s_tail *next;     /* in its bucket */
+} t_tail;
+
+typedef struct s_stream {
+    int32_t fd; /* read end of the pipe, non blocking */
+    t_sink *sink;
+    t_tail *tail; /* or NULL: spliced */
+    struct s_stream *prev;
+    struct s_stream *next;
+} t_stream;
+
+typedef struct s_capture {
+    int32_t epfd;
+    int32_t efd; /* wakes the io thread up to exit */
+    pthread_t thrd;
+    pthread_mutex_t lock;
+    t_sink *sinks;
+    t_stream *streams;
+    t_tail **tails; /* hash table of chained buckets, by id & rid */
+    uint32_t tail_mask;
+    uint32_t nb_tail;
+    atomic_bool timed; /* a sink rotates by age: the io thread has deadlines */
+    atomic_bool exit;
+    t_sink_io io; /* io thread only */
+    t_compress compress;
+} t_capture;
+
+struct s_rotate;
+
+uint8_t capture_init(t_capture *capture);
+int32_t capture_open(t_capture *capture, t_logfile *log, const char *path,
+                     const struct s_rotate *rotate, t_tail *tail);
+void capture_destroy(t_capture *capture);
+
+t_tail *capture_tail_open(t_capture *capture, uint32_t id, uint32_t rid,
+                          uint32_t size);
+t_tail *capture_tail(t_capture *capture, uint32_t id, uint32_t rid);
+void capture_forget(t_capture *capture, uint32_t id);
+void tail_put(t_tail *tail);
+uint32_t tail_copy(t_tail *tail, uint64_t *pos, uint8_t *dst);
+void tail_follow(t_tail *tail, int32_t efd);
+void tail_unfollow(t_tail *tail);
+
+#endif
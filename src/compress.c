@@ -0,0 +1,208 @@
+#include "compress.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/ioprio.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "lz4.h"
+#include "taskmaster.h"
+
+typedef struct s_compress_buf {
+    t_lz4 lz4;
+    uint8_t src[LZ4_BLOCK_SIZE];
+    uint8_t dst[LZ4_BLOCK_BOUND(LZ4_BLOCK_SIZE)];
+} t_compress_buf;
+
+/* ================================== worker ================================ */
+
+/* Leaves the cpu & the disk to anything else. Failures are harmless. */
+static void compress_idle(void) {
+    struct sched_param param = {0};
+
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+            IOPRIO_PRIO_VALUE(IOPRIO_CLASS_IDLE, 0));
+}
+
+static uint8_t write_all(int32_t fd, const uint8_t *buf, uint32_t len) {
+    ssize_t ret;
+
+    for (uint32_t off = 0; off < len; off += ret)
+        if ((ret = write(fd, buf + off, len - off)) <= 0) return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+/* Compresses in into out, an LZ4 frame. Reads until the end of in. */
+static uint8_t compress_lz4(t_compress *compress, t_compress_buf *buf,
+                            int32_t in, int32_t out) {
+    uint32_t size = lz4_frame_begin(&buf->lz4, buf->dst);
+    uint64_t off = 0;
+    ssize_t len;
+
+    if (write_all(out, buf->dst, size)) return EXIT_FAILURE;
+    while ((len = pread(in, buf->src, LZ4_BLOCK_SIZE, off)) > 0) {
+        if (atomic_load_explicit(&compress->exit, memory_order_relaxed))
+            return EXIT_FAILURE;
+        off += len;
+        size = lz4_frame_block(&buf->lz4, buf->dst, buf->src, len);
+        if (write_all(out, buf->dst, size)) return EXIT_FAILURE;
+    }
+    if (len == -1) return EXIT_FAILURE;
+    size = lz4_frame_end(&buf->lz4, buf->dst);
+    return write_all(out, buf->dst, size);
+}
+
+/* Swaps tmp in for the backup the file of the job is now, if it is still
+ * one. Returns false if it is not. */
+static bool compress_rename(t_compress *compress, const t_compress_job *job,
+                            const struct stat *st, const char *tmp) {
+    char path[PATH_MAX], dst[PATH_MAX];
+    struct stat cur;
+    bool found = false;
+
+    pthread_mutex_lock(&compress->names);
+    for (uint32_t i = 1; i <= job->backups && !found; i++) {
+        snprintf(path, sizeof(path), "%s.%u", job->path, i);
+        if (stat(path, &cur) || cur.st_dev != st->st_dev ||
+            cur.st_ino != st->st_ino)
+            continue;
+        if ((size_t)snprintf(dst, sizeof(dst), "%s" COMPRESS_SUFFIX, path) >=
+            sizeof(dst))
+            break; /* the sinks leave room for it, see CAPTURE_BACKUP_SUFFIX */
+        if ((found = !rename(tmp, dst))) unlink(path);
+    }
+    pthread_mutex_unlock(&compress->names);
+    return found;
+}
+
+static void compress_job(t_compress *compress, t_compress_buf *buf,
+                         const t_compress_job *job) {
+    char tmp[PATH_MAX];
+    struct stat st;
+    int32_t out;
+    uint8_t ret;
+
+    if (job->codec != codec_lz4 || fstat(job->fd, &st) == -1 ||
+        !st.st_nlink) /* dropped by the rotations meanwhile */
+        return;
+    snprintf(tmp, sizeof(tmp), "%s" COMPRESS_TMP, job->path);
+    out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+               st.st_mode & 07777);
+    if (out == -1) return;
+    ret = compress_lz4(compress, buf, job->fd, out);
+    if (close(out) || ret || !compress_rename(compress, job, &st, tmp))
+        unlink(tmp);
+}
+
+static void *compress_worker(void *arg) {
+    t_compress *compress = arg;
+    t_compress_buf *buf = malloc(sizeof(*buf));
+    t_compress_job job;
+
+    compress_idle();
+    pthread_mutex_lock(&compress->lock);
+    while (true) {
+        while (!compress->nb && !atomic_load(&compress->exit))
+            pthread_cond_wait(&compress->cond, &compress->lock);
+        if (atomic_load(&compress->exit)) break;
+        job = compress->job[compress->head];
+        compress->head = (compress->head + 1) % COMPRESS_QUEUE;
+        compress->nb--;
+        pthread_mutex_unlock(&compress->lock);
+        if (buf) compress_job(compress, buf, &job);
+        close(job.fd);
+        free(job.path);
+        pthread_mutex_lock(&compress->lock);
+    }
+    pthread_mutex_unlock(&compress->lock);
+    free(buf);
+    return NULL;
+}
+
+/* =================================== api ================================== */
+
+/* Renames path.from to path.to, compressed or not */
+static void backup_rename(const char *path, uint32_t from, uint32_t to) {
+    char src[PATH_MAX], dst[PATH_MAX];
+
+    snprintf(src, sizeof(src), "%s.%u", path, from);
+    snprintf(dst, sizeof(dst), "%s.%u", path, to);
+    rename(src, dst);
+    snprintf(src, sizeof(src), "%s.%u" COMPRESS_SUFFIX, path, from);
+    snprintf(dst, sizeof(dst), "%s.%u" COMPRESS_SUFFIX, path, to);
+    rename(src, dst);
+}
+
+/* Drops path.backups, then renames path.N-1 ... path.1 to path.N ...
+ * path.2, compressed ones as well: path.1 is free for the file rotated.
+ * Under compress->names. */
+void compress_shift(const char *path, uint32_t backups) {
+    char to[PATH_MAX];
+
+    snprintf(to, sizeof(to), "%s.%u", path, backups);
+    unlink(to);
+    snprintf(to, sizeof(to), "%s.%u" COMPRESS_SUFFIX, path, backups);
+    unlink(to);
+    for (uint32_t i = backups; i > 1; i--) backup_rename(path, i - 1, i);
+}
+
+void compress_init(t_compress *compress) {
+    *compress = (t_compress){0};
+    pthread_mutex_init(&compress->lock, NULL);
+    pthread_cond_init(&compress->cond, NULL);
+    pthread_mutex_init(&compress->names, NULL);
+}
+
+/* Queues the compression of fd, rotated from path, taking it over: it is
+ * closed if the queue is full. Starts the worker, with all signals blocked,
+ * on the first job. */
+void compress_push(t_compress *compress, int32_t fd, const char *path,
+                   uint8_t backups, uint8_t codec) {
+    t_compress_job job = {.fd = fd, .codec = codec, .backups = backups};
+    sigset_t all, old;
+
+    pthread_mutex_lock(&compress->lock);
+    if (!compress->started) {
+        sigfillset(&all);
+        pthread_sigmask(SIG_BLOCK, &all, &old);
+        compress->started = !pthread_create(&compress->thrd, NULL,
+                                            compress_worker, compress);
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+    }
+    if (compress->started && compress->nb < COMPRESS_QUEUE &&
+        (job.path = strdup(path))) {
+        compress->job[(compress->head + compress->nb++) % COMPRESS_QUEUE] = job;
+        pthread_cond_signal(&compress->cond);
+        fd = -1;
+    }
+    pthread_mutex_unlock(&compress->lock);
+    if (fd >= 0) close(fd);
+}
+
+/* Stops the worker, abandoning its job & the queue */
+void compress_destroy(t_compress *compress) {
+    t_compress_job *job;
+
+    pthread_mutex_lock(&compress->lock);
+    atomic_store(&compress->exit, true);
+    pthread_cond_signal(&compress->cond);
+    pthread_mutex_unlock(&compress->lock);
+    if (compress->started) pthread_join(compress->thrd, NULL);
+    for (; compress->nb; compress->nb--) {
+        job = &compress->job[compress->head];
+        compress->head = (compress->head + 1) % COMPRESS_QUEUE;
+        close(job->fd);
+        free(job->path);
+    }
+    pthread_mutex_destroy(&compress->names);
+    pthread_cond_destroy(&compress->cond);
+    pthread_mutex_destroy(&compress->lock);
+}
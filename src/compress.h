@@ -0,0 +1,53 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Compression of the rotated log files, off the io thread.
+ *
+ * A rotation hands the file it just renamed to file.1 - an fd of it - to a
+ * queue of COMPRESS_QUEUE jobs: a full queue leaves the file uncompressed.
+ * One worker, started by the first job, runs at SCHED_IDLE & in the idle io
+ * class: it only takes the cpu & the disk nothing else wants. It compresses
+ * the file into file.lz4.tmp, then renames that after the backup the file is
+ * by now, rotations having shifted it meanwhile, & removes the file. The
+ * renames of the rotations & of the worker are serialized by 'names'.
+ *
+ * At exit, the job in progress is abandoned & the queue dropped: the
+ * backups left are valid, only uncompressed.
+ */
+
+#define COMPRESS_QUEUE (16U)
+#define COMPRESS_SUFFIX ".lz4"
+#define COMPRESS_TMP ".lz4.tmp"
+
+typedef struct s_compress_job {
+    int32_t fd;      /* of the rotated file */
+    uint8_t codec;   /* t_codec */
+    uint8_t backups; /* of its sink, where to look for it once compressed */
+    char *path;      /* of its sink */
+} t_compress_job;
+
+typedef struct s_compress {
+    pthread_mutex_t lock; /* the queue */
+    pthread_cond_t cond;
+    pthread_mutex_t names; /* renames of the backups */
+    t_compress_job job[COMPRESS_QUEUE];
+    uint32_t head;
+    uint32_t nb;
+    bool started;
+    atomic_bool exit;
+    pthread_t thrd;
+} t_compress;
+
+void compress_init(t_compress *compress);
+void compress_shift(const char *path, uint32_t backups);
+void compress_push(t_compress *compress, int32_t fd, const char *path,
+                   uint8_t backups, uint8_t codec);
+void compress_destroy(t_compress *compress);
+
+#endif
@@ -0,0 +1,404 @@
+#include "conf_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "taskmaster.h"
+
+_Static_assert(sizeof(char *) == sizeof(uint64_t),
+               "pointer arrays are relocated in place");
+
+#define TMC_ALIGN(n, a) (((n) + (a) - 1) & ~(size_t)((a) - 1))
+
+/* FNV-1a 64 of the source, its length included */
+uint64_t conf_cache_key(const void *src, size_t len) {
+    uint64_t key = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < len; i++) {
+        key ^= ((const uint8_t *)src)[i];
+        key *= 1099511628211ULL;
+    }
+    return key ^ len;
+}
+
+t_conf_cache *conf_cache_get(t_conf_cache *cache) {
+    atomic_fetch_add_explicit(&cache->refcount, 1, memory_order_relaxed);
+    return cache;
+}
+
+void conf_cache_put(t_conf_cache *cache) {
+    if (!cache) return;
+    if (atomic_fetch_sub_explicit(&cache->refcount, 1, memory_order_acq_rel) !=
+        1)
+        return;
+    munmap(cache->map, cache->size);
+    free(cache);
+}
+
+/* ================================= write ================================== */
+
+typedef struct s_blob {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} t_blob;
+
+#define BLOB_AT(blob, off, type) ((type *)((blob)->data + (off)))
+
+/* Appends len zeroed bytes aligned on 'align'. Returns their offset. */
+static uint64_t blob_reserve(t_blob *blob, size_t len, size_t align) {
+    size_t off = TMC_ALIGN(blob->len, align), cap = blob->cap;
+    uint8_t *data;
+
+    while (off + len > cap) cap = cap ? cap * 2 : 4096;
+    if (cap != blob->cap) {
+        if (!(data = realloc(blob->data, cap))) handle_error("realloc");
+        blob->data = data;
+        blob->cap = cap;
+    }
+    memset(blob->data + blob->len, 0, off + len - blob->len);
+    blob->len = off + len;
+    return off;
+}
+
+static uint64_t blob_str(t_blob *blob, const char *str) {
+    size_t len;
+    uint64_t off;
+
+    if (!str) return 0;
+    len = strlen(str) + 1;
+    off = blob_reserve(blob, len, 1);
+    memcpy(blob->data + off, str, len);
+    return off;
+}
+
+/* Array of the offsets of nb strings, NULL terminated, then the strings */
+static uint64_t blob_str_array(t_blob *blob, char *const *array, uint32_t nb) {
+    uint64_t off, str;
+
+    if (!array) return 0;
+    off = blob_reserve(blob, (nb + 1) * sizeof(uint64_t), sizeof(uint64_t));
+    for (uint32_t i = 0; i < nb; i++) {
+        str = blob_str(blob, array[i]);
+        BLOB_AT(blob, off, uint64_t)[i] = str;
+    }
+    return off;
+}
+
+static void blob_pgm(t_blob *blob, uint64_t rec, const t_pgm_conf *conf) {
+    const t_pgm_usr *usr = &conf->usr;
+    uint32_t nb_cmd = 0;
+    t_tmc_pgm pgm = {
+        .fp_launch = conf->fp_launch,
+        .fp_conf = conf->fp_conf,
+        .env_size = usr->env.array_size,
+        .nb_exitcodes = usr->exitcodes.array_size,
+        .numprocs = usr->numprocs,
+        .umask = usr->umask,
+        .autorestart = usr->autorestart,
+        .starttime = usr->starttime,
+        .stoptime = usr->stoptime,
+        .startretries = usr->startretries,
+        .autostart = usr->autostart,
+        .stopsignal = usr->stopsignal.nb,
+        .capture = usr->capture,
+        .out_maxage = usr->out_rotate.maxage,
+        .err_maxage = usr->err_rotate.maxage,
+        .out_maxbytes = usr->out_rotate.maxbytes,
+        .err_maxbytes = usr->err_rotate.maxbytes,
+        .out_backups = usr->out_rotate.backups,
+        .err_backups = usr->err_rotate.backups,
+        .out_compress = usr->out_rotate.compress,
+        .err_compress = usr->err_rotate.compress,
+        .tail_bytes = usr->tail_bytes,
+    };
+
+    while (usr->cmd && usr->cmd[nb_cmd]) nb_cmd++;
+    pgm.name = blob_str(blob, usr->name);
+    pgm.cmd = blob_str_array(blob, usr->cmd, nb_cmd);
+    pgm.env = blob_str_array(blob, usr->env.array_val, usr->env.array_size);
+    pgm.std_out = blob_str(blob, usr->std_out);
+    pgm.std_err = blob_str(blob, usr->std_err);
+    pgm.workingdir = blob_str(blob, usr->workingdir);
+    pgm.stopsignal_name = blob_str(blob, usr->stopsignal.name);
+    if (usr->exitcodes.array_val) {
+        pgm.exitcodes = blob_reserve(
+            blob, usr->exitcodes.array_size * sizeof(int32_t), sizeof(int32_t));
+        memcpy(blob->data + pgm.exitcodes, usr->exitcodes.array_val,
+               usr->exitcodes.array_size * sizeof(int32_t));
+    }
+    *BLOB_AT(blob, rec, t_tmc_pgm) = pgm;
+}
+
+static void blob_group(t_blob *blob, uint64_t rec, const t_group_conf *group) {
+    t_tmc_group tmc = {.nb_member = group->nb_member};
+
+    tmc.name = blob_str(blob, group->name);
+    tmc.member = blob_str_array(blob, group->member, group->nb_member);
+    *BLOB_AT(blob, rec, t_tmc_group) = tmc;
+}
+
+static uint8_t write_all(int32_t fd, const uint8_t *data, size_t len) {
+    ssize_t ret;
+
+    while (len) {
+        if ((ret = write(fd, data, len)) == -1) {
+            if (errno == EINTR) continue;
+            return EXIT_FAILURE;
+        }
+        data += ret;
+        len -= ret;
+    }
+    return EXIT_SUCCESS;
+}
+
+/* Compiles the programs & groups of node, defaults filled in, into the cache
+ * 'path' for the source of hash 'key'. The file is replaced by a rename():
+ * a taskmaster loading it meanwhile maps either the old or the new one. */
+uint8_t conf_cache_write(const t_tm_node *node, const char *path,
+                         uint64_t key) {
+    t_blob blob = {0};
+    t_tmc_header header = {.version = TMC_VERSION,
+                           .ptr_size = sizeof(void *),
+                           .key = key};
+    char tmp[PATH_MAX];
+    uint64_t rec;
+    int32_t fd;
+    uint8_t ret;
+
+    if ((size_t)snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= sizeof(tmp)) {
+        errno = ENAMETOOLONG;
+        return EXIT_FAILURE;
+    }
+    memcpy(header.magic, TMC_MAGIC, sizeof(header.magic));
+    for (const t_pgm *pgm = node->head; pgm; pgm = pgm->privy.next)
+        header.nb_pgm++;
+    for (const t_group_conf *group = node->groups; group; group = group->next)
+        header.nb_group++;
+    blob_reserve(&blob, sizeof(header), sizeof(uint64_t));
+    header.pgm_off = blob_reserve(&blob, header.nb_pgm * sizeof(t_tmc_pgm),
+                                  sizeof(uint64_t));
+    header.group_off = blob_reserve(
+        &blob, header.nb_group * sizeof(t_tmc_group), sizeof(uint64_t));
+
+    rec = header.pgm_off;
+    for (const t_pgm *pgm = node->head; pgm; pgm = pgm->privy.next) {
+        blob_pgm(&blob, rec, pgm->conf);
+        rec += sizeof(t_tmc_pgm);
+    }
+    rec = header.group_off;
+    for (const t_group_conf *group = node->groups; group; group = group->next) {
+        blob_group(&blob, rec, group);
+        rec += sizeof(t_tmc_group);
+    }
+    blob_reserve(&blob, 1, 1); /* last string can't run past the file */
+    header.size = blob.len;
+    memcpy(blob.data, &header, sizeof(header));
+
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) goto error;
+    ret = write_all(fd, blob.data, blob.len);
+    if (close(fd) == -1 || ret || rename(tmp, path) == -1) {
+        unlink(tmp);
+        goto error;
+    }
+    free(blob.data);
+    return EXIT_SUCCESS;
+
+error:
+    free(blob.data);
+    return EXIT_FAILURE;
+}
+
+/* ================================== load ================================== */
+
+/* Whether nb elements of elem_size from 'off' fit in size bytes: checked by
+ * subtraction, as a forged off or nb would wrap a sum */
+static bool array_fits(uint64_t off, uint64_t nb, size_t elem_size,
+                       size_t size) {
+    return off <= size && nb <= (size - off) / elem_size;
+}
+
+typedef struct s_cache_load {
+    t_conf_cache *cache;
+    uint8_t *base;
+    size_t size;
+} t_cache_load;
+
+/* Pointer to the string at 'off', NULL for 0. Fails if out of the file. */
+static uint8_t load_str(const t_cache_load *load, uint64_t off, char **str) {
+    if (off >= load->size) return EXIT_FAILURE;
+    *str = off ? (char *)load->base + off : NULL;
+    return EXIT_SUCCESS;
+}
+
+/* Relocates the pointer array at 'off' in place: nb entries, NULL terminated,
+ * or up to its NULL terminator if nb is UINT32_MAX */
+static uint8_t load_str_array(const t_cache_load *load, uint64_t off,
+                              uint32_t nb, char ***array) {
+    uint64_t *slot = (uint64_t *)(load->base + off);
+    char *str;
+
+    *array = NULL;
+    if (!off) return EXIT_SUCCESS;
+    if (off % sizeof(uint64_t) || off >= load->size) return EXIT_FAILURE;
+    for (uint32_t i = 0;; i++) {
+        if (off + (i + 1) * sizeof(uint64_t) > load->size) return EXIT_FAILURE;
+        if (i == nb || (nb == UINT32_MAX && !slot[i])) {
+            if (slot[i]) return EXIT_FAILURE;
+            break;
+        }
+        if (load_str(load, slot[i], &str)) return EXIT_FAILURE;
+        slot[i] = (uint64_t)(uintptr_t)str;
+    }
+    *array = (char **)slot;
+    return EXIT_SUCCESS;
+}
+
+static uint8_t load_pgm(const t_cache_load *load, const t_tmc_pgm *rec,
+                        t_pgm_conf *conf) {
+    t_pgm_usr *usr = &conf->usr;
+    char *signame;
+
+    if (load_str(load, rec->name, &usr->name) || !usr->name ||
+        load_str_array(load, rec->cmd, UINT32_MAX, &usr->cmd) ||
+        load_str_array(load, rec->env, rec->env_size, &usr->env.array_val) ||
+        load_str(load, rec->std_out, &usr->std_out) ||
+        load_str(load, rec->std_err, &usr->std_err) ||
+        load_str(load, rec->workingdir, &usr->workingdir) ||
+        (!rec->env && rec->env_size) ||
+        load_str(load, rec->stopsignal_name, &signame) ||
+        rec->stopsignal >= NSIG || (!rec->exitcodes && rec->nb_exitcodes) ||
+        rec->exitcodes % sizeof(int32_t) ||
+        !array_fits(rec->exitcodes, rec->nb_exitcodes, sizeof(int32_t),
+                    load->size))
+        return EXIT_FAILURE;
+    usr->env.array_size = rec->env_size;
+    usr->exitcodes.array_val =
+        rec->exitcodes ? (int32_t *)(load->base + rec->exitcodes) : NULL;
+    usr->exitcodes.array_size = rec->nb_exitcodes;
+    usr->numprocs = rec->numprocs;
+    usr->umask = rec->umask;
+    usr->autorestart = rec->autorestart;
+    usr->startretries = rec->startretries;
+    usr->autostart = rec->autostart;
+    usr->stopsignal.nb = rec->stopsignal;
+    if (signame)
+        snprintf(usr->stopsignal.name, sizeof(usr->stopsignal.name), "%s",
+                 signame);
+    usr->starttime = rec->starttime;
+    usr->stoptime = rec->stoptime;
+    usr->capture = rec->capture;
+    usr->out_rotate = (t_rotate){rec->out_maxbytes, rec->out_maxage,
+                                 rec->out_backups, rec->out_compress};
+    usr->err_rotate = (t_rotate){rec->err_maxbytes, rec->err_maxage,
+                                 rec->err_backups, rec->err_compress};
+    usr->tail_bytes = rec->tail_bytes;
+    conf->fp_launch = rec->fp_launch;
+    conf->fp_conf = rec->fp_conf;
+    return EXIT_SUCCESS;
+}
+
+static uint8_t load_group(const t_cache_load *load, const t_tmc_group *rec,
+                          t_group_conf *group) {
+    if (load_str(load, rec->name, &group->name) || !group->name ||
+        load_str_array(load, rec->member, rec->nb_member, &group->member))
+        return EXIT_FAILURE;
+    group->nb_member = rec->nb_member;
+    return EXIT_SUCCESS;
+}
+
+/* Builds the programs & groups of the cache into node, in the order they
+ * were compiled: the tables are walked backward as lists are built by the
+ * head, like the parser does. */
+static uint8_t load_tables(const t_cache_load *load, t_tm_node *node,
+                           const t_tmc_header *header) {
+    const t_tmc_pgm *pgm_rec =
+        (const t_tmc_pgm *)(load->base + header->pgm_off);
+    const t_tmc_group *group_rec =
+        (const t_tmc_group *)(load->base + header->group_off);
+    t_group_conf *group;
+    t_pgm *pgm;
+
+    for (uint32_t i = header->nb_pgm; i-- > 0;) {
+        if (!(pgm = calloc(1, sizeof(*pgm)))) handle_error("calloc");
+        if (!(pgm->conf = pgm_conf_new())) handle_error("calloc");
+        pgm->conf->cache = conf_cache_get(load->cache);
+        pgm->privy.next = node->head;
+        node->head = pgm;
+        pgm->privy.node = node;
+        pgm->privy.id = node->pgm_ids++;
+        node->pgm_nb++;
+        if (load_pgm(load, &pgm_rec[i], pgm->conf)) return EXIT_FAILURE;
+    }
+    for (uint32_t i = header->nb_group; i-- > 0;) {
+        if (!(group = calloc(1, sizeof(*group)))) handle_error("calloc");
+        group->cache = conf_cache_get(load->cache);
+        group->next = node->groups;
+        node->groups = group;
+        if (load_group(load, &group_rec[i], group)) return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+static bool header_valid(const t_tmc_header *header, size_t size,
+                         uint64_t key) {
+    return !memcmp(header->magic, TMC_MAGIC, sizeof(header->magic)) &&
+           header->version == TMC_VERSION &&
+           header->ptr_size == sizeof(void *) && header->key == key &&
+           header->size == size && header->pgm_off % sizeof(uint64_t) == 0 &&
+           header->group_off % sizeof(uint64_t) == 0 &&
+           array_fits(header->pgm_off, header->nb_pgm, sizeof(t_tmc_pgm),
+                      size) &&
+           array_fits(header->group_off, header->nb_group, sizeof(t_tmc_group),
+                      size) &&
+           ((const uint8_t *)header)[size - 1] == '\0';
+}
+
+/* Loads the programs & groups of the cache 'path' into node, an empty node,
+ * if it was compiled from the source of hash 'key'. Fails - node left empty
+ * - if there is no such cache or it can't be used: the source must be
+ * parsed. */
+uint8_t conf_cache_load(t_tm_node *node, const char *path, uint64_t key) {
+    t_cache_load load = {0};
+    uint32_t pgm_ids = node->pgm_ids;
+    struct stat st;
+    void *map;
+    int32_t fd;
+    uint8_t ret;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) return EXIT_FAILURE;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(t_tmc_header)) {
+        close(fd);
+        return EXIT_FAILURE;
+    }
+    /* private & writable: the pointer arrays are relocated in copies of
+     * their pages, the strings stay shared with the page cache */
+    map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return EXIT_FAILURE;
+    if (!header_valid(map, st.st_size, key)) {
+        munmap(map, st.st_size);
+        return EXIT_FAILURE;
+    }
+    if (!(load.cache = malloc(sizeof(*load.cache)))) handle_error("malloc");
+    *load.cache = (t_conf_cache){.map = map, .size = st.st_size};
+    atomic_init(&load.cache->refcount, 1); /* dropped once loaded */
+    load.base = map;
+    load.size = st.st_size;
+    ret = load_tables(&load, node, map);
+    if (ret) {
+        fprintf(stderr, "%s: %s: corrupted configuration cache\n",
+                node->tm_name, path);
+        destroy_pgm_list(&node->head);
+        destroy_group_list(&node->groups);
+        node->pgm_nb = 0;
+        node->pgm_ids = pgm_ids;
+    }
+    conf_cache_put(load.cache);
+    return ret;
+}
@@ -0,0 +1,94 @@
+#ifndef CONF_CACHE_H
+#define CONF_CACHE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Compiled configuration cache (taskmaster -C config.yaml -o config.tmc).
+ *
+ * The programs & groups of a configuration file, defaults filled in, stored
+ * as one flat blob keyed by a hash of the yaml source. Loading it maps the
+ * file once: strings are used in place & the pointer arrays (cmd, env, group
+ * members) are relocated in the private mapping, so a program costs its
+ * t_pgm & t_pgm_conf allocations and nothing by string. Every configuration
+ * loaded from a cache holds a reference on the mapping.
+ *
+ * All offsets are from the start of the file, 0 standing for NULL. Pointer
+ * arrays are arrays of 64 bits offsets, NULL terminated. The file ends with
+ * a NUL byte, so that no string can run past the mapping.
+ */
+
+#define TMC_MAGIC "TMCONF01"
+#define TMC_VERSION (4U)
+
+typedef struct s_tmc_header {
+    char magic[8];        /* TMC_MAGIC, without NUL */
+    uint32_t version;     /* TMC_VERSION */
+    uint32_t ptr_size;    /* sizeof(void *) of the compiling taskmaster */
+    uint64_t key;         /* conf_cache_key() of the yaml source */
+    uint64_t size;        /* bytes of the file */
+    uint32_t nb_pgm;
+    uint32_t nb_group;
+    uint64_t pgm_off;     /* t_tmc_pgm table, in the order of t_tm_node::head */
+    uint64_t group_off;   /* t_tmc_group table, in the order of the list */
+} t_tmc_header;
+
+typedef struct s_tmc_pgm {
+    uint64_t name;
+    uint64_t cmd;        /* pointer array */
+    uint64_t env;        /* pointer array of env_size entries */
+    uint64_t std_out;
+    uint64_t std_err;
+    uint64_t workingdir;
+    uint64_t exitcodes;  /* int32_t array of nb_exitcodes */
+    uint64_t stopsignal_name;
+    uint64_t fp_launch;
+    uint64_t fp_conf;
+    uint32_t env_size;
+    uint32_t nb_exitcodes;
+    uint32_t numprocs;
+    uint32_t umask;
+    uint32_t autorestart;
+    uint32_t starttime;
+    uint32_t stoptime;
+    uint8_t startretries;
+    uint8_t autostart;
+    uint8_t stopsignal;
+    uint8_t capture;
+    uint32_t out_maxage;
+    uint32_t err_maxage;
+    uint64_t out_maxbytes;
+    uint64_t err_maxbytes;
+    uint8_t out_backups;
+    uint8_t err_backups;
+    uint8_t out_compress;
+    uint8_t err_compress;
+    uint32_t tail_bytes;
+} t_tmc_pgm;
+
+typedef struct s_tmc_group {
+    uint64_t name;
+    uint64_t member; /* pointer array of nb_member entries */
+    uint32_t nb_member;
+    uint32_t reserved;
+} t_tmc_group;
+
+/* mapping of a cache file, released with the last configuration using it */
+typedef struct s_conf_cache {
+    atomic_uint refcount;
+    void *map;
+    size_t size;
+} t_conf_cache;
+
+typedef struct s_tm_node t_tm_node;
+
+uint64_t conf_cache_key(const void *src, size_t len);
+uint8_t conf_cache_load(t_tm_node *node, const char *path, uint64_t key);
+uint8_t conf_cache_write(const t_tm_node *node, const char *path,
+                         uint64_t key);
+t_conf_cache *conf_cache_get(t_conf_cache *cache);
+void conf_cache_put(t_conf_cache *cache);
+
+#endif
@@ -0,0 +1,143 @@
+#include "config_check.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "logfile.h"
+#include "parsing.h"
+#include "taskmaster.h"
+
+#define CHECK_MIN_CAP (64U)
+
+static uint32_t path_check_hash(const char *path, t_path_kind kind) {
+    uint32_t hash = 2166136261U ^ kind;
+
+    for (; *path; path++) {
+        hash ^= (uint8_t)*path;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+uint8_t path_check_init(t_path_check *check) {
+    *check = (t_path_check){.cap = CHECK_MIN_CAP, .mask = CHECK_MIN_CAP * 2 - 1};
+    check->entry = malloc(check->cap * sizeof(*check->entry));
+    check->slot = calloc(check->mask + 1, sizeof(*check->slot));
+    if (!check->entry || !check->slot) {
+        path_check_destroy(check);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/* Doubles the entries & rehashes the slots, kept at most half full */
+static void path_check_grow(t_path_check *check) {
+    t_path_entry *entry;
+    uint32_t *slot, mask = check->mask * 2 + 1, i;
+
+    entry = realloc(check->entry, check->cap * 2 * sizeof(*entry));
+    if (!entry) handle_error("realloc");
+    check->entry = entry;
+    check->cap *= 2;
+    if (!(slot = calloc(mask + 1, sizeof(*slot)))) handle_error("calloc");
+    for (uint32_t e = 0; e < check->nb; e++) {
+        for (i = entry[e].hash & mask; slot[i]; i = (i + 1) & mask)
+            ;
+        slot[i] = e + 1;
+    }
+    free(check->slot);
+    check->slot = slot;
+    check->mask = mask;
+}
+
+/* Registers a path to check, once whatever the number of programs naming
+ * it. Returns its ref for path_check_get(). */
+uint32_t path_check_add(t_path_check *check, const char *path,
+                        t_path_kind kind) {
+    uint32_t hash = path_check_hash(path, kind), i;
+    const t_path_entry *entry;
+
+    for (i = hash & check->mask; check->slot[i]; i = (i + 1) & check->mask) {
+        entry = &check->entry[check->slot[i] - 1];
+        if (entry->hash == hash && entry->kind == kind &&
+            !strcmp(entry->path, path))
+            return check->slot[i] - 1;
+    }
+    if (check->nb == check->cap) {
+        path_check_grow(check);
+        for (i = hash & check->mask; check->slot[i];
+             i = (i + 1) & check->mask)
+            ;
+    }
+    check->entry[check->nb] = (t_path_entry){
+        .path = path, .hash = hash, .kind = kind};
+    check->slot[i] = ++check->nb;
+    return check->nb - 1;
+}
+
+static void path_check_one(t_path_entry *entry) {
+    struct stat statbuf;
+
+    switch (entry->kind) {
+        case PATH_EXEC:
+        case PATH_DIR:
+            if (stat(entry->path, &statbuf) == -1)
+                entry->err = errno;
+            else if (entry->kind == PATH_EXEC ? !S_ISREG(statbuf.st_mode)
+                                              : !S_ISDIR(statbuf.st_mode))
+                entry->err = CHECK_NOT_TYPE;
+            break;
+        case PATH_LOG:
+            if (!(entry->log = logfile_open(entry->path))) entry->err = errno;
+            break;
+    }
+}
+
+static void *path_check_worker(void *arg) {
+    t_path_check *check = arg;
+    uint32_t i;
+
+    while ((i = atomic_fetch_add_explicit(&check->next, 1,
+                                          memory_order_relaxed)) < check->nb)
+        path_check_one(&check->entry[i]);
+    return NULL;
+}
+
+/* Checks every registered path. A few paths are checked by the calling
+ * thread alone; more are spread over up to one thread by cpu, each one
+ * taking the next unchecked path. A thread which can't be created only
+ * leaves more paths to the others. */
+void path_check_run(t_path_check *check) {
+    pthread_t thrd[CHECK_THREADS_MAX];
+    long nb_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t nb_thrd = check->nb / CHECK_PER_THREAD, nb_started = 0;
+    sigset_t all, old;
+
+    if (nb_cpu > 0 && nb_thrd > (uint32_t)nb_cpu) nb_thrd = nb_cpu;
+    if (nb_thrd > CHECK_THREADS_MAX) nb_thrd = CHECK_THREADS_MAX;
+    atomic_store_explicit(&check->next, 0, memory_order_relaxed);
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    for (uint32_t t = 1; t < nb_thrd; t++)
+        if (!pthread_create(&thrd[nb_started], NULL, path_check_worker, check))
+            nb_started++;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    path_check_worker(check);
+    for (uint32_t t = 0; t < nb_started; t++) pthread_join(thrd[t], NULL);
+}
+
+/* Drops the references of the checks to the log files: their users hold
+ * their own */
+void path_check_destroy(t_path_check *check) {
+    for (uint32_t e = 0; check->entry && e < check->nb; e++)
+        logfile_put(check->entry[e].log, false);
+    free(check->entry);
+    free(check->slot);
+    *check = (t_path_check){0};
+}
@@ -0,0 +1,61 @@
+#ifndef CONFIG_CHECK_H
+#define CONFIG_CHECK_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Filesystem checks of a configuration: the cmd & workingdir of each
+ * program are stat()ed, its stdout & stderr files opened.
+ *
+ * sanitize_config() registers every path first: a path shared by several
+ * programs - a log file, /dev/null, a common binary - is checked once. The
+ * checks then fan out over a few threads, the calling one included, since
+ * each one waits on the filesystem rather than on the cpu. Results are read
+ * back in the order of the programs, so errors are reported as before, all
+ * at once.
+ */
+
+#define CHECK_THREADS_MAX (16)   /* threads checking paths, caller included */
+#define CHECK_PER_THREAD (32)    /* paths worth one more thread */
+#define CHECK_NOT_TYPE (-1)      /* t_path_entry::err: exists, wrong type */
+#define CHECK_NONE (UINT32_MAX)  /* no path registered */
+
+typedef enum e_path_kind {
+    PATH_EXEC, /* regular file, cmd[0] */
+    PATH_DIR,  /* directory, workingdir */
+    PATH_LOG,  /* opened for appending, stdout & stderr */
+} t_path_kind;
+
+typedef struct s_path_entry {
+    const char *path; /* owned by the configuration */
+    uint32_t hash;
+    t_path_kind kind;
+    int32_t err; /* 0, an errno or CHECK_NOT_TYPE */
+    struct s_logfile *log; /* PATH_LOG: a reference for each user */
+} t_path_entry;
+
+typedef struct s_path_check {
+    t_path_entry *entry;
+    uint32_t nb;
+    uint32_t cap;
+    uint32_t *slot; /* open addressing on (path, kind): entry index + 1 */
+    uint32_t mask;
+    _Atomic uint32_t next; /* next entry to check, shared by the threads */
+} t_path_check;
+
+uint8_t path_check_init(t_path_check *check);
+uint32_t path_check_add(t_path_check *check, const char *path,
+                        t_path_kind kind);
+void path_check_run(t_path_check *check);
+void path_check_destroy(t_path_check *check);
+
+/* Result of the path registered as 'ref', NULL for CHECK_NONE */
+static inline const t_path_entry *path_check_get(const t_path_check *check,
+                                                 uint32_t ref) {
+    return ref == CHECK_NONE ? NULL : &check->entry[ref];
+}
+
+#endif
@@ -0,0 +1,745 @@
+#include "control.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "run_server.h"
+
+/* ================================ buffers ================================= */
+
+/* Makes room for n more bytes, compacting the consumed bytes first */
+static uint8_t buf_reserve(t_ctl_buf *buf, size_t n) {
+    size_t cap = buf->cap ? buf->cap : CTL_READ_SZ;
+    uint8_t *data;
+
+    if (buf->cap - buf->len >= n) return EXIT_SUCCESS;
+    if (buf->off) {
+        memmove(buf->data, buf->data + buf->off, buf->len - buf->off);
+        buf->len -= buf->off;
+        buf->off = 0;
+        if (buf->cap - buf->len >= n) return EXIT_SUCCESS;
+    }
+    while (cap - buf->len < n) cap *= 2;
+    if (!(data = realloc(buf->data, cap))) return EXIT_FAILURE;
+    buf->data = data;
+    buf->cap = cap;
+    return EXIT_SUCCESS;
+}
+
+static uint8_t buf_append(t_ctl_buf *buf, const void *src, size_t n) {
+    if (buf_reserve(buf, n)) return EXIT_FAILURE;
+    memcpy(buf->data + buf->len, src, n);
+    buf->len += n;
+    return EXIT_SUCCESS;
+}
+
+static void buf_consume(t_ctl_buf *buf, size_t n) {
+    buf->off += n;
+    if (buf->off == buf->len) buf->off = buf->len = 0;
+}
+
+static inline size_t buf_pending(const t_ctl_buf *buf) {
+    return buf->len - buf->off;
+}
+
+/* ================================ replies ================================= */
+
+/* A reply is written in place in the output buffer: its header is reserved
+ * first & completed once the payload is appended. */
+static uint8_t reply_begin(t_ctl_conn *conn, size_t *at) {
+    if (buf_reserve(&conn->out, sizeof(t_tmp_header))) return EXIT_FAILURE;
+    *at = buf_pending(&conn->out); /* compaction keeps it from out.off */
+    conn->out.len += sizeof(t_tmp_header);
+    return EXIT_SUCCESS;
+}
+
+static void reply_end(t_ctl_conn *conn, size_t at, const t_tmp_header *req,
+                      t_tmp_status status) {
+    t_tmp_header header = {
+        .len = buf_pending(&conn->out) - at - sizeof(header),
+        .tag = req->tag,
+        .op = req->op,
+        .status = status,
+    };
+
+    memcpy(conn->out.data + conn->out.off + at, &header, sizeof(header));
+}
+
+/* Replies with no payload, or on error with msg detailing it if any */
+static uint8_t reply(t_ctl_conn *conn, const t_tmp_header *req,
+                     t_tmp_status status, const char *msg) {
+    size_t at;
+
+    if (reply_begin(conn, &at)) return EXIT_FAILURE;
+    if (status != TMP_OK && msg && buf_append(&conn->out, msg, strlen(msg) + 1))
+        return EXIT_FAILURE;
+    reply_end(conn, at, req, status);
+    return EXIT_SUCCESS;
+}
+
+/* ============================ request handlers ============================ */
+
+/* Resolves the NUL terminated selectors of a payload into the set of the
+ * programs they select. The set is NULL without selectors. On error, bad
+ * points to the selector matching no program. */
+static t_tmp_status ctl_select(t_control *ctl, const t_pgm_index *index,
+                               const char *payload, uint32_t len,
+                               t_pgm_set **set, const char **bad) {
+    uint32_t arg_len;
+
+    *set = NULL;
+    *bad = NULL;
+    if (len && payload[len - 1]) return TMP_ERR_BAD_OP;
+    for (uint32_t i = 0; i < len; i += arg_len + 1) {
+        arg_len = strlen(payload + i);
+        if (!*set && !(*set = pgm_set_new(index->nb_id))) return TMP_ERR_NOMEM;
+        if (!arg_len ||
+            pgm_select(index, &ctl->cache, payload + i, arg_len, *set)) {
+            *bad = payload + i;
+            DESTROY_PTR(*set);
+            return TMP_ERR_BAD_ARG;
+        }
+    }
+    return TMP_OK;
+}
+
+/* Status of the selected programs, read from the seqlocked processus data */
+static uint8_t ctl_status(t_ctl_conn *conn, const t_tmp_header *req,
+                          const t_pgm_index *index, const t_pgm_set *set) {
+    bool summary = req->flags & TMP_FLAG_SUMMARY;
+    t_thrd_snapshot snap;
+    t_tmp_pgm rec;
+    t_tmp_proc *proc;
+    const char *name;
+    t_pgm_conf *conf;
+    t_pgm *pgm;
+    size_t at, rec_sz;
+
+    if (reply_begin(conn, &at)) return EXIT_FAILURE;
+    for (uint32_t id = pgm_set_next(set, 0);
+         id != PGM_SET_END && id < index->nb_id;
+         id = pgm_set_next(set, id + 1)) {
+        if (!(pgm = index->by_id[id])) continue;
+        conf = PGM_CONF(pgm);
+        name = conf->usr.name;
+        rec = (t_tmp_pgm){
+            .id = id,
+            .numprocs = conf->usr.numprocs,
+            .nb_proc = summary ? 0 : conf->usr.numprocs,
+            .name_len = strlen(name),
+        };
+        rec_sz = sizeof(rec) + TMP_ALIGN(rec.name_len + 1) +
+                 rec.nb_proc * sizeof(*proc);
+        if (buf_reserve(&conn->out, rec_sz)) return EXIT_FAILURE;
+        proc = (t_tmp_proc *)(conn->out.data + conn->out.len + sizeof(rec) +
+                              TMP_ALIGN(rec.name_len + 1));
+        for (uint32_t i = 0; i < conf->usr.numprocs; i++) {
+            thrd_snapshot(&pgm->privy.thrd[i], &snap);
+            rec.nb_started += (snap.info & 0x0f) == PROC_ST_STARTED;
+            if (summary) continue;
+            proc[i] = (t_tmp_proc){
+                .start_time = snap.start_timestamp,
+                .pid = snap.pid,
+                .restart_counter = snap.restart_counter,
+                .rid = i,
+                .state = snap.info & 0x0f,
+            };
+        }
+        memcpy(conn->out.data + conn->out.len, &rec, sizeof(rec));
+        bzero(conn->out.data + conn->out.len + sizeof(rec),
+              TMP_ALIGN(rec.name_len + 1));
+        memcpy(conn->out.data + conn->out.len + sizeof(rec), name,
+               rec.name_len);
+        conn->out.len += rec_sz;
+    }
+    reply_end(conn, at, req, TMP_OK);
+    return EXIT_SUCCESS;
+}
+
+/* Names of all programs, for the completion of the shell */
+static uint8_t ctl_list(t_ctl_conn *conn, const t_tmp_header *req,
+                        const t_pgm_index *index) {
+    const char *name;
+    size_t at;
+
+    if (reply_begin(conn, &at)) return EXIT_FAILURE;
+    for (uint32_t id = 0; id < index->nb_id; id++) {
+        if (!index->by_id[id]) continue;
+        name = PGM_CONF(index->by_id[id])->usr.name;
+        if (buf_append(&conn->out, name, strlen(name) + 1)) return EXIT_FAILURE;
+    }
+    reply_end(conn, at, req, TMP_OK);
+    return EXIT_SUCCESS;
+}
+
+/* Pushes an event to the master thread, or adds it to the batch being
+ * handled. The queue is only full when the master thread lags behind by
+ * LEN_EV_QUEUE events, so just yield until a slot is popped, unless the
+ * master thread is gone. */
+static t_tmp_status ctl_push(t_control *ctl, t_event event) {
+    t_ev_batch *batch = ctl->batch;
+
+    if (batch) {
+        if (batch->nb == batch->cap) {
+            batch = realloc(batch, sizeof(*batch) +
+                                       2 * batch->cap * sizeof(t_event));
+            if (!batch) return TMP_ERR_NOMEM;
+            batch->cap *= 2;
+            ctl->batch = batch;
+        }
+        batch->event[batch->nb++] = event;
+        return TMP_OK;
+    }
+    while (ev_queue_push(&ctl->node->ev_queue, event)) {
+        if (ctl->node->exit_mastt) return TMP_ERR_EXITING;
+        sched_yield();
+    }
+    return TMP_OK;
+}
+
+/* Releases the events of a batch which won't be sent */
+static void ctl_drop_batch(t_ev_batch *batch) {
+    for (uint32_t i = 0; batch && i < batch->nb; i++) {
+        free(batch->event[i].set);
+        destroy_pgm_list(&batch->event[i].pgm);
+        destroy_group_list(&batch->event[i].groups);
+    }
+    free(batch);
+}
+
+/* start, stop, restart & del: sent to the master thread on the selected
+ * programs */
+static uint8_t ctl_command(t_control *ctl, t_ctl_conn *conn,
+                           const t_tmp_header *req, const char *payload) {
+    const t_client_ev type[TMP_OP_MAX] = {
+        [TMP_OP_START] = CLIENT_START,
+        [TMP_OP_STOP] = CLIENT_STOP,
+        [TMP_OP_RESTART] = CLIENT_RESTART,
+        [TMP_OP_DEL] = CLIENT_DEL,
+    };
+    t_tmp_status status;
+    t_pgm_set *set;
+    const char *bad;
+
+    if (ctl->node->exit_mastt)
+        return reply(conn, req, TMP_ERR_EXITING, NULL);
+    if (!req->len) return reply(conn, req, TMP_ERR_ARG_MISSING, NULL);
+    rcu_read_lock(&ctl->node->rcu, ctl->reader);
+    status = ctl_select(ctl, PGM_INDEX(ctl->node), payload, req->len, &set,
+                        &bad);
+    rcu_read_unlock(ctl->reader);
+    if (status == TMP_OK) {
+        status = ctl_push(ctl, (t_event){.set = set, .type = type[req->op]});
+        if (status != TMP_OK) free(set);
+    }
+    return reply(conn, req, status, bad);
+}
+
+/* The programs of the yaml payload are built by the control thread, then
+ * handed over to the master thread which links & starts them */
+static uint8_t ctl_add(t_control *ctl, t_ctl_conn *conn,
+                       const t_tmp_header *req, const char *payload) {
+    t_tm_node tmp = {.tm_name = ctl->node->tm_name};
+    const t_pgm_index *index;
+    char msg[128] = {0};
+    t_tmp_status status = TMP_OK;
+    const char *name;
+
+    if (ctl->node->exit_mastt)
+        return reply(conn, req, TMP_ERR_EXITING, NULL);
+    if (init_programs(&tmp, payload, req->len))
+        return reply(conn, req, TMP_ERR_CONFIG, NULL);
+
+    rcu_read_lock(&ctl->node->rcu, ctl->reader);
+    index = PGM_INDEX(ctl->node);
+    for (t_pgm *pgm = tmp.head; pgm && status == TMP_OK;
+         pgm = pgm->privy.next) {
+        name = PGM_CONF(pgm)->usr.name;
+        if (pgm_index_find(index, name, strlen(name))) status = TMP_ERR_CONFIG;
+        for (t_pgm *prev = tmp.head; prev != pgm; prev = prev->privy.next)
+            if (!strcmp(PGM_CONF(prev)->usr.name, name))
+                status = TMP_ERR_CONFIG;
+        if (status != TMP_OK)
+            snprintf(msg, sizeof(msg), "%s: name already taken", name);
+    }
+    rcu_read_unlock(ctl->reader);
+
+    if (status == TMP_OK)
+        status = ctl_push(ctl, (t_event){.pgm = tmp.head, .type = CLIENT_ADD});
+    if (status != TMP_OK) destroy_pgm_list(&tmp.head);
+    return reply(conn, req, status, *msg ? msg : NULL);
+}
+
+/* The configuration file is parsed by the control thread, then handed over
+ * to the master thread which compares it to the running programs */
+static uint8_t ctl_reload(t_control *ctl, t_ctl_conn *conn,
+                          const t_tmp_header *req) {
+    t_tm_node tmp = {.tm_name = ctl->node->tm_name,
+                     .config_path = ctl->node->config_path,
+                     .cache_path = ctl->node->cache_path};
+    t_tmp_status status;
+
+    if (ctl->node->exit_mastt)
+        return reply(conn, req, TMP_ERR_EXITING, NULL);
+    if (reload_programs(&tmp)) return reply(conn, req, TMP_ERR_CONFIG, NULL);
+    status = ctl_push(ctl, (t_event){.pgm = tmp.head,
+                                     .groups = tmp.groups,
+                                     .type = CLIENT_RELOAD});
+    if (status != TMP_OK) {
+        destroy_pgm_list(&tmp.head);
+        destroy_group_list(&tmp.groups);
+    }
+    return reply(conn, req, status, NULL);
+}
+
+/* Replies with what the tail got since the last reply. A followed tail
+ * sends nothing without new output, nor while the client lags behind: the
+ * output it misses is overwritten in the ring meanwhile. */
+static uint8_t ctl_tail_send(t_ctl_conn *conn, t_tail *tail, bool follow) {
+    size_t at;
+    uint32_t len;
+
+    if (follow && buf_pending(&conn->out) >= CTL_OUT_HIGH) return EXIT_SUCCESS;
+    if (buf_reserve(&conn->out, sizeof(t_tmp_header) + tail->size) ||
+        reply_begin(conn, &at))
+        return EXIT_FAILURE;
+    len = tail_copy(tail, &conn->tail_pos, conn->out.data + conn->out.len);
+    conn->out.len += len;
+    if (follow && !len)
+        conn->out.len -= sizeof(t_tmp_header);
+    else
+        reply_end(conn, at, &conn->tail_req, TMP_OK);
+    return EXIT_SUCCESS;
+}
+
+/* Last output of one processus, found by program name & rank. With
+ * TMP_FLAG_FOLLOW the connection keeps the tail & sends its new output: it
+ * takes no other tail request meanwhile, which would reset its position &
+ * the header of its replies. */
+static uint8_t ctl_tail(t_control *ctl, t_ctl_conn *conn,
+                        const t_tmp_header *req, const char *payload) {
+    t_capture *capture = ctl->node->capture;
+    const char *name = payload + sizeof(t_tmp_tail);
+    bool follow = req->flags & TMP_FLAG_FOLLOW;
+    t_tmp_tail args;
+    t_tail *tail;
+    t_pgm *pgm;
+    uint32_t id;
+
+    if (req->len <= sizeof(args) || payload[req->len - 1] || conn->tail)
+        return reply(conn, req, TMP_ERR_BAD_OP, NULL);
+    memcpy(&args, payload, sizeof(args));
+    rcu_read_lock(&ctl->node->rcu, ctl->reader);
+    pgm = pgm_index_find(PGM_INDEX(ctl->node), name, strlen(name));
+    if (pgm && args.rid < PGM_CONF(pgm)->usr.numprocs)
+        id = pgm->privy.id;
+    else
+        pgm = NULL;
+    rcu_read_unlock(ctl->reader);
+    if (!pgm) return reply(conn, req, TMP_ERR_BAD_ARG, name);
+    if (!capture || !(tail = capture_tail(capture, id, args.rid)))
+        return reply(conn, req, TMP_ERR_NO_TAIL, name);
+
+    conn->tail_pos = 0;
+    conn->tail_req = *req;
+    if (follow) { /* before the copy: no output can come unnoticed */
+        conn->tail = tail;
+        tail_follow(tail, ctl->tail_efd);
+    }
+    if (ctl_tail_send(conn, tail, false)) return EXIT_FAILURE;
+    if (!follow) tail_put(tail);
+    return EXIT_SUCCESS;
+}
+
+static uint8_t ctl_request(t_control *ctl, t_ctl_conn *conn,
+                           const t_tmp_header *req, const char *payload);
+
+/* A batch request carries requests, each one with its header, & its reply
+ * their replies in order. The commands for the master thread are pushed as
+ * a single event once all requests are handled. */
+static uint8_t ctl_batch(t_control *ctl, t_ctl_conn *conn,
+                         const t_tmp_header *req, const char *payload) {
+    t_tmp_header sub;
+    t_tmp_status status = TMP_OK;
+    t_ev_batch *batch;
+    uint32_t off;
+    size_t at;
+
+    /* framing is checked before any request is handled */
+    for (off = 0; off + sizeof(sub) <= req->len; off += sizeof(sub) + sub.len) {
+        memcpy(&sub, payload + off, sizeof(sub));
+        if (sub.len > req->len - off - sizeof(sub) || sub.op == TMP_OP_BATCH)
+            break;
+    }
+    if (off != req->len) return reply(conn, req, TMP_ERR_BAD_OP, NULL);
+
+    ctl->batch = malloc(sizeof(*batch) + CTL_BATCH_MIN * sizeof(t_event));
+    if (!ctl->batch) return reply(conn, req, TMP_ERR_NOMEM, NULL);
+    *ctl->batch = (t_ev_batch){.cap = CTL_BATCH_MIN};
+    if (reply_begin(conn, &at)) goto error;
+    for (off = 0; off < req->len; off += sizeof(sub) + sub.len) {
+        memcpy(&sub, payload + off, sizeof(sub));
+        if (ctl_request(ctl, conn, &sub, payload + off + sizeof(sub)))
+            goto error;
+    }
+    batch = ctl->batch;
+    ctl->batch = NULL;
+    if (!batch->nb)
+        free(batch);
+    else if ((status = ctl_push(ctl, (t_event){.batch = batch,
+                                               .type = CLIENT_BATCH}))) {
+        ctl_drop_batch(batch); /* replies of the requests are dropped too */
+        conn->out.len = conn->out.off + at;
+        return reply(conn, req, status, NULL);
+    }
+    reply_end(conn, at, req, TMP_OK);
+    return EXIT_SUCCESS;
+
+error:
+    ctl_drop_batch(ctl->batch);
+    ctl->batch = NULL;
+    return EXIT_FAILURE;
+}
+
+/* Handles one complete request, appending its reply to the output buffer */
+static uint8_t ctl_request(t_control *ctl, t_ctl_conn *conn,
+                           const t_tmp_header *req, const char *payload) {
+    const t_pgm_index *index;
+    t_tmp_status status;
+    t_pgm_set *set;
+    const char *bad;
+    uint8_t ret;
+
+    if ((req->op != TMP_OP_STATUS && req->op != TMP_OP_TAIL && req->flags) ||
+        (req->op == TMP_OP_STATUS && req->flags & ~TMP_FLAG_SUMMARY) ||
+        (req->op == TMP_OP_TAIL && req->flags & ~TMP_FLAG_FOLLOW))
+        return reply(conn, req, TMP_ERR_BAD_OP, NULL);
+    switch (req->op) {
+        case TMP_OP_STATUS:
+            rcu_read_lock(&ctl->node->rcu, ctl->reader);
+            index = PGM_INDEX(ctl->node);
+            status = ctl_select(ctl, index, payload, req->len, &set, &bad);
+            if (status == TMP_OK)
+                ret = ctl_status(conn, req, index, set ? set : index->all);
+            else
+                ret = reply(conn, req, status, bad);
+            rcu_read_unlock(ctl->reader);
+            free(set);
+            return ret;
+        case TMP_OP_START:
+        case TMP_OP_STOP:
+        case TMP_OP_RESTART:
+        case TMP_OP_DEL:
+            return ctl_command(ctl, conn, req, payload);
+        case TMP_OP_ADD:
+            return ctl_add(ctl, conn, req, payload);
+        case TMP_OP_RELOAD:
+            return ctl_reload(ctl, conn, req);
+        case TMP_OP_LIST:
+            rcu_read_lock(&ctl->node->rcu, ctl->reader);
+            ret = ctl_list(conn, req, PGM_INDEX(ctl->node));
+            rcu_read_unlock(ctl->reader);
+            return ret;
+        case TMP_OP_EXIT:
+            if (!ctl->node->exit_mastt)
+                ctl_push(ctl, (t_event){.type = CLIENT_EXIT});
+            return reply(conn, req, TMP_OK, NULL);
+        case TMP_OP_BATCH:
+            return ctl_batch(ctl, conn, req, payload);
+        case TMP_OP_TAIL:
+            return ctl_tail(ctl, conn, req, payload);
+        default:
+            return reply(conn, req, TMP_ERR_BAD_OP, NULL);
+    }
+}
+
+/* ============================== connections =============================== */
+
+static void conn_close(t_control *ctl, t_ctl_conn *conn) {
+    epoll_ctl(ctl->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    if (conn->prev)
+        conn->prev->next = conn->next;
+    else
+        ctl->conns = conn->next;
+    if (conn->next) conn->next->prev = conn->prev;
+    if (conn->tail) {
+        tail_unfollow(conn->tail);
+        tail_put(conn->tail);
+    }
+    free(conn->in.data);
+    free(conn->out.data);
+    free(conn);
+}
+
+static void conn_accept(t_control *ctl) {
+    struct epoll_event ev = {.events = EPOLLIN};
+    t_ctl_conn *conn;
+    int32_t fd;
+
+    while ((fd = accept4(ctl->lfd, NULL, NULL,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+        if (!(conn = calloc(1, sizeof(*conn)))) {
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->events = ev.events;
+        ev.data.ptr = conn;
+        if (epoll_ctl(ctl->epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+            perror("epoll_ctl");
+            close(fd);
+            free(conn);
+            continue;
+        }
+        conn->next = ctl->conns;
+        if (ctl->conns) ctl->conns->prev = conn;
+        ctl->conns = conn;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR &&
+        errno != ECONNABORTED)
+        perror("accept4");
+}
+
+/* Reads all that is available. Returns EXIT_FAILURE on error, eof is set
+ * once the client shut its side down. */
+static uint8_t conn_read(t_ctl_conn *conn) {
+    ssize_t nread;
+
+    while (true) {
+        if (buf_reserve(&conn->in, CTL_READ_SZ)) return EXIT_FAILURE;
+        nread = read(conn->fd, conn->in.data + conn->in.len,
+                     conn->in.cap - conn->in.len);
+        if (nread > 0) {
+            conn->in.len += nread;
+            continue;
+        }
+        if (!nread) conn->eof = true;
+        if (!nread || errno == EAGAIN || errno == EWOULDBLOCK)
+            return EXIT_SUCCESS;
+        if (errno != EINTR) return EXIT_FAILURE;
+    }
+}
+
+static uint8_t conn_flush(t_ctl_conn *conn) {
+    ssize_t nwrite;
+
+    while (buf_pending(&conn->out)) {
+        nwrite = send(conn->fd, conn->out.data + conn->out.off,
+                      buf_pending(&conn->out), MSG_NOSIGNAL);
+        if (nwrite == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == EINTR) continue;
+            return EXIT_FAILURE;
+        }
+        buf_consume(&conn->out, nwrite);
+    }
+    return EXIT_SUCCESS;
+}
+
+/* A complete request is pending & there is room for its reply */
+static bool conn_ready(const t_ctl_conn *conn) {
+    t_tmp_header req;
+
+    if (buf_pending(&conn->out) >= CTL_OUT_HIGH ||
+        buf_pending(&conn->in) < sizeof(req))
+        return false;
+    memcpy(&req, conn->in.data + conn->in.off, sizeof(req));
+    return buf_pending(&conn->in) >= sizeof(req) + req.len;
+}
+
+/* Handles complete requests in order while the pending output is below
+ * CTL_OUT_HIGH. A client not reading its replies stops being read. */
+static uint8_t conn_serve(t_control *ctl, t_ctl_conn *conn) {
+    t_tmp_header req;
+
+    do {
+        while (conn_ready(conn)) {
+            memcpy(&req, conn->in.data + conn->in.off, sizeof(req));
+            if (ctl_request(ctl, conn, &req,
+                            (char *)conn->in.data + conn->in.off + sizeof(req)))
+                return EXIT_FAILURE;
+            buf_consume(&conn->in, sizeof(req) + req.len);
+        }
+        if (buf_pending(&conn->in) >= sizeof(req)) {
+            memcpy(&req, conn->in.data + conn->in.off, sizeof(req));
+            if (req.len > TMP_MAX_REQUEST) return EXIT_FAILURE;
+        }
+        if (conn_flush(conn)) return EXIT_FAILURE;
+    } while (conn_ready(conn));
+    return EXIT_SUCCESS;
+}
+
+/* Polls input while the client may send & output while replies are pending */
+static uint8_t conn_update(t_control *ctl, t_ctl_conn *conn) {
+    struct epoll_event ev = {.data.ptr = conn};
+
+    if (!conn->eof && buf_pending(&conn->out) < CTL_OUT_HIGH)
+        ev.events |= EPOLLIN;
+    if (buf_pending(&conn->out)) ev.events |= EPOLLOUT;
+    if (!ev.events) return EXIT_FAILURE; /* eof & all replies sent */
+    if (ev.events == conn->events) return EXIT_SUCCESS;
+    conn->events = ev.events;
+    return epoll_ctl(ctl->epfd, EPOLL_CTL_MOD, conn->fd, &ev) == -1;
+}
+
+static void conn_event(t_control *ctl, t_ctl_conn *conn, uint32_t events) {
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR) && !conn->eof &&
+        conn_read(conn))
+        goto error;
+    if (conn_serve(ctl, conn)) goto error;
+    /* a follower which lagged behind catches up once it read its replies */
+    if (conn->tail &&
+        (ctl_tail_send(conn, conn->tail, true) || conn_flush(conn)))
+        goto error;
+    if (conn_update(ctl, conn)) goto error;
+    return;
+error:
+    conn_close(ctl, conn);
+}
+
+/* The io thread wrote to some followed tails */
+static void ctl_tail_wakeup(t_control *ctl) {
+    t_ctl_conn *conn, *next;
+    eventfd_t value;
+
+    eventfd_read(ctl->tail_efd, &value);
+    for (conn = ctl->conns; conn; conn = next) {
+        next = conn->next;
+        if (conn->tail &&
+            (ctl_tail_send(conn, conn->tail, true) || conn_flush(conn) ||
+             conn_update(ctl, conn)))
+            conn_close(ctl, conn);
+    }
+}
+
+/* ============================= control thread ============================= */
+
+static void *control_thread(void *arg) {
+    t_control *ctl = arg;
+    struct epoll_event events[CTL_MAX_EVENTS];
+    int32_t nfds;
+
+    while (true) {
+        nfds = epoll_wait(ctl->epfd, events, CTL_MAX_EVENTS, -1);
+        if (nfds == -1) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            return NULL;
+        }
+        for (int32_t i = 0; i < nfds; i++) {
+            if (events[i].data.ptr == ctl)
+                conn_accept(ctl);
+            else if (events[i].data.ptr == &ctl->efd)
+                return NULL;
+            else if (events[i].data.ptr == &ctl->tail_efd)
+                ctl_tail_wakeup(ctl);
+            else
+                conn_event(ctl, events[i].data.ptr, events[i].events);
+        }
+    }
+}
+
+/* A socket file left by a taskmaster which didn't exit cleanly is removed.
+ * Fails if a taskmaster still listens on it. */
+static uint8_t unlink_stale_socket(const struct sockaddr_un *addr) {
+    struct stat st;
+    int32_t fd;
+
+    if (lstat(addr->sun_path, &st) == -1)
+        return errno == ENOENT ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (!S_ISSOCK(st.st_mode)) {
+        errno = EEXIST;
+        return EXIT_FAILURE;
+    }
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1)
+        return EXIT_FAILURE;
+    if (!connect(fd, (const struct sockaddr *)addr, sizeof(*addr))) {
+        close(fd);
+        errno = EADDRINUSE;
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    return unlink(addr->sun_path) == -1;
+}
+
+/* Binds & listens on path, readable by the owner only. Requests are served
+ * once control_start() is called. errno is set on failure. */
+uint8_t control_init(t_control *ctl, t_tm_node *node, const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    struct epoll_event ev = {.events = EPOLLIN};
+
+    bzero(ctl, sizeof(*ctl));
+    ctl->node = node;
+    ctl->lfd = ctl->epfd = ctl->efd = ctl->tail_efd = -1;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return EXIT_FAILURE;
+    }
+    strcpy(addr.sun_path, path);
+    if (!(ctl->reader = rcu_register(&node->rcu))) {
+        errno = EUSERS;
+        return EXIT_FAILURE;
+    }
+
+    ctl->lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (ctl->lfd == -1 || unlink_stale_socket(&addr)) goto error;
+    if (bind(ctl->lfd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+        goto error;
+    if (!(ctl->path = strdup(path))) goto error;
+    if (chmod(path, S_IRUSR | S_IWUSR) == -1 ||
+        listen(ctl->lfd, CTL_BACKLOG) == -1)
+        goto error;
+
+    if ((ctl->epfd = epoll_create1(EPOLL_CLOEXEC)) == -1) goto error;
+    if ((ctl->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) goto error;
+    ev.data.ptr = ctl;
+    if (epoll_ctl(ctl->epfd, EPOLL_CTL_ADD, ctl->lfd, &ev) == -1) goto error;
+    ev.data.ptr = &ctl->efd;
+    if (epoll_ctl(ctl->epfd, EPOLL_CTL_ADD, ctl->efd, &ev) == -1) goto error;
+    ctl->tail_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ctl->tail_efd == -1) goto error;
+    ev.data.ptr = &ctl->tail_efd;
+    if (epoll_ctl(ctl->epfd, EPOLL_CTL_ADD, ctl->tail_efd, &ev) == -1)
+        goto error;
+    return EXIT_SUCCESS;
+
+error:
+    control_destroy(ctl);
+    return EXIT_FAILURE;
+}
+
+uint8_t control_start(t_control *ctl) {
+    if (pthread_create(&ctl->thrd, NULL, control_thread, ctl))
+        return EXIT_FAILURE;
+    ctl->running = true;
+    return EXIT_SUCCESS;
+}
+
+/* Stops the control thread, closes its clients & removes the socket file */
+void control_destroy(t_control *ctl) {
+    int32_t errsv = errno;
+
+    if (ctl->running) {
+        eventfd_write(ctl->efd, 1);
+        if (pthread_join(ctl->thrd, NULL)) perror("pthread_join");
+        ctl->running = false;
+    }
+    while (ctl->conns) conn_close(ctl, ctl->conns);
+    if (ctl->lfd >= 0) close(ctl->lfd);
+    if (ctl->epfd >= 0) close(ctl->epfd);
+    if (ctl->efd >= 0) close(ctl->efd);
+    if (ctl->tail_efd >= 0) close(ctl->tail_efd);
+    ctl->lfd = ctl->epfd = ctl->efd = ctl->tail_efd = -1;
+    if (ctl->path) {
+        unlink(ctl->path);
+        DESTROY_PTR(ctl->path);
+    }
+    select_cache_destroy(&ctl->cache);
+    errno = errsv;
+}
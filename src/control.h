@@ -0,0 +1,77 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <pthread.h>
+
+#include "taskmaster.h"
+#include "tm_protocol.h"
+
+/*
+ * Control server of taskmaster.
+ *
+ * A dedicated thread serves the Unix socket with its own epoll instance:
+ * clients are non blocking connections with an input & an output buffer.
+ * Complete requests are handled in order as soon as they are received.
+ * Status & list are answered by the control thread itself, inside an rcu
+ * read section, from the name index & the seqlocked t_thread_data. Other
+ * commands are pushed on the event queue of the master thread, the ones of
+ * a batch request as a single event. Tails are copied from the rings of the
+ * io thread (see capture.h); a connection following one is woken up thru
+ * tail_efd, written by the io thread.
+ *
+ * The interactive shell is a client like the others (see run_client.c).
+ */
+
+#define CTL_DEFAULT_PATH "./taskmaster.sock"
+#define CTL_MAX_EVENTS (64)     /* epoll_wait() batch size */
+#define CTL_BACKLOG (128)       /* listen() backlog */
+#define CTL_READ_SZ (16384U)    /* room made in the input buffer by read */
+#define CTL_OUT_HIGH (1U << 22) /* pending output pausing the requests */
+#define CTL_BATCH_MIN (16U)     /* events of a batch, grown by doubling */
+
+typedef struct s_ctl_buf {
+    uint8_t *data;
+    size_t off; /* bytes already consumed */
+    size_t len; /* bytes filled */
+    size_t cap;
+} t_ctl_buf;
+
+typedef struct s_ctl_conn {
+    int32_t fd;
+    uint32_t events; /* registered in epoll */
+    bool eof;        /* the client won't send anymore */
+    t_ctl_buf in;    /* received, not yet handled */
+    t_ctl_buf out;   /* replies not yet sent */
+    struct s_tail *tail;   /* followed, or NULL */
+    uint64_t tail_pos;     /* next byte of the tail to send */
+    t_tmp_header tail_req; /* TAIL request, echoed by each reply */
+    struct s_ctl_conn *prev;
+    struct s_ctl_conn *next;
+} t_ctl_conn;
+
+typedef struct s_control {
+    t_tm_node *node;
+    char *path;  /* bound socket, unlinked by control_destroy() */
+    int32_t lfd; /* listening socket */
+    int32_t epfd;
+    int32_t efd; /* eventfd asking the control thread to return */
+    int32_t tail_efd; /* eventfd written when a followed tail got output */
+    pthread_t thrd;
+    bool running;
+    t_rcu_reader *reader;
+    t_select_cache cache; /* globs resolved by the control thread */
+    t_ev_batch *batch;    /* events of the batch request being handled */
+    t_ctl_conn *conns;    /* open connections */
+} t_control;
+
+/* control.c */
+uint8_t control_init(t_control *ctl, t_tm_node *node, const char *path);
+uint8_t control_start(t_control *ctl);
+void control_destroy(t_control *ctl);
+
+/* control_client.c */
+int32_t ctl_connect(const char *path);
+uint8_t ctl_send(int32_t fd, const t_tmp_header *header, const void *payload);
+uint8_t ctl_recv(int32_t fd, t_tmp_header *header, uint8_t **payload);
+
+#endif
@@ -0,0 +1,78 @@
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "control.h"
+
+/* Blocking side of the control protocol, used by the shell */
+
+int32_t ctl_connect(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    int32_t fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static uint8_t write_all(int32_t fd, const void *buf, size_t len) {
+    ssize_t nwrite;
+
+    while (len) {
+        nwrite = send(fd, buf, len, MSG_NOSIGNAL);
+        if (nwrite == -1) {
+            if (errno == EINTR) continue;
+            return EXIT_FAILURE;
+        }
+        buf = (const uint8_t *)buf + nwrite;
+        len -= nwrite;
+    }
+    return EXIT_SUCCESS;
+}
+
+static uint8_t read_all(int32_t fd, void *buf, size_t len) {
+    ssize_t nread;
+
+    while (len) {
+        nread = read(fd, buf, len);
+        if (nread == -1) {
+            if (errno == EINTR) continue;
+            return EXIT_FAILURE;
+        }
+        if (!nread) {
+            errno = ECONNRESET;
+            return EXIT_FAILURE;
+        }
+        buf = (uint8_t *)buf + nread;
+        len -= nread;
+    }
+    return EXIT_SUCCESS;
+}
+
+/* Sends one request, header->len bytes of payload following the header */
+uint8_t ctl_send(int32_t fd, const t_tmp_header *header, const void *payload) {
+    if (write_all(fd, header, sizeof(*header))) return EXIT_FAILURE;
+    return write_all(fd, payload, header->len);
+}
+
+/* Receives one reply. Its payload is allocated with a NUL appended & must be
+ * freed by the caller. */
+uint8_t ctl_recv(int32_t fd, t_tmp_header *header, uint8_t **payload) {
+    *payload = NULL;
+    if (read_all(fd, header, sizeof(*header))) return EXIT_FAILURE;
+    if (!(*payload = malloc(header->len + 1))) return EXIT_FAILURE;
+    (*payload)[header->len] = 0;
+    if (read_all(fd, *payload, header->len)) {
+        DESTROY_PTR(*payload);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -4,7 +4,7 @@ void print_pgm_list(t_pgm *head) {
 #ifdef DEVELOPEMENT
     t_pgm_usr *pgm;
     while (head) {
-        pgm = &head->usr;
+        pgm = &head->conf->usr;
         printf("-------------------\n");
         printf("addr: %p\nname: %s\nstdout: %s\nstderr: %s\nworkingdir: %s\n",
                pgm, pgm->name, pgm->std_out, pgm->std_err, pgm->workingdir);
@@ -1,8 +1,9 @@
 #include <pthread.h>
 
+#include "conf_cache.h"
 #include "run_server.h"
 
-static void destroy_pgm_user_attributes(t_pgm_usr *pgm) {
+void destroy_pgm_user_attributes(t_pgm_usr *pgm) {
   DESTROY_PTR(pgm->name);
   if (pgm->cmd) {
     for (uint32_t i = 0; pgm->cmd[i]; i++) DESTROY_PTR(pgm->cmd[i]);
@@ -20,35 +21,20 @@ static void destroy_pgm_user_attributes(t_pgm_usr *pgm) {
   bzero(pgm, sizeof(*pgm));
 }
 
-static void destroy_thrd(t_thread_data *thrd, int32_t numprocs) {
-  t_thread_data *cpy = thrd;
-  for (int i = 0; i < numprocs; i++) {
-    pthread_rwlock_destroy(&thrd->rw_thrd);
-    pthread_barrier_destroy(&thrd->sync_barrier);
-    pthread_mutex_destroy(&thrd->mtx_wakeup);
-    pthread_cond_destroy(&thrd->cond_wakeup);
-    sem_destroy(&thrd->sync);
-    pthread_mutex_destroy(&thrd->mtx_timer);
-    pthread_cond_destroy(&thrd->cond_timer);
-    thrd++;
-  }
-  free(cpy);
-}
-
-static void destroy_pgm_private_attributes(t_pgm_private *pgm,
-                                           int32_t numprocs) {
-  if (pgm->log.out > 0) close(pgm->log.out);
-  if (pgm->log.err > 0) close(pgm->log.err);
+static void destroy_pgm_private_attributes(t_pgm_private *pgm) {
+  logfile_put(pgm->log.out, pgm->log.out_plain);
+  logfile_put(pgm->log.err, pgm->log.err_plain);
   if (pgm->thrd) {
-    pthread_rwlock_destroy(&pgm->rw_pgm);
-    destroy_thrd(pgm->thrd, numprocs);
+    for (uint32_t i = 0; i < pgm->nb_thrd; i++)
+      pgm_conf_put(pgm->thrd[i].conf);
+    free(pgm->thrd);
   }
   bzero(pgm, sizeof(*pgm));
 }
 
 void destroy_pgm(t_pgm *pgm) {
-  destroy_pgm_user_attributes(&pgm->usr);
-  destroy_pgm_private_attributes(&pgm->privy, pgm->usr.numprocs);
+  destroy_pgm_private_attributes(&pgm->privy);
+  pgm_conf_put(pgm->conf);
   DESTROY_PTR(pgm);
 }
 
@@ -63,11 +49,64 @@ void destroy_pgm_list(t_pgm **head) {
   *head = NULL;
 }
 
+void destroy_group_list(t_group_conf **head) {
+  t_group_conf *next;
+
+  while (*head) {
+    next = (*head)->next;
+    if ((*head)->cache) {
+      conf_cache_put((*head)->cache); /* strings live in the mapping */
+    } else {
+      for (uint32_t i = 0; i < (*head)->nb_member; i++)
+        free((*head)->member[i]);
+      free((*head)->member);
+      free((*head)->name);
+    }
+    free(*head);
+    *head = next;
+  }
+}
+
 void destroy_taskmaster(t_tm_node *node) {
-  fclose(node->config_file);
+  if (node->control) { /* stopped first: it reads programs */
+    control_destroy(node->control);
+    DESTROY_PTR(node->control);
+  }
+  if (node->ctl_fd >= 0) close(node->ctl_fd);
+  if (node->config_file) fclose(node->config_file);
   destroy_pgm_list(&node->head);
-  sem_destroy(&node->new_event);
-  sem_destroy(&node->free_place);
-  fclose(node->tm_stream_log);
+  destroy_group_list(&node->groups);
+  rcu_destroy(&node->rcu);
+  pgm_index_destroy(node->pgm_index);
+  ev_queue_destroy(&node->ev_queue);
+  if (node->wheel) {
+    tw_destroy(node->wheel);
+    DESTROY_PTR(node->wheel);
+  }
+  if (node->reaper) {
+    reaper_destroy(node->reaper);
+    DESTROY_PTR(node->reaper);
+  }
+  if (node->epoll_fd >= 0) close(node->epoll_fd);
+  if (node->capture) {
+    capture_destroy(node->capture);
+    DESTROY_PTR(node->capture);
+  }
+  if (node->logger) {
+    logger_destroy(node->logger);
+    DESTROY_PTR(node->logger);
+  }
+  if (node->journal) {
+    journal_close(node->journal);
+    DESTROY_PTR(node->journal);
+  }
+  if (node->status) {
+    status_table_close(node->status);
+    DESTROY_PTR(node->status);
+  }
+  if (node->startup) {
+    startup_close(node->startup);
+    DESTROY_PTR(node->startup);
+  }
   bzero(node, sizeof(*node));
 }
@@ -0,0 +1,91 @@
+/*
+ * Bounded lock-free multi-producer/single-consumer ring (Dmitry Vyukov's
+ * bounded queue, restricted to one consumer).
+ * Each slot carries a sequence number: a slot at position pos is free for a
+ * producer when seq == pos, and holds an event ready to be popped when
+ * seq == pos + 1. Popping a slot gives it back to producers of the next lap
+ * by setting seq to pos + LEN_EV_QUEUE.
+ * Producers only contend on a CAS of tail, the consumer never writes tail,
+ * so a pop costs O(1) whatever the number of pending events.
+ */
+
+#include <sys/eventfd.h>
+
+#include "taskmaster.h"
+
+#define EV_QUEUE_MASK (LEN_EV_QUEUE - 1)
+
+uint8_t ev_queue_init(t_ev_queue *queue) {
+    atomic_init(&queue->tail, 0);
+    queue->head = 0;
+    atomic_init(&queue->signaled, false);
+    for (uint32_t i = 0; i < LEN_EV_QUEUE; i++)
+        atomic_init(&queue->slot[i].seq, i);
+    queue->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (queue->efd == -1) return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+void ev_queue_destroy(t_ev_queue *queue) {
+    if (queue->efd >= 0) close(queue->efd);
+    queue->efd = -1;
+}
+
+/* Adds an event then wakes the consumer up if it isn't already. Returns
+ * EXIT_FAILURE when the queue is full. */
+uint8_t ev_queue_push(t_ev_queue *queue, t_event event) {
+    uint32_t pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    t_ev_slot *slot;
+    int32_t diff;
+
+    while (true) {
+        slot = &queue->slot[pos & EV_QUEUE_MASK];
+        diff = (int32_t)(atomic_load_explicit(&slot->seq,
+                                              memory_order_acquire) -
+                         pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(
+                    &queue->tail, &pos, pos + 1, memory_order_relaxed,
+                    memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            return EXIT_FAILURE; /* slot of the previous lap not popped yet */
+        } else {
+            pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        }
+    }
+    slot->event = event;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+    if (!atomic_exchange_explicit(&queue->signaled, true, memory_order_acq_rel))
+        if (eventfd_write(queue->efd, 1) == -1) perror("eventfd_write");
+    return EXIT_SUCCESS;
+}
+
+/* Pops up to max events in FIFO order. Consumer only. */
+uint32_t ev_queue_pop_batch(t_ev_queue *queue, t_event *events,
+                            uint32_t max) {
+    t_ev_slot *slot;
+    uint32_t nb = 0;
+
+    while (nb < max) {
+        slot = &queue->slot[queue->head & EV_QUEUE_MASK];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) !=
+            queue->head + 1)
+            break;
+        events[nb++] = slot->event;
+        atomic_store_explicit(&slot->seq, queue->head + LEN_EV_QUEUE,
+                              memory_order_release);
+        queue->head++;
+    }
+    return nb;
+}
+
+/* Consumer acknowledges a wakeup before draining the queue, so that any event
+ * pushed from now on writes the eventfd again. */
+void ev_queue_wakeup_ack(t_ev_queue *queue) {
+    eventfd_t cnt;
+
+    eventfd_read(queue->efd, &cnt);
+    atomic_exchange_explicit(&queue->signaled, false, memory_order_acq_rel);
+}
@@ -0,0 +1,144 @@
+#include "journal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define JRN_RECORD_SZ (sizeof(t_jrn_record))
+
+const t_jrn_event_desc g_jrn_event[JRN_EV_NB] = {
+    [JRN_EV_NONE] = {"", "", JRN_VAL_NONE},
+    [JRN_EV_PGM] = {"journal", "PROGRAM", JRN_VAL_NONE},
+    [JRN_EV_NAME] = {"journal", "NAME", JRN_VAL_NONE},
+    [JRN_EV_LAUNCHED] = {"launcher", "LAUNCHED", JRN_VAL_NONE},
+    [JRN_EV_SPAWN_FAILED] = {"launcher", "SPAWN FAILED", JRN_VAL_ERRNO},
+    [JRN_EV_AUTO_RESTART] = {"auto restart", "AUTO RESTART", JRN_VAL_NONE},
+    [JRN_EV_STOPPED_BY_SIGNAL] = {"child supervisor", "STOPPED BY SIGNAL",
+                                  JRN_VAL_STATUS},
+    [JRN_EV_CONTINUED] = {"child supervisor", "CONTINUED", JRN_VAL_STATUS},
+    [JRN_EV_EXITED_EXPECTED] = {"child supervisor",
+                                "EXITED WITH EXPECTED STATUS", JRN_VAL_STATUS},
+    [JRN_EV_EXITED_UNEXPECTED] = {"child supervisor",
+                                  "EXITED WITH UNEXPECTED STATUS",
+                                  JRN_VAL_STATUS},
+    [JRN_EV_KILLED_BY_SIGNAL] = {"child supervisor", "KILLED BY SIGNAL",
+                                 JRN_VAL_STATUS},
+    [JRN_EV_EXITED_BEFORE_START] = {"start timer",
+                                    "EXITED BEFORE TIME TO LAUNCH",
+                                    JRN_VAL_STARTTIME},
+    [JRN_EV_START_FAILED] = {"start timer", "DIDN'T STARTED CORRECTLY",
+                             JRN_VAL_STARTTIME},
+    [JRN_EV_STARTED] = {"start timer", "STARTED CORRECTLY", JRN_VAL_STARTTIME},
+    [JRN_EV_KILLED] = {"stop timer", "PROCESSUS HAD BEEN KILLED",
+                       JRN_VAL_STOPTIME},
+    [JRN_EV_STOPPED] = {"stop timer", "PROCESSUS STOPPED AS EXPECTED",
+                        JRN_VAL_STOPTIME},
+    [JRN_EV_KILL_FAILED] = {"stop timer",
+                            "ERR: TASKMASTER DIDN'T SUCCEEDED TO KILL THE PROC",
+                            JRN_VAL_STOPTIME},
+};
+
+/* Maps the chunk starting at file offset 'off', growing the file to hold it */
+static uint8_t journal_map(t_journal *jrn, size_t off) {
+    if (jrn->map) munmap(jrn->map, JRN_CHUNK);
+    jrn->map = NULL;
+    if (ftruncate(jrn->fd, off + JRN_CHUNK) == -1) return EXIT_FAILURE;
+    jrn->map = mmap(NULL, JRN_CHUNK, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    jrn->fd, off);
+    if (jrn->map == MAP_FAILED) {
+        jrn->map = NULL;
+        return EXIT_FAILURE;
+    }
+    jrn->map_off = off;
+    return EXIT_SUCCESS;
+}
+
+/* The mapped chunk is full: maps the next one */
+uint8_t journal_grow(t_journal *jrn) {
+    if (journal_map(jrn, jrn->map_off + JRN_CHUNK)) {
+        jrn->pos = JRN_CHUNK; /* drop records until it works again */
+        return EXIT_FAILURE;
+    }
+    jrn->pos = 0;
+    return EXIT_SUCCESS;
+}
+
+/* Size of the valid part of an existing journal: trailing records zeroed by
+ * a crash are skipped */
+static size_t journal_end(t_journal *jrn, size_t size) {
+    t_jrn_record rec;
+
+    size -= size % JRN_RECORD_SZ;
+    while (size > JRN_RECORD_SZ) {
+        if (pread(jrn->fd, &rec, sizeof(rec), size - JRN_RECORD_SZ) !=
+            sizeof(rec))
+            return 0;
+        if (rec.event != JRN_EV_NONE) break;
+        size -= JRN_RECORD_SZ;
+    }
+    return size;
+}
+
+/* Opens or creates a journal & maps its end to append to it */
+uint8_t journal_open(t_journal *jrn, const char *path) {
+    t_jrn_header header = {.magic = JRN_MAGIC,
+                           .version = JRN_VERSION,
+                           .record_size = JRN_RECORD_SZ};
+    t_jrn_header found;
+    struct stat st;
+    size_t end;
+
+    *jrn = (t_journal){.fd = -1};
+    jrn->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (jrn->fd == -1 || fstat(jrn->fd, &st) == -1) return EXIT_FAILURE;
+    if (st.st_size < (off_t)sizeof(header)) {
+        if (pwrite(jrn->fd, &header, sizeof(header), 0) != sizeof(header))
+            return EXIT_FAILURE;
+        end = sizeof(header);
+    } else {
+        if (pread(jrn->fd, &found, sizeof(found), 0) != sizeof(found) ||
+            memcmp(found.magic, header.magic, sizeof(found.magic)) ||
+            found.record_size != JRN_RECORD_SZ) {
+            errno = EINVAL; /* not a journal: never overwrite it */
+            return EXIT_FAILURE;
+        }
+        end = journal_end(jrn, st.st_size);
+    }
+    if (journal_map(jrn, end - end % JRN_CHUNK)) return EXIT_FAILURE;
+    jrn->pos = end % JRN_CHUNK;
+    return EXIT_SUCCESS;
+}
+
+/* Declares the name of a program id */
+void journal_pgm(t_journal *jrn, uint32_t pgm_id, const char *name) {
+    size_t len = strlen(name);
+    t_jrn_record rec = {.time_ns = journal_clock(),
+                        .pgm_id = pgm_id,
+                        .event = JRN_EV_PGM,
+                        .len = len > UINT16_MAX ? UINT16_MAX : len};
+    t_jrn_record chunk;
+
+    journal_record(jrn, &rec);
+    for (size_t i = 0; i < rec.len; i += JRN_NAME_CHUNK) {
+        memset(&chunk, 0, sizeof(chunk));
+        memcpy(&chunk, name + i,
+               rec.len - i < JRN_NAME_CHUNK ? rec.len - i : JRN_NAME_CHUNK);
+        chunk.event = JRN_EV_NAME;
+        journal_record(jrn, &chunk);
+    }
+}
+
+/* Unmaps the journal & truncates it to its records */
+void journal_close(t_journal *jrn) {
+    if (jrn->map) {
+        munmap(jrn->map, JRN_CHUNK);
+        if (ftruncate(jrn->fd, jrn->map_off + jrn->pos) == -1)
+            perror("journal");
+    }
+    if (jrn->fd >= 0) close(jrn->fd);
+    *jrn = (t_journal){.fd = -1};
+}
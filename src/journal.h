@@ -0,0 +1,119 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Binary journal of processus transitions (taskmaster -j <file>).
+ *
+ * Instead of formatting a text line, the reactor appends a fixed size record
+ * to a file mapped in memory: recording costs a clock read and a memcpy.
+ * The file grows by JRN_CHUNK, only the last chunk is mapped, and it is
+ * truncated to its exact size when taskmaster exits. After a crash, trailing
+ * zeroed records (JRN_EV_NONE) are ignored & overwritten by the next run.
+ * taskmaster-logdump renders a journal as text.
+ *
+ * Programs are recorded by id: a JRN_EV_PGM record declares the name of an
+ * id, its 'len' bytes being carried by the JRN_EV_NAME records following it,
+ * JRN_NAME_CHUNK bytes per record.
+ */
+
+#define JRN_MAGIC "TMJRNL01"
+#define JRN_VERSION (1U)
+#define JRN_CHUNK (1U << 20) /* file growth, multiple of page & record size */
+
+typedef enum e_jrn_event {
+    JRN_EV_NONE,              /* end of journal */
+    JRN_EV_PGM,               /* declares the name of pgm_id */
+    JRN_EV_NAME,              /* name bytes of the previous JRN_EV_PGM */
+    JRN_EV_LAUNCHED,          /* value: - */
+    JRN_EV_SPAWN_FAILED,      /* value: errno */
+    JRN_EV_AUTO_RESTART,      /* value: - */
+    JRN_EV_STOPPED_BY_SIGNAL, /* value: signal */
+    JRN_EV_CONTINUED,         /* value: signal */
+    JRN_EV_EXITED_EXPECTED,   /* value: exit status */
+    JRN_EV_EXITED_UNEXPECTED, /* value: exit status */
+    JRN_EV_KILLED_BY_SIGNAL,  /* value: signal */
+    JRN_EV_EXITED_BEFORE_START, /* value: starttime */
+    JRN_EV_START_FAILED,      /* value: starttime */
+    JRN_EV_STARTED,           /* value: starttime */
+    JRN_EV_KILLED,            /* value: stoptime */
+    JRN_EV_STOPPED,           /* value: stoptime */
+    JRN_EV_KILL_FAILED,       /* value: stoptime */
+    JRN_EV_NB
+} t_jrn_event;
+
+/* how the value of an event is rendered */
+typedef enum e_jrn_value {
+    JRN_VAL_NONE,
+    JRN_VAL_ERRNO,
+    JRN_VAL_STATUS,
+    JRN_VAL_STARTTIME,
+    JRN_VAL_STOPTIME,
+} t_jrn_value;
+
+typedef struct s_jrn_record {
+    uint64_t time_ns; /* CLOCK_REALTIME */
+    uint32_t pgm_id;
+    uint32_t rid;
+    int32_t pid;
+    int32_t restart_counter;
+    int32_t value; /* see t_jrn_event */
+    uint16_t event;
+    uint16_t len; /* JRN_EV_PGM: length of the name following the record */
+} t_jrn_record;
+
+_Static_assert(sizeof(t_jrn_record) == 32, "journal records are 32 bytes");
+
+#define JRN_NAME_CHUNK (offsetof(t_jrn_record, event))
+_Static_assert(JRN_CHUNK % sizeof(t_jrn_record) == 0, "bad JRN_CHUNK");
+
+/* first record of a journal */
+typedef struct s_jrn_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint8_t pad[16];
+} t_jrn_header;
+
+_Static_assert(sizeof(t_jrn_header) == sizeof(t_jrn_record), "bad header");
+
+typedef struct s_journal {
+    int32_t fd;
+    uint8_t *map;   /* mapped chunk */
+    size_t map_off; /* file offset of the mapped chunk */
+    size_t pos;     /* write offset in the mapped chunk */
+} t_journal;
+
+/* label & text of each event, shared with the text log */
+typedef struct s_jrn_event_desc {
+    const char *src;
+    const char *str;
+    t_jrn_value value;
+} t_jrn_event_desc;
+
+extern const t_jrn_event_desc g_jrn_event[JRN_EV_NB];
+
+uint8_t journal_open(t_journal *jrn, const char *path);
+void journal_close(t_journal *jrn);
+uint8_t journal_grow(t_journal *jrn);
+void journal_pgm(t_journal *jrn, uint32_t pgm_id, const char *name);
+
+static inline uint64_t journal_clock(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Appends rec. Single writer: the reactor */
+static inline void journal_record(t_journal *jrn, const t_jrn_record *rec) {
+    if (jrn->pos == JRN_CHUNK && journal_grow(jrn)) return;
+    memcpy(jrn->map + jrn->pos, rec, sizeof(*rec));
+    jrn->pos += sizeof(*rec);
+}
+
+#endif
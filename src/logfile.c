@@ -0,0 +1,200 @@
+#include "logfile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "parsing.h"
+#include "taskmaster.h"
+
+/* one table by process, as the fds */
+static struct {
+    pthread_mutex_t lock;
+    t_logfile **bucket;
+    uint32_t mask;
+    uint32_t nb;
+} g_logfiles = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static inline uint32_t logfile_hash(dev_t dev, ino_t ino) {
+    uint64_t h = ((uint64_t)dev * 0x9E3779B97F4A7C15ULL) ^ (uint64_t)ino;
+
+    h *= 0xFF51AFD7ED558CCDULL;
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+/* Entry of dev & ino, with one more reference, or NULL. Under the lock. */
+static t_logfile *logfile_find(dev_t dev, ino_t ino) {
+    t_logfile *log;
+
+    if (!g_logfiles.bucket) return NULL;
+    for (log = g_logfiles.bucket[logfile_hash(dev, ino) & g_logfiles.mask];
+         log; log = log->next)
+        if (log->dev == dev && log->ino == ino) {
+            log->refcount++;
+            return log;
+        }
+    return NULL;
+}
+
+/* Doubles the buckets once there are more files than buckets. Under the
+ * lock. */
+static uint8_t logfile_grow(void) {
+    uint32_t nb = g_logfiles.bucket ? (g_logfiles.mask + 1) * 2
+                                    : LOGFILE_BUCKETS;
+    t_logfile **bucket, *log, *next;
+
+    if (g_logfiles.bucket && g_logfiles.nb <= g_logfiles.mask)
+        return EXIT_SUCCESS;
+    if (!(bucket = calloc(nb, sizeof(*bucket)))) return EXIT_FAILURE;
+    for (uint32_t i = 0; g_logfiles.bucket && i <= g_logfiles.mask; i++)
+        for (log = g_logfiles.bucket[i]; log; log = next) {
+            next = log->next;
+            log->next = bucket[logfile_hash(log->dev, log->ino) & (nb - 1)];
+            bucket[logfile_hash(log->dev, log->ino) & (nb - 1)] = log;
+        }
+    free(g_logfiles.bucket);
+    g_logfiles.bucket = bucket;
+    g_logfiles.mask = nb - 1;
+    return EXIT_SUCCESS;
+}
+
+/* Bucket of log, under the lock */
+static t_logfile **logfile_bucket(const t_logfile *log) {
+    return &g_logfiles.bucket[logfile_hash(log->dev, log->ino) &
+                              g_logfiles.mask];
+}
+
+/* O_APPEND for the plain outputs, on the file log->fd is now. Failing, the
+ * sink keeps its offsets. Under the lock. */
+static void logfile_append(t_logfile *log) {
+    int32_t flags = fcntl(log->fd, F_GETFL);
+
+    if (flags != -1 && fcntl(log->fd, F_SETFL, flags | O_APPEND) != -1)
+        atomic_store(&log->append, true);
+}
+
+/* Reference to the log file of path, created if missing. Returns NULL with
+ * errno set if it can't be opened. Opened without O_APPEND, for the capture:
+ * see logfile_get(). */
+t_logfile *logfile_open(const char *path) {
+    t_logfile *log = NULL, *found;
+    struct stat st;
+    int32_t fd;
+
+    if (!stat(path, &st)) {
+        pthread_mutex_lock(&g_logfiles.lock);
+        log = logfile_find(st.st_dev, st.st_ino);
+        pthread_mutex_unlock(&g_logfiles.lock);
+        if (log) return log;
+    }
+    fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, LOGFILE_PERM);
+    if (fd == -1) return NULL;
+    if (fstat(fd, &st) == -1 || !(log = calloc(1, sizeof(*log)))) goto error;
+    *log = (t_logfile){
+        .dev = st.st_dev, .ino = st.st_ino, .fd = fd, .refcount = 1};
+    atomic_init(&log->plain, 0);
+    atomic_init(&log->append, false);
+    pthread_mutex_lock(&g_logfiles.lock);
+    /* opened by another thread meanwhile, or created by this open() */
+    if ((found = logfile_find(st.st_dev, st.st_ino)) || logfile_grow()) {
+        pthread_mutex_unlock(&g_logfiles.lock);
+        if (found) {
+            free(log);
+            close(fd);
+            return found;
+        }
+        errno = ENOMEM;
+        goto error;
+    }
+    log->next = *logfile_bucket(log);
+    *logfile_bucket(log) = log;
+    g_logfiles.nb++;
+    pthread_mutex_unlock(&g_logfiles.lock);
+    return log;
+
+error:
+    free(log);
+    close(fd);
+    return NULL;
+}
+
+/* One more reference to log. The first plain one sets O_APPEND, before the
+ * processus writing to the fd are launched: they can't write over the sink,
+ * nor the sink over them. */
+t_logfile *logfile_get(t_logfile *log, bool plain) {
+    pthread_mutex_lock(&g_logfiles.lock);
+    log->refcount++;
+    if (plain && !atomic_fetch_add(&log->plain, 1) &&
+        !atomic_load(&log->append))
+        logfile_append(log);
+    pthread_mutex_unlock(&g_logfiles.lock);
+    return log;
+}
+
+/* Closes the file with its last reference. The table is freed with the
+ * last file. O_APPEND stays: processus may outlive their program. */
+void logfile_put(t_logfile *log, bool plain) {
+    t_logfile **link;
+
+    if (!log) return;
+    pthread_mutex_lock(&g_logfiles.lock);
+    if (plain) atomic_fetch_sub(&log->plain, 1);
+    if (--log->refcount) {
+        pthread_mutex_unlock(&g_logfiles.lock);
+        return;
+    }
+    link = logfile_bucket(log);
+    while (*link != log) link = &(*link)->next;
+    *link = log->next;
+    if (!--g_logfiles.nb) {
+        free(g_logfiles.bucket);
+        g_logfiles.bucket = NULL;
+    }
+    pthread_mutex_unlock(&g_logfiles.lock);
+    close(log->fd);
+    free(log);
+}
+
+/* Renames the file of log, named path, to 'to', then swaps a new file in
+ * on log->fd & moves the entry to its key: under the lock, so that path
+ * names the old file or the entry meanwhile, & no plain output is added.
+ * Refused with EBUSY if the file has plain outputs: their processus would
+ * keep writing to the old file. Returns EXIT_FAILURE with errno set if the
+ * file wasn't renamed, or if the new one couldn't be opened: log keeps
+ * writing to the old one. */
+uint8_t logfile_rotate(t_logfile *log, const char *path, const char *to) {
+    uint8_t ret = EXIT_FAILURE;
+    t_logfile **link;
+    struct stat st;
+    int32_t fd;
+
+    pthread_mutex_lock(&g_logfiles.lock);
+    if (atomic_load(&log->plain)) {
+        errno = EBUSY;
+        goto end;
+    }
+    if (rename(path, to) == -1) goto end;
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, LOGFILE_PERM);
+    if (fd == -1) goto end;
+    if (fstat(fd, &st) == -1 || dup3(fd, log->fd, O_CLOEXEC) == -1) {
+        close(fd);
+        goto end;
+    }
+    close(fd);
+    link = logfile_bucket(log);
+    while (*link != log) link = &(*link)->next;
+    *link = log->next;
+    log->dev = st.st_dev;
+    log->ino = st.st_ino;
+    log->next = *logfile_bucket(log);
+    *logfile_bucket(log) = log;
+    atomic_store(&log->append, false);
+    ret = EXIT_SUCCESS;
+
+end:
+    pthread_mutex_unlock(&g_logfiles.lock);
+    return ret;
+}
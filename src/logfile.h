@@ -0,0 +1,53 @@
+#ifndef LOGFILE_H
+#define LOGFILE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Log files of the programs - stdout & stderr - opened once by file for the
+ * whole process, whatever the number of programs, paths & reloads naming
+ * them.
+ *
+ * Files are keyed by (dev, inode), not by path: /dev/null, a file named thru
+ * a symlink or a relative path are one entry, one fd shared by all the
+ * programs writing to it. A path is stat()ed first, so a file already in the
+ * table is not even opened again: a reload of thousands of programs logging
+ * to a few files opens none. A program holds one reference by output, taken
+ * by sanitize_config() & released with the program, so a reload takes the
+ * references of the new programs before the old ones are dropped & files
+ * kept from one configuration to the next one stay open.
+ *
+ * The fd is also the one of the capture sink of the file, if any: one writer
+ * by file. The outputs not captured - 'plain', the processus write to the fd
+ * directly - set O_APPEND on it with their first reference, as splice()
+ * refuses it: the sink then appends too, instead of writing at the offsets
+ * it tracks. A rotation renames the file & swaps a new one in on the same
+ * fd, then moves the entry to its key.
+ *
+ * The table is shared by the threads parsing configurations - control
+ * thread for add & reload - and the master thread destroying programs,
+ * under one lock.
+ */
+
+#define LOGFILE_BUCKETS (64U) /* initial buckets, doubled with the files */
+
+typedef struct s_logfile {
+    dev_t dev;
+    ino_t ino;
+    int32_t fd;          /* O_CLOEXEC, O_APPEND once 'append' */
+    uint32_t refcount;   /* programs' outputs, path checks & capture sink */
+    atomic_uint plain;   /* outputs not captured */
+    atomic_bool append;  /* set with the first plain output, until a rotation */
+    struct s_sink *sink; /* of the capture, under its lock */
+    struct s_logfile *next;
+} t_logfile;
+
+t_logfile *logfile_open(const char *path);
+t_logfile *logfile_get(t_logfile *log, bool plain);
+void logfile_put(t_logfile *log, bool plain);
+uint8_t logfile_rotate(t_logfile *log, const char *path, const char *to);
+
+#endif
@@ -0,0 +1,320 @@
+#include "logger.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "taskmaster.h"
+
+#define LOG_RING_MASK (LOG_RING_LEN - 1)
+
+/* ring of the calling thread, given on its first log */
+static _Thread_local t_log_ring *tls_ring;
+static _Thread_local bool tls_shared; /* tls_ring is the shared one */
+
+/* ================================ producers =============================== */
+
+static void logger_wakeup(t_logger *logger) {
+    if (!atomic_exchange_explicit(&logger->signaled, true,
+                                  memory_order_acq_rel))
+        eventfd_write(logger->efd, 1);
+}
+
+/* Own ring of the calling thread, or the shared one once LOG_MAX_THREADS
+ * threads have theirs */
+static t_log_ring *logger_ring(t_logger *logger) {
+    uint32_t slot;
+
+    if (tls_ring) return tls_ring;
+    slot = atomic_fetch_add(&logger->nb_rings, 1);
+    if (slot < LOG_MAX_THREADS && (tls_ring = calloc(1, sizeof(*tls_ring)))) {
+        atomic_store_explicit(&logger->ring[slot], tls_ring,
+                              memory_order_release);
+        return tls_ring;
+    }
+    tls_shared = true;
+    tls_ring = atomic_load(&logger->ring[LOG_MAX_THREADS]);
+    return tls_ring;
+}
+
+/* Sleeps until the writer gave records of the full ring back. Returns its
+ * head. */
+static uint32_t logger_room(t_logger *logger, t_log_ring *ring, uint32_t tail) {
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    while (tail - head == LOG_RING_LEN) {
+        logger_wakeup(logger);
+        pthread_mutex_lock(&logger->room_lock);
+        atomic_fetch_add(&logger->nb_waiting, 1);
+        /* seen by the writer, or the head it moved is seen here */
+        if (tail - atomic_load(&ring->head) == LOG_RING_LEN)
+            pthread_cond_wait(&logger->room, &logger->room_lock);
+        atomic_fetch_sub(&logger->nb_waiting, 1);
+        pthread_mutex_unlock(&logger->room_lock);
+        head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    }
+    return head;
+}
+
+/* Formats a line into the ring of the calling thread. Never blocks on I/O:
+ * if the ring is full, sleeps until the writer makes room. */
+void logger_log(t_logger *logger, const char *fmt, ...) {
+    t_log_ring *ring = logger_ring(logger);
+    t_log_record *rec;
+    uint32_t tail, head, pending;
+    va_list ap;
+    int32_t len;
+
+    if (!ring) return; /* no logger */
+    if (tls_shared) pthread_mutex_lock(&logger->shared_lock);
+    tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    head = logger_room(logger, ring, tail);
+
+    rec = &ring->rec[tail & LOG_RING_MASK];
+    rec->sec = time(NULL);
+    va_start(ap, fmt);
+    len = vsnprintf(rec->msg, LOG_MSG_LEN, fmt, ap);
+    va_end(ap);
+    if (len < 0) len = 0;
+    if (len >= LOG_MSG_LEN) { /* truncated: keep the line ending */
+        len = LOG_MSG_LEN - 1;
+        rec->msg[len - 1] = '\n';
+    }
+    rec->len = len;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    if (tls_shared) pthread_mutex_unlock(&logger->shared_lock);
+
+    pending = tail + 1 - head;
+    if (pending == 1 || pending == LOG_FLUSH_BATCH) logger_wakeup(logger);
+}
+
+/* ================================= writer ================================= */
+
+/* timestamps of the last seconds logged */
+typedef struct s_log_ts {
+    uint32_t nb;
+    int64_t sec[LOG_TS_CACHE];
+    char buf[LOG_TS_CACHE][LOG_TS_LEN + 1];
+} t_log_ts;
+
+/* formatted timestamp of sec, NULL if it can't be. The cache starts over
+ * once full. */
+static char *log_timestamp(t_log_ts *ts, int64_t sec) {
+    time_t curtime = sec;
+    struct tm loctime;
+
+    for (uint32_t i = 0; i < ts->nb; i++)
+        if (ts->sec[i] == sec) return ts->buf[i];
+    if (ts->nb == LOG_TS_CACHE) ts->nb = 0;
+    if (localtime_r(&curtime, &loctime) != &loctime) return NULL;
+    strftime(ts->buf[ts->nb], sizeof(ts->buf[0]), "%F, %T ", &loctime);
+    ts->sec[ts->nb] = sec;
+    return ts->buf[ts->nb++];
+}
+
+/* Shifts the backups, renames the file to file.1 & swaps a new one in, on
+ * the same fd, then queues file.1 for its compression. Without backups, the
+ * file is truncated. On failure, the writes go on where they did. */
+static void log_rotate(t_logger *logger) {
+    char to[PATH_MAX];
+    int32_t fd, old = -1;
+
+    sink_io_file_wait(&logger->io, &logger->file);
+    logger->size = 0;
+    if (!logger->backups) {
+        ftruncate(logger->fd, 0); /* O_APPEND: the writes follow */
+        return;
+    }
+    pthread_mutex_lock(&logger->compress.names);
+    compress_shift(logger->path, logger->backups);
+    snprintf(to, sizeof(to), "%s.1", logger->path);
+    if (rename(logger->path, to) == -1) {
+        pthread_mutex_unlock(&logger->compress.names);
+        return;
+    }
+    fd = open(logger->path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd >= 0 && dup3(fd, logger->fd, O_CLOEXEC) >= 0 &&
+        logger->codec != codec_none)
+        old = open(to, O_RDONLY | O_CLOEXEC);
+    pthread_mutex_unlock(&logger->compress.names);
+    if (fd < 0) return;
+    close(fd);
+    sink_io_file_reset(&logger->io, &logger->file);
+    if (old >= 0)
+        compress_push(&logger->compress, old, logger->path, logger->backups,
+                      logger->codec);
+}
+
+/* Queues buf at the end of the file, rotating the file first if buf would
+ * take it past maxbytes */
+static void log_write(t_logger *logger, t_sink_buf *buf) {
+    if (logger->maxbytes && logger->size &&
+        logger->size + buf->len > logger->maxbytes)
+        log_rotate(logger);
+    logger->size += buf->len;
+    /* taskmaster.log is opened with O_APPEND: written in order, at its end */
+    sink_io_write(&logger->io, &logger->file, buf, -1);
+}
+
+/* Copies every pending record of every ring into buffers, giving the records
+ * back on the way, then submits the buffers in one go */
+static void log_flush(t_logger *logger, t_log_ts *ts) {
+    t_sink_buf *buf = NULL;
+    uint32_t head, tail;
+    t_log_ring *ring;
+    t_log_record *rec;
+    char *stamp;
+
+    for (uint32_t r = 0; r < LOG_RINGS; r++) {
+        ring = atomic_load_explicit(&logger->ring[r], memory_order_acquire);
+        if (!ring) continue;
+        head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        for (; head != tail; head++) {
+            rec = &ring->rec[head & LOG_RING_MASK];
+            if (buf && buf->len + LOG_TS_LEN + rec->len > SINK_IO_BUF_SIZE) {
+                log_write(logger, buf);
+                buf = NULL;
+            }
+            if (!buf) { /* may wait for a write: release what was copied */
+                atomic_store_explicit(&ring->head, head, memory_order_release);
+                buf = sink_io_buf(&logger->io);
+            }
+            if ((stamp = log_timestamp(ts, rec->sec))) {
+                memcpy(buf->data + buf->len, stamp, LOG_TS_LEN);
+                buf->len += LOG_TS_LEN;
+            }
+            memcpy(buf->data + buf->len, rec->msg, rec->len);
+            buf->len += rec->len;
+        }
+        atomic_store_explicit(&ring->head, head, memory_order_release);
+    }
+    if (buf) log_write(logger, buf);
+    sink_io_submit(&logger->io);
+    /* the heads are moved: producers sleeping on a full ring go on */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&logger->nb_waiting)) {
+        pthread_mutex_lock(&logger->room_lock);
+        pthread_cond_broadcast(&logger->room);
+        pthread_mutex_unlock(&logger->room_lock);
+    }
+}
+
+static uint32_t log_pending(t_logger *logger) {
+    uint32_t pending = 0;
+    t_log_ring *ring;
+
+    for (uint32_t r = 0; r < LOG_RINGS; r++) {
+        ring = atomic_load_explicit(&logger->ring[r], memory_order_acquire);
+        if (ring)
+            pending += atomic_load_explicit(&ring->tail, memory_order_acquire) -
+                       atomic_load_explicit(&ring->head, memory_order_relaxed);
+    }
+    return pending;
+}
+
+/* Sleeps until a producer signals or timeout_ms elapsed (-1: no timeout) */
+static void log_wait(t_logger *logger, int32_t timeout_ms) {
+    struct pollfd pfd = {.fd = logger->efd, .events = POLLIN};
+    eventfd_t value;
+
+    if (poll(&pfd, 1, timeout_ms) > 0) {
+        eventfd_read(logger->efd, &value);
+        atomic_store_explicit(&logger->signaled, false, memory_order_release);
+    }
+}
+
+/* Flushes by size - LOG_FLUSH_BATCH pending records - or by time -
+ * LOG_FLUSH_MS after the wakeup of the first record. */
+static void *log_writer(void *arg) {
+    t_logger *logger = arg;
+    t_log_ts ts = {0};
+    uint32_t pending;
+
+    while (true) {
+        pending = log_pending(logger);
+        if (!pending) {
+            if (atomic_load(&logger->exit)) break;
+            log_wait(logger, -1);
+            continue;
+        }
+        if (pending < LOG_FLUSH_BATCH && !atomic_load(&logger->exit))
+            log_wait(logger, LOG_FLUSH_MS);
+        log_flush(logger, &ts);
+    }
+    sink_io_drain(&logger->io);
+    return NULL;
+}
+
+/* ================================== api =================================== */
+
+/* The writer is created with all signals blocked: it must never take a
+ * signal meant to be read thru a signalfd (SIGCHLD of the reaper). rotate
+ * may be NULL: the file is never rotated. */
+uint8_t logger_init(t_logger *logger, const char *path,
+                    const struct s_rotate *rotate) {
+    struct stat st;
+    sigset_t all, old;
+    int32_t ret;
+
+    *logger = (t_logger){.fd = -1, .efd = -1};
+    if (rotate) {
+        logger->maxbytes = rotate->maxbytes;
+        logger->backups = rotate->backups;
+        logger->codec = rotate->compress;
+    }
+    compress_init(&logger->compress);
+    pthread_mutex_init(&logger->shared_lock, NULL);
+    pthread_mutex_init(&logger->room_lock, NULL);
+    pthread_cond_init(&logger->room, NULL);
+    logger->ring[LOG_MAX_THREADS] = calloc(1, sizeof(t_log_ring));
+    if (!logger->ring[LOG_MAX_THREADS]) return EXIT_FAILURE;
+    logger->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (logger->fd == -1 || fstat(logger->fd, &st) == -1 ||
+        !(logger->path = strdup(path)))
+        return EXIT_FAILURE;
+    logger->size = st.st_size;
+    sink_io_file_init(&logger->file, logger->fd, logger->path);
+    if (sink_io_init(&logger->io, LOG_IO_BUFS)) return EXIT_FAILURE;
+    logger->efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (logger->efd == -1) return EXIT_FAILURE;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    ret = pthread_create(&logger->writer, NULL, log_writer, logger);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret) {
+        close(logger->efd);
+        logger->efd = -1;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/* Flushes every record left, stops the writer then waits for the writes */
+void logger_destroy(t_logger *logger) {
+    if (logger->efd >= 0) {
+        atomic_store(&logger->exit, true);
+        eventfd_write(logger->efd, 1);
+        pthread_join(logger->writer, NULL);
+        close(logger->efd);
+    }
+    if (logger->path) sink_io_file_close(&logger->io, &logger->file);
+    sink_io_destroy(&logger->io);
+    compress_destroy(&logger->compress);
+    for (uint32_t r = 0; r < LOG_RINGS; r++) free(logger->ring[r]);
+    if (logger->fd >= 0) close(logger->fd);
+    free(logger->path);
+    pthread_cond_destroy(&logger->room);
+    pthread_mutex_destroy(&logger->room_lock);
+    pthread_mutex_destroy(&logger->shared_lock);
+    *logger = (t_logger){.fd = -1, .efd = -1};
+}
@@ -0,0 +1,87 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "compress.h"
+#include "sink_io.h"
+
+/*
+ * Asynchronous logger of taskmaster.log.
+ *
+ * Each of the first LOG_MAX_THREADS logging threads owns a lock-free
+ * single-producer/single-consumer ring of fixed size records. The threads
+ * after them share one more ring, filled under 'shared_lock'. A dedicated
+ * writer thread drains all rings thru its sink_io: a batch is flushed once
+ * LOG_FLUSH_BATCH records are pending in a ring, or LOG_FLUSH_MS after the
+ * first record of an idle ring. Records only carry the second they were
+ * logged at, the writer formats the timestamp once by second.
+ *
+ * A producer whose ring is full sleeps on 'room' until the writer gave
+ * records back: no line is dropped & no thread spins.
+ *
+ * With rotation settings (-r), the writer rotates the file before a buffer
+ * would take it past maxbytes, as the io thread does the outputs of the
+ * programs: backups shifted, the file renamed to file.1 & a new one dup3()ed
+ * on its fd once the writes in flight completed, file.1 compressed by a
+ * worker of its own if asked.
+ */
+
+#define LOG_RING_LEN (256U)     /* records by ring, must be a power of 2 */
+#define LOG_MAX_THREADS (8U)    /* logging threads with their own ring */
+#define LOG_RINGS (LOG_MAX_THREADS + 1) /* the last one is shared */
+#define LOG_MSG_LEN (244)       /* so that a record is 256 bytes */
+#define LOG_FLUSH_BATCH (64U)   /* pending records waking the writer up */
+#define LOG_FLUSH_MS (50)       /* max delay of a record before its flush */
+#define LOG_IO_BUFS (4U)        /* buffers of SINK_IO_BUF_SIZE in flight */
+#define LOG_TS_LEN (21)         /* "%F, %T " */
+#define LOG_TS_CACHE (8U)       /* seconds formatted ahead */
+
+typedef struct s_log_record {
+    int64_t sec;  /* time it was logged at */
+    uint32_t len; /* length of msg */
+    char msg[LOG_MSG_LEN];
+} t_log_record;
+
+typedef struct s_log_ring {
+    alignas(64) atomic_uint head; /* next record to write, owned by writer */
+    alignas(64) atomic_uint tail; /* next record to fill, owned by producer */
+    t_log_record rec[LOG_RING_LEN];
+} t_log_ring;
+
+typedef struct s_logger {
+    int32_t fd;  /* taskmaster.log */
+    t_sink_file file;
+    t_sink_io io; /* owned by the writer */
+    char *path;
+    uint64_t maxbytes; /* rotation settings, see t_rotate */
+    uint8_t backups;
+    uint8_t codec;
+    uint64_t size; /* of the file, writer only */
+    t_compress compress;
+    int32_t efd; /* eventfd waking the writer up */
+    atomic_bool signaled; /* efd had been written since last wakeup */
+    atomic_bool exit;     /* writer flushes everything then returns */
+    atomic_uint nb_rings;
+    _Atomic(t_log_ring *) ring[LOG_RINGS];
+    pthread_mutex_t shared_lock; /* producers of ring[LOG_MAX_THREADS] */
+    pthread_mutex_t room_lock;
+    pthread_cond_t room;    /* records given back by the writer */
+    atomic_uint nb_waiting; /* producers sleeping on room */
+    pthread_t writer;
+} t_logger;
+
+struct s_rotate;
+
+uint8_t logger_init(t_logger *logger, const char *path,
+                    const struct s_rotate *rotate);
+void logger_destroy(t_logger *logger);
+void logger_log(t_logger *logger, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+#endif
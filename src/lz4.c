@@ -0,0 +1,207 @@
+#include "lz4.h"
+
+#include <string.h>
+
+#define LZ4_MAGIC (0x184D2204U)
+#define LZ4_FLG (0x64) /* version 1, independent blocks, content checksum */
+#define LZ4_BD (0x40)  /* blocks of 64 KiB max */
+#define LZ4_MIN_MATCH (4)
+#define LZ4_LAST_LITERALS (5) /* a block ends with literals */
+#define LZ4_MFLIMIT (12)      /* no match starts in the last bytes */
+#define LZ4_UNCOMPRESSED (0x80000000U)
+#define LZ4_SKIP_TRIGGER (6) /* misses by step, to skip what doesn't shrink */
+
+#define XXH_P1 (2654435761U)
+#define XXH_P2 (2246822519U)
+#define XXH_P3 (3266489917U)
+#define XXH_P4 (668265263U)
+#define XXH_P5 (374761393U)
+
+static inline uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v; /* little endian hosts only, as the rest of taskmaster */
+}
+
+static inline void write32(uint8_t *p, uint32_t v) { memcpy(p, &v, sizeof(v)); }
+
+static inline uint32_t rotl32(uint32_t v, uint32_t r) {
+    return (v << r) | (v >> (32 - r));
+}
+
+/* ================================== xxh32 ================================= */
+
+static inline uint32_t xxh32_round(uint32_t acc, uint32_t input) {
+    return rotl32(acc + input * XXH_P2, 13) * XXH_P1;
+}
+
+void xxh32_init(t_xxh32 *st, uint32_t seed) {
+    *st = (t_xxh32){.v = {seed + XXH_P1 + XXH_P2, seed + XXH_P2, seed,
+                          seed - XXH_P1},
+                    .seed = seed};
+}
+
+static void xxh32_stripe(t_xxh32 *st, const uint8_t *p) {
+    for (uint32_t i = 0; i < 4; i++)
+        st->v[i] = xxh32_round(st->v[i], read32(p + i * 4));
+}
+
+void xxh32_update(t_xxh32 *st, const void *data, size_t len) {
+    const uint8_t *p = data, *end = p + len;
+    uint32_t fill;
+
+    st->total += len;
+    if (st->memsize) {
+        fill = 16 - st->memsize < len ? 16 - st->memsize : len;
+        memcpy(st->mem + st->memsize, p, fill);
+        st->memsize += fill;
+        p += fill;
+        if (st->memsize < 16) return;
+        xxh32_stripe(st, st->mem);
+        st->memsize = 0;
+    }
+    for (; end - p >= 16; p += 16) xxh32_stripe(st, p);
+    memcpy(st->mem, p, end - p);
+    st->memsize = end - p;
+}
+
+uint32_t xxh32_digest(const t_xxh32 *st) {
+    const uint8_t *p = st->mem, *end = p + st->memsize;
+    uint32_t h;
+
+    if (st->total >= 16)
+        h = rotl32(st->v[0], 1) + rotl32(st->v[1], 7) + rotl32(st->v[2], 12) +
+            rotl32(st->v[3], 18);
+    else
+        h = st->seed + XXH_P5;
+    h += (uint32_t)st->total;
+    for (; end - p >= 4; p += 4) h = rotl32(h + read32(p) * XXH_P3, 17) * XXH_P4;
+    for (; p < end; p++) h = rotl32(h + *p * XXH_P5, 11) * XXH_P1;
+    h ^= h >> 15;
+    h *= XXH_P2;
+    h ^= h >> 13;
+    h *= XXH_P3;
+    h ^= h >> 16;
+    return h;
+}
+
+/* =================================== lz4 ================================== */
+
+static inline uint32_t lz4_hash(uint32_t seq) {
+    return (seq * XXH_P1) >> (32 - LZ4_HASH_LOG);
+}
+
+/* Extra bytes of a length of 15 or more */
+static uint8_t *lz4_length(uint8_t *op, uint32_t len) {
+    for (len -= 15; len >= 255; len -= 255) *op++ = 255;
+    *op++ = len;
+    return op;
+}
+
+/* Literals then a match of 'mlen' bytes 'offset' bytes back, if any */
+static uint8_t *lz4_sequence(uint8_t *op, const uint8_t *lit, uint32_t nb_lit,
+                             uint32_t offset, uint32_t mlen) {
+    uint8_t *token = op++;
+
+    *token = (nb_lit < 15 ? nb_lit : 15) << 4;
+    if (nb_lit >= 15) op = lz4_length(op, nb_lit);
+    memcpy(op, lit, nb_lit);
+    op += nb_lit;
+    if (!offset) return op;
+    *op++ = offset;
+    *op++ = offset >> 8;
+    mlen -= LZ4_MIN_MATCH;
+    *token |= mlen < 15 ? mlen : 15;
+    if (mlen >= 15) op = lz4_length(op, mlen);
+    return op;
+}
+
+/* End of the match of m & ref, 8 bytes at a time */
+static const uint8_t *lz4_match_end(const uint8_t *m, const uint8_t *ref,
+                                    const uint8_t *limit) {
+    uint64_t a, b;
+
+    for (; m + sizeof(a) <= limit; m += sizeof(a), ref += sizeof(a)) {
+        memcpy(&a, m, sizeof(a));
+        memcpy(&b, ref, sizeof(b));
+        if (a != b) return m + (__builtin_ctzll(a ^ b) >> 3);
+    }
+    while (m < limit && *m == *ref) {
+        m++;
+        ref++;
+    }
+    return m;
+}
+
+/* Greedy compression of src into dst, of LZ4_BLOCK_BOUND(len) bytes */
+static uint32_t lz4_compress(uint16_t *table, uint8_t *dst, const uint8_t *src,
+                             uint32_t len) {
+    const uint8_t *ip = src + 1, *anchor = src, *end = src + len;
+    const uint8_t *mflimit = end - LZ4_MFLIMIT;
+    const uint8_t *matchlimit = end - LZ4_LAST_LITERALS;
+    const uint8_t *ref, *m;
+    uint32_t h, miss = 1 << LZ4_SKIP_TRIGGER;
+    uint8_t *op = dst;
+
+    if (len <= LZ4_MFLIMIT) goto last;
+    memset(table, 0, sizeof(uint16_t) << LZ4_HASH_LOG);
+    while (ip < mflimit) {
+        h = lz4_hash(read32(ip));
+        ref = src + table[h];
+        table[h] = ip - src;
+        if (ref >= ip || read32(ref) != read32(ip)) {
+            ip += miss++ >> LZ4_SKIP_TRIGGER;
+            continue;
+        }
+        miss = 1 << LZ4_SKIP_TRIGGER;
+        m = lz4_match_end(ip + LZ4_MIN_MATCH, ref + LZ4_MIN_MATCH, matchlimit);
+        while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+            ip--;
+            ref--;
+        }
+        op = lz4_sequence(op, anchor, ip - anchor, ip - ref, m - ip);
+        ip = anchor = m;
+    }
+last:
+    return lz4_sequence(op, anchor, end - anchor, 0, 0) - dst;
+}
+
+/* ================================== frame ================================= */
+
+/* Writes the header of a frame, LZ4_FRAME_HEADER bytes */
+uint32_t lz4_frame_begin(t_lz4 *lz4, uint8_t *dst) {
+    t_xxh32 hc;
+
+    write32(dst, LZ4_MAGIC);
+    dst[4] = LZ4_FLG;
+    dst[5] = LZ4_BD;
+    xxh32_init(&hc, 0);
+    xxh32_update(&hc, dst + 4, 2);
+    dst[6] = xxh32_digest(&hc) >> 8;
+    xxh32_init(&lz4->checksum, 0);
+    return LZ4_FRAME_HEADER;
+}
+
+/* Writes a block of len bytes, LZ4_BLOCK_SIZE max, into dst of
+ * LZ4_BLOCK_BOUND(len) bytes. Returns the bytes written. */
+uint32_t lz4_frame_block(t_lz4 *lz4, uint8_t *dst, const uint8_t *src,
+                         uint32_t len) {
+    uint32_t size = lz4_compress(lz4->table, dst + 4, src, len);
+
+    xxh32_update(&lz4->checksum, src, len);
+    if (size >= len) {
+        memcpy(dst + 4, src, len);
+        write32(dst, len | LZ4_UNCOMPRESSED);
+        return 4 + len;
+    }
+    write32(dst, size);
+    return 4 + size;
+}
+
+/* Writes the end of the frame, LZ4_FRAME_END bytes */
+uint32_t lz4_frame_end(t_lz4 *lz4, uint8_t *dst) {
+    write32(dst, 0);
+    write32(dst + 4, xxh32_digest(&lz4->checksum));
+    return LZ4_FRAME_END;
+}
@@ -0,0 +1,50 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * LZ4 frames, written by the compressor of the rotated logs: in-tree, so
+ * that taskmaster builds without any library. Files are readable by the lz4
+ * tool (lz4 -d file.1.lz4).
+ *
+ * Blocks are independent, LZ4_BLOCK_SIZE bytes of input each, compressed
+ * greedily with a hash table of the last position of each 4 byte sequence:
+ * a few hundred MB/s, which is plenty for text written at the speed of a
+ * program. A block which doesn't shrink is stored as is. The frame ends with
+ * the xxh32 of the content, checked by the decoder.
+ *
+ * Format: https://github.com/lz4/lz4/blob/dev/doc/lz4_Frame_format.md
+ */
+
+#define LZ4_BLOCK_SIZE (64 * 1024)
+#define LZ4_HASH_LOG (12)
+#define LZ4_FRAME_HEADER (7) /* magic, FLG, BD & header checksum */
+#define LZ4_FRAME_END (8)    /* end mark & content checksum */
+/* written for a block of n bytes, its size included */
+#define LZ4_BLOCK_BOUND(n) (4 + (n) + (n) / 255 + 16)
+
+typedef struct s_xxh32 {
+    uint32_t v[4];
+    uint32_t seed;
+    uint64_t total;
+    uint8_t mem[16];
+    uint32_t memsize;
+} t_xxh32;
+
+typedef struct s_lz4 {
+    uint16_t table[1 << LZ4_HASH_LOG]; /* positions in the block */
+    t_xxh32 checksum;                  /* of the content */
+} t_lz4;
+
+void xxh32_init(t_xxh32 *st, uint32_t seed);
+void xxh32_update(t_xxh32 *st, const void *data, size_t len);
+uint32_t xxh32_digest(const t_xxh32 *st);
+
+uint32_t lz4_frame_begin(t_lz4 *lz4, uint8_t *dst);
+uint32_t lz4_frame_block(t_lz4 *lz4, uint8_t *dst, const uint8_t *src,
+                         uint32_t len);
+uint32_t lz4_frame_end(t_lz4 *lz4, uint8_t *dst);
+
+#endif
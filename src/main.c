@@ -1,24 +1,81 @@
 #include <errno.h>
 #include <pthread.h>
 
+#include "control.h"
+#include "journal.h"
+#include "logger.h"
+#include "startup.h"
+#include "status_table.h"
 #include "taskmaster.h"
 
 static uint8_t usage(char *const *av) {
-  fprintf(stderr, "Usage: %s [-f filename]\n", av[0]);
+  fprintf(stderr,
+          "Usage: %s [-f filename [-o cache]] [-j journal] [-m shm_name] "
+          "[-r maxbytes[:backups[:codec]]] [-s socket] [-t trace]\n"
+          "       %s -C filename -o cache\n"
+          "       %s -c socket\n",
+          av[0], av[0], av[0]);
   return EXIT_FAILURE;
 }
 
-static uint8_t get_options(int ac, char *const *av, t_tm_node *node) {
+/* -c runs the shell alone, as a client of the taskmaster serving socket.
+ * -C compiles the configuration into the cache given by -o, then exits.
+ * -r rotates taskmaster.log, as stdout_maxbytes, stdout_backups &
+ * stdout_compress do the output of a program. */
+static uint8_t get_options(int ac, char *const *av, t_tm_node *node,
+                           bool *client_only, bool *compile_only) {
   int32_t opt;
 
-  while ((opt = getopt(ac, av, "f:")) != -1) {
+  while ((opt = getopt(ac, av, "f:C:o:j:m:r:s:t:c:")) != -1) {
     switch (opt) {
+      case 'C':
+        *compile_only = true;
+        /* fall through */
       case 'f':
+        if (node->config_file) return usage(av);
+        node->config_path = optarg;
         if (!(node->config_file = fopen(optarg, "r"))) {
           fprintf(stderr, "%s: %s: %s\n", av[0], optarg, strerror(errno));
           return EXIT_FAILURE;
         }
         break;
+      case 'j':
+        if (!(node->journal = malloc(sizeof(*node->journal))) ||
+            journal_open(node->journal, optarg)) {
+          fprintf(stderr, "%s: %s: %s\n", av[0], optarg, strerror(errno));
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'm':
+        if (!(node->status = malloc(sizeof(*node->status))) ||
+            status_table_open(node->status, optarg)) {
+          fprintf(stderr, "%s: %s: %s\n", av[0], optarg, strerror(errno));
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'o':
+        node->cache_path = optarg;
+        break;
+      case 'r':
+        if (rotate_option(&node->log_rotate, optarg)) {
+          fprintf(stderr, "%s: %s: invalid rotation\n", av[0], optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 's':
+        node->ctl_path = optarg;
+        break;
+      case 't':
+        if (!(node->startup = malloc(sizeof(*node->startup))) ||
+            startup_open(node->startup, optarg)) {
+          fprintf(stderr, "%s: %s: %s\n", av[0], optarg, strerror(errno));
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'c':
+        node->ctl_path = optarg;
+        *client_only = true;
+        break;
       case '?':
       default:
         return usage(av);
@@ -26,6 +83,15 @@ static uint8_t get_options(int ac, char *const *av, t_tm_node *node) {
   }
 
   if (ac < 2 || optind < ac) return usage(av);
+  if (*client_only ? node->config_file || node->cache_path || node->journal ||
+                         node->status || node->startup ||
+                         node->log_rotate.maxbytes
+                   : !node->config_file)
+    return usage(av);
+  if (*compile_only && (*client_only || !node->cache_path || node->journal ||
+                        node->status || node->startup ||
+                        node->log_rotate.maxbytes))
+    return usage(av);
 
   return EXIT_SUCCESS;
 }
@@ -33,10 +99,11 @@ static uint8_t get_options(int ac, char *const *av, t_tm_node *node) {
 #define TM_LOGFILE "./taskmaster.log"
 
 static uint8_t init_node(t_tm_node *node) {
-  if (sem_init(&node->new_event, 0, 0) == -1) goto_error("sem_init");
-  if (sem_init(&node->free_place, 0, LEN_EV_QUEUE) == -1)
-    goto_error("sem_init");
-  if (!(node->tm_stream_log = fopen(TM_LOGFILE, "a"))) goto_error("fopen");
+  if (ev_queue_init(&node->ev_queue)) goto_error("eventfd");
+  rcu_init(&node->rcu);
+  if (!(node->logger = malloc(sizeof(*node->logger)))) goto_error("malloc");
+  if (logger_init(node->logger, TM_LOGFILE, &node->log_rotate))
+    goto_error(TM_LOGFILE);
   return EXIT_SUCCESS;
 error:
   return EXIT_FAILURE;
@@ -45,12 +112,25 @@ error:
 int main(int ac, char **av) {
   t_tm_node node = {
       .tm_name = av[0],
-      .mtx_log = PTHREAD_MUTEX_INITIALIZER,
-      .mtx_queue = PTHREAD_MUTEX_INITIALIZER,
+      .ev_queue.efd = -1,
+      .epoll_fd = -1,
+      .ctl_path = CTL_DEFAULT_PATH,
+      .ctl_fd = -1,
   };
+  bool client_only = false, compile_only = false;
+  uint8_t ret;
 
+  if (get_options(ac, av, &node, &client_only, &compile_only)) {
+    destroy_taskmaster(&node); /* unlinks a status table already created */
+    return EXIT_FAILURE;
+  }
+  if (compile_only) return compile_config(&node);
+  if (client_only) {
+    ret = run_client(&node);
+    destroy_taskmaster(&node);
+    return ret;
+  }
   if (init_node(&node)) return EXIT_FAILURE;
-  if (get_options(ac, av, &node)) return EXIT_FAILURE;
   if (init_taskmaster(&node)) return EXIT_FAILURE;
   if (run_server(&node)) return EXIT_FAILURE;
   run_client(&node);
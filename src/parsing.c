@@ -6,6 +6,8 @@
 #include <signal.h>
 #include <sys/stat.h>
 
+#include "conf_cache.h"
+#include "config_check.h"
 #include "run_server.h"
 #include "yaml.h"
 
@@ -23,7 +25,10 @@ static const char keys[KEY_NB_MAX][KEY_BUF_LEN] = {
     "\0",           "cmd\0",         "env\0",          "stdout\0",
     "stderr\0",     "workingdir\0",  "exitcodes\0",    "numprocs\0",
     "umask\0",      "autorestart\0", "startretries\0", "autostart\0",
-    "stopsignal\0", "starttime\0",   "stoptime\0",
+    "stopsignal\0", "starttime\0",   "stoptime\0",      "capture\0",
+    "stdout_maxbytes\0", "stdout_backups\0", "stdout_maxage\0",
+    "stderr_maxbytes\0", "stderr_backups\0", "stderr_maxage\0",
+    "tail_bytes\0",      "stdout_compress\0", "stderr_compress\0",
 };
 
 static t_config_error print_san_err(const char *name, t_keys key,
@@ -335,6 +340,139 @@ DECL_DATA_LOAD_HANDLER(stoptime_data_load) {
   return EXIT_SUCCESS;
 }
 
+DECL_DATA_LOAD_HANDLER(capture_data_load) {
+  if (!*data) return EXIT_SUCCESS;
+  if (!strcmp("true\0", data))
+    pgm->capture = true;
+  else if (!strcmp("false\0", data))
+    pgm->capture = false;
+  else
+    return VALUE_ERROR;
+  return EXIT_SUCCESS;
+}
+
+/* a size in bytes, with an optional K, M or G suffix (powers of 1024) */
+static uint8_t size_load(uint64_t *size, const char *data) {
+  static const char suffix[] = "KMG";
+  uint64_t mult = 1;
+  char *endptr;
+  const char *unit;
+
+  if (!*data) return MISSING_ERROR;
+  errno = 0;
+  *size = strtoumax(data, &endptr, 10);
+  if (endptr == data || errno) return VALUE_ERROR;
+  if (*endptr && (unit = strchr(suffix, *endptr))) {
+    mult <<= 10 * (unit - suffix + 1);
+    endptr++;
+  }
+  if (*endptr == 'B') endptr++;
+  if (*endptr || *size > UINT64_MAX / mult) return VALUE_ERROR;
+  *size *= mult;
+  return EXIT_SUCCESS;
+}
+
+static uint8_t maxbytes_load(t_rotate *rotate, const char *data) {
+  return size_load(&rotate->maxbytes, data);
+}
+
+static uint8_t backups_load(t_rotate *rotate, const char *data) {
+  char *endptr;
+  uintmax_t backups;
+
+  if (!*data) return MISSING_ERROR;
+  backups = strtoumax(data, &endptr, 10);
+  if (endptr == data || *endptr || backups > SAN_BACKUPS_MAX)
+    return VALUE_ERROR;
+  rotate->backups = (uint8_t)backups;
+  return EXIT_SUCCESS;
+}
+
+static uint8_t maxage_load(t_rotate *rotate, const char *data) {
+  char *endptr;
+  uintmax_t maxage;
+
+  if (!*data) return MISSING_ERROR;
+  maxage = strtoumax(data, &endptr, 10);
+  if (endptr == data || *endptr || maxage > SAN_MAXAGE_MAX) return VALUE_ERROR;
+  rotate->maxage = (uint32_t)maxage;
+  return EXIT_SUCCESS;
+}
+
+DECL_DATA_LOAD_HANDLER(stdout_maxbytes_data_load) {
+  return maxbytes_load(&pgm->out_rotate, data);
+}
+
+DECL_DATA_LOAD_HANDLER(stdout_backups_data_load) {
+  return backups_load(&pgm->out_rotate, data);
+}
+
+DECL_DATA_LOAD_HANDLER(stdout_maxage_data_load) {
+  return maxage_load(&pgm->out_rotate, data);
+}
+
+DECL_DATA_LOAD_HANDLER(stderr_maxbytes_data_load) {
+  return maxbytes_load(&pgm->err_rotate, data);
+}
+
+DECL_DATA_LOAD_HANDLER(stderr_backups_data_load) {
+  return backups_load(&pgm->err_rotate, data);
+}
+
+DECL_DATA_LOAD_HANDLER(stderr_maxage_data_load) {
+  return maxage_load(&pgm->err_rotate, data);
+}
+
+/* codec of the backups: none or lz4 */
+static uint8_t compress_load(t_rotate *rotate, const char *data) {
+  static const char codecs[codec_max][8] = {"none\0", "lz4\0"};
+
+  if (!*data) return MISSING_ERROR;
+  for (uint8_t codec = 0; codec < codec_max; codec++)
+    if (!strcmp(codecs[codec], data)) {
+      rotate->compress = codec;
+      return EXIT_SUCCESS;
+    }
+  return VALUE_ERROR;
+}
+
+DECL_DATA_LOAD_HANDLER(stdout_compress_data_load) {
+  return compress_load(&pgm->out_rotate, data);
+}
+
+DECL_DATA_LOAD_HANDLER(stderr_compress_data_load) {
+  return compress_load(&pgm->err_rotate, data);
+}
+
+/* -r maxbytes[:backups[:codec]], rotation of taskmaster.log: the settings
+ * of the program outputs, without maxage */
+uint8_t rotate_option(t_rotate *rotate, const char *arg) {
+  char buf[64], *backups = NULL, *codec = NULL;
+
+  *rotate = (t_rotate){0};
+  if ((size_t)snprintf(buf, sizeof(buf), "%s", arg) >= sizeof(buf))
+    return EXIT_FAILURE;
+  if ((backups = strchr(buf, ':'))) {
+    *backups++ = '\0';
+    if ((codec = strchr(backups, ':'))) *codec++ = '\0';
+  }
+  if (size_load(&rotate->maxbytes, buf) || !rotate->maxbytes ||
+      (backups && backups_load(rotate, backups)) ||
+      (codec && compress_load(rotate, codec)))
+    return EXIT_FAILURE;
+  return EXIT_SUCCESS;
+}
+
+DECL_DATA_LOAD_HANDLER(tail_bytes_data_load) {
+  uint64_t size;
+  uint8_t ret;
+
+  if ((ret = size_load(&size, data))) return ret;
+  if (size > SAN_TAIL_MAX) return VALUE_ERROR;
+  pgm->tail_bytes = (uint32_t)size;
+  return EXIT_SUCCESS;
+}
+
 /* array of functions of type DATA_LOAD_HANDLER */
 static uint8_t (*handle_data_loading[KEY_NB_MAX])(t_pgm_usr *, const char *) = {
     nokey_data_load,       cmd_data_load,          env_data_load,
@@ -342,6 +480,11 @@ static uint8_t (*handle_data_loading[KEY_NB_MAX])(t_pgm_usr *, const char *) = {
     exitcodes_data_load,   numprocs_data_load,     umask_data_load,
     autorestart_data_load, startretries_data_load, autostart_data_load,
     stopsignal_data_load,  starttime_data_load,    stoptime_data_load,
+    capture_data_load,     stdout_maxbytes_data_load,
+    stdout_backups_data_load, stdout_maxage_data_load,
+    stderr_maxbytes_data_load, stderr_backups_data_load,
+    stderr_maxage_data_load,  tail_bytes_data_load,
+    stdout_compress_data_load, stderr_compress_data_load,
 };
 
 /* ============================= yaml handlers ============================== */
@@ -395,32 +538,67 @@ DECL_YAML_HANDLER(yaml_scalar_0) {
   return EXIT_FAILURE;
 }
 
-/* this depth of scalar event should happen only once and declare the begining
- * of programs declaration */
+/* this depth of scalar event declares the begining of a section: 'programs'
+ * or 'groups'. Each one must happen only once */
 DECL_YAML_HANDLER(yaml_scalar_1) {
+  const char *key = (char *)event->data.scalar.value;
+
   UNUSED_PARAM(node);
-  if (parsing->info != PARSING_READY) {
-    if (!strcmp("programs\0", (char *)event->data.scalar.value)) {
-      parsing->info |= MASK_PGM;
-    } else {
-      return EXIT_FAILURE; /* wrong key */
-    }
+  if ((parsing->info & PARSING_READY) != PARSING_READY) return EXIT_FAILURE;
+  if (!strcmp("programs\0", key) && !(parsing->info & MASK_PGM)) {
+    parsing->info |= MASK_PGM;
+    parsing->section = SECTION_PROGRAMS;
+  } else if (!strcmp("groups\0", key) && !(parsing->info & MASK_GROUPS)) {
+    parsing->info |= MASK_GROUPS;
+    parsing->section = SECTION_GROUPS;
   } else {
-    return EXIT_FAILURE; /* We should enter only once in 'programs' field */
+    return EXIT_FAILURE; /* wrong key or section entered twice */
+  }
+  return EXIT_SUCCESS;
+}
+
+/* In the groups section, a key declares a new group & the values following
+ * it, single or in sequence, are its members */
+DECL_YAML_HANDLER(yaml_group) {
+  const char *value = (char *)event->data.scalar.value;
+  t_group_conf *group = node->groups;
+  char **member;
+
+  if (parsing->scalar_type == KEY_TYPE && !parsing->seq_depth) {
+    if (!(group = calloc(1, sizeof(*group)))) handle_error("calloc");
+    group->next = node->groups;
+    node->groups = group;
+    if (!(group->name = strdup(value))) handle_error("strdup");
+    TOGGLE_TYPE(parsing->scalar_type);
+    return EXIT_SUCCESS;
+  }
+  if (!group) return WRONG_KEY;
+  if (*value) {
+    member = realloc(group->member, (group->nb_member + 1) * sizeof(*member));
+    if (!member) handle_error("realloc");
+    group->member = member;
+    if (!(member[group->nb_member] = strdup(value))) handle_error("strdup");
+    group->nb_member++;
   }
+  if (!parsing->seq_depth) TOGGLE_TYPE(parsing->scalar_type);
   return EXIT_SUCCESS;
 }
 
 /* this depth of scalar event is a declaration of a new program, the key being
  * the program name */
 DECL_YAML_HANDLER(yaml_scalar_2) {
-  UNUSED_PARAM(parsing);
+  if (parsing->section == SECTION_GROUPS)
+    return yaml_group(node, parsing, event);
   t_pgm *new = calloc(1, sizeof(*new));
   if (!new) handle_error("calloc");
   if (node->head) new->privy.next = node->head;
   node->head = new;
-  new->usr.name = strdup((char *)event->data.scalar.value);
-  if (!new->usr.name) handle_error("strdup");
+  new->conf = pgm_conf_new();
+  if (!new->conf) handle_error("calloc");
+  new->conf->usr.name = strdup((char *)event->data.scalar.value);
+  if (!new->conf->usr.name) handle_error("strdup");
+  new->privy.node = node;
+  new->privy.id = node->pgm_ids++;
   node->pgm_nb++;
   return EXIT_SUCCESS;
 }
@@ -439,7 +617,7 @@ DECL_YAML_HANDLER(yaml_scalar_3) {
     ret = (ret * (parsing->key > 0)) + (WRONG_KEY * (parsing->key == 0));
   } else if (parsing->scalar_type == VALUE_TYPE) {
     if (!parsing->key || parsing->key >= KEY_NB_MAX) return EXIT_FAILURE;
-    ret = handle_data_loading[parsing->key](&node->head->usr,
+    ret = handle_data_loading[parsing->key](&node->head->conf->usr,
                                             (char *)event->data.scalar.value);
   } else
     return EXIT_FAILURE;
@@ -454,7 +632,7 @@ DECL_YAML_HANDLER(yaml_scalar_4) {
 
   if (parsing->key != KEY_ENV || !parsing->key || parsing->key >= KEY_NB_MAX)
     return EXIT_FAILURE;
-  ret = handle_data_loading[parsing->key](&node->head->usr,
+  ret = handle_data_loading[parsing->key](&node->head->conf->usr,
                                           (char *)event->data.scalar.value);
   return ret;
 }
@@ -473,7 +651,12 @@ DECL_YAML_HANDLER(yaml_scalar) {
 DECL_YAML_HANDLER(yaml_seq_st) {
   UNUSED_PARAM(node);
   UNUSED_PARAM(event);
-  if (parsing->map_depth < 3)
+  if (parsing->section == SECTION_GROUPS) {
+    /* members of a group */
+    if (parsing->map_depth != 2 || parsing->seq_depth ||
+        parsing->scalar_type != VALUE_TYPE)
+      return EXIT_FAILURE;
+  } else if (parsing->map_depth < 3)
     return EXIT_FAILURE; /* no sequence before pgm definition */
   parsing->seq_depth++;
   return EXIT_SUCCESS;
@@ -490,6 +673,8 @@ DECL_YAML_HANDLER(yaml_seq_e) {
 DECL_YAML_HANDLER(yaml_map_st) {
   UNUSED_PARAM(node);
   UNUSED_PARAM(event);
+  if (parsing->section == SECTION_GROUPS && parsing->map_depth >= 2)
+    return EXIT_FAILURE; /* a group is a list of members */
   parsing->map_depth++;
   return EXIT_SUCCESS;
 }
@@ -505,10 +690,9 @@ DECL_YAML_HANDLER(yaml_map_e) {
 
 /* ========================= main parsing functions ========================= */
 
-/* Parse yaml configuration file and load data into t_pgm linked list.
+/* Parse yaml configuration and load data into t_pgm linked list.
  * Do some basic sanitation */
-uint8_t load_config_file(t_tm_node *node) {
-  yaml_parser_t parser;
+static uint8_t load_config(t_tm_node *node, yaml_parser_t *parser) {
   yaml_event_t event;
   t_config_parsing parsing = {0};
   uint8_t done = 0, ret;
@@ -519,180 +703,395 @@ uint8_t load_config_file(t_tm_node *node) {
       yaml_seq_e,   yaml_map_st,    yaml_map_e}; /* array of functions of type
                                                     YAML_HANDLER */
 
-  yaml_parser_initialize(&parser);
-  yaml_parser_set_input_file(&parser, node->config_file);
-
   /* Read the event sequence. */
   while (!done) {
     /* Get the next event. */
-    if (!yaml_parser_parse(&parser, &event)) {
-      if (parser.problem_mark.line || parser.problem_mark.column) {
+    if (!yaml_parser_parse(parser, &event)) {
+      if (parser->problem_mark.line || parser->problem_mark.column) {
         fprintf(stderr, "Parse error: %s\nLine: %lu Column: %lu\n",
-                parser.problem, (unsigned long)parser.problem_mark.line + 1,
-                (unsigned long)parser.problem_mark.column + 1);
+                parser->problem, (unsigned long)parser->problem_mark.line + 1,
+                (unsigned long)parser->problem_mark.column + 1);
       } else {
-        fprintf(stderr, "Parse error: %s\n", parser.problem);
+        fprintf(stderr, "Parse error: %s\n", parser->problem);
       }
-      goto error;
+      return EXIT_FAILURE;
     }
 
     ret = handle_yaml_event[event.type](node, &parsing, &event);
     if (ret) {
       handle_config_error(&event, ret, parsing.key);
       yaml_event_delete(&event);
-      goto error;
+      return EXIT_FAILURE;
     }
     done = (event.type == YAML_STREAM_END_EVENT);
     yaml_event_delete(&event);
   }
+  return EXIT_SUCCESS;
+}
 
+uint8_t load_config_file(t_tm_node *node) {
+  yaml_parser_t parser;
+  uint8_t ret;
+
+  yaml_parser_initialize(&parser);
+  yaml_parser_set_input_file(&parser, node->config_file);
+  ret = load_config(node, &parser);
   yaml_parser_delete(&parser);
-  return EXIT_SUCCESS;
+  return ret;
+}
 
-error:
+/* Configuration sent thru the control socket (add command) */
+static uint8_t load_config_string(t_tm_node *node, const char *yaml,
+                                  size_t len) {
+  yaml_parser_t parser;
+  uint8_t ret;
+
+  yaml_parser_initialize(&parser);
+  yaml_parser_set_input_string(&parser, (const unsigned char *)yaml, len);
+  ret = load_config(node, &parser);
   yaml_parser_delete(&parser);
-  return EXIT_FAILURE;
+  return ret;
 }
 
-/* Sanitize configuration. Verify files and directory access, open logging fd */
-uint8_t sanitize_config(t_pgm *head_pgm) {
-  t_pgm_usr *pgm;
-  struct stat statbuf;
+/* paths of a program registered to the checks, see config_check.h */
+typedef struct s_pgm_paths {
+  uint32_t cmd;
+  uint32_t workingdir;
+  uint32_t out;
+  uint32_t err;
+} t_pgm_paths;
+
+/* Reports the result of one path check. Log files get a reference each,
+ * 'plain' if the output isn't captured. */
+static uint8_t sanitize_path(const char *name, t_keys key,
+                             const t_path_entry *entry, t_logfile **log,
+                             bool plain) {
+  if (!entry) return 0;
+  if (entry->err == CHECK_NOT_TYPE)
+    print_san_err(name, key, 0,
+                  key == KEY_CMD ? "Not a regular file" : "Not a directory");
+  else if (entry->err)
+    print_san_err(name, key, 0, strerror(entry->err));
+  else {
+    if (log) *log = logfile_get(entry->log, plain);
+    return 0;
+  }
+  return 1;
+}
+
+/* an output of a program, for the rotation check */
+typedef struct s_output {
+  t_logfile *log;
+  const char *name;
   t_keys key;
-  uint8_t err, tot_err = 0;
-  int8_t ret;
+  bool plain; /* else rotated */
+} t_output;
 
+static int output_cmp(const void *a, const void *b) {
+  uintptr_t x = (uintptr_t)((const t_output *)a)->log;
+  uintptr_t y = (uintptr_t)((const t_output *)b)->log;
+
+  return (x > y) - (x < y);
+}
+
+static void output_add(t_output *out, uint32_t *nb, t_logfile *log,
+                       const char *name, t_keys key, bool plain) {
+  if (log) out[(*nb)++] = (t_output){log, name, key, plain};
+}
+
+/* A rotation swaps a new file in on the fd of the capture only: processus
+ * writing to the file without capture would keep writing to the backup. Files
+ * both rotated & written to without capture are refused. Returns the errors
+ * count. */
+static uint32_t sanitize_rotations(t_pgm *head_pgm, uint32_t nb_pgm) {
+  t_output *out;
+  t_pgm_usr *pgm;
+  uint32_t nb = 0, tot_err = 0, end;
+  bool plain;
+
+  if (!(out = malloc(2 * nb_pgm * sizeof(*out)))) handle_error("malloc");
   for (t_pgm *head = head_pgm; head; head = head->privy.next) {
-    pgm = &head->usr;
-    err = 0;
+    pgm = &head->conf->usr;
+    if (head->privy.log.out_plain || ROTATE_IS_SET(pgm->out_rotate))
+      output_add(out, &nb, head->privy.log.out, pgm->name, KEY_STDOUT,
+                 head->privy.log.out_plain);
+    if (head->privy.log.err_plain || ROTATE_IS_SET(pgm->err_rotate))
+      output_add(out, &nb, head->privy.log.err, pgm->name, KEY_STDERR,
+                 head->privy.log.err_plain);
+  }
+  qsort(out, nb, sizeof(*out), output_cmp);
+  for (uint32_t i = 0; i < nb; i = end) {
+    plain = false;
+    for (end = i; end < nb && out[end].log == out[i].log; end++)
+      plain |= out[end].plain;
+    for (uint32_t j = i; plain && j < end; j++)
+      if (!out[j].plain)
+        tot_err++, print_san_err(out[j].name, out[j].key, VALUE_ERROR,
+                                 ": rotated file written without capture too");
+  }
+  free(out);
+  return tot_err;
+}
 
+/* Sanitize configuration. Verify files and directory access, open logging
+ * files. Every path is registered first then checked once, in parallel,
+ * whatever the number of programs naming it: errors are reported in the order
+ * of the programs after the checks. Programs without stdout or stderr log to
+ * /dev/null. A log file is opened once for the whole taskmaster, see
+ * logfile.h, & can't be both rotated & written to without capture. */
+uint8_t sanitize_config(t_pgm *head_pgm) {
+  t_path_check check;
+  t_pgm_paths *paths;
+  t_pgm_usr *pgm;
+  uint32_t nb = 0, i = 0;
+  uint32_t tot_err = 0;
+
+  for (t_pgm *head = head_pgm; head; head = head->privy.next) nb++;
+  if (!nb) return EXIT_SUCCESS;
+  if (!(paths = malloc(nb * sizeof(*paths)))) handle_error("malloc");
+  if (path_check_init(&check)) handle_error("path_check_init");
+  for (t_pgm *head = head_pgm; head; head = head->privy.next, i++) {
+    pgm = &head->conf->usr;
+    paths[i] = (t_pgm_paths){CHECK_NONE, CHECK_NONE, CHECK_NONE, CHECK_NONE};
+    if (pgm->cmd && *pgm->cmd)
+      paths[i].cmd = path_check_add(&check, pgm->cmd[0], PATH_EXEC);
+    if (pgm->workingdir)
+      paths[i].workingdir = path_check_add(&check, pgm->workingdir, PATH_DIR);
+    paths[i].out = path_check_add(
+        &check, pgm->std_out ? pgm->std_out : "/dev/null", PATH_LOG);
+    paths[i].err = path_check_add(
+        &check, pgm->std_err ? pgm->std_err : "/dev/null", PATH_LOG);
+  }
+  path_check_run(&check);
+
+  i = 0;
+  for (t_pgm *head = head_pgm; head; head = head->privy.next, i++) {
+    pgm = &head->conf->usr;
     if (!pgm->cmd || !*(pgm->cmd))
-      tot_err++, key = KEY_CMD,
-                 err = print_san_err(pgm->name, key, MISSING_ERROR, NULL);
-    if (pgm->cmd) {
-      ret = stat(pgm->cmd[0], &statbuf);
-      if (ret == -1) {
-        tot_err++, key = KEY_CMD,
-                   err = print_san_err(pgm->name, key, 0, strerror(errno));
-      } else if (!ret) {
-        if (!S_ISREG(statbuf.st_mode))
-          tot_err++,
-              key = KEY_CMD,
-              err = print_san_err(pgm->name, key, 0, "Not a regular file");
-      }
-    }
-    if (pgm->workingdir) {
-      ret = stat(pgm->workingdir, &statbuf);
-      if (ret == -1) {
-        tot_err++, key = KEY_WORKINGDIR,
-                   err = print_san_err(pgm->name, key, 0, strerror(errno));
-      } else if (!ret) {
-        if (!S_ISDIR(statbuf.st_mode))
-          tot_err++, key = KEY_WORKINGDIR,
-                     err = print_san_err(pgm->name, key, 0, "Not a directory");
-      }
-    }
+      tot_err++, print_san_err(pgm->name, KEY_CMD, MISSING_ERROR, NULL);
+    tot_err += sanitize_path(pgm->name, KEY_CMD,
+                             path_check_get(&check, paths[i].cmd), NULL,
+                             false);
+    tot_err += sanitize_path(pgm->name, KEY_WORKINGDIR,
+                             path_check_get(&check, paths[i].workingdir), NULL,
+                             false);
     if (!pgm->numprocs)
-      tot_err++, key = KEY_NUMPROCS,
-                 err = print_san_err(pgm->name, key, MISSING_ERROR, NULL);
-    if (pgm->std_out) {
-      head->privy.log.out =
-          open(pgm->std_out, O_WRONLY | O_CREAT | O_APPEND, LOGFILE_PERM);
-      if (head->privy.log.out == -1) {
-        tot_err++, key = KEY_STDOUT,
-                   err = print_san_err(pgm->name, key, 0, strerror(errno));
-      }
-    }
-    if (pgm->std_err) {
-      head->privy.log.err =
-          open(pgm->std_err, O_WRONLY | O_CREAT | O_APPEND, LOGFILE_PERM);
-      if (head->privy.log.err == -1) {
-        tot_err++, key = KEY_STDERR,
-                   err = print_san_err(pgm->name, key, 0, strerror(errno));
-      }
-    }
+      tot_err++, print_san_err(pgm->name, KEY_NUMPROCS, MISSING_ERROR, NULL);
+    head->privy.log.out_plain = !OUTPUT_IS_CAPTURED(
+        pgm, pgm->std_out ? pgm->std_out : "/dev/null", pgm->out_rotate);
+    head->privy.log.err_plain = !OUTPUT_IS_CAPTURED(
+        pgm, pgm->std_err ? pgm->std_err : "/dev/null", pgm->err_rotate);
+    tot_err += sanitize_path(pgm->name, KEY_STDOUT,
+                             path_check_get(&check, paths[i].out),
+                             &head->privy.log.out, head->privy.log.out_plain);
+    tot_err += sanitize_path(pgm->name, KEY_STDERR,
+                             path_check_get(&check, paths[i].err),
+                             &head->privy.log.err, head->privy.log.err_plain);
   }
+  path_check_destroy(&check);
+  free(paths);
+  tot_err += sanitize_rotations(head_pgm, nb);
 
   if (tot_err) {
-    fprintf(stderr, "%d error%c detected\n", tot_err, tot_err > 1 ? 's' : '\0');
+    fprintf(stderr, "%u error%c detected\n", tot_err, tot_err > 1 ? 's' : '\0');
     return EXIT_FAILURE;
   }
   return EXIT_SUCCESS;
 }
 
-/* Set default values in blank variables of t_pgm */
+/* Set default values in blank variables of t_pgm. Log files are already
+ * opened by sanitize_config(). */
 uint8_t fulfill_config(t_pgm *head_pgm) {
   t_pgm_usr *pgm;
 
   for (t_pgm *head = head_pgm; head; head = head->privy.next) {
-    pgm = &head->usr;
+    pgm = &head->conf->usr;
     if (!pgm->env.array_val) {
       pgm->env.array_val = calloc(1, sizeof(*pgm->env.array_val));
       if (!pgm->env.array_val) handle_error("calloc");
       pgm->env.array_size++;
     }
-    if (!pgm->std_out) {
-      pgm->std_out = strdup("/dev/null");
-      if (!pgm->std_out) handle_error("strdup");
-      head->privy.log.out =
-          open(pgm->std_out, O_WRONLY | O_CREAT | O_APPEND, LOGFILE_PERM);
-      if ((head->privy.log.out) == -1) handle_error("open");
-    }
-    if (!pgm->std_err) {
-      pgm->std_err = strdup("/dev/null");
-      if (!pgm->std_err) handle_error("strdup");
-      head->privy.log.err =
-          open(pgm->std_err, O_WRONLY | O_CREAT | O_APPEND, LOGFILE_PERM);
-      if ((head->privy.log.out) == -1) handle_error("open");
-    }
+    if (!pgm->std_out && !(pgm->std_out = strdup("/dev/null")))
+      handle_error("strdup");
+    if (!pgm->std_err && !(pgm->std_err = strdup("/dev/null")))
+      handle_error("strdup");
     if (!pgm->stopsignal.nb) pgm->stopsignal = siglist[SIGTERM];
+    pgm_conf_fingerprint(head->conf);
   }
   return EXIT_SUCCESS;
 }
 
+/* Members of groups which aren't globs must name a program */
+static uint8_t sanitize_groups(t_tm_node *node, const t_pgm_index *index) {
+  char err_msg[ERR_MSG_BUF_SIZE];
+  uint8_t tot_err = 0;
+  const char *member;
+
+  for (t_group_conf *group = node->groups; group; group = group->next) {
+    for (uint32_t i = 0; i < group->nb_member; i++) {
+      member = group->member[i];
+      if (strpbrk(member, "*?[") ||
+          pgm_index_find(index, member, strlen(member)))
+        continue;
+      snprintf(err_msg, sizeof(err_msg), ": unknown program %s", member);
+      print_san_err(group->name, NO_KEY, VALUE_ERROR, err_msg);
+      tot_err++;
+    }
+  }
+  return tot_err > 0;
+}
+
 uint8_t init_thrd(t_tm_node *node) {
   t_thread_data *new_thrd, *current_thrd;
 
   for (t_pgm *pgm = node->head; pgm; pgm = pgm->privy.next) {
-    if (!pgm->usr.numprocs) continue;
-    new_thrd = calloc(pgm->usr.numprocs, sizeof(*new_thrd));
+    if (!pgm->conf->usr.numprocs) continue;
+    new_thrd = calloc(pgm->conf->usr.numprocs, sizeof(*new_thrd));
     if (!new_thrd) handle_error("calloc");
-    if (pthread_rwlock_init(&pgm->privy.rw_pgm, NULL))
-      handle_error("pthread_rwlock_init");
 
-    for (uint32_t i = 0; i < pgm->usr.numprocs; i++) {
+    for (uint32_t i = 0; i < pgm->conf->usr.numprocs; i++) {
       current_thrd = &new_thrd[i];
-      if (pthread_rwlock_init(&current_thrd->rw_thrd, NULL))
-        handle_error("pthread_rwlock_init");
-      if (pthread_barrier_init(&current_thrd->sync_barrier, NULL, 2))
-        handle_error("pthread_barrier_init");
-      if (pthread_mutex_init(&current_thrd->mtx_wakeup, NULL))
-        handle_error("pthread_mutex_init");
-      if (pthread_cond_init(&current_thrd->cond_wakeup, NULL))
-        handle_error("pthread_cond_init");
-      if (sem_init(&current_thrd->sync, 0, 0)) handle_error("sem_init");
-      if (pthread_mutex_init(&current_thrd->mtx_timer, NULL))
-        handle_error("pthread_mutex_init");
-      if (pthread_cond_init(&current_thrd->cond_timer, NULL))
-        handle_error("pthread_cond_init");
       current_thrd->rid = i;
       current_thrd->pgm = pgm;
-      current_thrd->node = node;
-      current_thrd->restart_counter = pgm->usr.startretries;
+      current_thrd->conf = pgm_conf_get(pgm->conf);
+      current_thrd->restart_counter = pgm->conf->usr.startretries;
     }
     pgm->privy.thrd = new_thrd;
+    pgm->privy.nb_thrd = pgm->conf->usr.numprocs;
   }
   return EXIT_SUCCESS;
 }
 
-uint8_t init_taskmaster(t_tm_node *node) {
-  if (load_config_file(node)) goto error;
+/* Builds the programs of a yaml document received by the add command into
+ * node, a scratch node: they are linked to the running taskmaster by the
+ * master thread. Groups can't be added. */
+uint8_t init_programs(t_tm_node *node, const char *yaml, size_t len) {
+  if (load_config_string(node, yaml, len)) goto error;
+  if (node->groups) {
+    fprintf(stderr, "%s: groups can't be added\n", node->tm_name);
+    goto error;
+  }
   if (sanitize_config(node->head)) goto error;
   if (fulfill_config(node->head)) goto error;
   if (init_thrd(node)) goto error;
+  return node->head ? EXIT_SUCCESS : EXIT_FAILURE;
+
+error:
+  destroy_pgm_list(&node->head);
+  destroy_group_list(&node->groups);
+  return EXIT_FAILURE;
+}
+
+/* Reads the whole configuration file, for its hash & to parse it */
+static char *read_config_file(t_tm_node *node, size_t *len) {
+  size_t cap = BUFSIZ, ret;
+  char *buf = NULL, *tmp;
+
+  *len = 0;
+  do {
+    if (*len == cap || !buf) {
+      cap *= 2;
+      if (!(tmp = realloc(buf, cap))) handle_error("realloc");
+      buf = tmp;
+    }
+    ret = fread(buf + *len, 1, cap - *len, node->config_file);
+    *len += ret;
+  } while (ret);
+  if (ferror(node->config_file)) {
+    fprintf(stderr, "%s: %s: %s\n", node->tm_name, node->config_path,
+            strerror(errno));
+    free(buf);
+    return NULL;
+  }
+  return buf;
+}
+
+/* Parses the configuration file & fills the defaults in. With a cache
+ * (-o), the programs are loaded from it as long as it was compiled from the
+ * same source, the source being parsed & compiled again otherwise. */
+static uint8_t load_config_cached(t_tm_node *node) {
+  uint64_t key;
+  size_t len;
+  char *yaml;
+  uint8_t ret;
+
+  if (!node->cache_path)
+    return load_config_file(node) || fulfill_config(node->head);
+  if (!(yaml = read_config_file(node, &len))) return EXIT_FAILURE;
+  key = conf_cache_key(yaml, len);
+  if (!conf_cache_load(node, node->cache_path, key)) {
+    free(yaml);
+    return EXIT_SUCCESS;
+  }
+  ret = load_config_string(node, yaml, len) || fulfill_config(node->head);
+  free(yaml);
+  if (!ret && conf_cache_write(node, node->cache_path, key))
+    fprintf(stderr, "%s: %s: %s\n", node->tm_name, node->cache_path,
+            strerror(errno)); /* the configuration itself is fine */
+  return ret;
+}
+
+/* taskmaster -C: compiles the configuration file into node->cache_path */
+uint8_t compile_config(t_tm_node *node) {
+  uint8_t ret = load_config_cached(node);
+
+  destroy_taskmaster(node);
+  return ret;
+}
+
+/* Loads the programs of the configuration file into node & builds their
+ * index into *index, not published: the caller publishes it or destroys it
+ * once checked. */
+static uint8_t load_programs(t_tm_node *node, t_pgm_index **index) {
+  startup_mark(node->startup, STARTUP_INIT);
+  if (load_config_cached(node)) return EXIT_FAILURE;
+  startup_mark(node->startup, STARTUP_PARSE);
+  if (sanitize_config(node->head)) return EXIT_FAILURE;
+  startup_mark(node->startup, STARTUP_SANITIZE);
+  if (init_thrd(node)) return EXIT_FAILURE;
+  *index = pgm_index_build(node->head, node->pgm_nb, node->pgm_ids,
+                           node->groups);
+  if (!*index || sanitize_groups(node, *index)) return EXIT_FAILURE;
+  startup_mark(node->startup, STARTUP_INIT_THRD);
+  return EXIT_SUCCESS;
+}
+
+/* Builds the programs & groups of the configuration file node->config_path
+ * into node, a scratch node, for a reload: the master thread compares them
+ * to the running ones. */
+uint8_t reload_programs(t_tm_node *node) {
+  t_pgm_index *index = NULL;
+  uint8_t ret;
+
+  if (!(node->config_file = fopen(node->config_path, "r"))) {
+    fprintf(stderr, "%s: %s: %s\n", node->tm_name, node->config_path,
+            strerror(errno));
+    return EXIT_FAILURE;
+  }
+  ret = load_programs(node, &index);
+  if (!ret && index->size != node->pgm_nb) {
+    fprintf(stderr, "%s: %s: program declared twice\n", node->tm_name,
+            node->config_path);
+    ret = EXIT_FAILURE;
+  }
+  fclose(node->config_file);
+  node->config_file = NULL;
+  pgm_index_destroy(index); /* only used for checks */
+  if (!ret) return EXIT_SUCCESS;
+  destroy_pgm_list(&node->head);
+  destroy_group_list(&node->groups);
+  return EXIT_FAILURE;
+}
+
+uint8_t init_taskmaster(t_tm_node *node) {
+  t_pgm_index *index = NULL;
+
+  if (load_programs(node, &index)) goto error;
+  atomic_store(&node->pgm_index, index); /* before the master thread runs */
   return EXIT_SUCCESS;
 
 error:
+  pgm_index_destroy(index);
   destroy_taskmaster(node);
   return EXIT_FAILURE;
 }
@@ -23,6 +23,16 @@ typedef enum e_keys {
   KEY_STOPSIGNAL,
   KEY_STARTTIME,
   KEY_STOPTIME,
+  KEY_CAPTURE,
+  KEY_STDOUT_MAXBYTES,
+  KEY_STDOUT_BACKUPS,
+  KEY_STDOUT_MAXAGE,
+  KEY_STDERR_MAXBYTES,
+  KEY_STDERR_BACKUPS,
+  KEY_STDERR_MAXAGE,
+  KEY_TAIL_BYTES,
+  KEY_STDOUT_COMPRESS,
+  KEY_STDERR_COMPRESS,
   KEY_NB_MAX, /* number of keys in a config file */
 } t_keys;
 
@@ -36,8 +46,16 @@ typedef struct s_config_parsing {
   t_keys key;          /* key number */
   uint8_t map_depth;   /* increments when a new field appears at a new level */
   uint8_t seq_depth;
+  uint8_t section; /* t_config_section being parsed */
 } t_config_parsing;
 
+/* sections at the top level of a config file */
+typedef enum e_config_section {
+  SECTION_NONE,
+  SECTION_PROGRAMS,
+  SECTION_GROUPS,
+} t_config_section;
+
 #define KEY_TYPE (0)
 #define VALUE_TYPE (1)
 #define TOGGLE_TYPE(value) \
@@ -49,10 +67,11 @@ typedef enum e_parsing_info_mask {
   MASK_STREAM = (1 << 0),
   MASK_DOC = (1 << 1),
   MASK_PGM = (1 << 2),
+  MASK_GROUPS = (1 << 3),
 } t_parsing_info_mask;
 
 #define PARSING_READY \
-  (0x7) /* value of t_config_parsing::info when all bits are set (0000 0111)*/
+  (0x3) /* value of t_config_parsing::info inside the document (0000 0011)*/
 
 #define YAML_MAX_EVENT (YAML_MAPPING_END_EVENT + 1)
 #define YAML_MAX_SCALAR_EVENT (5)
@@ -62,10 +81,13 @@ typedef enum e_parsing_info_mask {
 #define DECL_DATA_LOAD_HANDLER(name) \
   static uint8_t name(t_pgm_usr *pgm, const char *data)
 
-#define SAN_NUM_PROC_MAX (30)
+#define SAN_NUM_PROC_MAX (4096)
 #define SAN_RETRIES_MAX (128)
 #define SAN_STARTTIME_MAX (120) /* in seconds */
 #define SAN_STOPTIME_MAX (60)   /* in seconds */
+#define SAN_BACKUPS_MAX (99)
+#define SAN_MAXAGE_MAX (366 * 24 * 3600) /* in seconds */
+#define SAN_TAIL_MAX (1U << 20)          /* in bytes */
 
 #define LOGFILE_PERM (0755)
 
@@ -134,4 +156,16 @@ typedef enum e_config_error {
 ** -MAP
 ** -DOC
 ** -STR
+**
+** A 'groups' section may come before or after 'programs'. Each group is a
+** sequence - or a single scalar - of program names or globs:
+**
+** =VAL :groups
+** +MAP
+** =VAL :web
+** +SEQ
+** =VAL :nginx
+** =VAL :web_*
+** -SEQ
+** -MAP
 */
@@ -0,0 +1,109 @@
+/*
+ * Reference counted configuration snapshots of programs.
+ *
+ * t_pgm.conf holds one reference, each processus holds one on the snapshot
+ * it was started with, so a running processus keeps the timings & exit codes
+ * it was launched with until it is started again. Publishing a new snapshot
+ * is a single pointer swap: the reference of the pgm on the old one is
+ * dropped after an rcu grace period as the client may still be reading it.
+ *
+ * A snapshot carries two FNV-1a fingerprints of its fields, so that a reload
+ * tells unchanged programs apart without comparing them field by field:
+ * fp_launch covers what a processus is launched with, fp_conf every field
+ * but the name & numprocs, which a reload applies without any restart.
+ */
+
+#include "conf_cache.h"
+#include "taskmaster.h"
+
+t_pgm_conf *pgm_conf_new(void) {
+    t_pgm_conf *conf = calloc(1, sizeof(*conf));
+
+    if (!conf) return NULL;
+    atomic_init(&conf->refcount, 1);
+    return conf;
+}
+
+t_pgm_conf *pgm_conf_get(t_pgm_conf *conf) {
+    atomic_fetch_add_explicit(&conf->refcount, 1, memory_order_relaxed);
+    return conf;
+}
+
+void pgm_conf_put(t_pgm_conf *conf) {
+    if (!conf) return;
+    if (atomic_fetch_sub_explicit(&conf->refcount, 1, memory_order_acq_rel) !=
+        1)
+        return;
+    if (conf->cache)
+        conf_cache_put(conf->cache); /* usr points into the mapping */
+    else
+        destroy_pgm_user_attributes(&conf->usr);
+    free(conf);
+}
+
+static void pgm_conf_release(void *conf) { pgm_conf_put(conf); }
+
+#define FP_OFFSET (14695981039346656037ULL)
+#define FP_PRIME (1099511628211ULL)
+
+static uint64_t fp_bytes(uint64_t fp, const void *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        fp ^= ((const uint8_t *)data)[i];
+        fp *= FP_PRIME;
+    }
+    return fp;
+}
+
+/* NUL included, so that consecutive strings can't be confused */
+static uint64_t fp_str(uint64_t fp, const char *str) {
+    if (!str) return fp_bytes(fp, "\xff", 1);
+    return fp_bytes(fp, str, strlen(str) + 1);
+}
+
+#define FP_FIELD(fp, field) fp_bytes((fp), &(field), sizeof(field))
+
+/* Computes the fingerprints of a configuration once it is complete */
+void pgm_conf_fingerprint(t_pgm_conf *conf) {
+    const t_pgm_usr *usr = &conf->usr;
+    uint64_t fp = FP_OFFSET;
+    uint32_t nb = 0;
+
+    while (usr->cmd && usr->cmd[nb]) fp = fp_str(fp, usr->cmd[nb++]);
+    fp = FP_FIELD(fp, nb);
+    for (uint32_t i = 0; i < usr->env.array_size; i++)
+        fp = fp_str(fp, usr->env.array_val[i]);
+    fp = FP_FIELD(fp, usr->env.array_size);
+    fp = fp_str(fp, usr->std_out);
+    fp = fp_str(fp, usr->std_err);
+    fp = fp_str(fp, usr->workingdir);
+    fp = FP_FIELD(fp, usr->umask);
+    fp = FP_FIELD(fp, usr->capture);
+    fp = FP_FIELD(fp, usr->out_rotate.maxbytes);
+    fp = FP_FIELD(fp, usr->out_rotate.maxage);
+    fp = FP_FIELD(fp, usr->out_rotate.backups);
+    fp = FP_FIELD(fp, usr->out_rotate.compress);
+    fp = FP_FIELD(fp, usr->err_rotate.maxbytes);
+    fp = FP_FIELD(fp, usr->err_rotate.maxage);
+    fp = FP_FIELD(fp, usr->err_rotate.backups);
+    fp = FP_FIELD(fp, usr->err_rotate.compress);
+    fp = FP_FIELD(fp, usr->tail_bytes);
+    conf->fp_launch = fp;
+
+    fp = fp_bytes(fp, usr->exitcodes.array_val,
+                  usr->exitcodes.array_size * sizeof(int32_t));
+    fp = FP_FIELD(fp, usr->exitcodes.array_size);
+    fp = FP_FIELD(fp, usr->autorestart);
+    fp = FP_FIELD(fp, usr->startretries);
+    fp = FP_FIELD(fp, usr->autostart);
+    fp = FP_FIELD(fp, usr->stopsignal.nb);
+    fp = FP_FIELD(fp, usr->starttime);
+    fp = FP_FIELD(fp, usr->stoptime);
+    conf->fp_conf = fp;
+}
+
+/* Replaces the configuration of pgm. Master thread only */
+uint8_t pgm_conf_publish(t_tm_node *node, t_pgm *pgm, t_pgm_conf *conf) {
+    t_pgm_conf *old = atomic_exchange(&pgm->conf, conf);
+
+    return rcu_retire(&node->rcu, old, pgm_conf_release);
+}
@@ -0,0 +1,157 @@
+/*
+ * Index of the programs by name, id & group.
+ *
+ * Open addressing table with linear probing, keyed by the FNV-1a hash of the
+ * name: a lookup compares the stored hash before touching the name, so it
+ * costs one or two cache lines whatever the number of programs. Names are
+ * matched on their whole length. Groups & the set of all programs are
+ * compiled into bitsets of pgm ids when the index is built, so selecting
+ * them costs nothing more than a name lookup.
+ *
+ * The index is immutable once published: the master thread, the only
+ * updater, builds a new one when programs are added or removed and swaps it,
+ * the old one being freed after an rcu grace period. Outside of the master
+ * thread it must be read inside an rcu read section.
+ */
+
+#include "taskmaster.h"
+
+#define PGM_INDEX_MIN_CAP (16U)
+
+/* indexes are built by the master thread, & by the control thread for the
+ * checks of a reload */
+static atomic_uint_fast64_t g_index_gen;
+
+static uint32_t pgm_index_hash(const char *name, size_t len) {
+    uint32_t hash = 2166136261U;
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+static bool pgm_index_match(const t_pgm *pgm, const char *name, size_t len) {
+    const char *pgm_name = PGM_CONF(pgm)->usr.name;
+
+    return !strncmp(pgm_name, name, len) && !pgm_name[len];
+}
+
+/* Indexes the programs by name & id. Names already indexed are skipped: the
+ * first declaration wins. */
+static uint8_t pgm_index_fill(t_pgm_index *index, t_pgm *head) {
+    uint32_t mask = index->cap - 1, hash, i;
+    const char *name;
+    size_t len;
+
+    for (t_pgm *pgm = head; pgm; pgm = pgm->privy.next) {
+        name = PGM_CONF(pgm)->usr.name;
+        len = strlen(name);
+        hash = pgm_index_hash(name, len);
+        for (i = hash & mask; index->slot[i].pgm; i = (i + 1) & mask)
+            if (index->slot[i].hash == hash &&
+                pgm_index_match(index->slot[i].pgm, name, len))
+                break;
+        if (index->slot[i].pgm) continue;
+        if (pgm->privy.id >= index->nb_id) return EXIT_FAILURE;
+        index->slot[i] = (t_pgm_slot){.hash = hash, .pgm = pgm};
+        index->by_id[pgm->privy.id] = pgm;
+        pgm_set_add(index->all, pgm->privy.id);
+        index->size++;
+    }
+    return EXIT_SUCCESS;
+}
+
+/* Compiles each group into the set of the programs its members select */
+static uint8_t pgm_index_compile_groups(t_pgm_index *index,
+                                        const t_group_conf *groups) {
+    t_pgm_group *group;
+    t_pgm_set *glob;
+    t_pgm *pgm;
+
+    for (const t_group_conf *conf = groups; conf; conf = conf->next)
+        index->nb_group++;
+    if (!index->nb_group) return EXIT_SUCCESS;
+    index->group = calloc(index->nb_group, sizeof(*index->group));
+    if (!index->group) return EXIT_FAILURE;
+    group = index->group;
+    for (const t_group_conf *conf = groups; conf; conf = conf->next, group++) {
+        group->name = strdup(conf->name);
+        group->set = pgm_set_new(index->nb_id);
+        if (!group->name || !group->set) return EXIT_FAILURE;
+        for (uint32_t i = 0; i < conf->nb_member; i++) {
+            pgm = pgm_index_find(index, conf->member[i],
+                                 strlen(conf->member[i]));
+            if (pgm) {
+                pgm_set_add(group->set, pgm->privy.id);
+                continue;
+            }
+            if (!(glob = pgm_select_glob(index, conf->member[i])))
+                return EXIT_FAILURE;
+            pgm_set_merge(group->set, glob);
+            free(glob);
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/* Builds the index of the nb programs of the list, whose ids are lower than
+ * nb_id, & compiles the groups against them */
+t_pgm_index *pgm_index_build(t_pgm *head, uint32_t nb, uint32_t nb_id,
+                             const t_group_conf *groups) {
+    uint32_t cap = PGM_INDEX_MIN_CAP;
+    t_pgm_index *index;
+
+    while (cap < 2 * nb) cap <<= 1; /* load factor <= 0.5 */
+    index = calloc(1, sizeof(*index) + cap * sizeof(index->slot[0]));
+    if (!index) return NULL;
+    index->gen = atomic_fetch_add(&g_index_gen, 1) + 1;
+    index->cap = cap;
+    index->nb_id = nb_id;
+    index->by_id = calloc(nb_id ? nb_id : 1, sizeof(*index->by_id));
+    index->all = pgm_set_new(nb_id);
+    if (!index->by_id || !index->all || pgm_index_fill(index, head) ||
+        pgm_index_compile_groups(index, groups)) {
+        pgm_index_destroy(index);
+        return NULL;
+    }
+    return index;
+}
+
+void pgm_index_destroy(t_pgm_index *index) {
+    if (!index) return;
+    for (uint32_t i = 0; index->group && i < index->nb_group; i++) {
+        free(index->group[i].name);
+        free(index->group[i].set);
+    }
+    free(index->group);
+    free(index->all);
+    free(index->by_id);
+    free(index);
+}
+
+/* Program named by the len first bytes of name, NULL if none */
+t_pgm *pgm_index_find(const t_pgm_index *index, const char *name, size_t len) {
+    uint32_t hash = pgm_index_hash(name, len), mask = index->cap - 1;
+
+    for (uint32_t i = hash & mask; index->slot[i].pgm; i = (i + 1) & mask)
+        if (index->slot[i].hash == hash &&
+            pgm_index_match(index->slot[i].pgm, name, len))
+            return index->slot[i].pgm;
+    return NULL;
+}
+
+static void pgm_index_release(void *index) { pgm_index_destroy(index); }
+
+/* Indexes the current list of programs. Master thread only */
+uint8_t pgm_index_publish(t_tm_node *node) {
+    t_pgm_index *index, *old;
+
+    index = pgm_index_build(node->head, node->pgm_nb, node->pgm_ids,
+                            node->groups);
+    if (!index) return EXIT_FAILURE;
+    old = atomic_exchange(&node->pgm_index, index);
+    if (!old) return EXIT_SUCCESS;
+    return rcu_retire(&node->rcu, old, pgm_index_release);
+}
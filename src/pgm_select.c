@@ -0,0 +1,145 @@
+/*
+ * Selection of programs by the arguments of a command.
+ *
+ * An argument is a program name, a group ("group:<name>") or a glob
+ * (fnmatch(3) pattern, "*" selecting all programs). Each one resolves to a
+ * bitset of pgm ids: names thru the name index, groups & "*" to the sets
+ * compiled with the index, other globs by matching all names once per index,
+ * their set being kept in the cache of the calling thread. A whole command is
+ * then sent to the master thread as one event carrying the union of its
+ * sets.
+ */
+
+#include <fnmatch.h>
+
+#include "taskmaster.h"
+
+#define SELECT_PATTERN_MAX (256U) /* longest glob */
+
+/* ================================= bitsets ================================ */
+
+t_pgm_set *pgm_set_new(uint32_t nb_id) {
+    uint32_t nb_word = (nb_id + 63) / 64;
+    t_pgm_set *set = calloc(1, sizeof(*set) + nb_word * sizeof(set->word[0]));
+
+    if (!set) return NULL;
+    set->nb_word = nb_word;
+    return set;
+}
+
+void pgm_set_add(t_pgm_set *set, uint32_t id) {
+    if (id / 64 < set->nb_word) set->word[id / 64] |= 1ULL << (id % 64);
+}
+
+void pgm_set_merge(t_pgm_set *dst, const t_pgm_set *src) {
+    for (uint32_t i = 0; i < dst->nb_word && i < src->nb_word; i++)
+        dst->word[i] |= src->word[i];
+}
+
+bool pgm_set_is_empty(const t_pgm_set *set) {
+    for (uint32_t i = 0; i < set->nb_word; i++)
+        if (set->word[i]) return false;
+    return true;
+}
+
+/* Lowest id of set not lower than from, PGM_SET_END if none */
+uint32_t pgm_set_next(const t_pgm_set *set, uint32_t from) {
+    uint32_t i = from / 64;
+    uint64_t word;
+
+    if (i >= set->nb_word) return PGM_SET_END;
+    word = set->word[i] & (~0ULL << (from % 64));
+    while (!word) {
+        if (++i >= set->nb_word) return PGM_SET_END;
+        word = set->word[i];
+    }
+    return i * 64 + __builtin_ctzll(word);
+}
+
+/* ================================ selectors =============================== */
+
+static bool is_glob(const char *arg, size_t len) {
+    for (size_t i = 0; i < len; i++)
+        if (arg[i] == '*' || arg[i] == '?' || arg[i] == '[') return true;
+    return false;
+}
+
+/* Set of the programs matching pattern. NULL if out of memory */
+t_pgm_set *pgm_select_glob(const t_pgm_index *index, const char *pattern) {
+    t_pgm_set *set = pgm_set_new(index->nb_id);
+
+    if (!set) return NULL;
+    for (uint32_t id = 0; id < index->nb_id; id++)
+        if (index->by_id[id] &&
+            !fnmatch(pattern, PGM_CONF(index->by_id[id])->usr.name, 0))
+            pgm_set_add(set, id);
+    return set;
+}
+
+static const t_pgm_set *select_group(const t_pgm_index *index,
+                                     const char *name, size_t len) {
+    for (uint32_t i = 0; i < index->nb_group; i++)
+        if (!strncmp(index->group[i].name, name, len) &&
+            !index->group[i].name[len])
+            return index->group[i].set;
+    return NULL;
+}
+
+/* Set of a glob, resolved once per index by the calling thread */
+static const t_pgm_set *select_glob(const t_pgm_index *index,
+                                    t_select_cache *cache, const char *arg,
+                                    size_t len) {
+    char pattern[SELECT_PATTERN_MAX];
+    struct s_select_entry *entry;
+
+    if (len >= sizeof(pattern)) return NULL;
+    if (len == 1 && *arg == '*') return index->all;
+    memcpy(pattern, arg, len);
+    pattern[len] = '\0';
+    for (uint32_t i = 0; i < SELECT_CACHE_NB; i++) {
+        entry = &cache->entry[i];
+        if (entry->pattern && entry->gen == index->gen &&
+            !strcmp(entry->pattern, pattern))
+            return entry->set;
+    }
+    entry = &cache->entry[cache->next];
+    cache->next = (cache->next + 1) % SELECT_CACHE_NB;
+    free(entry->pattern);
+    free(entry->set);
+    *entry = (struct s_select_entry){.gen = index->gen,
+                                     .pattern = strdup(pattern),
+                                     .set = pgm_select_glob(index, pattern)};
+    if (!entry->pattern || !entry->set) handle_error("malloc");
+    return entry->set;
+}
+
+/* Adds the programs selected by the len first bytes of arg to set. Returns
+ * EXIT_FAILURE if it selects none. */
+uint8_t pgm_select(const t_pgm_index *index, t_select_cache *cache,
+                   const char *arg, size_t len, t_pgm_set *set) {
+    size_t prefix_len = strlen(SELECT_GROUP_PREFIX);
+    const t_pgm_set *selected;
+    t_pgm *pgm;
+
+    if ((pgm = pgm_index_find(index, arg, len))) {
+        pgm_set_add(set, pgm->privy.id);
+        return EXIT_SUCCESS;
+    }
+    if (len > prefix_len && !strncmp(arg, SELECT_GROUP_PREFIX, prefix_len))
+        selected = select_group(index, arg + prefix_len, len - prefix_len);
+    else if (is_glob(arg, len))
+        selected = select_glob(index, cache, arg, len);
+    else
+        return EXIT_FAILURE;
+    if (!selected || pgm_set_is_empty(selected)) return EXIT_FAILURE;
+    pgm_set_merge(set, selected);
+    return EXIT_SUCCESS;
+}
+
+void select_cache_destroy(t_select_cache *cache) {
+    for (uint32_t i = 0; i < SELECT_CACHE_NB; i++) {
+        free(cache->entry[i].pattern);
+        free(cache->entry[i].set);
+    }
+    bzero(cache, sizeof(*cache));
+}
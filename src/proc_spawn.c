@@ -0,0 +1,139 @@
+#include "proc_spawn.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+ * All backends give the same result: the child starts with an empty signal
+ * mask, in its working directory, with its umask & its stdout/stderr then
+ * execve() its program. If anything fails before execve() no processus is
+ * left: -1 is returned and *error is set to the errno of the failing call.
+ *
+ * Only one thread may spawn at a time: the clone()d child runs on a static
+ * stack.
+ */
+
+/* ================================= child ================================== */
+
+typedef struct s_spawn_child {
+    const t_spawn_attr *attr;
+    sigset_t mask;      /* restored in the child before execve() */
+    volatile int error; /* written by the child, shares memory with parent */
+} t_spawn_child;
+
+/* Configures & executes the child. Async-signal-safe only. Returns the errno
+ * of the failing call. */
+static int32_t child_exec(const t_spawn_attr *attr, const sigset_t *mask) {
+    sigprocmask(SIG_SETMASK, mask, NULL);
+    if (attr->umask) umask(attr->umask);
+    if (attr->workingdir && chdir(attr->workingdir) == -1) return errno;
+    if (dup2(attr->out, STDOUT_FILENO) == -1) return errno;
+    if (dup2(attr->err, STDERR_FILENO) == -1) return errno;
+    execve(attr->path, attr->argv, attr->envp);
+    return errno;
+}
+
+static int clone_child(void *arg) {
+    t_spawn_child *child = arg;
+
+    child->error = child_exec(child->attr, &child->mask);
+    _exit(127);
+}
+
+/* =============================== backends ================================= */
+
+static pid_t spawn_fork(const t_spawn_attr *attr, int32_t *error) {
+    int32_t pipefd[2], child_err = 0;
+    sigset_t empty;
+    pid_t pid;
+
+    /* execve() failure is reported thru a close-on-exec pipe */
+    if (pipe2(pipefd, O_CLOEXEC) == -1) {
+        *error = errno;
+        return -1;
+    }
+    sigemptyset(&empty);
+    pid = fork();
+    if (pid == 0) {
+        child_err = child_exec(attr, &empty);
+        write(pipefd[1], &child_err, sizeof(child_err));
+        _exit(127);
+    }
+    if (pid == -1) *error = errno;
+    close(pipefd[1]);
+    if (pid > 0 && read(pipefd[0], &child_err, sizeof(child_err)) > 0) {
+        waitpid(pid, NULL, 0);
+        *error = child_err;
+        pid = -1;
+    }
+    close(pipefd[0]);
+    return pid;
+}
+
+static pid_t spawn_vfork(const t_spawn_attr *attr, int32_t *error) {
+    static alignas(16) char stack[SPAWN_STACK_SIZE];
+    t_spawn_child child = {.attr = attr, .error = 0};
+    sigset_t all, old;
+    pid_t pid;
+
+    /* no signal handler may run on the borrowed memory of the child */
+    sigfillset(&all);
+    sigemptyset(&child.mask);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    pid = clone(clone_child, stack + sizeof(stack),
+                CLONE_VM | CLONE_VFORK | SIGCHLD, &child);
+    if (pid == -1) *error = errno;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    /* the parent resumes once the child called execve() or _exit() */
+    if (pid > 0 && child.error) {
+        waitpid(pid, NULL, 0);
+        *error = child.error;
+        pid = -1;
+    }
+    return pid;
+}
+
+static pid_t spawn_posix(const t_spawn_attr *attr, int32_t *error) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t spawnattr;
+    sigset_t empty;
+    pid_t pid = -1;
+
+    if (attr->umask) {
+        *error = ENOTSUP;
+        return -1;
+    }
+    sigemptyset(&empty);
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&spawnattr);
+    posix_spawnattr_setflags(&spawnattr, POSIX_SPAWN_SETSIGMASK);
+    posix_spawnattr_setsigmask(&spawnattr, &empty);
+    if (attr->workingdir)
+        posix_spawn_file_actions_addchdir_np(&actions, attr->workingdir);
+    posix_spawn_file_actions_adddup2(&actions, attr->out, STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, attr->err, STDERR_FILENO);
+    *error = posix_spawn(&pid, attr->path, &actions, &spawnattr, attr->argv,
+                         attr->envp);
+    posix_spawnattr_destroy(&spawnattr);
+    posix_spawn_file_actions_destroy(&actions);
+    return *error ? -1 : pid;
+}
+
+/* ================================== api =================================== */
+
+pid_t spawn_process(t_spawn_backend backend, const t_spawn_attr *attr,
+                    int32_t *error) {
+    static pid_t (*spawn[])(const t_spawn_attr *, int32_t *) = {
+        spawn_fork, spawn_vfork, spawn_posix};
+
+    *error = 0;
+    return spawn[backend](attr, error);
+}
@@ -0,0 +1,38 @@
+#ifndef PROC_SPAWN_H
+#define PROC_SPAWN_H
+
+#include <inttypes.h>
+#include <sys/types.h>
+
+#define SPAWN_STACK_SIZE (64 * 1024) /* stack of the clone()d child */
+
+/*
+ * How a processus is created:
+ * - SPAWN_FORK   legacy fork(). Copies the page tables of taskmaster so its
+ *                latency grows with the supervisor's memory mappings.
+ * - SPAWN_VFORK  clone(CLONE_VM | CLONE_VFORK): the child borrows the memory
+ *                of taskmaster until execve(), nothing is copied. Default.
+ * - SPAWN_POSIX  posix_spawn() with file actions. Can't set umask, so fails
+ *                with ENOTSUP when one is asked.
+ */
+typedef enum e_spawn_backend {
+    SPAWN_FORK,
+    SPAWN_VFORK,
+    SPAWN_POSIX,
+} t_spawn_backend;
+
+/* everything the child needs to be configured & executed */
+typedef struct s_spawn_attr {
+    const char *path;
+    char *const *argv;
+    char *const *envp;
+    mode_t umask;           /* 0 keeps the one of taskmaster */
+    const char *workingdir; /* NULL keeps the one of taskmaster */
+    int32_t out;            /* dup2()ed on STDOUT_FILENO */
+    int32_t err;            /* dup2()ed on STDERR_FILENO */
+} t_spawn_attr;
+
+pid_t spawn_process(t_spawn_backend backend, const t_spawn_attr *attr,
+                    int32_t *error);
+
+#endif
@@ -0,0 +1,85 @@
+/*
+ * Epoch based read-copy-update.
+ *
+ * A reader announces the epoch it enters its read section at in its own
+ * slot. The updater unpublishes an object, retires it with the current epoch
+ * then moves to the next one: readers entering after that can't see the
+ * object anymore. It is released once no reader is in a section entered at
+ * an epoch lower or equal to the one it was retired at.
+ *
+ * The slot store of a reader is ordered before its loads, and the unpublish
+ * of the updater before its scan of the slots (seq_cst), so a reader missed
+ * by the scan can only load the new pointer.
+ */
+
+#include "taskmaster.h"
+
+void rcu_init(t_rcu *rcu) {
+    bzero(rcu, sizeof(*rcu));
+    atomic_init(&rcu->epoch, 1);
+}
+
+/* Gives a reader slot to the calling thread. NULL if all slots are taken */
+t_rcu_reader *rcu_register(t_rcu *rcu) {
+    uint32_t slot = atomic_fetch_add(&rcu->nb_readers, 1);
+
+    if (slot >= RCU_MAX_READERS) return NULL;
+    return &rcu->reader[slot];
+}
+
+void rcu_read_lock(t_rcu *rcu, t_rcu_reader *reader) {
+    atomic_store(&reader->epoch, atomic_load(&rcu->epoch));
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+void rcu_read_unlock(t_rcu_reader *reader) {
+    atomic_store_explicit(&reader->epoch, 0, memory_order_release);
+}
+
+/* Defers release(ptr) after the grace period. ptr must be unpublished.
+ * Updater only. */
+uint8_t rcu_retire(t_rcu *rcu, void *ptr, void (*release)(void *)) {
+    t_rcu_retired *retired = malloc(sizeof(*retired));
+
+    if (!retired) return EXIT_FAILURE;
+    retired->ptr = ptr;
+    retired->release = release;
+    retired->epoch = atomic_fetch_add(&rcu->epoch, 1);
+    retired->next = rcu->retired;
+    rcu->retired = retired;
+    return EXIT_SUCCESS;
+}
+
+/* Releases the retired objects no reader can see anymore. Updater only */
+void rcu_reclaim(t_rcu *rcu) {
+    uint64_t oldest = UINT64_MAX, epoch;
+    uint32_t nb_readers = atomic_load(&rcu->nb_readers);
+    t_rcu_retired **link = &rcu->retired, *retired;
+
+    if (!rcu->retired) return;
+    if (nb_readers > RCU_MAX_READERS) nb_readers = RCU_MAX_READERS;
+    atomic_thread_fence(memory_order_seq_cst);
+    for (uint32_t i = 0; i < nb_readers; i++) {
+        epoch = atomic_load(&rcu->reader[i].epoch);
+        if (epoch && epoch < oldest) oldest = epoch;
+    }
+    while ((retired = *link)) {
+        if (retired->epoch < oldest) {
+            *link = retired->next;
+            retired->release(retired->ptr);
+            free(retired);
+        } else
+            link = &retired->next;
+    }
+}
+
+/* Releases everything retired. No reader may be left. */
+void rcu_destroy(t_rcu *rcu) {
+    t_rcu_retired *retired;
+
+    while ((retired = rcu->retired)) {
+        rcu->retired = retired->next;
+        retired->release(retired->ptr);
+        free(retired);
+    }
+}
@@ -0,0 +1,133 @@
+#include "reaper.h"
+
+#include <errno.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+
+/* ================================ pid index =============================== */
+
+/* fibonacci hashing of the pid on log2(cap) bits */
+static inline uint32_t pid_hash(pid_t pid, uint32_t cap) {
+    return ((uint32_t)pid * 2654435769U) >> (32 - __builtin_ctz(cap));
+}
+
+static void index_insert(t_pid_slot *index, uint32_t cap, pid_t pid,
+                         t_thread_data *thrd) {
+    uint32_t i = pid_hash(pid, cap);
+
+    while (index[i].pid && index[i].pid != pid) i = (i + 1) & (cap - 1);
+    index[i] = (t_pid_slot){pid, thrd};
+}
+
+static uint8_t index_grow(t_reaper *reaper) {
+    uint32_t cap = reaper->cap * 2;
+    t_pid_slot *index = calloc(cap, sizeof(*index));
+
+    if (!index) return EXIT_FAILURE;
+    for (uint32_t i = 0; i < reaper->cap; i++)
+        if (reaper->index[i].pid)
+            index_insert(index, cap, reaper->index[i].pid,
+                         reaper->index[i].thrd);
+    free(reaper->index);
+    reaper->index = index;
+    reaper->cap = cap;
+    return EXIT_SUCCESS;
+}
+
+static int64_t index_find(const t_reaper *reaper, pid_t pid) {
+    uint32_t i = pid_hash(pid, reaper->cap);
+
+    while (reaper->index[i].pid) {
+        if (reaper->index[i].pid == pid) return i;
+        i = (i + 1) & (reaper->cap - 1);
+    }
+    return -1;
+}
+
+/* Registers the pid of a freshly launched child. Load factor stays <= 1/2 */
+uint8_t reaper_watch(t_reaper *reaper, pid_t pid, t_thread_data *thrd) {
+    if ((reaper->size + 1) * 2 > reaper->cap)
+        if (index_grow(reaper)) return EXIT_FAILURE;
+    index_insert(reaper->index, reaper->cap, pid, thrd);
+    reaper->size++;
+    return EXIT_SUCCESS;
+}
+
+/* Removes pid, shifting back the following slots of its probe sequence so
+ * that no tombstone is needed */
+void reaper_unwatch(t_reaper *reaper, pid_t pid) {
+    uint32_t mask = reaper->cap - 1, hole, i, home;
+    int64_t found = index_find(reaper, pid);
+
+    if (found < 0) return;
+    hole = found;
+    i = (hole + 1) & mask;
+    while (reaper->index[i].pid) {
+        home = pid_hash(reaper->index[i].pid, reaper->cap);
+        /* slot i can fill the hole if its home isn't in ]hole, i] */
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            reaper->index[hole] = reaper->index[i];
+            hole = i;
+        }
+        i = (i + 1) & mask;
+    }
+    reaper->index[hole] = (t_pid_slot){0, NULL};
+    reaper->size--;
+}
+
+/* ================================= reaper ================================= */
+
+/* SIGCHLD must be blocked in every thread for the signalfd to receive it.
+ * Call it before any thread is created so that they inherit the mask. */
+uint8_t reaper_block_sigchld(void) {
+    sigset_t mask;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (pthread_sigmask(SIG_BLOCK, &mask, NULL)) return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+uint8_t reaper_init(t_reaper *reaper) {
+    sigset_t mask;
+
+    *reaper = (t_reaper){.sfd = -1, .cap = PID_INDEX_MIN_CAP};
+    reaper->index = calloc(reaper->cap, sizeof(*reaper->index));
+    if (!reaper->index) return EXIT_FAILURE;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    reaper->sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (reaper->sfd == -1) return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+void reaper_destroy(t_reaper *reaper) {
+    if (reaper->sfd >= 0) close(reaper->sfd);
+    DESTROY_PTR(reaper->index);
+    reaper->sfd = -1;
+}
+
+/* Called when the signalfd is readable. SIGCHLD are coalesced by the kernel
+ * so the signalfd is only drained, then every child whose state changed is
+ * collected. Never fails: EINTR is retried, ECHILD means nothing to reap and
+ * children unknown to the index are ignored. */
+void reaper_collect(t_reaper *reaper, t_reap_callback callback) {
+    struct signalfd_siginfo fdsi[16];
+    siginfo_t info;
+    int64_t slot;
+
+    while (read(reaper->sfd, fdsi, sizeof(fdsi)) > 0)
+        ;
+    while (true) {
+        info.si_pid = 0;
+        if (waitid(P_ALL, 0, &info, WEXITED | WSTOPPED | WCONTINUED | WNOHANG) ==
+            -1) {
+            if (errno == EINTR) continue;
+            if (errno != ECHILD) perror("waitid");
+            return;
+        }
+        if (!info.si_pid) return;
+        slot = index_find(reaper, info.si_pid);
+        if (slot >= 0) callback(reaper->index[slot].thrd, &info);
+    }
+}
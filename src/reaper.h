@@ -0,0 +1,39 @@
+#ifndef REAPER_H
+#define REAPER_H
+
+#include <signal.h>
+
+#include "taskmaster.h"
+
+#define PID_INDEX_MIN_CAP (64U) /* must be a power of 2 */
+
+/* slot of the pid index. pid 0 marks an empty slot */
+typedef struct s_pid_slot {
+    pid_t pid;
+    t_thread_data *thrd;
+} t_pid_slot;
+
+/*
+ * Central child reaper. SIGCHLD is blocked in every thread and read thru a
+ * signalfd polled by the reactor. Children are then collected with
+ * waitid(P_ALL, WNOHANG) and routed to the t_thread_data owning their pid
+ * thru an open addressing index (linear probing, backward shift deletion),
+ * which keeps the cost of an exit O(1) whatever the number of children.
+ */
+typedef struct s_reaper {
+    int32_t sfd;       /* signalfd of SIGCHLD */
+    uint32_t cap;      /* slots in index, a power of 2 */
+    uint32_t size;     /* pids stored in index */
+    t_pid_slot *index; /* pid -> t_thread_data */
+} t_reaper;
+
+typedef void (*t_reap_callback)(t_thread_data *thrd, const siginfo_t *info);
+
+uint8_t reaper_block_sigchld(void);
+uint8_t reaper_init(t_reaper *reaper);
+void reaper_destroy(t_reaper *reaper);
+uint8_t reaper_watch(t_reaper *reaper, pid_t pid, t_thread_data *thrd);
+void reaper_unwatch(t_reaper *reaper, pid_t pid);
+void reaper_collect(t_reaper *reaper, t_reap_callback callback);
+
+#endif
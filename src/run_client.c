@@ -1,163 +1,329 @@
 #include "run_client.h"
 
+#include <errno.h>
+#include <poll.h>
 #include <pthread.h>
+#include <sys/stat.h>
 
+#include "control.h"
 #include "ft_readline.h"
-#include "run_server.h"
 
 /* =============================== initialization =========================== */
 
 static void *destroy_str_array(char **array, uint32_t sz) {
-    while (--sz >= 0) {
+    while (sz--) {
         free(array[sz]);
         array[sz] = NULL;
     }
+    free(array);
     return NULL;
 }
 
-/* Add taskmaster commands and program names to completion */
-static char **get_completion(const t_tm_node *node, const t_tm_cmd *commands,
-                             uint32_t cmd_nb) {
+/* Add taskmaster commands and the program names received from the control
+ * socket, each NUL terminated, to completion */
+static char **get_completion(const t_tm_cmd *commands, const char *names,
+                             uint32_t len, uint32_t *cmd_nb) {
     uint32_t i = 0;
-    t_pgm *pgm = node->head;
-    char **completions = malloc(cmd_nb * sizeof(*completions));
+    char **completions;
 
-    if (!completions) return NULL;
+    *cmd_nb = TM_CMD_NB;
+    for (uint32_t off = 0; off < len; off += strlen(names + off) + 1)
+        (*cmd_nb)++;
+    if (!(completions = malloc(*cmd_nb * sizeof(*completions)))) return NULL;
 
     while (i < TM_CMD_NB) {
         completions[i] = strdup(commands[i].name);
         if (!completions[i]) return destroy_str_array(completions, i);
         i++;
     }
-    while (i < cmd_nb && pgm) {
-        completions[i] = strdup(pgm->usr.name);
+    for (uint32_t off = 0; i < *cmd_nb; off += strlen(names + off) + 1) {
+        completions[i] = strdup(names + off);
         if (!completions[i]) return destroy_str_array(completions, i);
-        pgm = pgm->privy.next;
         i++;
     }
     return completions;
 }
 
-/* ============================== command handlers ========================== */
+/* ============================= control socket ============================= */
 
-static char *get_next_word(const char *str) {
-    int32_t i = 0;
+static void err_reply(const t_tm_node *node, const t_tmp_header *header,
+                      const char *detail) {
+    static const char reply_errors[TMP_ERR_MAX][CMD_ERR_BUFSZ] = {
+        "\0",
+        "bad request",
+        "argument missing",
+        "bad argument",
+        "invalid configuration",
+        "taskmaster is exiting",
+        "out of memory",
+        "output not kept (tail_bytes)"};
+    const char *err = header->status < TMP_ERR_MAX
+                          ? reply_errors[header->status]
+                          : reply_errors[TMP_ERR_BAD_OP];
+
+    if (header->len && *detail)
+        fprintf(stderr, "%s: command error: %s (%s)\n", node->tm_name, err,
+                detail);
+    else
+        fprintf(stderr, "%s: command error: %s\n", node->tm_name, err);
+}
 
-    while (str[i] == ' ') i++;
-    if (i) return (char *)(str + i);
-    while (str[i] && str[i] != ' ') i++;
-    while (str[i] == ' ') i++;
-    if (!str[i]) return NULL;
-    return (char *)(str + i);
+/* Sends a request to the control socket & waits for its reply. header is
+ * overwritten by the one of the reply & its payload is returned in reply,
+ * to be freed. The shell stops once the connection is lost. */
+static uint8_t request(t_tm_node *node, t_tmp_header *header,
+                       const void *payload, uint8_t **reply) {
+    if (ctl_send(node->ctl_fd, header, payload) ||
+        ctl_recv(node->ctl_fd, header, reply)) {
+        fprintf(stderr, "%s: %s: %s\n", node->tm_name, node->ctl_path,
+                strerror(errno));
+        node->exit_maint = true;
+        return EXIT_FAILURE;
+    }
+    if (header->status == TMP_OK) return EXIT_SUCCESS;
+    err_reply(node, header, (char *)*reply);
+    DESTROY_PTR(*reply);
+    return EXIT_FAILURE;
 }
 
-static void add_event(t_tm_node *node, t_event event) {
-    UNUSED_PARAM(node);
-    sem_wait(&node->free_place);
-    pthread_mutex_lock(&node->mtx_queue);
-    node->event_queue[node->ev_queue_sz] = event;
-    node->ev_queue_sz++;
-    pthread_mutex_unlock(&node->mtx_queue);
-    sem_post(&node->new_event);
+/* Arguments of a command are sent as selectors, each NUL terminated. Returns
+ * the length of the payload. */
+static uint32_t args_to_payload(char *args) {
+    uint32_t len;
+
+    if (!args) return 0;
+    len = strlen(args);
+    for (uint32_t i = 0; i < len; i++)
+        if (args[i] == ' ') args[i] = 0;
+    return len + 1;
 }
 
-/* Compare pgm names with the current argument and returns the corresponding
- * pgm adress if it match */
-static t_pgm *get_pgm(const t_tm_node *node, char **args) {
-    if (!*args) return NULL;
-    for (t_pgm *pgm = node->head; pgm; pgm = pgm->privy.next) {
-        if (!strncmp(pgm->usr.name, *args, strlen(pgm->usr.name))) {
-            *args = get_next_word(*args);
-            return pgm;
-        }
+/* Sends the command on the programs selected by its arguments */
+static uint8_t send_selectors(t_tm_node *node, t_tm_cmd *cmd, t_tmp_op op) {
+    t_tmp_header header = {.op = op};
+    uint8_t *reply;
+
+    header.len = args_to_payload(cmd->args);
+    if (request(node, &header, cmd->args, &reply)) return EXIT_FAILURE;
+    free(reply);
+    return EXIT_SUCCESS;
+}
+
+/* Whole file as the payload of an add request */
+static char *read_config(const t_tm_node *node, const char *path,
+                         uint32_t *len) {
+    struct stat st;
+    char *yaml = NULL;
+    FILE *file = fopen(path, "r");
+
+    if (!file || fstat(fileno(file), &st) == -1) goto error;
+    if (st.st_size > TMP_MAX_REQUEST) {
+        errno = EFBIG;
+        goto error;
     }
+    if (!(yaml = malloc(st.st_size + 1))) goto error;
+    *len = fread(yaml, 1, st.st_size, file);
+    if (ferror(file)) goto error;
+    fclose(file);
+    return yaml;
+
+error:
+    fprintf(stderr, "%s: %s: %s\n", node->tm_name, path, strerror(errno));
+    free(yaml);
+    if (file) fclose(file);
     return NULL;
 }
 
-/* status can have 0 or 1 argument */
+/* ============================== command handlers ========================== */
+
+/* state of a processus as printed by status */
+static const char *proc_state(uint8_t state) {
+    static const char names[4][16] = {"stopped", "started", "starting",
+                                      "stopping"};
+
+    return names[((state == TMP_PROC_STARTED) * 1) +
+                 ((state == TMP_PROC_STARTING) * 2) +
+                 ((state == TMP_PROC_STOPPING) * 3)];
+}
+
+/* status can have 0 or many arguments. Without any, only the number of
+ * started processus of each program is asked for. */
 DECL_CMD_HANDLER(cmd_status) {
     t_tm_cmd *cmd = command;
-    char *args = cmd->args;
-    t_pgm *pgm;
-    t_thread_data *thrd;
-    const char state[4][16] = {"stopped", "started", "starting", "stopping"};
-    int32_t proc_st;
-
-    if (cmd->args) {
-        while ((pgm = get_pgm(node, &args))) {
-            printf("- %s:\n", pgm->usr.name);
-            for (int32_t i = pgm->usr.numprocs - 1; i >= 0; i--) {
-                thrd = &(pgm->privy.thrd[i]);
-                proc_st = ((GET_PROC_STATE == PROC_ST_STARTED) * 1) +
-                          ((GET_PROC_STATE == PROC_ST_STARTING) * 2) +
-                          ((GET_PROC_STATE == PROC_ST_STOPPING) * 3);
-                printf("pid <%d> - state <%s>\n", thrd->pid, state[proc_st]);
-            }
-        }
-    } else {
-        for (pgm = node->head; pgm; pgm = pgm->privy.next) {
-            uint32_t started = 0;
-            for (int32_t i = pgm->usr.numprocs - 1; i >= 0; i--) {
-                thrd = &(pgm->privy.thrd[i]);
-                started = started + (GET_PROC_STATE == PROC_ST_STARTED);
-            }
-            printf("%s - run <%u/%u>\n", pgm->usr.name, started,
-                   pgm->usr.numprocs);
+    t_tmp_header header = {.op = TMP_OP_STATUS};
+    const t_tmp_pgm *pgm;
+    const t_tmp_proc *proc;
+    const char *name;
+    uint8_t *reply;
+
+    header.len = args_to_payload(cmd->args);
+    if (!cmd->args) header.flags = TMP_FLAG_SUMMARY;
+    if (request(node, &header, cmd->args, &reply)) return EXIT_FAILURE;
+
+    for (uint32_t off = 0; off + sizeof(*pgm) <= header.len;
+         off += sizeof(*pgm) + TMP_ALIGN(pgm->name_len + 1) +
+                pgm->nb_proc * sizeof(*proc)) {
+        pgm = (const t_tmp_pgm *)(reply + off);
+        name = (const char *)(pgm + 1);
+        proc = (const t_tmp_proc *)(name + TMP_ALIGN(pgm->name_len + 1));
+        if (!cmd->args) {
+            printf("%s - run <%u/%u>\n", name, pgm->nb_started, pgm->numprocs);
+            continue;
         }
+        printf("- %s:\n", name);
+        for (int32_t i = pgm->nb_proc - 1; i >= 0; i--)
+            printf("pid <%d> - state <%s>\n", proc[i].pid,
+                   proc_state(proc[i].state));
     }
     fflush(stdout);
+    free(reply);
     return EXIT_SUCCESS;
 }
 
-/* start has many arguments which must match with a pgm name */
+/* start has many arguments which must select programs */
 DECL_CMD_HANDLER(cmd_start) {
-    t_tm_cmd *cmd = command;
-    char *args = cmd->args;
-    t_pgm *pgm;
-
-    while ((pgm = get_pgm(node, &args)))
-        add_event(node, (t_event){pgm, CLIENT_START});
-    return EXIT_SUCCESS;
+    return send_selectors(node, command, TMP_OP_START);
 }
 
-/* stop has many arguments which must match with a pgm name */
+/* stop has many arguments which must select programs */
 DECL_CMD_HANDLER(cmd_stop) {
-    t_tm_cmd *cmd = command;
-    char *args = cmd->args;
-    t_pgm *pgm;
-
-    while ((pgm = get_pgm(node, &args)))
-        add_event(node, (t_event){pgm, CLIENT_STOP});
-    return EXIT_SUCCESS;
+    return send_selectors(node, command, TMP_OP_STOP);
 }
 
-/* restart has many arguments which must match with a pgm name */
+/* restart has many arguments which must select programs */
 DECL_CMD_HANDLER(cmd_restart) {
-    t_tm_cmd *cmd = command;
-    char *args = cmd->args;
-    t_pgm *pgm;
+    return send_selectors(node, command, TMP_OP_RESTART);
+}
 
-    while ((pgm = get_pgm(node, &args)))
-        add_event(node, (t_event){pgm, CLIENT_RESTART});
+/* add has many arguments, yaml files whose programs are added */
+DECL_CMD_HANDLER(cmd_add) {
+    t_tm_cmd *cmd = command;
+    uint32_t len = args_to_payload(cmd->args);
+    t_tmp_header header;
+    uint8_t *reply;
+    char *yaml;
+
+    for (uint32_t off = 0; off < len; off += strlen(cmd->args + off) + 1) {
+        header = (t_tmp_header){.op = TMP_OP_ADD};
+        if (!(yaml = read_config(node, cmd->args + off, &header.len))) continue;
+        if (!request(node, &header, yaml, &reply)) free(reply);
+        free(yaml);
+    }
     return EXIT_SUCCESS;
 }
 
-/* reload config has 0 argument */
+/* del has many arguments which must select programs */
+DECL_CMD_HANDLER(cmd_del) {
+    return send_selectors(node, command, TMP_OP_DEL);
+}
+
+/* reload config has 0 argument. taskmaster reads its configuration file
+ * again & only applies what changed */
 DECL_CMD_HANDLER(cmd_reload) {
-    UNUSED_PARAM(node);
+    t_tmp_header header = {.op = TMP_OP_RELOAD};
+    uint8_t *reply;
+
     UNUSED_PARAM(command);
-    // appeler la fonction reload que j'ai faite dans l'autre tm
+    if (!request(node, &header, NULL, &reply)) free(reply);
     return EXIT_SUCCESS;
 }
 
 /* exit has 0 argument */
 DECL_CMD_HANDLER(cmd_exit) {
+    t_tmp_header header = {.op = TMP_OP_EXIT};
+    uint8_t *reply;
+
     UNUSED_PARAM(command);
-    add_event(node, (t_event){NULL, CLIENT_EXIT});
+    if (!request(node, &header, NULL, &reply)) free(reply);
     node->exit_maint = true;
     return EXIT_SUCCESS;
 }
 
+/* Prints the output of a followed tail as it comes, until a line is
+ * entered. The follow has its own connection, closed to end it. */
+static void tail_follow_loop(t_tm_node *node, int32_t fd) {
+    struct pollfd pfd[2] = {{.fd = fd, .events = POLLIN},
+                            {.fd = STDIN_FILENO, .events = POLLIN}};
+    t_tmp_header header;
+    uint8_t *reply;
+    char line[256];
+
+    while (poll(pfd, 2, -1) != -1 || errno == EINTR) {
+        if (pfd[1].revents) {
+            if (read(STDIN_FILENO, line, sizeof(line)) == -1) perror("read");
+            return;
+        }
+        if (!pfd[0].revents) continue;
+        if (ctl_recv(fd, &header, &reply)) {
+            fprintf(stderr, "%s: %s: %s\n", node->tm_name, node->ctl_path,
+                    strerror(errno));
+            return;
+        }
+        fwrite(reply, 1, header.len, stdout);
+        fflush(stdout);
+        free(reply);
+    }
+}
+
+/* tail <name>[:rid] [-f]: last output of a processus, rank 0 by default.
+ * With -f, its output is then printed as it comes. */
+DECL_CMD_HANDLER(cmd_tail) {
+    t_tm_cmd *cmd = command;
+    t_tmp_header header = {.op = TMP_OP_TAIL};
+    t_tmp_tail args = {0};
+    char *name = cmd->args, *opt, *rid, *end;
+    uint8_t *payload, *reply;
+    int32_t fd = node->ctl_fd;
+
+    if ((opt = strchr(name, ' '))) {
+        *opt++ = 0;
+        if (strcmp(opt, "-f")) {
+            fprintf(stderr, "%s: tail: %s: unknown option\n", node->tm_name,
+                    opt);
+            return EXIT_FAILURE;
+        }
+        header.flags = TMP_FLAG_FOLLOW;
+    }
+    if ((rid = strrchr(name, ':'))) {
+        args.rid = strtoul(rid + 1, &end, 10);
+        if (end == rid + 1 || *end) {
+            fprintf(stderr, "%s: tail: %s: bad rank\n", node->tm_name, rid + 1);
+            return EXIT_FAILURE;
+        }
+        *rid = 0;
+    }
+    header.len = sizeof(args) + strlen(name) + 1;
+    if (!(payload = malloc(header.len))) return EXIT_FAILURE;
+    memcpy(payload, &args, sizeof(args));
+    memcpy(payload + sizeof(args), name, header.len - sizeof(args));
+    if (header.flags && (fd = ctl_connect(node->ctl_path)) == -1) {
+        fprintf(stderr, "%s: %s: %s\n", node->tm_name, node->ctl_path,
+                strerror(errno));
+        free(payload);
+        return EXIT_FAILURE;
+    }
+    if (header.flags) {
+        if (!ctl_send(fd, &header, payload) && !ctl_recv(fd, &header, &reply)) {
+            if (header.status == TMP_OK) {
+                fwrite(reply, 1, header.len, stdout);
+                fflush(stdout);
+                tail_follow_loop(node, fd);
+            } else
+                err_reply(node, &header, (char *)reply);
+            free(reply);
+        } else
+            fprintf(stderr, "%s: %s: %s\n", node->tm_name, node->ctl_path,
+                    strerror(errno));
+        close(fd);
+    } else if (!request(node, &header, payload, &reply)) {
+        fwrite(reply, 1, header.len, stdout);
+        fflush(stdout);
+        free(reply);
+    }
+    free(payload);
+    return EXIT_SUCCESS;
+}
+
 /* help has 0 argument */
 DECL_CMD_HANDLER(cmd_help) {
     UNUSED_PARAM(node);
@@ -168,7 +334,12 @@ DECL_CMD_HANDLER(cmd_help) {
         "restart <name>\t\tRestart all processes\n"
         "status <name>\t\tGet status for <name> processes\n"
         "status\t\tGet status for all programs\n"
-        "exit\t\tExit the taskmaster shell and server.\n",
+        "add <file>\t\tAdd the programs of a yaml file\n"
+        "del <name>\t\tStop then remove programs\n"
+        "reload\t\tApply the changes of the configuration file\n"
+        "tail <name>[:rank] [-f]\tLast output of a processus, -f to follow\n"
+        "exit\t\tExit the taskmaster shell and server.\n"
+        "<name> is a program name, a glob (web_*, *) or group:<group>\n",
         stdout);
     fflush(stdout);
     return EXIT_SUCCESS;
@@ -176,7 +347,7 @@ DECL_CMD_HANDLER(cmd_help) {
 
 /* ========================== user input sanitizer ========================== */
 
-static void err_usr_input(t_tm_node *node, int32_t err) {
+static void err_usr_input(const t_tm_node *node, int32_t err) {
     static const char cmd_errors[CMD_ERR_NB][CMD_ERR_BUFSZ] = {
         "\0",
         "empty line",
@@ -189,51 +360,22 @@ static void err_usr_input(t_tm_node *node, int32_t err) {
     fprintf(stderr, "%s: command error: %s\n", node->tm_name, cmd_errors[err]);
 }
 
-/* Checks number and validity of arguments according to the command */
-static int32_t sanitize_arg(const t_tm_node *node, t_tm_cmd *command,
-                            const char *args) {
-    t_pgm *pgm;
-    int32_t i = 0, arg_len;
-    uint32_t match_nb = 0;
-    bool found;
-
-    while (args[i] == ' ') i++;
-    while (args[i]) {
-        found = false;
-        if (command->flag == NO_ARGS) return CMD_TOO_MANY_ARGS;
-
-        for (pgm = node->head; pgm && !found; pgm = pgm->privy.next) {
-            arg_len = strlen(pgm->usr.name);
-            if (!strncmp(args + i, pgm->usr.name, arg_len) &&
-                (args[i + arg_len] == ' ' || args[i + arg_len] == 0)) {
-                if (match_nb == node->pgm_nb) return CMD_TOO_MANY_ARGS;
-                if (!match_nb) command->args = (char *)(args + i);
-                match_nb++;
-                found = true;
-                i += arg_len;
-            }
-        }
-
-        if (!found) return CMD_BAD_ARG;
-        while (args[i] == ' ') i++;
-    }
-
-    if (command->flag == MANY_ARGS && !match_nb) return CMD_ARG_MISSING;
-    return EXIT_SUCCESS;
-}
-
-/* Search for a registered command & sanitize its args */
-static int32_t find_cmd(const t_tm_node *node, t_tm_cmd *command,
-                        const char *line) {
-    int32_t cmd_len, ret;
+/* Search for a registered command & check its number of arguments. Their
+ * validity is checked by the server. */
+static int32_t find_cmd(t_tm_cmd *command, char *line) {
+    int32_t cmd_len;
 
     if (!line[0]) return CMD_EMPTY_LINE;
     for (int32_t i = 0; i < TM_CMD_NB; i++) {
         cmd_len = strlen(command[i].name);
         if (!strncmp(line, command[i].name, cmd_len) &&
             (line[cmd_len] == ' ' || !line[cmd_len])) {
-            ret = sanitize_arg(node, &command[i], line + cmd_len);
-            return ((i * (ret >= 0)) + (ret * (ret < 0)));
+            if (line[cmd_len]) command[i].args = line + cmd_len + 1;
+            if (command[i].flag == NO_ARGS && command[i].args)
+                return CMD_TOO_MANY_ARGS;
+            if (command[i].flag == MANY_ARGS && !command[i].args)
+                return CMD_ARG_MISSING;
+            return i;
         }
     }
     return CMD_NOT_FOUND;
@@ -291,28 +433,44 @@ static inline void clean_command(t_tm_cmd *command) {
     for (int32_t i = 0; i < TM_CMD_NB; i++) command[i].args = NULL;
 }
 
-#include "run_server.h"
-
-/* Main client function. Reads, sanitize & execute client input */
+/* Main client function. Reads, sanitize & sends client input to the control
+ * socket, then prints the replies. Beside the server, joins the master
+ * thread once the shell is done. */
 uint8_t run_client(t_tm_node *node) {
     char *line = NULL;
     char **completion = NULL;
-    int32_t cmd_nb = TM_CMD_NB + node->pgm_nb, hdlr_type;
-    t_tm_cmd command[TM_CMD_NB] = {{cmd_status, "status", FREE_NB_ARGS, 0},
-                                   {cmd_start, "start", MANY_ARGS, 0},
-                                   {cmd_stop, "stop", MANY_ARGS, 0},
-                                   {cmd_restart, "restart", MANY_ARGS, 0},
-                                   {cmd_reload, "reload", NO_ARGS, 0},
-                                   {cmd_exit, "exit", NO_ARGS, 0},
-                                   {cmd_help, "help", NO_ARGS, 0}};
-
-    completion = get_completion(node, command, cmd_nb);
-    ft_readline_add_completion(completion, cmd_nb);
+    uint32_t cmd_nb;
+    int32_t hdlr_type;
+    t_tmp_header header = {.op = TMP_OP_LIST};
+    uint8_t *names;
+    t_tm_cmd command[TM_CMD_NB] = {
+        {cmd_status, "status", FREE_NB_ARGS, NULL},
+        {cmd_start, "start", MANY_ARGS, NULL},
+        {cmd_stop, "stop", MANY_ARGS, NULL},
+        {cmd_restart, "restart", MANY_ARGS, NULL},
+        {cmd_add, "add", MANY_ARGS, NULL},
+        {cmd_del, "del", MANY_ARGS, NULL},
+        {cmd_reload, "reload", NO_ARGS, NULL},
+        {cmd_tail, "tail", MANY_ARGS, NULL},
+        {cmd_exit, "exit", NO_ARGS, NULL},
+        {cmd_help, "help", NO_ARGS, NULL}};
+
+    if ((node->ctl_fd = ctl_connect(node->ctl_path)) == -1) {
+        fprintf(stderr, "%s: %s: %s\n", node->tm_name, node->ctl_path,
+                strerror(errno));
+        if (node->control) exit(EXIT_FAILURE); /* nothing could stop it */
+        return EXIT_FAILURE;
+    }
+    if (!request(node, &header, NULL, &names)) {
+        completion = get_completion(command, (char *)names, header.len, &cmd_nb);
+        if (completion) ft_readline_add_completion(completion, cmd_nb);
+        free(names);
+    }
 
     while (!node->exit_maint && (line = ft_readline("taskmaster$ ")) != NULL) {
         ft_readline_add_history(line);
         format_user_input(line); /* maybe use this only to send to a client */
-        hdlr_type = find_cmd(node, command, line);
+        hdlr_type = find_cmd(command, line);
 
         if (hdlr_type >= 0) {
             command[hdlr_type].handler(node, &command[hdlr_type]);
@@ -321,6 +479,7 @@ uint8_t run_client(t_tm_node *node) {
         clean_command(command);
         free(line);
     }
-    if (pthread_join(node->master_thrd, NULL)) perror("pthread_join");
+    if (node->control && pthread_join(node->master_thrd, NULL))
+        perror("pthread_join");
     return EXIT_SUCCESS;
 }
@@ -3,7 +3,7 @@
 
 #include "taskmaster.h"
 
-#define TM_CMD_NB (7)      /* number of commands of taskmaster */
+#define TM_CMD_NB (10)     /* number of commands of taskmaster */
 #define TM_CMD_BUF_SZ (32) /* buf size to store command names */
 
 typedef uint8_t (*cmd_handler)(t_tm_node *node, void *command);
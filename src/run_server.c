@@ -1,413 +1,343 @@
 #include "run_server.h"
 
+#include <errno.h>
 #include <pthread.h>
+#include <signal.h>
+#include <sys/epoll.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/wait.h>
 
-/*================================= getters ==================================*/
+/*================================== timers ==================================*/
 
-THRD_DATA_GET_IMPLEMENTATION(uint32_t)
-THRD_DATA_GET_IMPLEMENTATION(int32_t)
-THRD_DATA_GET_IMPLEMENTATION(pid_t)
-THRD_DATA_GET_IMPLEMENTATION(pthread_t)
-THRD_DATA_GET_IMPLEMENTATION(tm_timeval_t)
-
-PGM_SPEC_GET_IMPLEMENTATION(uint32_t)
-PGM_SPEC_GET_IMPLEMENTATION(int32_Ptr)
-PGM_SPEC_GET_IMPLEMENTATION(uint8_t)
-PGM_SPEC_GET_IMPLEMENTATION(bool)
-PGM_SPEC_GET_IMPLEMENTATION(t_autorestart)
-PGM_SPEC_GET_IMPLEMENTATION(char_Ptr)
-PGM_SPEC_GET_IMPLEMENTATION(tm_timeval_t)
-
-/*=================================== utils ==================================*/
-
-/* time diff in ms */
-static uint32_t timediff(struct timeval *time1) {
-    struct timeval time2;
-
-    gettimeofday(&time2, NULL);
-    return (((time2.tv_sec - time1->tv_sec) * 1000000) +
-            (time2.tv_usec - time1->tv_usec)) /
-           1000;
+/* Arms the deadline of the processus to fire in 'ms' milliseconds */
+static void proc_timer_set(t_thread_data *thrd, t_proc_timer type,
+                           uint32_t ms) {
+    tw_timer_add(thrd->pgm->privy.node->wheel, &thrd->deadline, ms);
+    thrd->timer = type;
 }
 
-static uint32_t timediff2(struct timeval time1) {
-    struct timeval time2;
-
-    gettimeofday(&time2, NULL);
-    return (((time2.tv_sec - time1.tv_sec) * 1000000) +
-            (time2.tv_usec - time1.tv_usec)) /
-           1000;
+static void proc_timer_clear(t_thread_data *thrd) {
+    tw_timer_del(&thrd->deadline);
+    thrd->timer = TIMER_NONE;
 }
 
-/*================================ timer thread ==============================*/
+/*============================== state machine ===============================*/
 
-/* checks if the process is stopped in the given time otherwise it sends a kill
- * signal. To be sure the signal is catched, it is sent in a loop during 1 sec
- * if ever the proc is still alive. */
-static uint8_t stop_time(t_thread_data *thrd) {
-    struct timeval stop;
+static void proc_stopped(t_thread_data *thrd);
 
-    /* in the case of a processus stopping without client event, stopped state
-     * is set directly after the waitpid() and we don't want to time it */
-    if (GET_PROC_STATE == PROC_ST_STOPPED) return EXIT_SUCCESS;
+/* The io thread is started by the first captured launch, then published
+ * to the control thread which reads the tails */
+static t_capture *capture_get(t_tm_node *node) {
+    t_capture *capture = node->capture;
 
-    SET_PROC_STATE(PROC_ST_STOPPING);
-    pthread_mutex_unlock(&thrd->mtx_timer);
-    sem_wait(&thrd->sync); /* sync with stop_signal() */
-    pthread_mutex_lock(&thrd->mtx_timer);
-    while ((THRD_DATA_GET(pid_t, pid) > 0) &&
-           timediff2((PGM_SPEC_GET_T(tm_timeval_t, privy.stop_timestamp))) <
-               PGM_SPEC_GET_T(uint32_t, usr.stoptime))
-        usleep(STOP_SUPERVISOR_RATE);
-
-    gettimeofday(&stop, NULL);
-    if (THRD_DATA_GET(pid_t, pid)) {
-        THRD_DATA_SET(restart_counter, 0);
-        while (THRD_DATA_GET(pid_t, pid) && timediff(&stop) < KILL_TIME_LIMIT) {
-            kill(THRD_DATA_GET(pid_t, pid), SIGKILL);
-            usleep(STOP_SUPERVISOR_RATE);
-        }
-        if (timediff(&stop) > KILL_TIME_LIMIT) {
-            TM_STOP_LOG("ERR: TASKMASTER DIDN'T SUCCEEDED TO KILL THE PROC");
-        } else
-            TM_STOP_LOG("PROCESSUS HAD BEEN KILLED");
-    } else
-        TM_STOP_LOG("PROCESSUS STOPPED AS EXPECTED");
+    if (capture) return capture;
+    if (!(capture = malloc(sizeof(*capture)))) return NULL;
+    if (capture_init(capture)) {
+        free(capture);
+        return NULL;
+    }
+    node->capture = capture;
+    return capture;
+}
 
-    SET_PROC_STATE(PROC_ST_STOPPED);
+/* Replaces the log file 'fd' of a processus by a pipe to it if the output
+ * is captured: by the capture key, to be rotated or kept in a tail.
+ * /dev/null is left alone unless kept in a tail. */
+static uint8_t capture_pipe(t_tm_node *node, const t_pgm_usr *conf,
+                            t_logfile *log, const char *path,
+                            const t_rotate *rotate, t_tail *tail,
+                            int32_t *fd) {
+    int32_t pipe_fd;
+
+    if (!OUTPUT_IS_CAPTURED(conf, path, *rotate)) return EXIT_SUCCESS;
+    if (!capture_get(node)) return EXIT_FAILURE;
+    pipe_fd = capture_open(node->capture, log, path, rotate, tail);
+    if (pipe_fd == -1) return EXIT_FAILURE;
+    *fd = pipe_fd;
     return EXIT_SUCCESS;
 }
 
-/* This joinable thread is a timer which is coupled with its launcher thread.
- * It checks if the processus is launched correctly, then wait for a restart or
- * an exit, to count the stop time. */
-static void *timer(void *arg) {
-    t_thread_data *thrd = arg;
-    struct timeval started;
-    bool init = false;
+/* Pipes of the outputs of a processus, sharing its tail if it has one */
+static uint8_t capture_pipes(t_thread_data *thrd, t_spawn_attr *attr) {
+    t_tm_node *node = thrd->pgm->privy.node;
+    const t_pgm_usr *conf = &thrd->conf->usr;
+    t_tail *tail = NULL;
+    uint8_t ret;
+
+    if (conf->tail_bytes &&
+        (!capture_get(node) ||
+         !(tail = capture_tail_open(node->capture, thrd->pgm->privy.id,
+                                    thrd->rid, conf->tail_bytes))))
+        return EXIT_FAILURE;
+    ret = capture_pipe(node, conf, thrd->pgm->privy.log.out, conf->std_out,
+                       &conf->out_rotate, tail, &attr->out) ||
+          capture_pipe(node, conf, thrd->pgm->privy.log.err, conf->std_err,
+                       &conf->err_rotate, tail, &attr->err);
+    tail_put(tail);
+    return ret;
+}
+
+/* Creates the child with the configuration asked from config file - umask,
+ * working directory, file logging - and execve() the process. The child is
+ * clone()d with CLONE_VM | CLONE_VFORK: no page table copy from a threaded
+ * supervisor, nor any unsafe call in a forked copy of it (see proc_spawn.c). */
+static pid_t configure_and_launch(t_thread_data *thrd, int32_t *error) {
+    t_pgm_usr *conf = &thrd->conf->usr;
+    const int32_t out = thrd->pgm->privy.log.out->fd;
+    const int32_t err = thrd->pgm->privy.log.err->fd;
+    t_spawn_attr attr = {
+        .path = conf->cmd[0],
+        .argv = conf->cmd,
+        .envp = (char **)conf->env.array_val,
+        .umask = conf->umask,
+        .workingdir = conf->workingdir,
+        .out = out,
+        .err = err,
+    };
     pid_t pid;
 
-idle_timer:
-    pthread_barrier_wait(&thrd->sync_barrier);
-    pthread_mutex_lock(&thrd->mtx_wakeup);
-    if (!init) {
-        init = true;
-        /* sync thread_pool creation with start*/
-        sem_post(&thrd->sync);
-    }
-    /* Waits for MT to signal a start */
-    pthread_cond_wait(&thrd->cond_wakeup, &thrd->mtx_wakeup);
-    pthread_mutex_unlock(&thrd->mtx_wakeup);
-    if (GET_THRD_EVENT == THRD_EV_EXIT) return NULL;
-start_timer:
-    pthread_barrier_wait(&thrd->sync_barrier);
-    pthread_mutex_lock(&thrd->mtx_timer);
-    SET_PROC_STATE(PROC_ST_STARTING); /* Careful: this clears thread_event */
-    sem_post(&thrd->sync); /* sync launcher thread with timer at init */
-wait:
-    if (GET_THRD_EVENT) {
-        stop_time(thrd);
-        goto check_ret;
+    if (capture_pipes(thrd, &attr)) {
+        *error = errno;
+        if (attr.out != out) close(attr.out);
+        return -1;
     }
+    pid = spawn_process(SPAWN_VFORK, &attr, error);
+    if (attr.out != out) close(attr.out);
+    if (attr.err != err) close(attr.err);
+    return pid;
+}
 
-    pthread_cond_wait(&thrd->cond_timer, &thrd->mtx_timer);
-
-    if (GET_THRD_EVENT) {
-        stop_time(thrd);
-        goto check_ret;
-    }
+/* Update information of the thread_data struct related to one process - the
+ * timestamp, pid & restart_counter - and register the child to the reaper. */
+static void thread_data_update(t_thread_data *thrd, pid_t pid) {
+    time_t start = time(NULL);
+
+    thrd_write_begin(thrd);
+    thrd->start_timestamp = start;
+    thrd->pid = pid;
+    thrd->restart_counter--;
+    thrd_write_end(thrd);
+    thrd->pgm->privy.nb_proc_alive++;
+    thrd->pgm->privy.node->nb_proc_alive++;
+    if (reaper_watch(thrd->pgm->privy.node->reaper, pid, thrd))
+        handle_error("reaper_watch");
+}
 
-    started = THRD_DATA_GET(tm_timeval_t, start_timestamp);
-    pid = THRD_DATA_GET(pid_t, pid);
+/* Spawns the processus then times its start. A spawn failure - bad cmd or
+ * workingdir, no more pid - counts as a failed launch. */
+static void proc_launch(t_thread_data *thrd) {
+    int32_t error;
+    pid_t pid;
 
-    SET_PROC_STATE(PROC_ST_STARTING);
-    while (timediff(&started) < PGM_SPEC_GET_T(uint32_t, usr.starttime)) {
-        if (GET_THRD_EVENT) {
-            TM_START_LOG("EXITED BEFORE TIME TO LAUNCH");
-            stop_time(thrd);
-            goto check_ret;
-        }
-        if (GET_PROC_STATE == PROC_ST_STOPPED) {
-            TM_START_LOG("DIDN'T STARTED CORRECTLY");
-            goto wait;
-        }
-        usleep(START_SUPERVISOR_RATE);
+    pid = configure_and_launch(thrd, &error);
+    if (pid == -1) {
+        THRD_DATA_SET(restart_counter, thrd->restart_counter - 1);
+        if (thrd->pgm->privy.node->journal)
+            TM_JOURNAL(JRN_EV_SPAWN_FAILED, error);
+        else
+            TM_LOG("launcher",
+                   "[%s] - rank[%u] - restart_counter[%d] • [%s: %s]",
+                   thrd->conf->usr.name, thrd->rid, thrd->restart_counter,
+                   g_jrn_event[JRN_EV_SPAWN_FAILED].str, strerror(error));
+        proc_stopped(thrd);
+        return;
     }
-    SET_PROC_STATE(PROC_ST_STARTED);
+    thread_data_update(thrd, pid);
+    TM_THRD_LOG(JRN_EV_LAUNCHED);
+    proc_timer_set(thrd, TIMER_START, thrd->conf->usr.starttime);
+}
 
-    TM_START_LOG("STARTED CORRECTLY");
-    goto wait;
+/* Starts a fresh workflow with the current configuration of the pgm: reset
+ * restart_counter and launch the processus */
+static void proc_start(t_thread_data *thrd) {
+    t_pgm_conf *conf = PGM_CONF(thrd->pgm);
 
-check_ret:
-    if (GET_THRD_EVENT == THRD_EV_NOEVENT || GET_THRD_EVENT == THRD_EV_STOP) {
-        pthread_mutex_unlock(&thrd->mtx_timer);
-        goto idle_timer;
-    } else if (GET_THRD_EVENT == THRD_EV_RESTART) {
-        pthread_mutex_unlock(&thrd->mtx_timer);
-        goto start_timer;
+    if (thrd->conf != conf) {
+        pgm_conf_put(thrd->conf);
+        thrd->conf = pgm_conf_get(conf);
     }
-    pthread_mutex_unlock(&thrd->mtx_timer);
-    return NULL;
+    THRD_DATA_SET(restart_counter, thrd->conf->usr.startretries + 1);
+    SET_PROC_STATE(PROC_ST_STARTING); /* Careful: this clears thread_event */
+    proc_launch(thrd);
 }
 
-/*============================= launcher thread ==============================*/
-
-/* Set pid & tid of the related thread_data structure to 0 */
-static void exit_thread(t_thread_data *thrd) {
-    if (!thrd) return;
-    THRD_DATA_SET(pid, 0);
-    /* thrd->pgm->privy.nb_thread_alive--; */
-}
+/* Asks a processus to stop with its stopsignal and arms its stoptime
+ * deadline. The event tells what to do once it is stopped. If there is no
+ * processus alive (idle or waiting for an auto restart) the event is handled
+ * right away. */
+static void proc_stop(t_thread_data *thrd, uint8_t event) {
+    SET_THRD_EVENT(event);
+    THRD_DATA_SET(restart_counter, 0);
+    if (!thrd->pid) {
+        proc_timer_clear(thrd);
+        SET_PROC_STATE(PROC_ST_STOPPED);
+        if (event == THRD_EV_RESTART) proc_start(thrd);
+        return;
+    }
+    /* the stop timer already runs, the new event is taken at its end */
+    if (GET_PROC_STATE == PROC_ST_STOPPING) return;
+    if (GET_PROC_STATE == PROC_ST_STARTING)
+        TM_START_LOG(JRN_EV_EXITED_BEFORE_START);
 
-static void *exit_launcher_thread(t_thread_data *thrd) {
-    if (pthread_join(THRD_DATA_GET(pthread_t, timer_id), NULL))
-        perror("pthread_join");
-    exit_thread(thrd);
-    TM_THRD_LOG("EXITED");
-    return NULL;
+    SET_PROC_STATE(PROC_ST_STOPPING);
+    thrd->killed = false;
+    kill(thrd->pid, thrd->conf->usr.stopsignal.nb);
+    proc_timer_set(thrd, TIMER_STOP, thrd->conf->usr.stoptime);
 }
 
-/* wait for child to exit() or to be killed by any signal */
-static int32_t child_control(t_thread_data *thrd, pid_t pid) {
-    int32_t w, wstatus, child_ret = 0;
-    uint8_t expected = false;
-
-    do {
-        w = waitpid(pid, &wstatus, WUNTRACED | WCONTINUED);
-        if (w == -1) handle_error("waitpid");
-        if (WIFEXITED(wstatus)) {
-            child_ret = WEXITSTATUS(wstatus);
-            for (uint16_t i = 0;
-                 !expected &&
-                 i < PGM_SPEC_GET_T(uint32_t, usr.exitcodes.array_size);
-                 i++)
-                expected =
-                    child_ret ==
-                    PGM_SPEC_GET_T(int32_Ptr, usr.exitcodes.array_val)[i];
-            if (expected) {
-                if (PGM_SPEC_GET_T(t_autorestart, usr.autorestart) ==
-                    autorestart_unexpected)
-                    THRD_DATA_SET(restart_counter, 0);
-                TM_CHILDCONTROL_LOG("EXITED WITH EXPECTED STATUS");
-            } else
-                TM_CHILDCONTROL_LOG("EXITED WITH UNEXPECTED STATUS");
-        } else if (WIFSIGNALED(wstatus)) {
-            child_ret = WTERMSIG(wstatus);
-            TM_CHILDCONTROL_LOG("KILLED BY SIGNAL");
-        } else if (WIFSTOPPED(wstatus)) {
-            child_ret = WSTOPSIG(wstatus);
-            TM_CHILDCONTROL_LOG("STOPPED BY SIGNAL");
-        } else if (WIFCONTINUED(wstatus)) {
-            TM_CHILDCONTROL_LOG("CONTINUED");
+/* The child is reaped. Either it stopped by itself and may be restarted, or a
+ * client event asked for its stop and this event is now handled. */
+static void proc_stopped(t_thread_data *thrd) {
+    int32_t pgm_restart;
+    uint8_t event = GET_THRD_EVENT;
+
+    proc_timer_clear(thrd);
+    if (event == THRD_EV_NOEVENT) {
+        if (GET_PROC_STATE == PROC_ST_STARTING)
+            TM_START_LOG(JRN_EV_START_FAILED);
+        pgm_restart = thrd->conf->usr.autorestart * thrd->restart_counter;
+        if (!pgm_restart) {
+            SET_PROC_STATE(PROC_ST_STOPPED);
+            return;
         }
-    } while (!WIFEXITED(wstatus) && !WIFSIGNALED(wstatus));
-    THRD_DATA_SET(pid, 0);
-    if (GET_THRD_EVENT == THRD_EV_NOEVENT) SET_PROC_STATE(PROC_ST_STOPPED);
-    return child_ret;
-}
+        if (thrd->pgm->privy.node->journal)
+            TM_JOURNAL(JRN_EV_AUTO_RESTART, 0);
+        else
+            TM_LOG("auto restart", "", NULL);
+        /* the more it restarts the more it waits (supervisord behavior) */
+        SET_PROC_STATE(PROC_ST_STARTING);
+        proc_timer_set(thrd, TIMER_BACKOFF,
+                       ((thrd->conf->usr.startretries + 1) -
+                        thrd->restart_counter) *
+                           1000);
+        return;
+    }
 
-/* Sets configuration asked from config file like umask, working directory
- * or file logging then execve() the process.
- *
- * As it is a child from a multi-threaded program, only uses async-signal-safe
- * functions.
- * However valgrind drd still triggers errors. Errors are relative to some sort
- * of race condition related to my locks (as rw_lock mutexes for example) but
- * as the child acts in a new memory area and doesn't have any concurrent data
- * access with its parent I don't understand the issue. No errors are triggered
- * when using vfork() instead but its manual says to not use any functions
- * before execve() so this isn't usable in our case. Can't figure out how
- * to fix that now. Hopefully this is a school pgm plus a poc. Final design will
- * be async instead, however the question remains. */
-static void configure_and_launch(t_thread_data *thrd) {
-    t_pgm *pgm = thrd->pgm;
-
-    if (pgm->usr.umask) umask(pgm->usr.umask); /* default file mode creation */
-    if (pgm->usr.workingdir) {
-        if (chdir((char *)pgm->usr.workingdir) == -1) perror("chdir");
-    }
-    dup2(pgm->privy.log.out, STDOUT_FILENO);
-    dup2(pgm->privy.log.err, STDERR_FILENO);
-    if (execve(pgm->usr.cmd[0], pgm->usr.cmd,
-               (char **)pgm->usr.env.array_val) == -1)
-        perror("execve");
-    exit(EXIT_FAILURE);
+    if (thrd->killed) {
+        TM_STOP_LOG(JRN_EV_KILLED);
+    } else
+        TM_STOP_LOG(JRN_EV_STOPPED);
+    SET_PROC_STATE(PROC_ST_STOPPED);
+    if (event == THRD_EV_RESTART) proc_start(thrd);
 }
 
-/* Update information of the thread_data struct related to one process - the
- * timestamp, pid & restart_counter.
- * Launch an attached timer thread which monitor if the process is still alive
- * after 'start_time' seconds. */
-static void thread_data_update(t_thread_data *thrd, pid_t pid) {
-    int32_t rt = THRD_DATA_GET(int32_t, restart_counter) - 1;
-    struct timeval start;
-
-    /* if the stop timer didn't finished, wait it */
-    pthread_mutex_lock(&thrd->mtx_timer);
-    gettimeofday(&start, NULL);
-    THRD_DATA_SET(start_timestamp, start);
-    THRD_DATA_SET(pid, pid);
-    THRD_DATA_SET(restart_counter, rt);
-    pthread_cond_signal(&thrd->cond_timer); /* start the start timer */
-    pthread_mutex_unlock(&thrd->mtx_timer);
-    TM_THRD_LOG("LAUNCHED");
-    /* debug_thrd(); */
-}
-
-static void *run_process(t_thread_data *thrd) {
-    int32_t pgm_restart = 1;
-    pid_t pid;
+/*============================== reactor handlers ============================*/
 
-    THRD_DATA_SET(restart_counter,
-                  PGM_SPEC_GET_T(uint8_t, usr.startretries) + 1);
-    while (pgm_restart > 0) {
-        /* the more it restarts the more it sleeps (supervisord behavior) */
-        sleep((PGM_SPEC_GET_T(uint8_t, usr.startretries) + 1) -
-              THRD_DATA_GET(int32_t, restart_counter));
-
-        if (GET_THRD_EVENT) break;
-        pid = fork();
-        if (pid == -1) {
-            handle_error("fork");
-            return NULL;
-        }
-        if (pid == 0)
-            configure_and_launch(thrd);
-        else {
-            thread_data_update(thrd, pid);
-            child_control(thrd, pid);
-            pgm_restart = PGM_SPEC_GET_T(t_autorestart, usr.autorestart) *
-                          (THRD_DATA_GET(int32_t, restart_counter));
-            if (GET_THRD_EVENT == THRD_EV_NOEVENT && pgm_restart)
-                TM_LOG("auto restart", "", NULL);
-        }
-    }
-    return NULL;
-}
-
-/*
- * Routine of a launcher_thread.
- * The thread must first find its id to match with the t_thread_data
- * it is allowed to write/read in.
- * Redirect stdout and stderr of child if necessary before execve()
- * Responsible for relaunching the program if required.
- * @args:
- *   void *arg  is the address of one t_pgm which
- *              contains the configuration of the related program with, among
- *              other things, array of t_thread_data.
- **/
-static void *routine_launcher_thrd(void *arg) {
-    t_thread_data *thrd = arg;
-    bool init = false;
+/* Callback of the reaper: the state of a child changed. Log why & update the
+ * state machine once it is dead. */
+static void child_control(t_thread_data *thrd, const siginfo_t *info) {
+    const t_pgm_usr *conf = &thrd->conf->usr;
+    int32_t child_ret = 0;
+    uint8_t expected = false;
 
-    /* thrd->pgm->privy.nb_thread_alive++; */
-    if (pthread_create(&thrd->timer_id, NULL, timer, arg)) {
-        handle_error("pthread_create");
-        return NULL;
+    if (info->si_code == CLD_STOPPED || info->si_code == CLD_CONTINUED) {
+        child_ret = info->si_status;
+        if (info->si_code == CLD_STOPPED) {
+            TM_CHILDCONTROL_LOG(JRN_EV_STOPPED_BY_SIGNAL);
+        } else
+            TM_CHILDCONTROL_LOG(JRN_EV_CONTINUED);
+        return;
     }
-idle_launcher:
-    pthread_barrier_wait(&thrd->sync_barrier);
-    pthread_mutex_lock(&thrd->mtx_wakeup);
-    if (!init) {
-        init = true;
-        /* sync thread_pool creation with start*/
-        sem_post(&thrd->sync);
-    }
-    /* Waits for MT to signal a start */
-    pthread_cond_wait(&thrd->cond_wakeup, &thrd->mtx_wakeup);
-    pthread_mutex_unlock(&thrd->mtx_wakeup);
-    if (GET_THRD_EVENT == THRD_EV_EXIT) return exit_launcher_thread(thrd);
-start_launcher:
-    pthread_barrier_wait(&thrd->sync_barrier);
-    sem_wait(&thrd->sync);
-    /* thrd_event may have changed in the meantime so we need to check it */
-    if (GET_THRD_EVENT == THRD_EV_EXIT) return exit_launcher_thread(thrd);
-
-    run_process(thrd);
-
-    pthread_mutex_lock(&thrd->mtx_timer); /* wait stop timer to finish */
-    if (GET_THRD_EVENT == THRD_EV_NOEVENT) {
-        SET_THRD_EVENT(THRD_EV_STOP);
-        sem_post(&thrd->sync);
-        pthread_cond_signal(&thrd->cond_timer);
-        pthread_mutex_unlock(&thrd->mtx_timer);
-        goto idle_launcher;
-    } else if (GET_THRD_EVENT == THRD_EV_STOP) {
-        pthread_mutex_unlock(&thrd->mtx_timer);
-        goto idle_launcher;
-    } else if (GET_THRD_EVENT == THRD_EV_RESTART) {
-        pthread_mutex_unlock(&thrd->mtx_timer);
-        goto start_launcher;
-    } else { /* PROC_EV_EXITING */
-        pthread_mutex_unlock(&thrd->mtx_timer);
-        return exit_launcher_thread(thrd);
+
+    if (info->si_code == CLD_EXITED) {
+        child_ret = info->si_status;
+        for (uint16_t i = 0; !expected && i < conf->exitcodes.array_size; i++)
+            expected = child_ret == conf->exitcodes.array_val[i];
+        if (expected) {
+            if (conf->autorestart == autorestart_unexpected)
+                THRD_DATA_SET(restart_counter, 0);
+            TM_CHILDCONTROL_LOG(JRN_EV_EXITED_EXPECTED);
+        } else
+            TM_CHILDCONTROL_LOG(JRN_EV_EXITED_UNEXPECTED);
+    } else {
+        child_ret = info->si_status;
+        TM_CHILDCONTROL_LOG(JRN_EV_KILLED_BY_SIGNAL);
     }
-}
 
-/*============================== handlers utils ==============================*/
+    reaper_unwatch(thrd->pgm->privy.node->reaper, thrd->pid);
+    THRD_DATA_SET(pid, 0);
+    thrd->pgm->privy.nb_proc_alive--;
+    thrd->pgm->privy.node->nb_proc_alive--;
+    proc_stopped(thrd);
+}
 
-static void stop_signal(t_thread_data *thrd, int32_t signal) {
-    THRD_DATA_SET(restart_counter, 0);
-    if (THRD_DATA_GET(pthread_t, tid) && GET_PROC_STATE != PROC_ST_STOPPING) {
-        /* we signal the timer here because the kill above can miss or take
-         * long time so the launcher_thread stay blocked and doesn't return
-         * neither exit. The timer is responsible for kill with SIGTERM if
-         * it takes too much time. */
-        pthread_mutex_lock(&thrd->mtx_timer);
-        sem_post(&thrd->sync);
-        pthread_cond_signal(&thrd->cond_timer);
-        if (THRD_DATA_GET(pid_t, pid)) kill(THRD_DATA_GET(pid_t, pid), signal);
-        pthread_mutex_unlock(&thrd->mtx_timer);
+/* The deadline of the ongoing transition is reached. Callback of the timer
+ * wheel. */
+static void timer_control(t_tw_timer *deadline) {
+    t_thread_data *thrd = THRD_OF_DEADLINE(deadline);
+    t_proc_timer timer = thrd->timer;
+
+    thrd->timer = TIMER_NONE;
+
+    switch (timer) {
+        case TIMER_BACKOFF:
+            proc_launch(thrd);
+            break;
+        case TIMER_START:
+            SET_PROC_STATE(PROC_ST_STARTED);
+            TM_START_LOG(JRN_EV_STARTED);
+            startup_started(thrd->pgm->privy.node->startup, thrd);
+            break;
+        case TIMER_STOP:
+            kill(thrd->pid, SIGKILL);
+            thrd->killed = true;
+            proc_timer_set(thrd, TIMER_KILL, KILL_TIME_LIMIT * 1000);
+            break;
+        case TIMER_KILL:
+            TM_STOP_LOG(JRN_EV_KILL_FAILED);
+            break;
+        default:
+            break;
     }
 }
 
-static uint8_t exit_pgm_launchers(t_pgm *pgm) {
-    t_thread_data *thrd;
-    struct timeval stop;
-
-    gettimeofday(&stop, NULL);
-    PGM_SPEC_SET(privy.stop_timestamp, stop);
-    for (uint32_t id = 0; id < pgm->usr.numprocs; id++) {
-        thrd = &pgm->privy.thrd[id];
-        SET_THRD_EVENT(THRD_EV_EXIT);
-        stop_signal(thrd, PGM_SPEC_GET_T(uint8_t, usr.stopsignal.nb));
+/*============================== handlers utils ==============================*/
 
-        if (THRD_DATA_GET(pthread_t, tid) && !IS_PROC_ACTIVE(thrd)) {
-            pthread_mutex_lock(&thrd->mtx_wakeup);
-            pthread_cond_broadcast(&thrd->cond_wakeup);
-            pthread_mutex_unlock(&thrd->mtx_wakeup);
-        }
-    }
+static uint8_t exit_pgm_procs(t_pgm *pgm) {
+    for (uint32_t id = 0; id < PGM_CONF(pgm)->usr.numprocs; id++)
+        proc_stop(&pgm->privy.thrd[id], THRD_EV_EXIT);
     return EXIT_SUCCESS;
 }
 
-static uint8_t join_pgm_launchers(t_pgm *pgm) {
+/* Binds the deadline of all processus of pgm to the timer wheel */
+static uint8_t create_proc_pool(t_tm_node *node, t_pgm *pgm) {
     t_thread_data *thrd;
 
-    for (uint32_t id = 0; id < pgm->usr.numprocs; id++) {
+    if (node->journal)
+        journal_pgm(node->journal, pgm->privy.id, PGM_CONF(pgm)->usr.name);
+    for (uint32_t id = 0; id < PGM_CONF(pgm)->usr.numprocs; id++) {
         thrd = &pgm->privy.thrd[id];
-        if (pthread_join(THRD_DATA_GET(pthread_t, tid), NULL))
-            perror("pthread_join");
+        tw_timer_init(&thrd->deadline);
     }
     return EXIT_SUCCESS;
 }
 
-/* Create a pool of launcher thread for pgm */
-static uint8_t create_launcher_pool(t_pgm *pgm) {
-    t_thread_data *thrd;
-    for (uint32_t id = 0; id < pgm->usr.numprocs; id++) {
-        thrd = &pgm->privy.thrd[id];
-        if (pthread_create(&thrd->tid, NULL, routine_launcher_thrd, thrd))
-            handle_error("pthread_create");
+static void pgm_release(void *pgm) { destroy_pgm(pgm); }
 
-        /* waits that LT & its timer are idle and waiting for start signal*/
-        sem_wait(&thrd->sync);
-        sem_wait(&thrd->sync);
+/* Lays the status table out again after the name index changed */
+static void status_table_refresh(t_tm_node *node) {
+    if (node->status && status_table_layout(node->status, node))
+        handle_error("status_table_layout");
+}
+
+/* Unlinks pgm from the list & the name index. It is destroyed after an rcu
+ * grace period as the client may still be holding it. */
+static void remove_pgm(t_tm_node *node, t_pgm *pgm) {
+    for (uint32_t id = 0; id < pgm->privy.nb_thrd; id++)
+        tw_timer_del(&pgm->privy.thrd[id].deadline);
+    if (node->capture) capture_forget(node->capture, pgm->privy.id);
+    for (t_pgm **link = &node->head; *link; link = &(*link)->privy.next) {
+        if (*link == pgm) {
+            *link = pgm->privy.next;
+            node->pgm_nb--;
+            break;
+        }
     }
-    return EXIT_SUCCESS;
+    if (pgm_index_publish(node)) handle_error("pgm_index_publish");
+    pgm->privy.status = NULL;
+    status_table_refresh(node);
+    if (rcu_retire(&node->rcu, pgm, pgm_release)) handle_error("rcu_retire");
 }
 
 /*============================== event handlers ==============================*/
@@ -417,7 +347,7 @@ static uint8_t create_launcher_pool(t_pgm *pgm) {
 
 DECL_EV_HANDLER(do_status) {
     if (pgm)
-        TM_LOG2("status", "%s", PGM_SPEC_GET(char_Ptr, usr.name));
+        TM_LOG2("status", "%s", PGM_CONF(pgm)->usr.name);
     else
         TM_LOG2("status", "", NULL);
     UNUSED_PARAM(pgm);
@@ -425,109 +355,264 @@ DECL_EV_HANDLER(do_status) {
     return EXIT_SUCCESS;
 }
 
-/* Start launcher_threads from one t_pgm, in a
- * detached mode, if it doesn't exists yet and if is inactive.
- * If the thread already exists the restart_counter is still reset. */
+/* Starts all inactive processus from one t_pgm. */
 DECL_EV_HANDLER(do_start) {
     t_thread_data *thrd;
 
-    TM_LOG2("start", "%s", PGM_SPEC_GET(char_Ptr, usr.name));
-    for (uint32_t id = 0; id < pgm->usr.numprocs; id++) {
+    UNUSED_PARAM(node);
+    TM_LOG2("start", "%s", PGM_CONF(pgm)->usr.name);
+    for (uint32_t id = 0; id < PGM_CONF(pgm)->usr.numprocs; id++) {
         thrd = &pgm->privy.thrd[id];
-
-        if (THRD_DATA_GET(pthread_t, tid) && !IS_PROC_ACTIVE(thrd)) {
-            pthread_mutex_lock(&thrd->mtx_wakeup);
-            /* signal LT and its timer to start workflow */
-            pthread_cond_broadcast(&thrd->cond_wakeup);
-            pthread_mutex_unlock(&thrd->mtx_wakeup);
-        }
+        if (!IS_PROC_ACTIVE(thrd)) proc_start(thrd);
     }
     return EXIT_SUCCESS;
 }
 
 /* Stops all processus from one t_pgm with the signal
- * set in configuration file.
- * Does nothing if the thread is already down or is stopping. */
+ * set in their configuration.
+ * Does nothing if the proc is already down or is stopping. */
 DECL_EV_HANDLER(do_stop) {
-    t_thread_data *thrd;
-    struct timeval stop;
-
-    gettimeofday(&stop, NULL);
-    PGM_SPEC_SET(privy.stop_timestamp, stop);
-    TM_LOG2("stop", "%s", PGM_SPEC_GET(char_Ptr, usr.name));
-    for (uint32_t id = 0; id < pgm->usr.numprocs; id++) {
-        thrd = &pgm->privy.thrd[id];
-        SET_THRD_EVENT(THRD_EV_STOP);
-        stop_signal(thrd, pgm->usr.stopsignal.nb);
-    }
+    UNUSED_PARAM(node);
+    TM_LOG2("stop", "%s", PGM_CONF(pgm)->usr.name);
+    for (uint32_t id = 0; id < PGM_CONF(pgm)->usr.numprocs; id++)
+        proc_stop(&pgm->privy.thrd[id], THRD_EV_STOP);
     return EXIT_SUCCESS;
 }
 
+/* Stops all processus from one t_pgm then starts them again once stopped */
 DECL_EV_HANDLER(do_restart) {
-    t_thread_data *thrd;
-    struct timeval stop;
+    UNUSED_PARAM(node);
+    TM_LOG2("restart", "%s", PGM_CONF(pgm)->usr.name);
+    for (uint32_t id = 0; id < PGM_CONF(pgm)->usr.numprocs; id++)
+        proc_stop(&pgm->privy.thrd[id], THRD_EV_RESTART);
+    return EXIT_SUCCESS;
+}
 
-    gettimeofday(&stop, NULL);
-    PGM_SPEC_SET(privy.stop_timestamp, stop);
-    TM_LOG2("restart", "%s", PGM_SPEC_GET(char_Ptr, usr.name));
-    for (uint32_t id = 0; id < PGM_SPEC_GET(uint32_t, usr.numprocs); id++) {
-        thrd = &pgm->privy.thrd[id];
-        SET_THRD_EVENT(THRD_EV_RESTART);
-        stop_signal(thrd, pgm->usr.stopsignal.nb);
+/* Exits processus of pgm. It is destroyed once all of them are reaped */
+DECL_EV_HANDLER(do_del) {
+    TM_LOG2("delete", "%s", PGM_CONF(pgm)->usr.name);
+    if (exit_pgm_procs(pgm)) return EXIT_FAILURE;
+    pgm->privy.deleting = true;
+    node->pgm_deleting++;
+    return EXIT_SUCCESS;
+}
 
-        if (THRD_DATA_GET(pthread_t, tid) && !IS_PROC_ACTIVE(thrd)) {
-            pthread_mutex_lock(&thrd->mtx_wakeup);
-            pthread_cond_broadcast(&thrd->cond_wakeup);
-            pthread_mutex_unlock(&thrd->mtx_wakeup);
+/* Links the programs built by the control thread for an add command, then
+ * creates their processus & starts them if autostart is true. A program
+ * whose name got taken since the command was checked is dropped. */
+DECL_EV_HANDLER(do_add) {
+    const t_pgm_index *index = PGM_INDEX(node);
+    const char *name;
+    t_pgm *next;
+    uint32_t nb = 0;
+
+    for (; pgm; pgm = next) {
+        next = pgm->privy.next;
+        name = PGM_CONF(pgm)->usr.name;
+        if (pgm_index_find(index, name, strlen(name))) {
+            TM_LOG2("add", "%s: name already taken", name);
+            destroy_pgm(pgm);
+            continue;
         }
+        pgm->privy.node = node;
+        pgm->privy.id = node->pgm_ids++;
+        pgm->privy.next = node->head;
+        node->head = pgm;
+        node->pgm_nb++;
+        nb++;
+    }
+    if (!nb) return EXIT_SUCCESS;
+    if (pgm_index_publish(node)) handle_error("pgm_index_publish");
+    status_table_refresh(node);
+
+    pgm = node->head;
+    for (uint32_t i = 0; i < nb; i++, pgm = pgm->privy.next) {
+        TM_LOG2("add", "%s", PGM_CONF(pgm)->usr.name);
+        if (create_proc_pool(node, pgm)) return EXIT_FAILURE;
+        if (PGM_CONF(pgm)->usr.autostart && do_start(pgm, node))
+            return EXIT_FAILURE;
     }
     return EXIT_SUCCESS;
 }
 
-/* exit and destroy pgm. This function is blocking as it joins launchers */
-DECL_EV_HANDLER(do_del) {
-    TM_LOG2("delete", "%s", PGM_SPEC_GET(char_Ptr, usr.name));
-    if (exit_pgm_launchers(pgm)) return EXIT_FAILURE;
-    if (join_pgm_launchers(pgm)) return EXIT_FAILURE;
+/*================================== reload ==================================*/
+
+/* Grows the processus array of pgm to nb. Processus are moved: the reaper
+ * index & the timer wheel are pointed to their new address, the old array
+ * being freed after an rcu grace period as the control thread may still be
+ * reading it. The new array is published before the configuration with the
+ * new numprocs. */
+static void pgm_grow(t_tm_node *node, t_pgm *pgm, uint32_t nb,
+                     t_pgm_conf *conf) {
+    t_thread_data *old = pgm->privy.thrd, *thrd;
+
+    if (!(thrd = calloc(nb, sizeof(*thrd)))) handle_error("calloc");
+    memcpy(thrd, old, pgm->privy.nb_thrd * sizeof(*thrd));
+    for (uint32_t id = 0; id < pgm->privy.nb_thrd; id++) {
+        /* after the copy: a move updates the links of the next timer */
+        tw_timer_move(&thrd[id].deadline, &old[id].deadline);
+        if (!thrd[id].pid) continue;
+        reaper_unwatch(node->reaper, thrd[id].pid);
+        if (reaper_watch(node->reaper, thrd[id].pid, &thrd[id]))
+            handle_error("reaper_watch");
+    }
+    for (uint32_t id = pgm->privy.nb_thrd; id < nb; id++) {
+        thrd[id].rid = id;
+        thrd[id].pgm = pgm;
+        thrd[id].conf = pgm_conf_get(conf);
+        thrd[id].restart_counter = conf->usr.startretries;
+    }
+    pgm->privy.status = NULL; /* until the status table is laid out again */
+    atomic_store_explicit(&pgm->privy.thrd, thrd, memory_order_release);
+    pgm->privy.nb_thrd = nb;
+    if (rcu_retire(&node->rcu, old, free)) handle_error("rcu_retire");
+}
 
-    destroy_pgm(pgm);
-    free(pgm);
+/* Applies the new configuration of a running program, then destroys 'new'
+ * which carried it. Nothing happens if the fingerprints are the same & the
+ * numprocs too. Otherwise the configuration is published: processus launched
+ * since use it, the running ones being restarted only if what they are
+ * launched with changed. A numprocs change starts or stops the last
+ * instances, the others aren't touched. */
+static void reload_pgm(t_tm_node *node, t_pgm *pgm, t_pgm *new) {
+    t_pgm_conf *old = PGM_CONF(pgm), *conf = new->conf;
+    uint32_t prev = old->usr.numprocs, nb = conf->usr.numprocs;
+    bool relaunch = conf->fp_launch != old->fp_launch;
+    struct log log = pgm->privy.log;
+    t_thread_data *thrd;
 
-    return EXIT_SUCCESS;
+    if (conf->fp_conf == old->fp_conf && nb == prev) {
+        destroy_pgm(new);
+        return;
+    }
+    TM_LOG2("reload", "%s", conf->usr.name);
+    if (nb > pgm->privy.nb_thrd) pgm_grow(node, pgm, nb, conf);
+    pgm->privy.log = new->privy.log; /* same files or the new ones */
+    new->privy.log = log;
+    new->conf = NULL;
+    if (pgm_conf_publish(node, pgm, conf)) handle_error("pgm_conf_publish");
+    destroy_pgm(new);
+
+    for (uint32_t id = nb; id < prev; id++)
+        proc_stop(&pgm->privy.thrd[id], THRD_EV_EXIT);
+    for (uint32_t id = 0; relaunch && id < prev && id < nb; id++) {
+        thrd = &pgm->privy.thrd[id];
+        if (IS_PROC_ACTIVE(thrd)) proc_stop(thrd, THRD_EV_RESTART);
+    }
+    for (uint32_t id = prev; id < nb; id++) {
+        thrd = &pgm->privy.thrd[id];
+        /* still stopping since a previous reload removed it */
+        if (IS_PROC_ACTIVE(thrd))
+            proc_stop(thrd,
+                      conf->usr.autostart ? THRD_EV_RESTART : THRD_EV_STOP);
+        else if (conf->usr.autostart)
+            proc_start(thrd);
+    }
 }
 
-/* create launchers of pgm and start them if auto_start is true */
-DECL_EV_HANDLER(do_add) {
-    TM_LOG2("add", "%s", PGM_SPEC_GET(char_Ptr, usr.name));
-    if (create_launcher_pool(pgm)) return EXIT_FAILURE;
-
-    if (PGM_SPEC_GET(bool, usr.autostart))
-        if (do_start(pgm, node)) return EXIT_FAILURE;
-    return EXIT_SUCCESS;
+/* Applies the configuration file read again by the control thread: programs
+ * are matched by name. New ones are added, missing ones deleted, the others
+ * reloaded (see reload_pgm). The groups are replaced & the index published
+ * once. */
+static void do_reload(t_tm_node *node, t_pgm *head, t_group_conf *groups) {
+    const t_pgm_index *index = PGM_INDEX(node);
+    t_pgm_set *kept = pgm_set_new(index->nb_id);
+    t_pgm *pgm, *next, *cur, *added = NULL;
+    const char *name;
+    uint32_t nb = 0;
+
+    if (!kept) handle_error("pgm_set_new");
+    TM_LOG2("reload", "%s", node->config_path);
+    for (pgm = head; pgm; pgm = next) {
+        next = pgm->privy.next;
+        name = PGM_CONF(pgm)->usr.name;
+        cur = pgm_index_find(index, name, strlen(name));
+        if (!cur) {
+            pgm->privy.next = added;
+            added = pgm;
+            continue;
+        }
+        if (cur->privy.deleting) {
+            TM_LOG2("reload", "%s: still being deleted", name);
+            destroy_pgm(pgm);
+            continue;
+        }
+        pgm_set_add(kept, cur->privy.id);
+        reload_pgm(node, cur, pgm);
+    }
+    for (cur = node->head; cur; cur = cur->privy.next)
+        if (!cur->privy.deleting && pgm_set_next(kept, cur->privy.id) !=
+                                        cur->privy.id)
+            do_del(cur, node);
+    free(kept);
+
+    for (pgm = added; pgm; pgm = next) {
+        next = pgm->privy.next;
+        pgm->privy.node = node;
+        pgm->privy.id = node->pgm_ids++;
+        pgm->privy.next = node->head;
+        node->head = pgm;
+        node->pgm_nb++;
+        nb++;
+    }
+    destroy_group_list(&node->groups);
+    node->groups = groups;
+    if (pgm_index_publish(node)) handle_error("pgm_index_publish");
+    status_table_refresh(node);
+
+    pgm = node->head;
+    for (uint32_t i = 0; i < nb; i++, pgm = pgm->privy.next) {
+        TM_LOG2("add", "%s", PGM_CONF(pgm)->usr.name);
+        create_proc_pool(node, pgm);
+        if (PGM_CONF(pgm)->usr.autostart) do_start(pgm, node);
+    }
 }
 
-/* exit LT and wait them. */
+/* exit all processus. The reactor returns once all of them are reaped. */
 DECL_EV_HANDLER(do_exit) {
     UNUSED_PARAM(pgm);
     node->exit_mastt = true;
     TM_LOG2("exit", "...", NULL);
     for (t_pgm *pgm_cp = node->head; pgm_cp; pgm_cp = pgm_cp->privy.next)
-        if (exit_pgm_launchers(pgm_cp)) return EXIT_FAILURE;
-    for (t_pgm *pgm_cp = node->head; pgm_cp; pgm_cp = pgm_cp->privy.next)
-        if (join_pgm_launchers(pgm_cp)) return EXIT_FAILURE;
+        if (exit_pgm_procs(pgm_cp)) return EXIT_FAILURE;
     return EXIT_SUCCESS;
 }
 
 /*=================================== init ===================================*/
 
-/* Creates a pool of launcher thread for all programs */
+/* Creates the reactor, its timer wheel, its child reaper and the processus
+ * pool of all programs */
 static uint8_t create_thread_pool(t_tm_node *node) {
     t_pgm *pgm = node->head;
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = &node->queue_src};
+
+    node->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (node->epoll_fd == -1) handle_error("epoll_create1");
+    node->queue_src = (t_reactor_src){SRC_EVENT_QUEUE, node};
+    if (epoll_ctl(node->epoll_fd, EPOLL_CTL_ADD, node->ev_queue.efd, &ev) ==
+        -1)
+        handle_error("epoll_ctl");
+
+    node->wheel = malloc(sizeof(*node->wheel));
+    if (!node->wheel || tw_init(node->wheel, timer_control))
+        handle_error("tw_init");
+    node->wheel_src = (t_reactor_src){SRC_TIMER, node->wheel};
+    ev.data.ptr = &node->wheel_src;
+    if (epoll_ctl(node->epoll_fd, EPOLL_CTL_ADD, node->wheel->tfd, &ev) == -1)
+        handle_error("epoll_ctl");
+
+    node->reaper = malloc(sizeof(*node->reaper));
+    if (!node->reaper || reaper_init(node->reaper)) handle_error("reaper_init");
+    node->reaper_src = (t_reactor_src){SRC_CHILD, node->reaper};
+    ev.data.ptr = &node->reaper_src;
+    if (epoll_ctl(node->epoll_fd, EPOLL_CTL_ADD, node->reaper->sfd, &ev) == -1)
+        handle_error("epoll_ctl");
 
     for (uint32_t i = 0; i < node->pgm_nb && pgm; i++) {
-        if (create_launcher_pool(pgm)) return EXIT_FAILURE;
+        if (create_proc_pool(node, pgm)) return EXIT_FAILURE;
         pgm = pgm->privy.next;
     }
+    status_table_refresh(node);
     return EXIT_SUCCESS;
 }
 
@@ -535,15 +620,96 @@ static uint8_t set_autostart(t_tm_node *node) {
     t_pgm *pgm = node->head;
 
     for (uint32_t i = 0; i < node->pgm_nb && pgm; i++) {
-        if (PGM_SPEC_GET(bool, usr.autostart)) do_start(pgm, node);
+        if (PGM_CONF(pgm)->usr.autostart) do_start(pgm, node);
         pgm = pgm->privy.next;
     }
     return EXIT_SUCCESS;
 }
 
+/*================================== reactor =================================*/
+
+/* Executes an event on its pgm or on each pgm of its set. Ids of the set
+ * are resolved with the current index: programs removed since the command
+ * was sent are skipped. */
+static void execute_client_event(t_tm_node *node, t_event *event,
+                                 uint8_t (*execute_event[])(t_pgm *,
+                                                            t_tm_node *)) {
+    const t_pgm_index *index = PGM_INDEX(node);
+    t_pgm *pgm;
+
+    if (!event->set) {
+        execute_event[event->type](event->pgm, node);
+        return;
+    }
+    for (uint32_t id = pgm_set_next(event->set, 0);
+         id != PGM_SET_END && id < index->nb_id;
+         id = pgm_set_next(event->set, id + 1)) {
+        pgm = index->by_id[id];
+        if (pgm && !pgm->privy.deleting) execute_event[event->type](pgm, node);
+    }
+}
+
+/* Executes a client event, unless it could launch processus while exiting:
+ * the programs of such an add or reload are destroyed. A batch is executed
+ * event by event, in order. */
+static void handle_client_event(t_tm_node *node, t_event *event,
+                                uint8_t (*execute_event[])(t_pgm *,
+                                                           t_tm_node *)) {
+    if (event->type == CLIENT_BATCH) {
+        for (uint32_t i = 0; i < event->batch->nb; i++)
+            handle_client_event(node, &event->batch->event[i], execute_event);
+        free(event->batch);
+        return;
+    }
+    if (event->type == CLIENT_RELOAD && !node->exit_mastt) {
+        do_reload(node, event->pgm, event->groups);
+        return;
+    }
+    if (!node->exit_mastt ||
+        (event->type != CLIENT_START && event->type != CLIENT_RESTART &&
+         event->type != CLIENT_ADD && event->type != CLIENT_RELOAD))
+        execute_client_event(node, event, execute_event);
+    else if (event->type == CLIENT_ADD || event->type == CLIENT_RELOAD) {
+        destroy_pgm_list(&event->pgm);
+        destroy_group_list(&event->groups);
+    }
+    free(event->set);
+}
+
+/* Pops all pending client events by batches and executes them. Once
+ * exiting, only events which can't launch any processus are executed. */
+static void handle_client_events(t_tm_node *node,
+                                 uint8_t (*execute_event[])(t_pgm *,
+                                                            t_tm_node *)) {
+    t_event batch[EV_QUEUE_BATCH];
+    uint32_t nb;
+
+    ev_queue_wakeup_ack(&node->ev_queue);
+    while ((nb = ev_queue_pop_batch(&node->ev_queue, batch, EV_QUEUE_BATCH)))
+        for (uint32_t i = 0; i < nb; i++)
+            handle_client_event(node, &batch[i], execute_event);
+}
+
+/* Destroys deleted pgms once all their processus are reaped. Done after an
+ * epoll batch as pending events of this batch may point to them. */
+static void sweep_deleted_pgm(t_tm_node *node) {
+    t_pgm *pgm = node->head, *next;
+
+    while (pgm && node->pgm_deleting) {
+        next = pgm->privy.next;
+        if (pgm->privy.deleting && !pgm->privy.nb_proc_alive) {
+            node->pgm_deleting--;
+            remove_pgm(node, pgm);
+        }
+        pgm = next;
+    }
+}
+
 /*
- * The master thread listen the client events
- * - start, stop, restart, reload, exit - and handle them.
+ * The master thread is a reactor which listens to the client events
+ * - start, stop, restart, reload, exit -, to the children exits and to the
+ * deadlines of processus transitions, then handles them. All processus are
+ * driven by this single thread whatever their number.
  *
  * @args:
  *   void *arg  is the address of the t_tm_node which is the node
@@ -551,35 +717,71 @@ static uint8_t set_autostart(t_tm_node *node) {
  **/
 static void *master_thread(void *arg) {
     t_tm_node *node = arg;
-    t_event client_ev;
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    t_reactor_src *src;
+    int32_t nfds;
     uint8_t (*execute_event[CLIENT_MAX_EVENT])(t_pgm *, t_tm_node *) = {
         do_status, do_start, do_restart, do_stop, do_exit, do_add, do_del,
     };
 
     TM_LOG2("taskmaster", "program started", NULL);
     if (create_thread_pool(node)) return NULL;
+    startup_mark(node->startup, STARTUP_THREAD_POOL);
     if (set_autostart(node)) return NULL;
+    if (startup_expect(node->startup, node)) handle_error("startup_expect");
 
-    while (node->exit_mastt == false) {
-        sem_wait(&node->new_event);
-        pthread_mutex_lock(&node->mtx_queue);
-        client_ev = node->event_queue[0];
-        for (uint32_t i = 0; i < node->ev_queue_sz; i++) {
-            node->event_queue[i] = node->event_queue[i + 1];
+    while (node->exit_mastt == false || node->nb_proc_alive) {
+        nfds = epoll_wait(node->epoll_fd, events, REACTOR_MAX_EVENTS, -1);
+        if (nfds == -1) {
+            if (errno == EINTR) continue;
+            handle_error("epoll_wait");
+        }
+        for (int32_t i = 0; i < nfds; i++) {
+            src = events[i].data.ptr;
+            if (src->type == SRC_EVENT_QUEUE)
+                handle_client_events(node, execute_event);
+            else if (src->type == SRC_CHILD)
+                reaper_collect(src->owner, child_control);
+            else if (src->type == SRC_TIMER)
+                tw_expire(src->owner);
         }
-        node->ev_queue_sz--;
-        pthread_mutex_unlock(&node->mtx_queue);
-        sem_post(&node->free_place);
-        execute_event[client_ev.type](client_ev.pgm, node);
+        if (node->pgm_deleting) sweep_deleted_pgm(node);
+        rcu_reclaim(&node->rcu);
     }
     TM_LOG2("taskmaster", "program exit", NULL);
+    /* exit came thru the control socket: the shell may wait for input */
+    if (!atomic_exchange(&node->exit_maint, true))
+        pthread_kill(node->main_thrd, SIGUSR2);
     return NULL;
 }
 
+static void wakeup_shell(int32_t sig) { UNUSED_PARAM(sig); }
+
+/* Starts the master thread & the control server. SIGUSR2 interrupts the
+ * read of the shell, without SA_RESTART, once the master thread is done. */
 uint8_t run_server(t_tm_node *node) {
-    if (pthread_create(&node->master_thrd, NULL, master_thread, node)) {
-        destroy_taskmaster(node);
-        return EXIT_FAILURE;
+    struct sigaction sa = {.sa_handler = wakeup_shell};
+
+    node->main_thrd = pthread_self();
+    if (sigaction(SIGUSR2, &sa, NULL) == -1) goto error;
+    /* inherited by the master thread: SIGCHLD is only read thru the reaper */
+    if (reaper_block_sigchld()) goto error;
+    if (!(node->control = malloc(sizeof(*node->control)))) goto error;
+    if (control_init(node->control, node, node->ctl_path)) {
+        fprintf(stderr, "%s: %s: %s\n", node->tm_name, node->ctl_path,
+                strerror(errno));
+        DESTROY_PTR(node->control);
+        goto error;
+    }
+    /* events pushed before the master thread runs wait in the queue */
+    if (control_start(node->control) ||
+        pthread_create(&node->master_thrd, NULL, master_thread, node)) {
+        perror("pthread_create");
+        goto error;
     }
     return EXIT_SUCCESS;
+
+error:
+    destroy_taskmaster(node);
+    return EXIT_FAILURE;
 }
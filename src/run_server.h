@@ -2,11 +2,19 @@
 #define RUN_SERVER_H
 
 #include "taskmaster.h"
-
-/* usleep() value for master_thread listening loop - in us */
-#define START_SUPERVISOR_RATE (4000)
-#define STOP_SUPERVISOR_RATE (4000)
-#define KILL_TIME_LIMIT (5) /* in sec */
+#include "capture.h"
+#include "control.h"
+#include "journal.h"
+#include "logfile.h"
+#include "logger.h"
+#include "reaper.h"
+#include "startup.h"
+#include "status_table.h"
+#include "proc_spawn.h"
+#include "timer_wheel.h"
+
+#define REACTOR_MAX_EVENTS (64) /* epoll_wait() batch size */
+#define KILL_TIME_LIMIT (5)     /* in sec */
 
 typedef struct timeval tm_timeval_t;
 typedef int32_t *int32_Ptr;
@@ -14,25 +22,26 @@ typedef uint8_t *uint8_Ptr;
 typedef char *char_Ptr;
 typedef char **char_PtrPtr;
 
-/* runtime data relative to a thread. One launcher thread has one timer */
+/* deadline the timer of a processus is armed for */
+typedef enum e_proc_timer {
+    TIMER_NONE,    /* disarmed */
+    TIMER_BACKOFF, /* delay before an automatic restart */
+    TIMER_START,   /* starttime: proc is considered started when it fires */
+    TIMER_STOP,    /* stoptime: proc is killed when it fires */
+    TIMER_KILL,    /* proc is still alive KILL_TIME_LIMIT after SIGKILL */
+} t_proc_timer;
+
+/* runtime data relative to one processus. All processus are driven by the
+ * reactor of the master thread which is the only writer. The fields read by
+ * the client thread are published thru a seqlock (see thrd_snapshot).
+ * Programs may run thousands of instances: the record fits a cache line,
+ * the node being reached thru the pgm and the timer callback getting the
+ * record back from its deadline (THRD_OF_DEADLINE). */
 typedef struct thread_data {
-    /* pthread_mutex_t rw_thrd; */
-    pthread_rwlock_t rw_thrd;
-    /* constant synchronization between timer & launcher */
-    pthread_barrier_t sync_barrier;
-
-    t_tm_node *node; /* pointer to the node */
-    t_pgm *pgm;      /* pointer to the related pgm data */
-
-    uint32_t rid;  /* rank id of current thread/proc. Index for an array */
-    pthread_t tid; /* thread id of current thread */
-    pid_t pid;     /* pid of current process */
+    atomic_uint seq; /* seqlock: odd while the reactor writes */
+    pid_t pid;       /* pid of current process */
     int32_t restart_counter; /* how many time the process can be restarted */
-    tm_timeval_t start_timestamp; /* time when process started */
-
-    pthread_mutex_t mtx_wakeup;
-    pthread_cond_t
-        cond_wakeup; /* conditon variable to signal thread to start */
+    uint16_t rid;    /* rank id of current proc. Index for an array */
 
     /* This variable must be set with its macros
      * bits are ordered as following: eeeessss
@@ -40,15 +49,21 @@ typedef struct thread_data {
      * events: no_event - stop - restart - exit. */
     atomic_uchar info;
 
-    /*    timer    */
+    /*   reactor   */
 
-    /* semaphore to synchronize timer & launcher thread at init */
-    sem_t sync;
-    pthread_mutex_t mtx_timer;
-    pthread_cond_t cond_timer; /* conditon variable to unlock timer */
-    pthread_t timer_id;        /* thread id of start_timer thread */
+    uint8_t timer : 7;    /* t_proc_timer the deadline is armed for */
+    uint8_t killed : 1;   /* SIGKILL had been sent during the current stop */
+    time_t start_timestamp; /* time when process started */
+    t_pgm *pgm;           /* pointer to the related pgm data */
+    t_pgm_conf *conf;     /* configuration of the ongoing workflow */
+    t_tw_timer deadline;  /* deadline of the ongoing transition */
 } t_thread_data;
 
+_Static_assert(sizeof(t_thread_data) <= 64, "t_thread_data exceeds 64 bytes");
+
+#define THRD_OF_DEADLINE(timer) \
+    ((t_thread_data *)((char *)(timer) - offsetof(t_thread_data, deadline)))
+
 /* ----- PROCESSUS STATES ----- */
 
 #define PROC_ST_STOPPED (0x00) /* 0000 */
@@ -61,9 +76,9 @@ typedef struct thread_data {
 /* ----- THREAD EVENTS ----- */
 
 #define THRD_EV_NOEVENT (0x0) /* default. */
-#define THRD_EV_STOP (0x1)    /* thread gets idle */
-#define THRD_EV_RESTART (0x2) /* thread gets active */
-#define THRD_EV_EXIT (0x3)    /* thread gets exited */
+#define THRD_EV_STOP (0x1)    /* proc gets idle */
+#define THRD_EV_RESTART (0x2) /* proc gets started again once stopped */
+#define THRD_EV_EXIT (0x3)    /* proc gets stopped for good */
 
 /* ----- MASKS ----- */
 
@@ -79,16 +94,20 @@ typedef struct thread_data {
  **/
 #define SET_PROC_STATE(value)                                          \
     do {                                                               \
+        thrd_write_begin(thrd);                                        \
         thrd->info = (((thrd->info & 0xf0) + ((value)&0x0f)) *         \
                       ((value) != PROC_ST_STARTING)) +                 \
                      (((value)&0x0f) * ((value) == PROC_ST_STARTING)); \
+        thrd_write_end(thrd);                                          \
     } while (0)
 #define GET_PROC_STATE (thrd->info & 0x0f)
 
 /* set event to info without overriding states */
 #define SET_THRD_EVENT(value)                              \
     do {                                                   \
+        thrd_write_begin(thrd);                            \
         thrd->info = ((value) << 4) + (thrd->info & 0x0f); \
+        thrd_write_end(thrd);                              \
     } while (0)
 
 #define GET_THRD_EVENT (thrd->info >> 4)
@@ -98,104 +117,81 @@ typedef struct thread_data {
 #ifdef DEVELOPEMENT
 #define debug_thrd()                                                        \
     do {                                                                    \
-        printf("[%-14s- %-2d] - tid %lu - pid %d - cnt %d\n",               \
-               PGM_SPEC_GET_T(uint8_Ptr, str_name),                         \
-               THRD_DATA_GET(uint32_t, rid), THRD_DATA_GET(pthread_t, tid), \
-               THRD_DATA_GET(pid_t, pid),                                   \
-               THRD_DATA_GET(int32_t, restart_counter));                    \
+        printf("[%-14s- %-2d] - pid %d - cnt %d\n",                         \
+               thrd->conf->usr.name, thrd->rid, thrd->pid,                  \
+               thrd->restart_counter);                                      \
         fflush(stdout);                                                     \
     } while (0)
 #else
 #define debug_thrd()
 #endif
 
-#define exit_thrd(thrd, msg, file, func, line) \
-    do {                                       \
-        exit_thread(thrd);                     \
-        err_display(msg, file, func, line);    \
-        return (NULL);                         \
-    } while (0)
-
 /* ----- THREAD GETTERS & SETTERS ----- */
 
-/*
- * update data in struct thread_data.
- * @args:
- *   name    is the name of the variable from the struct that we want to update
- *   value   is the value we want to give to this variable
- **/
-#define THRD_DATA_SET(name, value)             \
-    do {                                       \
-        pthread_rwlock_wrlock(&thrd->rw_thrd); \
-        thrd->name = value;                    \
-        pthread_rwlock_unlock(&thrd->rw_thrd); \
-    } while (0)
-
-/* generic getters functions to have lock-free value from struct thread_data */
-#define THRD_DATA_GET_FUNC(type) thrd_data_get_##type
-#define THRD_DATA_GET_CALL(type, value) THRD_DATA_GET_FUNC(type)(thrd, value)
-
-#define THRD_DATA_GET_DECL(type) \
-    static type THRD_DATA_GET_FUNC(type)(t_thread_data * thrd, type * value)
-#define THRD_DATA_GET_IMPLEMENTATION(type)     \
-    THRD_DATA_GET_DECL(type) {                 \
-        type save;                             \
-                                               \
-        pthread_rwlock_rdlock(&thrd->rw_thrd); \
-        save = *value;                         \
-        pthread_rwlock_unlock(&thrd->rw_thrd); \
-        return save;                           \
-    }
-
-/* thread_data getter. name is the name of the struct variable name */
-#define THRD_DATA_GET(type, name) THRD_DATA_GET_CALL(type, &thrd->name)
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_RELAX() __builtin_ia32_pause()
+#else
+#define CPU_RELAX()
+#endif
 
-/* ----- PGM GETTERS & SETTERS ----- */
+/* consistent copy of the runtime fields of a processus */
+typedef struct s_thrd_snapshot {
+    pid_t pid;
+    int32_t restart_counter;
+    time_t start_timestamp;
+    uint8_t info;
+} t_thrd_snapshot;
+
+/* Seqlock write side, reactor only. Readers retry while seq is odd or has
+ * changed during their copy. The end of a write is mirrored in the status
+ * table when there is one. */
+static inline void thrd_write_begin(t_thread_data *thrd) {
+    atomic_store_explicit(
+        &thrd->seq, atomic_load_explicit(&thrd->seq, memory_order_relaxed) + 1,
+        memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void thrd_write_end(t_thread_data *thrd) {
+    atomic_store_explicit(
+        &thrd->seq, atomic_load_explicit(&thrd->seq, memory_order_relaxed) + 1,
+        memory_order_release);
+    if (thrd->pgm->privy.status && thrd->rid < thrd->pgm->privy.nb_status)
+        status_table_update(&thrd->pgm->privy.status[thrd->rid], thrd->pid,
+                            thrd->restart_counter, thrd->info & 0x0f,
+                            thrd->start_timestamp);
+}
+
+/* Lock-free read of the runtime fields from any thread */
+static inline void thrd_snapshot(const t_thread_data *thrd,
+                                 t_thrd_snapshot *snap) {
+    uint32_t seq;
+
+    do {
+        while ((seq = atomic_load_explicit(&thrd->seq, memory_order_acquire)) &
+               1)
+            CPU_RELAX();
+        snap->pid = thrd->pid;
+        snap->restart_counter = thrd->restart_counter;
+        snap->start_timestamp = thrd->start_timestamp;
+        snap->info = atomic_load_explicit(&thrd->info, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+    } while (atomic_load_explicit(&thrd->seq, memory_order_relaxed) != seq);
+}
 
 /*
- * update data in struct program_specification.
+ * update data in struct thread_data. Reactor only.
  * @args:
  *   name    is the name of the variable from the struct that we want to update
  *   value   is the value we want to give to this variable
  **/
-#define PGM_SPEC_SET_T(name, value)                \
-    do {                                           \
-        pthread_rwlock_wrlock(&thrd->pgm->rw_pgm); \
-        thrd->pgm->name = value;                   \
-        pthread_rwlock_unlock(&thrd->pgm->rw_pgm); \
-    } while (0)
-#define PGM_SPEC_SET(name, value)                  \
-    do {                                           \
-        pthread_rwlock_wrlock(&pgm->privy.rw_pgm); \
-        pgm->name = value;                         \
-        pthread_rwlock_unlock(&pgm->privy.rw_pgm); \
+#define THRD_DATA_SET(name, value) \
+    do {                           \
+        thrd_write_begin(thrd);    \
+        thrd->name = value;        \
+        thrd_write_end(thrd);      \
     } while (0)
 
-/* generic getters functions to have lock-free value from struct
- * program_specification */
-#define PGM_SPEC_GET_FUNC(type) pgm_spec_get_##type
-#define PGM_SPEC_GET_CALL(type, obj, name) \
-    PGM_SPEC_GET_FUNC(type)(obj, &(obj->name))
-
-#define PGM_SPEC_GET_DECL(type) \
-    static type PGM_SPEC_GET_FUNC(type)(t_pgm * pgm, type * value)
-#define PGM_SPEC_GET_IMPLEMENTATION(type)          \
-    PGM_SPEC_GET_DECL(type) {                      \
-        type save;                                 \
-                                                   \
-        pthread_rwlock_rdlock(&pgm->privy.rw_pgm); \
-        save = *value;                             \
-        pthread_rwlock_unlock(&pgm->privy.rw_pgm); \
-        return save;                               \
-    }
-
-/* pgm_spec getter. name is the name of the struct variable name */
-#define PGM_SPEC_GET_T(type, name) \
-    PGM_SPEC_GET_CALL(type, (thrd->pgm), name) /* get from launcher thread */
-
-#define PGM_SPEC_GET(type, name) \
-    PGM_SPEC_GET_CALL(type, (pgm), name) /* get from master thread */
-
 /* ----- PGM STATE GETTERS & SETTERS ----- */
 
 /*
@@ -228,67 +224,70 @@ typedef struct thread_data {
 
 /* ----- LOGGING MACROS ----- */
 
-#define BUF_LOG_LEN 256
-#define TM_LOG(func, fmt, ...)                                                \
-    do {                                                                      \
-        if (pthread_mutex_lock(&thrd->node->mtx_log)) break;                  \
-        char buf[BUF_LOG_LEN] = {0};                                          \
-        time_t curtime = time(NULL);                                          \
-        struct tm loctime;                                                    \
-        size_t len;                                                           \
-        if (localtime_r(&curtime, &loctime) != &loctime) break;               \
-                                                                              \
-        len = strftime(buf, BUF_LOG_LEN, "%F, %T ", &loctime);                \
-        len += snprintf(buf + len, BUF_LOG_LEN - len, "- [%17s] - " fmt "\n", \
-                        func, __VA_ARGS__);                                   \
-        fwrite(buf, sizeof(char), len, thrd->node->tm_stream_log);            \
-        fflush(thrd->node->tm_stream_log);                                    \
-        if (pthread_mutex_unlock(&thrd->node->mtx_log)) break;                \
+/* lines are formatted by the calling thread & written by the logger thread */
+#define TM_LOG(func, fmt, ...)                                      \
+    logger_log(thrd->pgm->privy.node->logger, "- [%17s] - " fmt "\n", func, \
+               __VA_ARGS__)
+#define TM_LOG2(func, fmt, ...) \
+    logger_log(node->logger, "- [" func "] - " fmt "\n", __VA_ARGS__)
+
+/* Logging macros below are only used from the reactor, which is the only
+ * writer of t_thread_data: fields are read without locking. With a journal
+ * (taskmaster -j) a processus transition costs a 32 bytes memcpy, its text
+ * being rendered by taskmaster-logdump. */
+#define TM_JOURNAL(ev, val)                                        \
+    journal_record(thrd->pgm->privy.node->journal,                            \
+                   &(t_jrn_record){.time_ns = journal_clock(),     \
+                                   .pgm_id = thrd->pgm->privy.id,  \
+                                   .rid = thrd->rid,               \
+                                   .pid = thrd->pid,               \
+                                   .restart_counter =              \
+                                       thrd->restart_counter,      \
+                                   .value = (val),                 \
+                                   .event = (ev)})
+
+#define TM_THRD_LOG(ev)                                                      \
+    do {                                                                     \
+        if (thrd->pgm->privy.node->journal)                                  \
+            TM_JOURNAL(ev, 0);                                               \
+        else                                                                 \
+            TM_LOG("launcher",                                               \
+                   "[%s pid[%d]] - rank[%u] - restart_counter[%d] • [%s]",   \
+                   thrd->conf->usr.name, thrd->pid, thrd->rid,               \
+                   thrd->restart_counter, g_jrn_event[ev].str);              \
     } while (0)
-#define TM_LOG2(func, fmt, ...)                                   \
-    do {                                                          \
-        if (pthread_mutex_lock(&node->mtx_log)) break;            \
-        char buf[BUF_LOG_LEN] = {0};                              \
-        time_t curtime = time(NULL);                              \
-        struct tm loctime;                                        \
-        size_t len;                                               \
-        if (localtime_r(&curtime, &loctime) != &loctime) break;   \
-                                                                  \
-        len = strftime(buf, BUF_LOG_LEN, "%F, %T ", &loctime);    \
-        len += snprintf(buf + len, BUF_LOG_LEN - len,             \
-                        "- [" func "] - " fmt "\n", __VA_ARGS__); \
-        fwrite(buf, sizeof(char), len, node->tm_stream_log);      \
-        fflush(node->tm_stream_log);                              \
-        if (pthread_mutex_unlock(&node->mtx_log)) break;          \
+
+#define TM_CHILDCONTROL_LOG(ev)                                              \
+    do {                                                                     \
+        if (thrd->pgm->privy.node->journal)                                  \
+            TM_JOURNAL(ev, child_ret);                                       \
+        else                                                                 \
+            TM_LOG("child supervisor",                                       \
+                   "[%s pid[%d]] - rank[%u] - restart_counter[%d] • [%s %d]", \
+                   thrd->conf->usr.name, thrd->pid, thrd->rid,               \
+                   thrd->restart_counter, g_jrn_event[ev].str, child_ret);   \
     } while (0)
 
-#define TM_THRD_LOG(status)                                                \
-    TM_LOG("launcher thread",                                              \
-           "[%s pid[%d]] - tid[%lu] - restart_counter[%d] • [" status "]", \
-           PGM_SPEC_GET_T(char_Ptr, usr.name), THRD_DATA_GET(pid_t, pid),  \
-           THRD_DATA_GET(pthread_t, tid),                                  \
-           THRD_DATA_GET(int32_t, restart_counter));
-
-#define TM_CHILDCONTROL_LOG(status)                                           \
-    TM_LOG("child supervisor",                                                \
-           "[%s pid[%d]] - tid[%lu] - restart_counter[%d] • [" status " %d]", \
-           PGM_SPEC_GET_T(char_Ptr, usr.name), THRD_DATA_GET(pid_t, pid),     \
-           THRD_DATA_GET(pthread_t, tid),                                     \
-           THRD_DATA_GET(int32_t, restart_counter), child_ret);
-
-#define TM_STOP_LOG(status)                                                   \
-    TM_LOG("stop timer",                                                      \
-           "[%s] - tid[%lu] - rank[%d] - stop_time[%d ms] • [" status "]",    \
-           PGM_SPEC_GET_T(char_Ptr, usr.name), THRD_DATA_GET(pthread_t, tid), \
-           THRD_DATA_GET(uint32_t, rid),                                      \
-           PGM_SPEC_GET_T(uint32_t, usr.stoptime));
-
-#define TM_START_LOG(status)                                                   \
-    TM_LOG("start timer",                                                      \
-           "[%s pid[%d]] - tid[%lu] - rank[%d] - start_time[%d ms] • [" status \
-           "]",                                                                \
-           PGM_SPEC_GET_T(char_Ptr, usr.name), pid,                            \
-           THRD_DATA_GET(pthread_t, tid), THRD_DATA_GET(uint32_t, rid),        \
-           PGM_SPEC_GET_T(uint32_t, usr.starttime));
+#define TM_STOP_LOG(ev)                                                \
+    do {                                                               \
+        if (thrd->pgm->privy.node->journal)                            \
+            TM_JOURNAL(ev, thrd->conf->usr.stoptime);                  \
+        else                                                           \
+            TM_LOG("stop timer",                                       \
+                   "[%s] - rank[%u] - stop_time[%d ms] • [%s]",        \
+                   thrd->conf->usr.name, thrd->rid,                    \
+                   thrd->conf->usr.stoptime, g_jrn_event[ev].str);     \
+    } while (0)
+
+#define TM_START_LOG(ev)                                                    \
+    do {                                                                    \
+        if (thrd->pgm->privy.node->journal)                                 \
+            TM_JOURNAL(ev, thrd->conf->usr.starttime);                      \
+        else                                                                \
+            TM_LOG("start timer",                                           \
+                   "[%s pid[%d]] - rank[%u] - start_time[%d ms] • [%s]",    \
+                   thrd->conf->usr.name, thrd->pid, thrd->rid,              \
+                   thrd->conf->usr.starttime, g_jrn_event[ev].str);         \
+    } while (0)
 
 #endif
@@ -0,0 +1,462 @@
+#include "sink_io.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <linux/io_uring.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "taskmaster.h"
+
+/* Counts the bytes of a failed write of file, reported on its first one */
+static void sink_file_lost(t_sink_file *file, uint64_t len, int32_t error) {
+    if (!atomic_fetch_add(&file->lost, len))
+        fprintf(stderr, "%s: %s: %s: output lost\n", program_invocation_name,
+                file->name, strerror(error));
+}
+
+/* ================================= io_uring =============================== */
+
+static int32_t uring_enter(t_uring *ring, uint32_t submit, uint32_t wait) {
+    return syscall(__NR_io_uring_enter, ring->fd, submit, wait,
+                   wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+static void uring_unmap(t_uring *ring) {
+    if (ring->sqes && ring->sqes != MAP_FAILED)
+        munmap(ring->sqes, ring->entries * sizeof(struct io_uring_sqe));
+    if (ring->cq_map && ring->cq_map != MAP_FAILED &&
+        ring->cq_map != ring->sq_map)
+        munmap(ring->cq_map, ring->cq_size);
+    if (ring->sq_map && ring->sq_map != MAP_FAILED)
+        munmap(ring->sq_map, ring->sq_size);
+    if (ring->fd >= 0) close(ring->fd);
+    *ring = (t_uring){.fd = -1};
+}
+
+/* Maps the rings. Offsets of -1 need IORING_FEAT_RW_CUR_POS (5.6). */
+static uint8_t uring_setup(t_uring *ring) {
+    struct io_uring_params p = {0};
+    uint8_t *sq, *cq;
+
+    *ring = (t_uring){.fd = syscall(__NR_io_uring_setup, SINK_IO_DEPTH, &p)};
+    if (ring->fd == -1) return EXIT_FAILURE;
+    if (!(p.features & IORING_FEAT_RW_CUR_POS)) goto error;
+    ring->entries = p.sq_entries;
+    ring->sq_size = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    ring->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_size > ring->sq_size) ring->sq_size = ring->cq_size;
+        ring->cq_size = ring->sq_size;
+    }
+    ring->sq_map =
+        mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_map == MAP_FAILED) goto error;
+    ring->cq_map = p.features & IORING_FEAT_SINGLE_MMAP
+                       ? ring->sq_map
+                       : mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, ring->fd,
+                              IORING_OFF_CQ_RING);
+    if (ring->cq_map == MAP_FAILED) goto error;
+    ring->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+                      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) goto error;
+    sq = ring->sq_map;
+    cq = ring->cq_map;
+    ring->sq_head = (_Atomic uint32_t *)(sq + p.sq_off.head);
+    ring->sq_tail = (_Atomic uint32_t *)(sq + p.sq_off.tail);
+    ring->sq_mask = *(uint32_t *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (uint32_t *)(sq + p.sq_off.array);
+    ring->cq_head = (_Atomic uint32_t *)(cq + p.cq_off.head);
+    ring->cq_tail = (_Atomic uint32_t *)(cq + p.cq_off.tail);
+    ring->cq_mask = *(uint32_t *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return EXIT_SUCCESS;
+
+error:
+    uring_unmap(ring);
+    return EXIT_FAILURE;
+}
+
+/* Submits the queued sqes, waiting for 'wait' completions */
+static void uring_submit(t_uring *ring, uint32_t wait) {
+    int32_t ret;
+
+    while (ring->queued || wait) {
+        ret = uring_enter(ring, ring->queued, wait);
+        if (ret == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EBUSY) {
+                sched_yield();
+                continue;
+            }
+            return; /* nothing was consumed: submitted again by the next call */
+        }
+        ring->queued -= ret;
+        wait = 0;
+    }
+}
+
+static void uring_queue(t_sink_io *io, t_sink_buf *buf) {
+    t_uring *ring = &io->ring;
+    t_sink_file *file = buf->file;
+    uint32_t tail = atomic_load_explicit(ring->sq_tail, memory_order_relaxed);
+    struct io_uring_sqe *sqe;
+
+    if (tail - atomic_load_explicit(ring->sq_head, memory_order_acquire) ==
+        ring->entries)
+        uring_submit(ring, 0);
+    sqe = &ring->sqes[tail & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = io->fixed_bufs ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->fd = file->slot >= 0 ? file->slot : file->fd;
+    sqe->flags = (file->slot >= 0 ? IOSQE_FIXED_FILE : 0) |
+                 (buf->off < 0 ? IOSQE_IO_DRAIN : 0);
+    sqe->off = buf->off < 0 ? (uint64_t)-1 : (uint64_t)(buf->off + buf->done);
+    sqe->addr = (uintptr_t)(buf->data + buf->done);
+    sqe->len = buf->len - buf->done;
+    sqe->buf_index = buf->index;
+    sqe->user_data = buf->index;
+    ring->sq_array[tail & ring->sq_mask] = tail & ring->sq_mask;
+    atomic_store_explicit(ring->sq_tail, tail + 1, memory_order_release);
+    ring->queued++;
+}
+
+static void sink_buf_release(t_sink_io *io, t_sink_buf *buf);
+
+/* Handles the completions: a short write is queued again for the rest, a
+ * failed one drops it */
+static void uring_reap(t_sink_io *io) {
+    t_uring *ring = &io->ring;
+    uint32_t head = atomic_load_explicit(ring->cq_head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(ring->cq_tail, memory_order_acquire);
+    struct io_uring_cqe *cqe;
+    t_sink_buf *buf;
+
+    for (; head != tail; head++) {
+        cqe = &ring->cqes[head & ring->cq_mask];
+        buf = &io->buf[cqe->user_data];
+        if (cqe->res > 0 && buf->done + cqe->res < buf->len) {
+            buf->done += cqe->res;
+            uring_queue(io, buf);
+            continue;
+        }
+        if (cqe->res <= 0)
+            sink_file_lost(buf->file, buf->len - buf->done,
+                           cqe->res ? -cqe->res : EIO);
+        atomic_fetch_sub(&buf->file->inflight, 1);
+        sink_buf_release(io, buf);
+    }
+    atomic_store_explicit(ring->cq_head, head, memory_order_release);
+}
+
+/* Registers the pool & empty file slots. Both are optional: registering
+ * fails over RLIMIT_MEMLOCK on kernels accounting it. */
+static void uring_register(t_sink_io *io) {
+    struct iovec iov[SINK_IO_DEPTH];
+    int32_t fds[SINK_IO_FILES];
+
+    for (uint32_t i = 0; i < io->nb_buf; i++)
+        iov[i] = (struct iovec){io->buf[i].data, SINK_IO_BUF_SIZE};
+    io->fixed_bufs = !syscall(__NR_io_uring_register, io->ring.fd,
+                              IORING_REGISTER_BUFFERS, iov, io->nb_buf);
+    memset(fds, -1, sizeof(fds));
+    io->fixed_files = !syscall(__NR_io_uring_register, io->ring.fd,
+                               IORING_REGISTER_FILES, fds, SINK_IO_FILES);
+}
+
+static int32_t uring_file_update(t_sink_io *io, uint32_t slot, int32_t fd) {
+    struct io_uring_files_update update = {
+        .offset = slot,
+        .fds = (uintptr_t)&fd,
+    };
+
+    return syscall(__NR_io_uring_register, io->ring.fd,
+                   IORING_REGISTER_FILES_UPDATE, &update, 1);
+}
+
+/* Gives the file a slot if one is left: the kernel then skips the lookup of
+ * the fd at each write */
+static void uring_file_register(t_sink_io *io, t_sink_file *file) {
+    file->slot = -1;
+    if (!io->fixed_files) return;
+    for (uint32_t slot = 0; slot < SINK_IO_FILES; slot++) {
+        if (io->slot_used[slot]) continue;
+        if (uring_file_update(io, slot, file->fd) == 1) {
+            io->slot_used[slot] = true;
+            file->slot = slot;
+        }
+        return;
+    }
+}
+
+/* ================================== worker ================================ */
+
+/* Writes a run of buffers of the same file, contiguous if at an offset. A
+ * failure drops what is left of the run. */
+static void worker_write(t_sink_buf *first, uint32_t nb) {
+    struct iovec iov[IOV_MAX];
+    int64_t off = first->off;
+    t_sink_buf *buf = first;
+    uint32_t cnt = 0;
+    uint64_t left = 0;
+    ssize_t ret;
+
+    for (uint32_t i = 0; i < nb; i++, buf = buf->next)
+        iov[i] = (struct iovec){buf->data, buf->len};
+    while (cnt < nb) {
+        ret = off < 0 ? writev(first->file->fd, iov + cnt, nb - cnt)
+                      : pwritev(first->file->fd, iov + cnt, nb - cnt, off);
+        if (ret == -1 && errno == EINTR) continue;
+        if (ret <= 0) {
+            for (uint32_t i = cnt; i < nb; i++) left += iov[i].iov_len;
+            sink_file_lost(first->file, left, ret ? errno : EIO);
+            return;
+        }
+        if (off >= 0) off += ret;
+        while (cnt < nb && (size_t)ret >= iov[cnt].iov_len)
+            ret -= iov[cnt++].iov_len;
+        if (cnt < nb) {
+            iov[cnt].iov_base = (char *)iov[cnt].iov_base + ret;
+            iov[cnt].iov_len -= ret;
+        }
+    }
+}
+
+/* Whether buf follows prev in the same file */
+static bool worker_contiguous(const t_sink_buf *prev, const t_sink_buf *buf) {
+    if (buf->file != prev->file) return false;
+    if (prev->off < 0) return buf->off < 0;
+    return buf->off == prev->off + prev->len;
+}
+
+static void *sink_io_worker(void *arg) {
+    t_sink_io *io = arg;
+    t_sink_buf *batch, *first, *buf, *last;
+    uint32_t nb;
+
+    pthread_mutex_lock(&io->lock);
+    while (true) {
+        while (!io->queue && !io->exit) pthread_cond_wait(&io->work, &io->lock);
+        if (!io->queue) break;
+        batch = io->queue;
+        io->queue = NULL;
+        io->queue_end = &io->queue;
+        pthread_mutex_unlock(&io->lock);
+
+        for (first = batch; first; first = buf) {
+            for (nb = 1, last = first, buf = first->next;
+                 buf && nb < IOV_MAX && worker_contiguous(last, buf);
+                 nb++, last = buf, buf = buf->next)
+                ;
+            worker_write(first, nb);
+        }
+
+        pthread_mutex_lock(&io->lock);
+        for (buf = batch; buf; buf = last) {
+            last = buf->next;
+            atomic_fetch_sub(&buf->file->inflight, 1);
+            buf->next = io->done;
+            io->done = buf;
+        }
+        pthread_cond_signal(&io->idle);
+    }
+    pthread_mutex_unlock(&io->lock);
+    return NULL;
+}
+
+/* =================================== api ================================== */
+
+static void sink_buf_release(t_sink_io *io, t_sink_buf *buf) {
+    buf->next = io->free;
+    io->free = buf;
+    io->inflight--;
+}
+
+/* Waits for at least one buffer in flight to come back */
+static void sink_io_wait_one(t_sink_io *io) {
+    uint32_t inflight = io->inflight;
+    t_sink_buf *done, *next;
+
+    sink_io_submit(io);
+    if (io->uring) {
+        if (io->inflight < inflight) return; /* reaped by the submit */
+        uring_submit(&io->ring, 1);
+        uring_reap(io);
+        return;
+    }
+    pthread_mutex_lock(&io->lock);
+    while (!io->done) pthread_cond_wait(&io->idle, &io->lock);
+    done = io->done;
+    io->done = NULL;
+    pthread_mutex_unlock(&io->lock);
+    for (; done; done = next) {
+        next = done->next;
+        sink_buf_release(io, done);
+    }
+}
+
+/* The worker is created with all signals blocked, as the other threads */
+uint8_t sink_io_init(t_sink_io *io, uint32_t nb_buf) {
+    sigset_t all, old;
+    int32_t ret;
+
+    *io = (t_sink_io){.ring.fd = -1, .nb_buf = nb_buf};
+    if (nb_buf > SINK_IO_DEPTH) io->nb_buf = SINK_IO_DEPTH;
+    if (!(io->pool = aligned_alloc(4096, io->nb_buf * SINK_IO_BUF_SIZE)))
+        return EXIT_FAILURE;
+    for (uint32_t i = 0; i < io->nb_buf; i++) {
+        io->buf[i] = (t_sink_buf){.data = io->pool + i * SINK_IO_BUF_SIZE,
+                                  .index = i,
+                                  .next = io->free};
+        io->free = &io->buf[i];
+    }
+    io->batch_end = &io->batch;
+    io->queue_end = &io->queue;
+    if (!uring_setup(&io->ring)) {
+        io->uring = true;
+        uring_register(io);
+        return EXIT_SUCCESS;
+    }
+    pthread_mutex_init(&io->lock, NULL);
+    pthread_cond_init(&io->work, NULL);
+    pthread_cond_init(&io->idle, NULL);
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    ret = pthread_create(&io->worker, NULL, sink_io_worker, io);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret) {
+        pthread_cond_destroy(&io->idle);
+        pthread_cond_destroy(&io->work);
+        pthread_mutex_destroy(&io->lock);
+        DESTROY_PTR(io->pool);
+        errno = ret;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/* Waits for all the writes, then stops the worker or closes the ring */
+void sink_io_destroy(t_sink_io *io) {
+    if (!io->pool) return;
+    sink_io_drain(io);
+    if (io->uring) {
+        uring_unmap(&io->ring);
+    } else {
+        pthread_mutex_lock(&io->lock);
+        io->exit = true;
+        pthread_cond_signal(&io->work);
+        pthread_mutex_unlock(&io->lock);
+        pthread_join(io->worker, NULL);
+        pthread_cond_destroy(&io->idle);
+        pthread_cond_destroy(&io->work);
+        pthread_mutex_destroy(&io->lock);
+    }
+    DESTROY_PTR(io->pool);
+}
+
+/* A free buffer, of SINK_IO_BUF_SIZE bytes: waits for one if they are all
+ * in flight */
+t_sink_buf *sink_io_buf(t_sink_io *io) {
+    t_sink_buf *buf;
+
+    if (io->uring && !io->free) uring_reap(io);
+    while (!io->free) sink_io_wait_one(io);
+    buf = io->free;
+    io->free = buf->next;
+    io->inflight++;
+    buf->len = buf->done = 0;
+    return buf;
+}
+
+/* Gives back a buffer which won't be written */
+void sink_io_drop(t_sink_io *io, t_sink_buf *buf) { sink_buf_release(io, buf); }
+
+/* Queues the write of buf->len bytes of buf at 'off' of file, until the next
+ * sink_io_submit() */
+void sink_io_write(t_sink_io *io, t_sink_file *file, t_sink_buf *buf,
+                   int64_t off) {
+    buf->file = file;
+    buf->off = off;
+    buf->next = NULL;
+    atomic_fetch_add(&file->inflight, 1);
+    if (!io->uring) {
+        *io->batch_end = buf;
+        io->batch_end = &buf->next;
+        return;
+    }
+    if (file->slot == SINK_FILE_NEW) uring_file_register(io, file);
+    uring_queue(io, buf);
+}
+
+/* Starts the writes queued, without waiting for them */
+void sink_io_submit(t_sink_io *io) {
+    if (io->uring) {
+        uring_submit(&io->ring, 0);
+        uring_reap(io);
+        return;
+    }
+    if (!io->batch) return;
+    pthread_mutex_lock(&io->lock);
+    *io->queue_end = io->batch;
+    io->queue_end = io->batch_end;
+    pthread_cond_signal(&io->work);
+    pthread_mutex_unlock(&io->lock);
+    io->batch = NULL;
+    io->batch_end = &io->batch;
+}
+
+/* Submits the writes queued & waits for all of them. By the owner, before
+ * it exits: io_uring cancels the requests of an exiting thread. */
+void sink_io_drain(t_sink_io *io) {
+    while (io->inflight) sink_io_wait_one(io);
+}
+
+/* Any thread: the file isn't known by the instance until its first write.
+ * name must outlive it. */
+void sink_io_file_init(t_sink_file *file, int32_t fd, const char *name) {
+    file->fd = fd;
+    file->slot = SINK_FILE_NEW;
+    file->name = name;
+    atomic_init(&file->inflight, 0);
+    atomic_init(&file->lost, 0);
+}
+
+/* Waits for the writes of file, before it is truncated or renamed */
+void sink_io_file_wait(t_sink_io *io, t_sink_file *file) {
+    while (atomic_load(&file->inflight)) sink_io_wait_one(io);
+}
+
+/* The fd of file now refers to another file (dup3): its slot is updated */
+void sink_io_file_reset(t_sink_io *io, t_sink_file *file) {
+    sink_io_file_wait(io, file);
+    if (file->slot >= 0 && uring_file_update(io, file->slot, file->fd) != 1) {
+        uring_file_update(io, file->slot, -1);
+        io->slot_used[file->slot] = false;
+        file->slot = -1;
+    }
+}
+
+/* Waits for the writes of file & frees its slot, reporting the bytes lost
+ * if any. The fd is left open. */
+void sink_io_file_close(t_sink_io *io, t_sink_file *file) {
+    uint64_t lost;
+
+    sink_io_file_wait(io, file);
+    if ((lost = atomic_exchange(&file->lost, 0)))
+        fprintf(stderr, "%s: %s: %" PRIu64 " bytes of output lost\n",
+                program_invocation_name, file->name, lost);
+    if (file->slot >= 0) {
+        uring_file_update(io, file->slot, -1);
+        io->slot_used[file->slot] = false;
+    }
+    file->slot = SINK_FILE_NEW;
+}
@@ -0,0 +1,111 @@
+#ifndef SINK_IO_H
+#define SINK_IO_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Asynchronous writes of log files, so that no thread waits on a disk.
+ *
+ * The owner of an instance - a single thread - fills buffers of a fixed
+ * pool, queues them with the file & the offset to write them at, then
+ * submits the batch at once. With io_uring the pool is registered once, so
+ * is each file in a slot, & a batch costs one io_uring_enter(). Without it -
+ * kernel older than 5.6, seccomp - a worker thread writes the batches with
+ * pwritev(), merging the buffers contiguous in a file. Either way the memory
+ * in flight is bounded by the pool: an owner out of buffers waits for a
+ * write to complete. The owner waits for its writes before it exits: the
+ * kernel cancels the io_uring requests of an exiting thread.
+ *
+ * Buffers written at an offset complete in any order. A buffer written at
+ * offset -1 - file opened with O_APPEND, or not seekable - waits for the
+ * writes queued before it, & the ones queued after it wait for it.
+ *
+ * A write failing - ENOSPC, EIO... - drops the rest of its buffer: the bytes
+ * lost are counted by file, reported on stderr at the first failure & once
+ * more, in total, when the file is closed.
+ */
+
+#define SINK_IO_BUF_SIZE (64 * 1024)
+#define SINK_IO_DEPTH (64U)  /* submission queue entries, max buffers */
+#define SINK_IO_FILES (256U) /* registered file slots */
+#define SINK_FILE_NEW (-2)   /* slot of a file not registered yet */
+
+typedef struct s_sink_file {
+    int32_t fd;
+    int32_t slot; /* registered file, -1 if none, or SINK_FILE_NEW */
+    atomic_uint inflight;
+    const char *name;       /* of the file, for the reports: not owned */
+    _Atomic uint64_t lost;  /* bytes of failed writes */
+} t_sink_file;
+
+typedef struct s_sink_buf {
+    char *data;
+    uint32_t len;  /* bytes to write */
+    uint32_t done; /* bytes written */
+    int64_t off;   /* where to write data, -1: at the position of the file */
+    uint32_t index;
+    t_sink_file *file;
+    struct s_sink_buf *next;
+} t_sink_buf;
+
+typedef struct s_uring {
+    int32_t fd;
+    uint32_t entries;
+    uint32_t queued; /* sqes not submitted yet */
+    _Atomic uint32_t *sq_head;
+    _Atomic uint32_t *sq_tail;
+    uint32_t sq_mask;
+    uint32_t *sq_array;
+    _Atomic uint32_t *cq_head;
+    _Atomic uint32_t *cq_tail;
+    uint32_t cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_map;
+    void *cq_map;
+    size_t sq_size;
+    size_t cq_size;
+} t_uring;
+
+typedef struct s_sink_io {
+    bool uring;      /* false: writes by the worker */
+    bool fixed_bufs; /* pool registered */
+    bool fixed_files;
+    t_uring ring;
+    char *pool;
+    uint32_t nb_buf;
+    uint32_t inflight; /* buffers not back in the free list */
+    t_sink_buf buf[SINK_IO_DEPTH];
+    t_sink_buf *free;
+    uint8_t slot_used[SINK_IO_FILES];
+
+    /* worker */
+    t_sink_buf *batch; /* queued by the owner, not submitted yet */
+    t_sink_buf **batch_end;
+    pthread_t worker;
+    pthread_mutex_t lock;
+    pthread_cond_t work; /* queue filled or exit */
+    pthread_cond_t idle; /* done filled */
+    t_sink_buf *queue;   /* submitted to the worker */
+    t_sink_buf **queue_end;
+    t_sink_buf *done;    /* written, back to the owner */
+    bool exit;
+} t_sink_io;
+
+uint8_t sink_io_init(t_sink_io *io, uint32_t nb_buf);
+void sink_io_destroy(t_sink_io *io);
+t_sink_buf *sink_io_buf(t_sink_io *io);
+void sink_io_drop(t_sink_io *io, t_sink_buf *buf);
+void sink_io_write(t_sink_io *io, t_sink_file *file, t_sink_buf *buf,
+                   int64_t off);
+void sink_io_submit(t_sink_io *io);
+void sink_io_drain(t_sink_io *io);
+void sink_io_file_init(t_sink_file *file, int32_t fd, const char *name);
+void sink_io_file_wait(t_sink_io *io, t_sink_file *file);
+void sink_io_file_reset(t_sink_io *io, t_sink_file *file);
+void sink_io_file_close(t_sink_io *io, t_sink_file *file);
+
+#endif
@@ -0,0 +1,118 @@
+#include "startup.h"
+
+#include <time.h>
+
+#include "run_server.h"
+
+static const char *const g_phase_name[STARTUP_PHASE_NB] = {
+    "init",        "parse",     "sanitize",    "init_thrd",
+    "thread_pool", "autostart", "all_started",
+};
+
+static int64_t startup_clock(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+uint8_t startup_open(t_startup *startup, const char *path) {
+    *startup = (t_startup){.t0 = startup_clock()};
+    if (!(startup->path = strdup(path))) return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+/* Ends 'phase'. No-op without -t. */
+void startup_mark(t_startup *startup, t_startup_phase phase) {
+    if (startup && !startup->mark[phase]) startup->mark[phase] = startup_clock();
+}
+
+/* Writes the trace: the duration of each phase reached, in ms, then the
+ * time from main() until the last phase reached */
+static void startup_report(t_startup *startup) {
+    int64_t prev = startup->t0, last = startup->t0;
+    FILE *file;
+
+    startup->reported = true;
+    if (!(file = fopen(startup->path, "w"))) {
+        perror(startup->path);
+        return;
+    }
+    fprintf(file,
+            "{\"programs\": %u, \"processus\": %u, \"autostart\": %u, "
+            "\"started\": %u",
+            startup->nb_pgm, startup->nb_proc, startup->nb_autostart,
+            startup->nb_autostart - startup->nb_pending);
+    for (uint32_t p = 0; p < STARTUP_PHASE_NB; p++) {
+        if (!startup->mark[p]) {
+            fprintf(file, ", \"%s_ms\": null", g_phase_name[p]);
+            continue;
+        }
+        fprintf(file, ", \"%s_ms\": %.3f", g_phase_name[p],
+                (startup->mark[p] - prev) / 1e6);
+        prev = last = startup->mark[p];
+    }
+    fprintf(file, ", \"total_ms\": %.3f, \"complete\": %s}\n",
+            (last - startup->t0) / 1e6,
+            startup->mark[STARTUP_ALL_STARTED] ? "true" : "false");
+    fclose(file);
+}
+
+/* Once the autostart processus are spawned, counts the ones to wait for.
+ * Master thread only, from then on. */
+uint8_t startup_expect(t_startup *startup, t_tm_node *node) {
+    const t_pgm_index *index = PGM_INDEX(node);
+    uint32_t nb_bit = 0;
+    t_pgm *pgm;
+
+    if (!startup) return EXIT_SUCCESS;
+    startup_mark(startup, STARTUP_AUTOSTART);
+    startup->nb_id = index->nb_id;
+    if (!(startup->first = calloc(index->nb_id + 1, sizeof(uint32_t))))
+        return EXIT_FAILURE;
+    for (uint32_t id = 0; id < index->nb_id; id++) {
+        startup->first[id] = nb_bit;
+        if (!(pgm = index->by_id[id])) continue;
+        startup->nb_pgm++;
+        startup->nb_proc += pgm->privy.nb_thrd;
+        nb_bit += pgm->privy.nb_thrd;
+        if (PGM_CONF(pgm)->usr.autostart)
+            startup->nb_autostart += pgm->privy.nb_thrd;
+    }
+    startup->first[index->nb_id] = nb_bit;
+    if (!(startup->seen = calloc(nb_bit / 64 + 1, sizeof(uint64_t))))
+        return EXIT_FAILURE;
+    startup->nb_pending = startup->nb_autostart;
+    if (!startup->nb_pending) {
+        startup_mark(startup, STARTUP_ALL_STARTED);
+        startup_report(startup);
+    }
+    return EXIT_SUCCESS;
+}
+
+/* A processus reached STARTED: the trace is written once the last autostart
+ * one did. Processus started again, or added since, don't count. */
+void startup_started(t_startup *startup, const t_thread_data *thrd) {
+    uint32_t id = thrd->pgm->privy.id, bit;
+
+    if (!startup || startup->reported || !startup->seen ||
+        id >= startup->nb_id || !PGM_CONF(thrd->pgm)->usr.autostart)
+        return;
+    bit = startup->first[id] + thrd->rid;
+    if (bit >= startup->first[id + 1] ||
+        startup->seen[bit / 64] & (1ULL << (bit % 64)))
+        return;
+    startup->seen[bit / 64] |= 1ULL << (bit % 64);
+    if (--startup->nb_pending) return;
+    startup_mark(startup, STARTUP_ALL_STARTED);
+    startup_report(startup);
+}
+
+/* Writes the trace if some autostart processus never started */
+void startup_close(t_startup *startup) {
+    if (!startup->reported && startup->path) startup_report(startup);
+    free(startup->path);
+    free(startup->first);
+    free(startup->seen);
+    *startup = (t_startup){0};
+}
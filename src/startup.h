@@ -0,0 +1,48 @@
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Startup trace (taskmaster -t file): time of each phase from main() until
+ * every autostart processus is STARTED, written to 'file' as one JSON object
+ * as soon as the last one is, or at exit if some never were. Read by
+ * test/bench/startup_bench.c (make bench-startup).
+ */
+
+typedef enum e_startup_phase {
+    STARTUP_INIT,        /* main() until the configuration is read */
+    STARTUP_PARSE,       /* yaml or cache, defaults filled in */
+    STARTUP_SANITIZE,    /* paths checked, log files opened */
+    STARTUP_INIT_THRD,   /* processus data & name index */
+    STARTUP_THREAD_POOL, /* reactor, reaper, timer wheel, processus pool */
+    STARTUP_AUTOSTART,   /* autostart processus spawned */
+    STARTUP_ALL_STARTED, /* the last one reached STARTED */
+    STARTUP_PHASE_NB,
+} t_startup_phase;
+
+typedef struct s_tm_node t_tm_node;
+typedef struct thread_data t_thread_data;
+
+typedef struct s_startup {
+    char *path;
+    int64_t t0;                     /* CLOCK_MONOTONIC at startup_open() */
+    int64_t mark[STARTUP_PHASE_NB]; /* end of each phase, 0 if not reached */
+    uint32_t nb_pgm;
+    uint32_t nb_proc;
+    uint32_t nb_autostart;
+    uint32_t nb_pending; /* autostart processus never STARTED yet */
+    uint32_t nb_id;      /* programs known at startup: ids are lower */
+    uint32_t *first;     /* bit of the rank 0 of each program in 'seen' */
+    uint64_t *seen;      /* processus STARTED at least once */
+    bool reported;
+} t_startup;
+
+uint8_t startup_open(t_startup *startup, const char *path);
+void startup_mark(t_startup *startup, t_startup_phase phase);
+uint8_t startup_expect(t_startup *startup, t_tm_node *node);
+void startup_started(t_startup *startup, const t_thread_data *thrd);
+void startup_close(t_startup *startup);
+
+#endif
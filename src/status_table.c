@@ -0,0 +1,132 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "run_server.h"
+
+#define TMS_ALIGN_PAGE(n) \
+    (((n) + TMS_MIN_SIZE - 1) & ~(size_t)(TMS_MIN_SIZE - 1))
+
+/* Creates the shm object 'name', replacing the table of a previous run */
+uint8_t status_table_open(t_status_table *table, const char *name) {
+    t_tms_header *header;
+
+    *table = (t_status_table){.fd = -1};
+    table->fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (table->fd == -1 || !(table->name = strdup(name)) ||
+        ftruncate(table->fd, TMS_MIN_SIZE) == -1)
+        return EXIT_FAILURE;
+    header = mmap(NULL, TMS_MIN_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  table->fd, 0);
+    if (header == MAP_FAILED) return EXIT_FAILURE;
+    table->map = header;
+    table->size = TMS_MIN_SIZE;
+    memcpy(header->magic, TMS_MAGIC, sizeof(header->magic));
+    header->version = TMS_VERSION;
+    header->supervisor_pid = getpid();
+    header->pgm_off = sizeof(*header);
+    header->proc_off = sizeof(*header);
+    atomic_store_explicit(&header->size, TMS_MIN_SIZE, memory_order_release);
+    return EXIT_SUCCESS;
+}
+
+/* Grows the region to hold 'size' bytes. Records may have moved. */
+static uint8_t status_table_grow(t_status_table *table, size_t size) {
+    void *map;
+
+    if (size <= table->size) return EXIT_SUCCESS;
+    if (size < table->size * 2) size = table->size * 2;
+    size = TMS_ALIGN_PAGE(size);
+    if (ftruncate(table->fd, size) == -1) return EXIT_FAILURE;
+    map = mremap(table->map, table->size, size, MREMAP_MAYMOVE);
+    if (map == MAP_FAILED) return EXIT_FAILURE;
+    table->map = map;
+    table->size = size;
+    atomic_store_explicit(&table->map->size, size, memory_order_release);
+    return EXIT_SUCCESS;
+}
+
+/* Records of pgm: its ranks below numprocs, thrd never being shrunk */
+static uint32_t status_table_nb_proc(const t_pgm *pgm) {
+    uint32_t numprocs = PGM_CONF(pgm)->usr.numprocs;
+
+    return numprocs < pgm->privy.nb_thrd ? numprocs : pgm->privy.nb_thrd;
+}
+
+static void status_table_fill_pgm(t_tms_pgm *rec, const t_pgm *pgm,
+                                  uint32_t first_proc) {
+    const t_pgm_usr *usr = &PGM_CONF(pgm)->usr;
+    size_t len = strlen(usr->name);
+
+    *rec = (t_tms_pgm){.id = pgm->privy.id,
+                       .numprocs = usr->numprocs,
+                       .nb_proc = status_table_nb_proc(pgm),
+                       .first_proc = first_proc,
+                       .name_len = len};
+    memcpy(rec->name, usr->name,
+           len < TMS_NAME_MAX - 1 ? len : TMS_NAME_MAX - 1);
+}
+
+/* Rewrites the tables from the current name index & points each program to
+ * its records. Master thread only, after each change of the index. */
+uint8_t status_table_layout(t_status_table *table, t_tm_node *node) {
+    const t_pgm_index *index = PGM_INDEX(node);
+    t_tms_header *header;
+    t_tms_pgm *pgm_rec;
+    t_tms_proc *proc_rec;
+    const t_thread_data *thrd;
+    uint32_t nb_pgm = 0, nb_proc = 0, seq;
+    t_pgm *pgm;
+
+    for (uint32_t id = 0; id < index->nb_id; id++) {
+        if (!(pgm = index->by_id[id])) continue;
+        nb_pgm++;
+        nb_proc += status_table_nb_proc(pgm);
+    }
+    if (status_table_grow(table, sizeof(*header) +
+                                     (size_t)nb_pgm * sizeof(*pgm_rec) +
+                                     (size_t)nb_proc * sizeof(*proc_rec)))
+        return EXIT_FAILURE;
+
+    header = table->map;
+    seq = atomic_load_explicit(&header->layout_seq, memory_order_relaxed);
+    atomic_store_explicit(&header->layout_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    pgm_rec = (t_tms_pgm *)(header + 1);
+    proc_rec = (t_tms_proc *)(pgm_rec + nb_pgm);
+    nb_pgm = 0;
+    nb_proc = 0;
+    for (uint32_t id = 0; id < index->nb_id; id++) {
+        if (!(pgm = index->by_id[id])) continue;
+        status_table_fill_pgm(&pgm_rec[nb_pgm], pgm, nb_proc);
+        pgm->privy.status = &proc_rec[nb_proc];
+        pgm->privy.nb_status = pgm_rec[nb_pgm].nb_proc;
+        for (uint32_t r = 0; r < pgm->privy.nb_status; r++) {
+            thrd = &pgm->privy.thrd[r];
+            /* the bytes may have belonged to any record: seq restarts */
+            memset(&proc_rec[nb_proc], 0, sizeof(*proc_rec));
+            proc_rec[nb_proc].pgm = nb_pgm;
+            proc_rec[nb_proc].rid = r;
+            status_table_update(&proc_rec[nb_proc++], thrd->pid,
+                                thrd->restart_counter, thrd->info & 0x0f,
+                                thrd->start_timestamp);
+        }
+        nb_pgm++;
+    }
+    header->nb_pgm = nb_pgm;
+    header->nb_proc = nb_proc;
+    header->pgm_off = (uint8_t *)pgm_rec - (uint8_t *)header;
+    header->proc_off = (uint8_t *)proc_rec - (uint8_t *)header;
+    atomic_store_explicit(&header->layout_seq, seq + 2, memory_order_release);
+    return EXIT_SUCCESS;
+}
+
+/* Unlinks the table: monitors opening it afterwards get ENOENT */
+void status_table_close(t_status_table *table) {
+    if (table->map) munmap(table->map, table->size);
+    if (table->fd >= 0) close(table->fd);
+    if (table->name) shm_unlink(table->name);
+    DESTROY_PTR(table->name);
+    *table = (t_status_table){.fd = -1};
+}
@@ -0,0 +1,62 @@
+#ifndef STATUS_TABLE_H
+#define STATUS_TABLE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "tm_status.h"
+
+/*
+ * Writer side of the shared memory status table (taskmaster -m name), see
+ * tm_status.h for its layout.
+ *
+ * The master thread is the only writer. Each transition of a processus
+ * copies its runtime fields into its record, under the record seqlock, right
+ * after the t_thread_data seqlock is released: readers polling the table
+ * never cost the supervisor a syscall nor a lock. The tables are rewritten
+ * by status_table_layout() when programs are added or removed, or their
+ * numprocs reloaded: a program has one record by rank below numprocs.
+ */
+
+#define TMS_MIN_SIZE (4096U) /* first size of the region */
+
+typedef struct s_tm_node t_tm_node;
+
+typedef struct s_status_table {
+    char *name; /* shm object, unlinked by status_table_close() */
+    int32_t fd;
+    t_tms_header *map;
+    size_t size; /* mapped bytes */
+} t_status_table;
+
+uint8_t status_table_open(t_status_table *table, const char *name);
+uint8_t status_table_layout(t_status_table *table, t_tm_node *node);
+void status_table_close(t_status_table *table);
+
+/* A few ms of resolution, read without syscall nor fence: it only dates the
+ * last change of a record */
+static inline int64_t status_table_clock(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Publishes the runtime fields of a processus in its record */
+static inline void status_table_update(t_tms_proc *rec, int32_t pid,
+                                       int32_t restart_counter, uint8_t state,
+                                       int64_t start_time) {
+    uint32_t seq = atomic_load_explicit(&rec->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&rec->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    rec->pid = pid;
+    rec->restart_counter = restart_counter;
+    rec->state = state;
+    rec->start_time = start_time;
+    rec->updated_ns = status_table_clock();
+    atomic_store_explicit(&rec->seq, seq + 2, memory_order_release);
+}
+
+#endif
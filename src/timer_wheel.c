@@ -0,0 +1,176 @@
+#include "timer_wheel.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+/* ================================== utils ================================= */
+
+/* current time of CLOCK_MONOTONIC in ms */
+uint64_t tw_clock(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+static void tw_list_add(t_tw_timer **head, t_tw_timer *timer) {
+    timer->next = *head;
+    if (*head) (*head)->pprev = &timer->next;
+    timer->pprev = head;
+    *head = timer;
+}
+
+static void tw_list_del(t_tw_timer *timer) {
+    *timer->pprev = timer->next;
+    if (timer->next) timer->next->pprev = timer->pprev;
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+/* detach the list of a slot so that callbacks can safely add or delete any
+ * timer, including ones of the detached list */
+static void tw_slot_take(t_timer_wheel *tw, uint32_t lvl, uint32_t idx,
+                         t_tw_timer **list) {
+    *list = tw->slot[lvl][idx];
+    if (*list) (*list)->pprev = list;
+    tw->slot[lvl][idx] = NULL;
+    tw->bitmap[lvl] &= ~(1ULL << idx);
+}
+
+/* ================================ placement =============================== */
+
+/* Stores the timer at the lowest level where its slot differs from the
+ * current one. Deadlines in the past are stored in the current slot of level
+ * 0 and deadlines out of range at the end of the top level: they are placed
+ * again at cascade time. */
+static void tw_place(t_timer_wheel *tw, t_tw_timer *timer) {
+    uint64_t at = timer->expires < tw->now ? tw->now : timer->expires, diff;
+    uint32_t lvl = 0, idx;
+
+    if ((at ^ tw->now) & ~TW_RANGE_MASK) at = tw->now | TW_RANGE_MASK;
+    diff = at ^ tw->now;
+    if (diff) lvl = (63 - __builtin_clzll(diff)) / TW_LVL_BITS;
+    idx = (at >> (lvl * TW_LVL_BITS)) & TW_SLOT_MASK;
+    tw_list_add(&tw->slot[lvl][idx], timer);
+    tw->bitmap[lvl] |= (1ULL << idx);
+}
+
+/* Earliest time the wheel has something to do: an exact deadline at level 0
+ * or the beginning of a slot to cascade at upper levels. */
+static uint64_t tw_next(const t_timer_wheel *tw) {
+    uint64_t next = TW_NO_DEADLINE, at, span;
+
+    for (uint32_t lvl = 0; lvl < TW_LVL_NB; lvl++) {
+        if (!tw->bitmap[lvl]) continue;
+        span = 1ULL << ((lvl + 1) * TW_LVL_BITS);
+        at = (tw->now & ~(span - 1)) |
+             ((uint64_t)__builtin_ctzll(tw->bitmap[lvl])
+              << (lvl * TW_LVL_BITS));
+        if (at < next) next = at;
+    }
+    return next;
+}
+
+/* Arms the timerfd on the next deadline if it changed */
+static void tw_rearm(t_timer_wheel *tw) {
+    struct itimerspec its = {0};
+    uint64_t next = tw_next(tw);
+
+    if (next == tw->armed) return;
+    if (next != TW_NO_DEADLINE) {
+        its.it_value.tv_sec = next / 1000;
+        its.it_value.tv_nsec = (next % 1000) * 1000000;
+    }
+    if (timerfd_settime(tw->tfd, TFD_TIMER_ABSTIME, &its, NULL) == -1)
+        perror("timerfd_settime");
+    tw->armed = next;
+}
+
+/* =================================== api ================================== */
+
+uint8_t tw_init(t_timer_wheel *tw, t_tw_callback callback) {
+    *tw = (t_timer_wheel){.armed = TW_NO_DEADLINE, .callback = callback};
+    tw->now = tw_clock();
+    tw->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (tw->tfd == -1) return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+void tw_destroy(t_timer_wheel *tw) {
+    if (tw->tfd >= 0) close(tw->tfd);
+    tw->tfd = -1;
+}
+
+void tw_timer_init(t_tw_timer *timer) { *timer = (t_tw_timer){0}; }
+
+bool tw_timer_pending(const t_tw_timer *timer) { return timer->pprev != NULL; }
+
+/* (Re)arms timer to expire in delay_ms from now */
+void tw_timer_add(t_timer_wheel *tw, t_tw_timer *timer, uint32_t delay_ms) {
+    uint64_t now = tw_clock();
+
+    if (tw_timer_pending(timer)) tw_list_del(timer);
+    /* catch up with the clock when nothing is due in between, so that the
+     * timer doesn't need to be cascaded from an outdated position */
+    if (tw_next(tw) > now) tw->now = now;
+    timer->expires = now + delay_ms;
+    tw_place(tw, timer);
+    if (timer->expires < tw->armed) tw_rearm(tw);
+}
+
+/* Moves src to dst, linking dst in its place. Timers of a same list may be
+ * moved one after the other: src is read when it is moved. */
+void tw_timer_move(t_tw_timer *dst, t_tw_timer *src) {
+    *dst = *src;
+    if (!tw_timer_pending(src)) return;
+    *dst->pprev = dst;
+    if (dst->next) dst->next->pprev = &dst->next;
+    src->pprev = NULL;
+}
+
+/* Cancels timer. The timerfd isn't re-armed: a spurious wakeup is cheaper
+ * than a syscall for each cancel. */
+void tw_timer_del(t_tw_timer *timer) {
+    if (!tw_timer_pending(timer)) return;
+    tw_list_del(timer);
+}
+
+/* Called when the timerfd is readable. Advances the wheel up to now,
+ * slot by slot where there is something to do, cascading upper levels and
+ * running callbacks of expired timers. */
+void tw_expire(t_timer_wheel *tw) {
+    uint64_t now = tw_clock(), next, expirations;
+    t_tw_timer *list, *timer;
+
+    /* a wakeup may be spurious, the timerfd is then not expired */
+    if (read(tw->tfd, &expirations, sizeof(expirations)) == -1 &&
+        errno != EAGAIN)
+        perror("read");
+    tw->armed = TW_NO_DEADLINE;
+    while ((next = tw_next(tw)) <= now) {
+        tw->now = next;
+        for (uint32_t lvl = TW_LVL_NB - 1; lvl > 0; lvl--) {
+            if (next & ((1ULL << (lvl * TW_LVL_BITS)) - 1)) continue;
+            tw_slot_take(tw, lvl, (next >> (lvl * TW_LVL_BITS)) & TW_SLOT_MASK,
+                         &list);
+            while ((timer = list)) {
+                tw_list_del(timer);
+                tw_place(tw, timer);
+            }
+        }
+        tw_slot_take(tw, 0, next & TW_SLOT_MASK, &list);
+        while ((timer = list)) {
+            tw_list_del(timer);
+            if (timer->expires > tw->now)
+                tw_place(tw, timer); /* was out of range */
+            else
+                tw->callback(timer);
+        }
+    }
+    if (now > tw->now) tw->now = now;
+    tw_rearm(tw);
+}
@@ -0,0 +1,55 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+/*
+ * Hierarchical timing wheel with a resolution of 1 ms, backed by a single
+ * timerfd armed on the earliest deadline: there is no periodic tick.
+ *
+ * Level L has TW_SLOT_NB slots of 64^L ms each. A timer is stored at the
+ * lowest level whose slot is not the current one, so only level 0 holds exact
+ * deadlines. Timers of upper levels are cascaded down when the wheel reaches
+ * the beginning of their slot, which is the only case the timerfd fires
+ * before an actual deadline.
+ */
+
+#define TW_LVL_BITS (6)
+#define TW_SLOT_NB (1 << TW_LVL_BITS) /* 64 slots by level */
+#define TW_SLOT_MASK (TW_SLOT_NB - 1)
+#define TW_LVL_NB (5) /* 64^5 ms: about 12 days */
+#define TW_RANGE_MASK ((1ULL << (TW_LVL_BITS * TW_LVL_NB)) - 1)
+#define TW_NO_DEADLINE (UINT64_MAX)
+
+typedef struct s_tw_timer t_tw_timer;
+typedef void (*t_tw_callback)(t_tw_timer *timer);
+
+/* intrusive timer. Must be embedded in the data it times, which the
+ * callback of the wheel gets back from the address of the timer. */
+struct s_tw_timer {
+    t_tw_timer *next;
+    t_tw_timer **pprev; /* address of the pointer pointing to this timer */
+    uint64_t expires;   /* absolute deadline, in ms of CLOCK_MONOTONIC */
+};
+
+typedef struct s_timer_wheel {
+    int32_t tfd;      /* timerfd armed on the next deadline */
+    uint64_t now;     /* time the wheel is advanced to, in ms */
+    uint64_t armed;   /* deadline tfd is armed on, TW_NO_DEADLINE if none */
+    t_tw_callback callback; /* called with each expired timer */
+    uint64_t bitmap[TW_LVL_NB]; /* non empty slots of each level */
+    t_tw_timer *slot[TW_LVL_NB][TW_SLOT_NB];
+} t_timer_wheel;
+
+uint8_t tw_init(t_timer_wheel *tw, t_tw_callback callback);
+void tw_destroy(t_timer_wheel *tw);
+uint64_t tw_clock(void);
+void tw_timer_init(t_tw_timer *timer);
+bool tw_timer_pending(const t_tw_timer *timer);
+void tw_timer_add(t_timer_wheel *tw, t_tw_timer *timer, uint32_t delay_ms);
+void tw_timer_del(t_tw_timer *timer);
+void tw_timer_move(t_tw_timer *dst, t_tw_timer *src);
+void tw_expire(t_timer_wheel *tw);
+
+#endif
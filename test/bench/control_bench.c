@@ -0,0 +1,232 @@
+/*
+ * Throughput of the control socket. The control thread serves a supervisor
+ * of 'nb' programs of 4 processus each, queried by clients either one
+ * request at a time or with pipelined requests, for a summary status (one
+ * record by program) & the status of one program.
+ * Commands - a stop of one program each - are sent the same ways & in
+ * batch requests, a thread standing for the master one draining the queue.
+ *
+ * usage: ./control_bench [nb_programs]
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "run_server.h"
+
+#define DEFAULT_NB (100)
+#define NUMPROCS (4)
+#define QUERIES (20000U)
+#define PIPELINE (64U)
+#define BATCH (1000U) /* commands by batch request */
+#define NAME_SZ (32)
+#define SOCK_PATH "./control_bench.sock"
+
+typedef struct s_client {
+    uint16_t op;
+    uint16_t flags;
+    const char *payload;
+    uint32_t len;
+    uint32_t depth; /* requests in flight */
+} t_client;
+
+/* only reached by add & reload commands, which aren't benched */
+uint8_t init_programs(t_tm_node *node, const char *yaml, size_t len) {
+    UNUSED_PARAM(node);
+    UNUSED_PARAM(yaml);
+    UNUSED_PARAM(len);
+    return EXIT_FAILURE;
+}
+
+uint8_t reload_programs(t_tm_node *node) {
+    UNUSED_PARAM(node);
+    return EXIT_FAILURE;
+}
+
+void destroy_pgm_list(t_pgm **head) { UNUSED_PARAM(head); }
+
+void destroy_group_list(t_group_conf **head) { UNUSED_PARAM(head); }
+
+static atomic_bool g_exit;
+static atomic_uint g_events; /* commands popped by the drain thread */
+
+static void free_event(t_event *event) {
+    if (event->batch) {
+        for (uint32_t i = 0; i < event->batch->nb; i++)
+            free_event(&event->batch->event[i]);
+        free(event->batch);
+    } else
+        atomic_fetch_add_explicit(&g_events, 1, memory_order_relaxed);
+    free(event->set);
+}
+
+/* consumer of the event queue, as the master thread */
+static void *drain(void *arg) {
+    t_ev_queue *queue = arg;
+    t_event batch[EV_QUEUE_BATCH];
+    uint32_t nb;
+
+    while (true) {
+        nb = ev_queue_pop_batch(queue, batch, EV_QUEUE_BATCH);
+        for (uint32_t i = 0; i < nb; i++) free_event(&batch[i]);
+        if (nb) continue;
+        if (atomic_load(&g_exit)) return NULL;
+        sched_yield();
+    }
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void create_pgms(t_tm_node *node, uint32_t nb, char (*names)[NAME_SZ]) {
+    t_pgm *pgm;
+
+    for (uint32_t i = 0; i < nb; i++) {
+        snprintf(names[i], NAME_SZ, "worker_%u", i);
+        if (!(pgm = calloc(1, sizeof(*pgm)))) handle_error("calloc");
+        if (!(pgm->conf = calloc(1, sizeof(*pgm->conf))))
+            handle_error("calloc");
+        pgm->conf->usr.name = names[i];
+        pgm->conf->usr.numprocs = NUMPROCS;
+        pgm->privy.nb_thrd = NUMPROCS;
+        if (!(pgm->privy.thrd = calloc(NUMPROCS, sizeof(t_thread_data))))
+            handle_error("calloc");
+        for (uint32_t r = 0; r < NUMPROCS; r++) {
+            pgm->privy.thrd[r].pid = 1000 + i * NUMPROCS + r;
+            pgm->privy.thrd[r].info = PROC_ST_STARTED;
+        }
+        pgm->privy.id = node->pgm_ids++;
+        pgm->privy.next = node->head;
+        node->head = pgm;
+        node->pgm_nb++;
+    }
+}
+
+static void destroy_pgms(t_pgm *head) {
+    t_pgm *next;
+
+    for (; head; head = next) {
+        next = head->privy.next;
+        free(head->privy.thrd);
+        free(head->conf);
+        free(head);
+    }
+}
+
+/* Sends QUERIES requests, at most client->depth in flight, & checks the tag
+ * of each reply */
+static double query_loop(const t_client *client) {
+    t_tmp_header header = {.len = client->len, .op = client->op,
+                           .flags = client->flags};
+    uint32_t sent = 0, received = 0;
+    uint8_t *payload;
+    uint64_t start;
+    int32_t fd = ctl_connect(SOCK_PATH);
+
+    if (fd == -1) handle_error("ctl_connect");
+    start = now_ns();
+    while (received < QUERIES) {
+        while (sent < QUERIES && sent - received < client->depth) {
+            header.tag = sent++;
+            if (ctl_send(fd, &header, client->payload))
+                handle_error("ctl_send");
+        }
+        if (ctl_recv(fd, &header, &payload)) handle_error("ctl_recv");
+        if (header.tag != received++ || header.status != TMP_OK)
+            fprintf(stderr, "unexpected reply %u\n", header.tag);
+        free(payload);
+        header = (t_tmp_header){.len = client->len, .op = client->op,
+                                .flags = client->flags};
+    }
+    close(fd);
+    return QUERIES / ((now_ns() - start) / 1e9);
+}
+
+/* Sends QUERIES stop commands by batch requests of BATCH commands, each one
+ * waiting for the reply of the previous one */
+static double batch_loop(const char *name) {
+    uint32_t sub_len = sizeof(t_tmp_header) + strlen(name) + 1;
+    t_tmp_header header = {.len = BATCH * sub_len, .op = TMP_OP_BATCH};
+    t_tmp_header sub = {.len = strlen(name) + 1, .op = TMP_OP_STOP};
+    char *payload = malloc(header.len);
+    uint8_t *reply;
+    uint64_t start;
+    int32_t fd = ctl_connect(SOCK_PATH);
+
+    if (fd == -1 || !payload) handle_error("batch_loop");
+    for (uint32_t i = 0; i < BATCH; i++) {
+        memcpy(payload + i * sub_len, &sub, sizeof(sub));
+        memcpy(payload + i * sub_len + sizeof(sub), name, sub.len);
+    }
+    start = now_ns();
+    for (uint32_t i = 0; i < QUERIES / BATCH; i++) {
+        if (ctl_send(fd, &header, payload) || ctl_recv(fd, &header, &reply))
+            handle_error("batch_loop");
+        if (header.status != TMP_OK ||
+            header.len != BATCH * sizeof(t_tmp_header))
+            fprintf(stderr, "unexpected batch reply\n");
+        free(reply);
+        header = (t_tmp_header){.len = BATCH * sub_len, .op = TMP_OP_BATCH};
+    }
+    close(fd);
+    free(payload);
+    return QUERIES / ((now_ns() - start) / 1e9);
+}
+
+int main(int ac, char **av) {
+    uint32_t nb = ac > 1 ? strtoul(av[1], NULL, 10) : DEFAULT_NB;
+    char(*names)[NAME_SZ];
+    t_tm_node node = {.tm_name = av[0]};
+    t_control ctl;
+    pthread_t drain_thrd;
+    const char *one = "worker_0";
+
+    if (!nb || !(names = malloc(nb * NAME_SZ))) {
+        fprintf(stderr, "usage: %s [nb_programs]\n", av[0]);
+        return EXIT_FAILURE;
+    }
+    rcu_init(&node.rcu);
+    if (ev_queue_init(&node.ev_queue)) handle_error("ev_queue_init");
+    create_pgms(&node, nb, names);
+    if (pgm_index_publish(&node)) handle_error("pgm_index_publish");
+    if (control_init(&ctl, &node, SOCK_PATH) || control_start(&ctl))
+        handle_error("control_init");
+    if (pthread_create(&drain_thrd, NULL, drain, &node.ev_queue))
+        handle_error("pthread_create");
+
+    printf("%u programs of %u processus, %u queries\n", nb, NUMPROCS, QUERIES);
+    printf("%-20s %14s %14s %14s\n", "query", "sequential/s", "pipelined/s",
+           "batched/s");
+    printf("%-20s %14.0f %14.0f %14s\n", "status (summary)",
+           query_loop(&(t_client){TMP_OP_STATUS, TMP_FLAG_SUMMARY, NULL, 0, 1}),
+           query_loop(&(t_client){TMP_OP_STATUS, TMP_FLAG_SUMMARY, NULL, 0,
+                                  PIPELINE}),
+           "-");
+    printf("%-20s %14.0f %14.0f %14s\n", "status <program>",
+           query_loop(&(t_client){TMP_OP_STATUS, 0, one, strlen(one) + 1, 1}),
+           query_loop(&(t_client){TMP_OP_STATUS, 0, one, strlen(one) + 1,
+                                  PIPELINE}),
+           "-");
+    printf("%-20s %14.0f %14.0f %14.0f\n", "stop <program>",
+           query_loop(&(t_client){TMP_OP_STOP, 0, one, strlen(one) + 1, 1}),
+           query_loop(&(t_client){TMP_OP_STOP, 0, one, strlen(one) + 1,
+                                  PIPELINE}),
+           batch_loop(one));
+
+    control_destroy(&ctl);
+    atomic_store(&g_exit, true);
+    pthread_join(drain_thrd, NULL);
+    if (atomic_load(&g_events) != 3 * QUERIES)
+        fprintf(stderr, "%u commands received\n", atomic_load(&g_events));
+    pgm_index_destroy(node.pgm_index);
+    rcu_destroy(&node.rcu);
+    ev_queue_destroy(&node.ev_queue);
+    destroy_pgms(node.head);
+    free(names);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,163 @@
+/*
+ * Memory taken by one processus instance in taskmaster: the former runtime
+ * data - a t_thread_data holding an rwlock, a barrier, 2 mutexes, 2 condvars
+ * & a semaphore, driven by a launcher thread & a timer thread by processus -
+ * against the current cache line sized t_thread_data driven by the reactor.
+ *
+ * Both are measured by allocating 'nb' instances the way taskmaster does and
+ * reading the growth of the resident & virtual memory of the process. The
+ * threads of the former model are parked on their condvar, as they were while
+ * their processus was running.
+ *
+ * usage: ./footprint_bench [nb_instances]
+ */
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "run_server.h"
+
+#define DEFAULT_NB (1024)
+
+/* t_thread_data before the reactor */
+typedef struct s_legacy_thread_data {
+    pthread_rwlock_t rw_thrd;
+    pthread_barrier_t sync_barrier;
+    t_tm_node *node;
+    t_pgm *pgm;
+    uint32_t rid;
+    pthread_t tid;
+    pid_t pid;
+    int32_t restart_counter;
+    struct timeval start_timestamp;
+    pthread_mutex_t mtx_wakeup;
+    pthread_cond_t cond_wakeup;
+    atomic_uchar info;
+    sem_t sync;
+    pthread_mutex_t mtx_timer;
+    pthread_cond_t cond_timer;
+    pthread_t timer_id;
+} t_legacy_thread_data;
+
+typedef struct s_mem {
+    size_t rss; /* in bytes */
+    size_t vsz; /* in bytes */
+} t_mem;
+
+static atomic_bool g_release;
+
+static t_mem mem_usage(void) {
+    size_t page = sysconf(_SC_PAGESIZE), vsz = 0, rss = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+
+    if (statm) {
+        if (fscanf(statm, "%zu %zu", &vsz, &rss) != 2) vsz = rss = 0;
+        fclose(statm);
+    }
+    return (t_mem){.rss = rss * page, .vsz = vsz * page};
+}
+
+static void *launcher(void *arg) {
+    t_legacy_thread_data *thrd = arg;
+
+    pthread_mutex_lock(&thrd->mtx_wakeup);
+    while (!atomic_load(&g_release))
+        pthread_cond_wait(&thrd->cond_wakeup, &thrd->mtx_wakeup);
+    pthread_mutex_unlock(&thrd->mtx_wakeup);
+    return NULL;
+}
+
+static void *timer(void *arg) {
+    t_legacy_thread_data *thrd = arg;
+
+    pthread_mutex_lock(&thrd->mtx_timer);
+    while (!atomic_load(&g_release))
+        pthread_cond_wait(&thrd->cond_timer, &thrd->mtx_timer);
+    pthread_mutex_unlock(&thrd->mtx_timer);
+    return NULL;
+}
+
+static void report(const char *name, size_t size, uint32_t nb, t_mem before,
+                   t_mem after) {
+    printf("%-8s sizeof %4zu B | rss %8.1f B/instance | virtual %10.1f "
+           "B/instance\n",
+           name, size, (double)(after.rss - before.rss) / nb,
+           (double)(after.vsz - before.vsz) / nb);
+}
+
+static uint8_t bench_legacy(uint32_t nb) {
+    t_legacy_thread_data *thrd;
+    uint32_t created = 0;
+    t_mem before = mem_usage(), after;
+
+    if (!(thrd = calloc(nb, sizeof(*thrd)))) return EXIT_FAILURE;
+    for (; created < nb; created++) {
+        pthread_rwlock_init(&thrd[created].rw_thrd, NULL);
+        pthread_barrier_init(&thrd[created].sync_barrier, NULL, 2);
+        pthread_mutex_init(&thrd[created].mtx_wakeup, NULL);
+        pthread_cond_init(&thrd[created].cond_wakeup, NULL);
+        sem_init(&thrd[created].sync, 0, 0);
+        pthread_mutex_init(&thrd[created].mtx_timer, NULL);
+        pthread_cond_init(&thrd[created].cond_timer, NULL);
+        if (pthread_create(&thrd[created].tid, NULL, launcher,
+                           &thrd[created]))
+            break;
+        if (pthread_create(&thrd[created].timer_id, NULL, timer,
+                           &thrd[created])) {
+            pthread_cancel(thrd[created].tid);
+            pthread_join(thrd[created].tid, NULL);
+            break;
+        }
+    }
+    usleep(100000); /* let all threads reach their condvar */
+    after = mem_usage();
+    if (created == nb)
+        report("threads", sizeof(*thrd), nb, before, after);
+    else
+        fprintf(stderr, "threads: only %u instances created\n", created);
+
+    atomic_store(&g_release, true);
+    for (uint32_t i = 0; i < created; i++) {
+        pthread_mutex_lock(&thrd[i].mtx_wakeup);
+        pthread_cond_signal(&thrd[i].cond_wakeup);
+        pthread_mutex_unlock(&thrd[i].mtx_wakeup);
+        pthread_mutex_lock(&thrd[i].mtx_timer);
+        pthread_cond_signal(&thrd[i].cond_timer);
+        pthread_mutex_unlock(&thrd[i].mtx_timer);
+        pthread_join(thrd[i].tid, NULL);
+        pthread_join(thrd[i].timer_id, NULL);
+    }
+    free(thrd);
+    return created == nb ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* as init_thrd() then create_proc_pool() */
+static uint8_t bench_reactor(uint32_t nb) {
+    t_thread_data *thrd;
+    t_mem before = mem_usage(), after;
+
+    if (!(thrd = calloc(nb, sizeof(*thrd)))) return EXIT_FAILURE;
+    for (uint32_t i = 0; i < nb; i++) {
+        thrd[i].rid = i;
+        tw_timer_init(&thrd[i].deadline);
+    }
+    after = mem_usage();
+    report("reactor", sizeof(*thrd), nb, before, after);
+    free(thrd);
+    return EXIT_SUCCESS;
+}
+
+int main(int ac, char **av) {
+    uint32_t nb = ac > 1 ? strtoul(av[1], NULL, 10) : DEFAULT_NB;
+
+    if (!nb) {
+        fprintf(stderr, "usage: %s [nb_instances]\n", av[0]);
+        return EXIT_FAILURE;
+    }
+    printf("%u instances\n", nb);
+    if (bench_reactor(nb)) return EXIT_FAILURE;
+    if (bench_legacy(nb)) return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
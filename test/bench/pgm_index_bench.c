@@ -0,0 +1,99 @@
+/*
+ * Cost of looking a program up by name: walk of the pgm list with strncmp
+ * (the former get_pgm & sanitize_arg) against the name index, for a growing
+ * number of programs. Every program is looked up once by round.
+ *
+ * usage: ./pgm_index_bench [max_programs]
+ */
+#include <stdio.h>
+#include <time.h>
+
+#include "taskmaster.h"
+
+#define DEFAULT_MAX (10000)
+#define NAME_SZ (32)
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* pgms named like a pool of workers, so names share a long prefix */
+static t_pgm *create_pgms(uint32_t nb, char (*names)[NAME_SZ]) {
+    t_pgm *head = NULL, *pgm;
+
+    for (uint32_t i = 0; i < nb; i++) {
+        snprintf(names[i], NAME_SZ, "worker_pool_%u", i);
+        if (!(pgm = calloc(1, sizeof(*pgm)))) handle_error("calloc");
+        if (!(pgm->conf = calloc(1, sizeof(*pgm->conf))))
+            handle_error("calloc");
+        pgm->conf->usr.name = names[i];
+        pgm->privy.id = i;
+        pgm->privy.next = head;
+        head = pgm;
+    }
+    return head;
+}
+
+static void destroy_pgms(t_pgm *head) {
+    t_pgm *next;
+
+    for (; head; head = next) {
+        next = head->privy.next;
+        free(head->conf);
+        free(head);
+    }
+}
+
+static t_pgm *list_find(t_pgm *head, const char *name, size_t len) {
+    const char *pgm_name;
+
+    for (t_pgm *pgm = head; pgm; pgm = pgm->privy.next) {
+        pgm_name = PGM_CONF(pgm)->usr.name;
+        if (!strncmp(pgm_name, name, len) && !pgm_name[len]) return pgm;
+    }
+    return NULL;
+}
+
+static void bench(uint32_t nb) {
+    char(*names)[NAME_SZ] = malloc(nb * NAME_SZ);
+    t_pgm *head, *found = NULL;
+    t_pgm_index *index;
+    uint32_t rounds = nb > 10000 ? 1 : 10000 / nb + 1;
+    uint64_t start, list_ns, index_ns;
+
+    if (!names) handle_error("malloc");
+    head = create_pgms(nb, names);
+    if (!(index = pgm_index_build(head, nb, nb, NULL)))
+        handle_error("pgm_index_build");
+
+    start = now_ns();
+    for (uint32_t r = 0; r < rounds; r++)
+        for (uint32_t i = 0; i < nb; i++)
+            found = list_find(head, names[i], strlen(names[i]));
+    list_ns = now_ns() - start;
+    if (!found) fprintf(stderr, "list: lookup failed\n");
+
+    start = now_ns();
+    for (uint32_t r = 0; r < rounds; r++)
+        for (uint32_t i = 0; i < nb; i++)
+            found = pgm_index_find(index, names[i], strlen(names[i]));
+    index_ns = now_ns() - start;
+    if (!found) fprintf(stderr, "index: lookup failed\n");
+
+    printf("%8u %14.1f %14.1f\n", nb, (double)list_ns / (rounds * nb),
+           (double)index_ns / (rounds * nb));
+    pgm_index_destroy(index);
+    destroy_pgms(head);
+    free(names);
+}
+
+int main(int ac, char **av) {
+    uint32_t max = ac > 1 ? strtoul(av[1], NULL, 10) : DEFAULT_MAX;
+
+    printf("%8s %14s %14s\n", "programs", "list(ns/find)", "index(ns/find)");
+    for (uint32_t nb = 10; nb <= max; nb *= 10) bench(nb);
+    return EXIT_SUCCESS;
+}
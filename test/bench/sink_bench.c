@@ -0,0 +1,104 @@
+/*
+ * Cost of log writes for the thread issuing them: 'mb' MB of log lines of
+ * LINE bytes, either written one write() each - the former logger & capture
+ * without splice() - or copied into the buffers of a sink_io, submitted by
+ * batch of BATCH lines & completed by io_uring or by its worker thread.
+ * The time of the issuing thread is measured with & without fsync() of the
+ * file at the end, which bounds what a disk can absorb.
+ *
+ * usage: ./sink_bench [mb]
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sink_io.h"
+#include "taskmaster.h"
+
+#define DEFAULT_MB (256)
+#define LINE (120)
+#define BATCH (256U)
+#define BENCH_FILE "./sink_bench.log"
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int32_t bench_open(void) {
+    return open(BENCH_FILE, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+}
+
+static void report(const char *name, uint64_t nb, uint64_t issue,
+                   uint64_t total) {
+    printf("  %-22s %8.0f MB/s issued %8.0f MB/s on disk\n", name,
+           nb * LINE / (issue / 1e3), nb * LINE / (total / 1e3));
+}
+
+static void bench_write(const char *line, uint64_t nb) {
+    int32_t fd = bench_open();
+    uint64_t start = now_ns(), issue;
+
+    for (uint64_t i = 0; i < nb; i++)
+        if (write(fd, line, LINE) != LINE) break;
+    issue = now_ns() - start;
+    fsync(fd);
+    report("write() by line", nb, issue, now_ns() - start);
+    close(fd);
+}
+
+static void bench_sink_io(const char *line, uint64_t nb) {
+    int32_t fd = bench_open();
+    t_sink_buf *buf = NULL;
+    uint64_t start, issue, off = 0;
+    t_sink_file file;
+    t_sink_io io;
+
+    if (sink_io_init(&io, 32)) {
+        perror("sink_io_init");
+        return;
+    }
+    sink_io_file_init(&file, fd, BENCH_FILE);
+    start = now_ns();
+    for (uint64_t i = 0; i < nb; i++) {
+        if (buf && buf->len + LINE > SINK_IO_BUF_SIZE) {
+            sink_io_write(&io, &file, buf, off);
+            off += buf->len;
+            buf = NULL;
+        }
+        if (!buf) buf = sink_io_buf(&io);
+        memcpy(buf->data + buf->len, line, LINE);
+        buf->len += LINE;
+        if (i % BATCH == BATCH - 1) sink_io_submit(&io);
+    }
+    if (buf) sink_io_write(&io, &file, buf, off);
+    sink_io_submit(&io);
+    issue = now_ns() - start;
+    sink_io_file_wait(&io, &file);
+    fsync(fd);
+    report(io.uring ? "sink_io, io_uring" : "sink_io, worker", nb, issue,
+           now_ns() - start);
+    sink_io_file_close(&io, &file);
+    sink_io_destroy(&io);
+    close(fd);
+}
+
+int main(int ac, char **av) {
+    int32_t mb = ac > 1 ? atoi(av[1]) : DEFAULT_MB;
+    uint64_t nb;
+    char line[LINE];
+
+    if (mb <= 0) mb = DEFAULT_MB;
+    nb = (uint64_t)mb * 1024 * 1024 / LINE;
+    memset(line, 'x', LINE - 1);
+    line[LINE - 1] = '\n';
+    printf("%d MB of %d byte lines\n", mb, LINE);
+    bench_write(line, nb);
+    bench_sink_io(line, nb);
+    unlink(BENCH_FILE);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,147 @@
+/*
+ * Reader cost of the runtime fields of a processus under concurrent state
+ * churn: rwlock getters (the former THRD_DATA_GET, one lock by field) against
+ * the seqlock snapshot of t_thread_data, and against the record mirrored in
+ * the shared memory status table (taskmaster -m), which also shows what the
+ * mirroring costs to the writer.
+ *
+ * One writer thread plays the reactor and keeps updating pid, restart_counter,
+ * start_timestamp & info with pid == restart_counter as invariant. Readers
+ * read all 4 fields & count the snapshots breaking the invariant.
+ *
+ * usage: ./snapshot_bench [duration_ms]
+ */
+#include <pthread.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "run_server.h"
+
+#define MAX_READERS (4)
+
+typedef enum e_mode {
+    MODE_RWLOCK,
+    MODE_SEQLOCK,
+    MODE_SHM, /* seqlock writer mirrored in a status table record */
+    MODE_NB
+} t_mode;
+
+static const char *g_mode_name[MODE_NB] = {"rwlock", "seqlock", "shm"};
+
+typedef struct s_bench {
+    t_thread_data thrd;
+    t_pgm pgm;
+    t_tms_proc rec;           /* shm mode */
+    pthread_rwlock_t rw_thrd; /* rwlock mode */
+    t_mode mode;
+    uint64_t writes;
+    atomic_bool stop;
+} t_bench;
+
+typedef struct s_reader {
+    t_bench *bench;
+    uint64_t reads;
+    uint64_t torn;
+    pthread_t tid;
+} t_reader;
+
+static void *writer(void *arg) {
+    t_bench *bench = arg;
+    t_thread_data *thrd = &bench->thrd;
+
+    int32_t i;
+
+    for (i = 1; !atomic_load(&bench->stop); i++) {
+        if (bench->mode == MODE_RWLOCK) {
+            pthread_rwlock_wrlock(&bench->rw_thrd);
+            thrd->start_timestamp = i;
+            thrd->pid = i;
+            thrd->restart_counter = i;
+            thrd->info = i & 0x07;
+            pthread_rwlock_unlock(&bench->rw_thrd);
+        } else {
+            thrd_write_begin(thrd);
+            thrd->start_timestamp = i;
+            thrd->pid = i;
+            thrd->restart_counter = i;
+            thrd_write_end(thrd);
+            SET_PROC_STATE(i & 0x07);
+        }
+    }
+    bench->writes = i - 1;
+    return NULL;
+}
+
+/* one lock by field, as the former THRD_DATA_GET */
+#define RW_GET(dst, field)                            \
+    do {                                              \
+        pthread_rwlock_rdlock(&bench->rw_thrd);       \
+        dst = bench->thrd.field;                      \
+        pthread_rwlock_unlock(&bench->rw_thrd);       \
+    } while (0)
+
+static void *reader(void *arg) {
+    t_reader *rd = arg;
+    t_bench *bench = rd->bench;
+    t_thrd_snapshot snap;
+    t_tms_proc rec;
+
+    while (!atomic_load_explicit(&bench->stop, memory_order_relaxed)) {
+        if (bench->mode == MODE_RWLOCK) {
+            RW_GET(snap.pid, pid);
+            RW_GET(snap.restart_counter, restart_counter);
+            RW_GET(snap.start_timestamp, start_timestamp);
+            RW_GET(snap.info, info);
+        } else if (bench->mode == MODE_SEQLOCK)
+            thrd_snapshot(&bench->thrd, &snap);
+        else {
+            tms_read_proc(&bench->rec, &rec);
+            snap.pid = rec.pid;
+            snap.restart_counter = rec.restart_counter;
+        }
+        rd->torn += snap.pid != snap.restart_counter;
+        rd->reads++;
+    }
+    return NULL;
+}
+
+static void run(t_mode mode, uint32_t nb_readers, uint32_t duration_ms) {
+    t_bench bench = {.mode = mode};
+    t_reader rd[MAX_READERS] = {0};
+    struct timespec ts = {duration_ms / 1000, (duration_ms % 1000) * 1000000};
+    uint64_t reads = 0, torn = 0;
+    pthread_t wr;
+
+    bench.thrd.pgm = &bench.pgm;
+    if (mode == MODE_SHM) bench.pgm.privy.status = &bench.rec;
+    pthread_rwlock_init(&bench.rw_thrd, NULL);
+    pthread_create(&wr, NULL, writer, &bench);
+    for (uint32_t i = 0; i < nb_readers; i++) {
+        rd[i].bench = &bench;
+        pthread_create(&rd[i].tid, NULL, reader, &rd[i]);
+    }
+    nanosleep(&ts, NULL);
+    atomic_store(&bench.stop, true);
+    pthread_join(wr, NULL);
+    for (uint32_t i = 0; i < nb_readers; i++) {
+        pthread_join(rd[i].tid, NULL);
+        reads += rd[i].reads;
+        torn += rd[i].torn;
+    }
+    pthread_rwlock_destroy(&bench.rw_thrd);
+    printf("%-8s %8u %14.1f %10.1f %10lu %14.1f\n", g_mode_name[mode],
+           nb_readers, reads / (duration_ms / 1e3) / 1e6,
+           (double)duration_ms * 1e6 * nb_readers / (reads ? reads : 1), torn,
+           bench.writes / (duration_ms / 1e3) / 1e6);
+}
+
+int main(int ac, char **av) {
+    uint32_t duration_ms = ac > 1 ? atoi(av[1]) : 500;
+
+    printf("%-8s %8s %14s %10s %10s %14s\n", "mode", "readers", "reads(M/s)",
+           "ns/read", "torn", "writes(M/s)");
+    for (uint32_t n = 1; n <= MAX_READERS; n *= 2)
+        for (t_mode mode = 0; mode < MODE_NB; mode++)
+            run(mode, n, duration_ms);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,88 @@
+/*
+ * Spawn-to-exec latency of the spawn backends of taskmaster.
+ *
+ * The supervisor memory is simulated by a touched anonymous mapping of
+ * growing size: fork() copies its page tables, clone(CLONE_VFORK) and
+ * posix_spawn() don't. Each sample spawns /bin/true and measures the time
+ * spent until spawn_process() returns - ie the child called execve() - then
+ * reaps it.
+ *
+ * usage: ./spawn_bench [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "proc_spawn.h"
+
+#define NB_RSS (4)
+
+static uint64_t clock_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void bench(t_spawn_backend backend, const t_spawn_attr *attr,
+                  uint64_t *samples, uint32_t iter) {
+    int32_t error;
+    uint64_t start;
+    pid_t pid;
+
+    for (uint32_t i = 0; i < iter; i++) {
+        start = clock_ns();
+        pid = spawn_process(backend, attr, &error);
+        samples[i] = clock_ns() - start;
+        if (pid == -1) {
+            fprintf(stderr, "spawn: %s\n", strerror(error));
+            exit(EXIT_FAILURE);
+        }
+        waitpid(pid, NULL, 0);
+    }
+    qsort(samples, iter, sizeof(*samples), cmp_u64);
+}
+
+int main(int ac, char **av) {
+    static const char *name[] = {"fork", "clone_vfork", "posix_spawn"};
+    static const size_t rss_mb[NB_RSS] = {0, 64, 256, 1024};
+    uint32_t iter = ac > 1 ? atoi(av[1]) : 200;
+    char *argv[] = {"/bin/true", NULL}, *envp[] = {NULL};
+    t_spawn_attr attr = {.path = argv[0], .argv = argv, .envp = envp,
+                         .workingdir = "/", .out = STDOUT_FILENO,
+                         .err = STDERR_FILENO};
+    uint64_t *samples = calloc(iter, sizeof(*samples));
+    char *rss;
+
+    if (!samples || !iter) return EXIT_FAILURE;
+    printf("%-12s %8s %10s %10s %10s\n", "backend", "rss(MB)", "p50(us)",
+           "p90(us)", "p99(us)");
+    for (uint32_t r = 0; r < NB_RSS; r++) {
+        rss = NULL;
+        if (rss_mb[r]) {
+            rss = mmap(NULL, rss_mb[r] << 20, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (rss == MAP_FAILED) return EXIT_FAILURE;
+            memset(rss, 1, rss_mb[r] << 20);
+        }
+        for (t_spawn_backend b = SPAWN_FORK; b <= SPAWN_POSIX; b++) {
+            bench(b, &attr, samples, iter);
+            printf("%-12s %8zu %10.1f %10.1f %10.1f\n", name[b], rss_mb[r],
+                   samples[iter / 2] / 1e3, samples[iter * 9 / 10] / 1e3,
+                   samples[iter * 99 / 100] / 1e3);
+        }
+        if (rss) munmap(rss, rss_mb[r] << 20);
+    }
+    free(samples);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,207 @@
+/*
+ * Startup-to-ready time of taskmaster. For each size, a configuration of
+ * 'programs' programs of 'procs' processus of the test daemon, all
+ * autostart, is generated then run headless with a startup trace
+ * (taskmaster -t): once every processus is STARTED - or after TIMEOUT_S -
+ * the supervisor is asked to exit thru its control socket. Each size runs
+ * from the yaml, then from its compiled cache (-C / -o).
+ *
+ * Prints one JSON object by run: the size, the mode & the trace of the
+ * supervisor, ie the duration of each startup phase in ms (see
+ * src/startup.h).
+ *
+ * usage: ./startup_bench taskmaster daemon [programs:procs ...]
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "control.h"
+
+#define DEFAULT_SIZES "100:1", "1000:1", "1000:4"
+#define TIMEOUT_S (60)
+#define POLL_MS (5)
+#define DIR_TEMPLATE "/tmp/startup_bench.XXXXXX"
+
+typedef struct s_run {
+    char taskmaster[4096];
+    char dir[sizeof(DIR_TEMPLATE)];
+    char yaml[sizeof(DIR_TEMPLATE) + 16];
+    char cache[sizeof(DIR_TEMPLATE) + 16];
+    char sock[sizeof(DIR_TEMPLATE) + 16];
+    char trace[sizeof(DIR_TEMPLATE) + 16];
+    char log[sizeof(DIR_TEMPLATE) + 16];
+} t_run;
+
+static void sleep_ms(uint32_t ms) {
+    struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+
+    nanosleep(&ts, NULL);
+}
+
+/* programs autostart their processus at once & stop on SIGINT, which the
+ * test daemon doesn't catch */
+static int gen_config(const char *path, const char *daemon, uint32_t nb_pgm,
+                      uint32_t procs) {
+    FILE *file = fopen(path, "w");
+
+    if (!file) return EXIT_FAILURE;
+    fprintf(file, "programs:\n");
+    for (uint32_t i = 0; i < nb_pgm; i++)
+        fprintf(file,
+                "  bench_%u:\n"
+                "    cmd: \"%s\"\n"
+                "    numprocs: %u\n"
+                "    autostart: true\n"
+                "    autorestart: false\n"
+                "    starttime: 0\n"
+                "    stopsignal: SIGINT\n"
+                "    stoptime: 1\n",
+                i, daemon, procs);
+    return fclose(file) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* Runs taskmaster in dir, where it writes its taskmaster.log */
+static pid_t spawn(const char *dir, char *const *argv) {
+    pid_t pid = fork();
+    int32_t null;
+
+    if (pid) return pid;
+    if ((null = open("/dev/null", O_RDWR)) != -1) {
+        dup2(null, STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+    }
+    if (chdir(dir)) _exit(127);
+    execv(argv[0], argv);
+    _exit(127);
+}
+
+static bool trace_written(const char *path) {
+    struct stat st;
+
+    return !stat(path, &st) && st.st_size > 0;
+}
+
+/* Asks the supervisor to exit, with a SIGKILL if its socket never showed */
+static void stop(const t_run *run, pid_t pid) {
+    t_tmp_header header = {.op = TMP_OP_EXIT};
+    uint8_t *payload = NULL;
+    int32_t fd = ctl_connect(run->sock);
+
+    if (fd == -1) {
+        kill(pid, SIGKILL);
+        return;
+    }
+    if (!ctl_send(fd, &header, NULL) && !ctl_recv(fd, &header, &payload))
+        free(payload);
+    close(fd);
+}
+
+/* Prints the trace of one run, prefixed by its size & mode */
+static int print_trace(const t_run *run, const char *mode, uint32_t nb_pgm,
+                       uint32_t procs) {
+    char buf[1024];
+    size_t len;
+    FILE *file = fopen(run->trace, "r");
+
+    if (!file) return EXIT_FAILURE;
+    len = fread(buf, 1, sizeof(buf) - 1, file);
+    fclose(file);
+    buf[len] = '\0';
+    if (len < 2 || buf[0] != '{') return EXIT_FAILURE;
+    printf("{\"size\": \"%u:%u\", \"mode\": \"%s\", %s", nb_pgm, procs, mode,
+           buf + 1);
+    fflush(stdout);
+    return EXIT_SUCCESS;
+}
+
+static int run_once(const t_run *run, const char *mode, uint32_t nb_pgm,
+                    uint32_t procs) {
+    char *argv[] = {(char *)run->taskmaster, "-f", (char *)run->yaml,
+                    "-s", (char *)run->sock, "-t", (char *)run->trace,
+                    NULL, NULL, NULL};
+    int status;
+    pid_t pid;
+
+    if (!strcmp(mode, "cache")) {
+        argv[7] = "-o";
+        argv[8] = (char *)run->cache;
+    }
+    unlink(run->trace);
+    if ((pid = spawn(run->dir, argv)) == -1) return EXIT_FAILURE;
+    for (uint32_t ms = 0;
+         ms < TIMEOUT_S * 1000 && !trace_written(run->trace) &&
+         !waitpid(pid, &status, WNOHANG);
+         ms += POLL_MS)
+        sleep_ms(POLL_MS);
+    stop(run, pid);
+    waitpid(pid, &status, 0);
+    return print_trace(run, mode, nb_pgm, procs);
+}
+
+static int compile(const t_run *run) {
+    char *argv[] = {(char *)run->taskmaster, "-C", (char *)run->yaml,
+                    "-o", (char *)run->cache, NULL};
+    int status;
+    pid_t pid = spawn(run->dir, argv);
+
+    if (pid == -1 || waitpid(pid, &status, 0) == -1) return EXIT_FAILURE;
+    return !WIFEXITED(status) || WEXITSTATUS(status);
+}
+
+int main(int ac, char **av) {
+    const char *default_sizes[] = {DEFAULT_SIZES};
+    const char *const *sizes = ac > 3 ? (const char *const *)av + 3
+                                      : default_sizes;
+    uint32_t nb_sizes = ac > 3 ? ac - 3
+                               : sizeof(default_sizes) / sizeof(*default_sizes);
+    char daemon[4096];
+    uint32_t nb_pgm, procs;
+    t_run run = {.dir = DIR_TEMPLATE};
+    int ret = EXIT_SUCCESS;
+
+    if (ac < 3 || !realpath(av[1], run.taskmaster) ||
+        !realpath(av[2], daemon)) {
+        fprintf(stderr, "usage: %s taskmaster daemon [programs:procs ...]\n",
+                av[0]);
+        return EXIT_FAILURE;
+    }
+    if (!mkdtemp(run.dir)) {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    snprintf(run.yaml, sizeof(run.yaml), "%s/bench.yaml", run.dir);
+    snprintf(run.cache, sizeof(run.cache), "%s/bench.tmc", run.dir);
+    snprintf(run.sock, sizeof(run.sock), "%s/bench.sock", run.dir);
+    snprintf(run.trace, sizeof(run.trace), "%s/trace.json", run.dir);
+    snprintf(run.log, sizeof(run.log), "%s/taskmaster.log", run.dir);
+
+    for (uint32_t i = 0; i < nb_sizes && !ret; i++) {
+        if (sscanf(sizes[i], "%u:%u", &nb_pgm, &procs) != 2 || !nb_pgm ||
+            !procs) {
+            fprintf(stderr, "%s: %s: expected programs:procs\n", av[0],
+                    sizes[i]);
+            ret = EXIT_FAILURE;
+        } else if (gen_config(run.yaml, daemon, nb_pgm, procs) ||
+                   run_once(&run, "yaml", nb_pgm, procs) || compile(&run) ||
+                   run_once(&run, "cache", nb_pgm, procs)) {
+            fprintf(stderr, "%s: %s: run failed: %s\n", av[0], sizes[i],
+                    strerror(errno));
+            ret = EXIT_FAILURE;
+        }
+        unlink(run.cache);
+    }
+    unlink(run.yaml);
+    unlink(run.trace);
+    unlink(run.sock);
+    unlink(run.log);
+    rmdir(run.dir);
+    return ret;
+}
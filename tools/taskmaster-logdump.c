@@ -0,0 +1,158 @@
+/*
+ * taskmaster-logdump: renders a binary journal (taskmaster -j) as the lines
+ * taskmaster writes to taskmaster.log.
+ *
+ * usage: taskmaster-logdump journal
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "journal.h"
+
+#define DUMP_MAX_PGM (1U << 16) /* name table grows up to pgm ids < this */
+
+typedef struct s_dump {
+    char **name; /* indexed by pgm id */
+    uint32_t nb_name;
+} t_dump;
+
+static const char *dump_name(const t_dump *dump, uint32_t pgm_id) {
+    if (pgm_id < dump->nb_name && dump->name[pgm_id]) return dump->name[pgm_id];
+    return "?";
+}
+
+/* Reads the name following a JRN_EV_PGM record. Returns the number of
+ * JRN_EV_NAME records consumed, -1 on error. */
+static int32_t dump_pgm(t_dump *dump, const t_jrn_record *rec, size_t nb) {
+    uint32_t nb_chunk = (rec->len + JRN_NAME_CHUNK - 1) / JRN_NAME_CHUNK;
+    uint32_t new_nb;
+    char *name, **tmp;
+
+    if (nb_chunk > nb || rec->pgm_id >= DUMP_MAX_PGM) return -1;
+    if (rec->pgm_id >= dump->nb_name) {
+        new_nb = rec->pgm_id + 1 > 2 * dump->nb_name ? rec->pgm_id + 1
+                                                      : 2 * dump->nb_name;
+        tmp = realloc(dump->name, new_nb * sizeof(*tmp));
+        if (!tmp) return -1;
+        memset(tmp + dump->nb_name, 0, (new_nb - dump->nb_name) * sizeof(*tmp));
+        dump->name = tmp;
+        dump->nb_name = new_nb;
+    }
+    if (!(name = malloc(rec->len + 1))) return -1;
+    for (uint32_t i = 0; i < nb_chunk; i++)
+        memcpy(name + i * JRN_NAME_CHUNK, &rec[1 + i],
+               i + 1 < nb_chunk ? JRN_NAME_CHUNK
+                                : rec->len - i * JRN_NAME_CHUNK);
+    name[rec->len] = '\0';
+    free(dump->name[rec->pgm_id]);
+    dump->name[rec->pgm_id] = name;
+    return nb_chunk;
+}
+
+/* Prints rec with the format of the text log */
+static void dump_record(const t_dump *dump, const t_jrn_record *rec) {
+    const t_jrn_event_desc *desc = &g_jrn_event[rec->event];
+    const char *name = dump_name(dump, rec->pgm_id);
+    time_t sec = rec->time_ns / 1000000000ULL;
+    struct tm loctime;
+    char stamp[32] = "";
+
+    if (localtime_r(&sec, &loctime))
+        strftime(stamp, sizeof(stamp), "%F, %T ", &loctime);
+    printf("%s- [%17s] - ", stamp, desc->src);
+    switch (rec->event) {
+        case JRN_EV_LAUNCHED:
+            printf("[%s pid[%d]] - rank[%u] - restart_counter[%d] • [%s]", name,
+                   rec->pid, rec->rid, rec->restart_counter, desc->str);
+            break;
+        case JRN_EV_SPAWN_FAILED:
+            printf("[%s] - rank[%u] - restart_counter[%d] • [%s: %s]", name,
+                   rec->rid, rec->restart_counter, desc->str,
+                   strerror(rec->value));
+            break;
+        case JRN_EV_AUTO_RESTART:
+            break;
+        default:
+            if (desc->value == JRN_VAL_STATUS)
+                printf(
+                    "[%s pid[%d]] - rank[%u] - restart_counter[%d] • [%s %d]",
+                    name, rec->pid, rec->rid, rec->restart_counter, desc->str,
+                    rec->value);
+            else if (desc->value == JRN_VAL_STARTTIME)
+                printf("[%s pid[%d]] - rank[%u] - start_time[%d ms] • [%s]",
+                       name, rec->pid, rec->rid, rec->value, desc->str);
+            else if (desc->value == JRN_VAL_STOPTIME)
+                printf("[%s] - rank[%u] - stop_time[%d ms] • [%s]", name,
+                       rec->rid, rec->value, desc->str);
+            break;
+    }
+    printf("\n");
+}
+
+static uint8_t dump_journal(const t_jrn_record *rec, size_t nb) {
+    const t_jrn_header *header = (const t_jrn_header *)rec;
+    t_dump dump = {0};
+    int32_t ret;
+    uint8_t status = EXIT_SUCCESS;
+
+    if (!nb || memcmp(header->magic, JRN_MAGIC, sizeof(header->magic)) ||
+        header->record_size != sizeof(*rec)) {
+        fprintf(stderr, "taskmaster-logdump: not a journal\n");
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 1; i < nb; i++) {
+        if (rec[i].event == JRN_EV_NONE) break; /* end of a crashed journal */
+        if (rec[i].event >= JRN_EV_NB || rec[i].event == JRN_EV_NAME) {
+            fprintf(stderr, "taskmaster-logdump: bad record %zu\n", i);
+            status = EXIT_FAILURE;
+            break;
+        }
+        if (rec[i].event == JRN_EV_PGM) {
+            if ((ret = dump_pgm(&dump, &rec[i], nb - i - 1)) == -1) {
+                fprintf(stderr, "taskmaster-logdump: bad record %zu\n", i);
+                status = EXIT_FAILURE;
+                break;
+            }
+            i += ret;
+            continue;
+        }
+        dump_record(&dump, &rec[i]);
+    }
+    for (uint32_t i = 0; i < dump.nb_name; i++) free(dump.name[i]);
+    free(dump.name);
+    return status;
+}
+
+int main(int ac, char **av) {
+    struct stat st;
+    void *map;
+    int32_t fd;
+    uint8_t status;
+
+    if (ac != 2) {
+        fprintf(stderr, "Usage: %s journal\n", av[0]);
+        return EXIT_FAILURE;
+    }
+    if ((fd = open(av[1], O_RDONLY)) == -1 || fstat(fd, &st) == -1) {
+        fprintf(stderr, "%s: %s: %s\n", av[0], av[1], strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (st.st_size < (off_t)sizeof(t_jrn_header)) {
+        fprintf(stderr, "%s: %s: not a journal\n", av[0], av[1]);
+        return EXIT_FAILURE;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "%s: %s: %s\n", av[0], av[1], strerror(errno));
+        return EXIT_FAILURE;
+    }
+    status = dump_journal(map, st.st_size / sizeof(t_jrn_record));
+    munmap(map, st.st_size);
+    return status;
+}
@@ -0,0 +1,155 @@
+/*
+ * taskmaster-shmstat: prints the status table a taskmaster publishes in
+ * shared memory (taskmaster -m name), without any request to it. Given an
+ * interval, prints it again every interval_ms until interrupted.
+ *
+ * usage: taskmaster-shmstat shm_name [interval_ms]
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tm_status.h"
+
+typedef struct s_stat {
+    int fd;
+    const t_tms_header *map;
+    size_t size; /* mapped bytes */
+    t_tms_pgm *pgm; /* copy of the program table */
+    t_tms_proc *proc; /* copy of the processus table */
+    uint32_t cap_pgm;
+    uint32_t cap_proc;
+} t_stat;
+
+/* Maps the whole region, again once it grew */
+static int stat_map(t_stat *st) {
+    size_t size = atomic_load_explicit(&st->map->size, memory_order_acquire);
+    void *map;
+
+    if (size <= st->size) return EXIT_SUCCESS;
+    map = mmap(NULL, size, PROT_READ, MAP_SHARED, st->fd, 0);
+    if (map == MAP_FAILED) return EXIT_FAILURE;
+    munmap((void *)st->map, st->size);
+    st->map = map;
+    st->size = size;
+    return EXIT_SUCCESS;
+}
+
+static int stat_reserve(void **ptr, uint32_t *cap, uint32_t nb, size_t sz) {
+    void *tmp;
+
+    if (nb <= *cap) return EXIT_SUCCESS;
+    if (!(tmp = realloc(*ptr, nb * sz))) return EXIT_FAILURE;
+    *ptr = tmp;
+    *cap = nb;
+    return EXIT_SUCCESS;
+}
+
+/* Copies the tables, retrying while they are rewritten. Returns the number
+ * of processus copied, -1 on error. */
+static int64_t stat_copy(t_stat *st, uint32_t *nb_pgm) {
+    const t_tms_pgm *pgm;
+    const t_tms_proc *proc;
+    uint32_t seq, nb_proc;
+
+    while (true) {
+        if (stat_map(st)) return -1;
+        seq = tms_layout_begin(st->map);
+        *nb_pgm = st->map->nb_pgm;
+        nb_proc = st->map->nb_proc;
+        if (st->map->proc_off + (uint64_t)nb_proc * sizeof(*proc) > st->size)
+            continue; /* grown meanwhile */
+        if (stat_reserve((void **)&st->pgm, &st->cap_pgm, *nb_pgm,
+                         sizeof(*pgm)) ||
+            stat_reserve((void **)&st->proc, &st->cap_proc, nb_proc,
+                         sizeof(*proc)))
+            return -1;
+        pgm = (const t_tms_pgm *)((const char *)st->map + st->map->pgm_off);
+        proc = (const t_tms_proc *)((const char *)st->map + st->map->proc_off);
+        memcpy(st->pgm, pgm, *nb_pgm * sizeof(*pgm));
+        for (uint32_t i = 0; i < nb_proc; i++)
+            tms_read_proc(&proc[i], &st->proc[i]);
+        if (!tms_layout_retry(st->map, seq)) return nb_proc;
+    }
+}
+
+static const char *stat_state(uint8_t state) {
+    switch (state) {
+        case TMP_PROC_STOPPED:
+            return "STOPPED";
+        case TMP_PROC_STARTED:
+            return "STARTED";
+        case TMP_PROC_STOPPING:
+            return "STOPPING";
+        case TMP_PROC_STARTING:
+            return "STARTING";
+        default:
+            return "?";
+    }
+}
+
+static int stat_print(t_stat *st) {
+    time_t now = time(NULL);
+    uint32_t nb_pgm;
+    int64_t nb_proc = stat_copy(st, &nb_pgm);
+    const t_tms_proc *proc;
+
+    if (nb_proc < 0) return EXIT_FAILURE;
+    printf("%-24s %6s %8s %-9s %8s %10s\n", "program", "rank", "pid", "state",
+           "restarts", "uptime(s)");
+    for (int64_t i = 0; i < nb_proc; i++) {
+        proc = &st->proc[i];
+        if (proc->pgm >= nb_pgm) continue;
+        printf("%-24s %6u %8d %-9s %8d %10lld\n", st->pgm[proc->pgm].name,
+               proc->rid, proc->pid, stat_state(proc->state),
+               proc->restart_counter,
+               proc->state == TMP_PROC_STARTED
+                   ? (long long)(now - proc->start_time)
+                   : 0LL);
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int ac, char **av) {
+    t_stat st = {.fd = -1};
+    uint32_t interval_ms = ac > 2 ? strtoul(av[2], NULL, 10) : 0;
+    struct timespec ts = {interval_ms / 1000, (interval_ms % 1000) * 1000000};
+    int ret = EXIT_FAILURE;
+
+    if (ac < 2 || ac > 3) {
+        fprintf(stderr, "usage: %s shm_name [interval_ms]\n", av[0]);
+        return EXIT_FAILURE;
+    }
+    if ((st.fd = shm_open(av[1], O_RDONLY | O_CLOEXEC, 0)) == -1) goto error;
+    st.map = mmap(NULL, sizeof(*st.map), PROT_READ, MAP_SHARED, st.fd, 0);
+    if (st.map == MAP_FAILED) goto error;
+    st.size = sizeof(*st.map);
+    if (memcmp(st.map->magic, TMS_MAGIC, sizeof(st.map->magic)) ||
+        st.map->version != TMS_VERSION) {
+        errno = EINVAL;
+        goto error;
+    }
+    printf("taskmaster %d\n", st.map->supervisor_pid);
+    while (!(ret = stat_print(&st)) && interval_ms) {
+        fflush(stdout);
+        if (kill(st.map->supervisor_pid, 0) == -1 && errno == ESRCH) break;
+        nanosleep(&ts, NULL);
+        printf("\n");
+    }
+    if (ret) goto error;
+    munmap((void *)st.map, st.size);
+    close(st.fd);
+    free(st.pgm);
+    free(st.proc);
+    return EXIT_SUCCESS;
+error:
+    fprintf(stderr, "%s: %s: %s\n", av[0], av[1], strerror(errno));
+    return EXIT_FAILURE;
+}